@@ -0,0 +1,206 @@
+/* Compression echo server.
+ *
+ * Listens on a TCP port; everything a client sends is run through a
+ * stream and sent back.  When the client shuts down its side of the
+ * connection the stream is finished, the remaining output is sent,
+ * and the connection is closed.  All clients are served from a
+ * single thread using epoll and SquashFdStream.
+ *
+ * Try it with something like:
+ *
+ *   ./epoll-server c gzip 7000 &
+ *   nc -N localhost 7000 < file | gunzip
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <squash/squash.h>
+
+#define MAX_EVENTS 64
+
+typedef struct {
+  int fd;
+  SquashFdStream* fd_stream;
+} Connection;
+
+static SquashCodec* codec = NULL;
+static SquashStreamType stream_type;
+
+static void
+connection_close (int epfd, Connection* conn) {
+  epoll_ctl (epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+  squash_fd_stream_free (conn->fd_stream);
+  close (conn->fd);
+  free (conn);
+}
+
+/* Returns 0 if the connection is still alive, -1 if it was closed. */
+static int
+connection_update (int epfd, Connection* conn, SquashStatus res, SquashFdStreamWant want) {
+  if (res == SQUASH_END_OF_STREAM) {
+    shutdown (conn->fd, SHUT_WR);
+    connection_close (epfd, conn);
+    return -1;
+  } else if (res < 0) {
+    fprintf (stderr, "Connection %d: %s\n", conn->fd,
+             res == SQUASH_IO ? strerror (errno) : squash_status_to_string (res));
+    connection_close (epfd, conn);
+    return -1;
+  }
+
+  struct epoll_event ev = { 0, };
+  if (want & SQUASH_FD_STREAM_WANT_READ)
+    ev.events |= EPOLLIN;
+  if (want & SQUASH_FD_STREAM_WANT_WRITE)
+    ev.events |= EPOLLOUT;
+  ev.data.ptr = conn;
+  epoll_ctl (epfd, EPOLL_CTL_MOD, conn->fd, &ev);
+
+  return 0;
+}
+
+static void
+accept_connections (int epfd, int listen_fd) {
+  while (1) {
+    const int fd = accept (listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno != EAGAIN &&
+#if EWOULDBLOCK != EAGAIN
+          errno != EWOULDBLOCK &&
+#endif
+          errno != EINTR)
+        perror ("accept");
+      return;
+    }
+
+    fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+    fcntl (fd, F_SETFD, FD_CLOEXEC);
+
+    Connection* conn = malloc (sizeof (Connection));
+    SquashStream* stream = squash_stream_new (codec, stream_type, NULL);
+    if (conn == NULL || stream == NULL) {
+      fprintf (stderr, "Failed to allocate memory.\n");
+      squash_object_unref (stream);
+      free (conn);
+      close (fd);
+      continue;
+    }
+
+    conn->fd = fd;
+    conn->fd_stream = squash_fd_stream_new (stream, fd, fd);
+    squash_object_unref (stream);
+    if (conn->fd_stream == NULL) {
+      fprintf (stderr, "Failed to allocate memory.\n");
+      free (conn);
+      close (fd);
+      continue;
+    }
+
+    struct epoll_event ev = { 0, };
+    ev.events = EPOLLIN;
+    ev.data.ptr = conn;
+    if (epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+      perror ("epoll_ctl");
+      squash_fd_stream_free (conn->fd_stream);
+      free (conn);
+      close (fd);
+    }
+  }
+}
+
+int main (int argc, char** argv) {
+  if (argc != 4) {
+    fprintf (stderr, "USAGE: %s (c|d) CODEC PORT\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  codec = squash_get_codec (argv[2]);
+  if (codec == NULL) {
+    fprintf (stderr, "Unable to find codec '%s'\n", argv[2]);
+    return EXIT_FAILURE;
+  }
+
+  if (strcmp ("c", argv[1]) == 0)
+    stream_type = SQUASH_STREAM_COMPRESS;
+  else if (strcmp ("d", argv[1]) == 0)
+    stream_type = SQUASH_STREAM_DECOMPRESS;
+  else {
+    fprintf (stderr, "Invalid mode '%s': must be 'c' or 'd'\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  /* A client disappearing shouldn't kill the server; we get EPIPE
+   * from write() instead. */
+  signal (SIGPIPE, SIG_IGN);
+
+  const int listen_fd = socket (AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd < 0) {
+    perror ("socket");
+    return EXIT_FAILURE;
+  }
+
+  const int one = 1;
+  setsockopt (listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+
+  struct sockaddr_in addr;
+  memset (&addr, 0, sizeof (addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_ANY);
+  addr.sin_port = htons ((uint16_t) atoi (argv[3]));
+
+  if (bind (listen_fd, (struct sockaddr*) &addr, sizeof (addr)) != 0 ||
+      listen (listen_fd, SOMAXCONN) != 0) {
+    perror ("bind");
+    close (listen_fd);
+    return EXIT_FAILURE;
+  }
+
+  const int epfd = epoll_create1 (EPOLL_CLOEXEC);
+  if (epfd < 0) {
+    perror ("epoll_create1");
+    close (listen_fd);
+    return EXIT_FAILURE;
+  }
+
+  struct epoll_event ev = { 0, };
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  epoll_ctl (epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+
+  struct epoll_event events[MAX_EVENTS];
+  while (1) {
+    const int n = epoll_wait (epfd, events, MAX_EVENTS, -1);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      perror ("epoll_wait");
+      break;
+    }
+
+    for (int i = 0 ; i < n ; i++) {
+      Connection* conn = events[i].data.ptr;
+      if (conn == NULL) {
+        accept_connections (epfd, listen_fd);
+        continue;
+      }
+
+      SquashFdStreamWant want;
+      const SquashStatus res = squash_fd_stream_process (conn->fd_stream, &want);
+      connection_update (epfd, conn, res, want);
+    }
+  }
+
+  close (epfd);
+  close (listen_fd);
+
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,143 @@
+/* Threaded buffer benchmark.
+ *
+ * Compresses and decompresses a file with a codec's "threads" option
+ * set to 1 and then to the requested number of threads, checks that
+ * both produce the same data, and reports how long each took.  Works
+ * with any codec which has a "threads" option, such as lznt1, bzip2,
+ * bgzf, wflz-chunked and zpaq.
+ *
+ *   ./threads lznt1 disk.img 8
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <squash/squash.h>
+
+static double
+now (void) {
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (double) ts.tv_sec + ((double) ts.tv_nsec / 1000000000.0);
+}
+
+static uint8_t*
+read_file (const char* filename, size_t* size) {
+  FILE* fp = fopen (filename, "rb");
+  uint8_t* data = NULL;
+  long length;
+
+  if (fp == NULL)
+    return NULL;
+
+  if (fseek (fp, 0, SEEK_END) == 0 && (length = ftell (fp)) > 0 && fseek (fp, 0, SEEK_SET) == 0) {
+    data = malloc ((size_t) length);
+    if (data != NULL && fread (data, 1, (size_t) length, fp) != (size_t) length) {
+      free (data);
+      data = NULL;
+    }
+    *size = (size_t) length;
+  }
+
+  fclose (fp);
+
+  return data;
+}
+
+int main (int argc, char** argv) {
+  if (argc != 3 && argc != 4) {
+    fprintf (stderr, "USAGE: %s CODEC FILE [THREADS]\n", argv[0]);
+    fprintf (stderr, "THREADS defaults to 0 (one per CPU)\n");
+    return EXIT_FAILURE;
+  }
+
+  SquashCodec* codec = squash_get_codec (argv[1]);
+  if (codec == NULL) {
+    fprintf (stderr, "Unable to find codec '%s'\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  const char* threads[2] = { "1", (argc == 4) ? argv[3] : "0" };
+  SquashOptions* options[2];
+  for (int i = 0 ; i < 2 ; i++) {
+    options[i] = squash_options_new (codec, "threads", threads[i], NULL);
+    if (options[i] == NULL) {
+      fprintf (stderr, "%s doesn't accept threads=%s\n", argv[1], threads[i]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  size_t uncompressed_size = 0;
+  uint8_t* uncompressed = read_file (argv[2], &uncompressed_size);
+  if (uncompressed == NULL) {
+    fprintf (stderr, "Unable to read %s: %s\n", argv[2], strerror (errno));
+    return EXIT_FAILURE;
+  }
+
+  const size_t max_compressed_size = squash_codec_get_max_compressed_size (codec, uncompressed_size);
+  uint8_t* compressed[2] = { malloc (max_compressed_size), malloc (max_compressed_size) };
+  size_t compressed_size[2] = { max_compressed_size, max_compressed_size };
+  uint8_t* decompressed = malloc (uncompressed_size);
+  if (compressed[0] == NULL || compressed[1] == NULL || decompressed == NULL) {
+    fprintf (stderr, "Failed to allocate memory.\n");
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0 ; i < 2 ; i++) {
+    double start = now ();
+    SquashStatus res =
+      squash_codec_compress_with_options (codec,
+                                          &(compressed_size[i]), compressed[i],
+                                          uncompressed_size, uncompressed,
+                                          options[i]);
+    const double compress_time = now () - start;
+    if (res != SQUASH_OK) {
+      fprintf (stderr, "Unable to compress data [%d]: %s\n", res, squash_status_to_string (res));
+      return EXIT_FAILURE;
+    }
+
+    size_t decompressed_size = uncompressed_size;
+    start = now ();
+    res = squash_codec_decompress_with_options (codec,
+                                                &decompressed_size, decompressed,
+                                                compressed_size[i], compressed[i],
+                                                options[i]);
+    const double decompress_time = now () - start;
+    if (res != SQUASH_OK) {
+      fprintf (stderr, "Unable to decompress data [%d]: %s\n", res, squash_status_to_string (res));
+      return EXIT_FAILURE;
+    }
+
+    if (decompressed_size != uncompressed_size || memcmp (decompressed, uncompressed, uncompressed_size) != 0) {
+      fprintf (stderr, "Bad decompressed data.\n");
+      return EXIT_FAILURE;
+    }
+
+    fprintf (stdout, "threads=%-4s %12zu bytes  compress %8.3f s (%8.2f MiB/s)  decompress %8.3f s (%8.2f MiB/s)\n",
+             threads[i], compressed_size[i],
+             compress_time, ((double) uncompressed_size / (1024.0 * 1024.0)) / compress_time,
+             decompress_time, ((double) uncompressed_size / (1024.0 * 1024.0)) / decompress_time);
+  }
+
+  if (compressed_size[0] == compressed_size[1] && memcmp (compressed[0], compressed[1], compressed_size[0]) == 0) {
+    fprintf (stdout, "Compressed data is identical.\n");
+  } else {
+    fprintf (stdout, "Compressed data differs (expected for codecs which write a different format when threaded).\n");
+  }
+
+  for (int i = 0 ; i < 2 ; i++) {
+    squash_object_unref (options[i]);
+    free (compressed[i]);
+  }
+  free (uncompressed);
+  free (decompressed);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/* Trusted decompression benchmark.
+ *
+ * Compresses a file with each codec which has a faster decoder for
+ * trusted input, then reports how long the regular (safe) and trusted
+ * decoders take to decompress it.  Codecs can be listed explicitly;
+ * for those without a trusted decoder both times should match.
+ *
+ *   ./trusted enwik8
+ *   ./trusted enwik8 lz4-raw lzo1x
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <squash/squash.h>
+
+#define ITERATIONS 5
+
+static double
+now (void) {
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (double) ts.tv_sec + ((double) ts.tv_nsec / 1000000000.0);
+}
+
+static uint8_t*
+read_file (const char* filename, size_t* size) {
+  FILE* fp = fopen (filename, "rb");
+  uint8_t* data = NULL;
+  long length;
+
+  if (fp == NULL)
+    return NULL;
+
+  if (fseek (fp, 0, SEEK_END) == 0 && (length = ftell (fp)) > 0 && fseek (fp, 0, SEEK_SET) == 0) {
+    data = malloc ((size_t) length);
+    if (data != NULL && fread (data, 1, (size_t) length, fp) != (size_t) length) {
+      free (data);
+      data = NULL;
+    }
+    *size = (size_t) length;
+  }
+
+  fclose (fp);
+
+  return data;
+}
+
+struct Input {
+  size_t size;
+  uint8_t* data;
+  int failures;
+};
+
+/* Fastest of ITERATIONS runs, or a negative value on failure */
+static double
+time_decompress (SquashCodec* codec, int trusted,
+                 size_t compressed_size, const uint8_t* compressed,
+                 const struct Input* input, uint8_t* decompressed) {
+  double best = -1.0;
+
+  for (int i = 0 ; i < ITERATIONS ; i++) {
+    size_t decompressed_size = input->size;
+    const double start = now ();
+    SquashStatus res = trusted ?
+      squash_codec_decompress_trusted (codec, &decompressed_size, decompressed, compressed_size, compressed, NULL) :
+      squash_codec_decompress (codec, &decompressed_size, decompressed, compressed_size, compressed, NULL);
+    const double elapsed = now () - start;
+
+    if (res != SQUASH_OK) {
+      fprintf (stderr, "%s: unable to decompress data [%d]: %s\n",
+               squash_codec_get_name (codec), res, squash_status_to_string (res));
+      return -1.0;
+    }
+
+    if (decompressed_size != input->size || memcmp (decompressed, input->data, input->size) != 0) {
+      fprintf (stderr, "%s: bad decompressed data.\n", squash_codec_get_name (codec));
+      return -1.0;
+    }
+
+    if (best < 0.0 || elapsed < best)
+      best = elapsed;
+  }
+
+  return best;
+}
+
+static void
+benchmark_codec (SquashCodec* codec, void* data) {
+  struct Input* input = data;
+  const char* name = squash_codec_get_name (codec);
+  double safe_time = -1.0, trusted_time = -1.0;
+
+  size_t compressed_size = squash_codec_get_max_compressed_size (codec, input->size);
+  uint8_t* compressed = malloc (compressed_size);
+  uint8_t* decompressed = malloc (input->size);
+  if (compressed == NULL || decompressed == NULL) {
+    fprintf (stderr, "Failed to allocate memory.\n");
+  } else {
+    SquashStatus res = squash_codec_compress (codec, &compressed_size, compressed, input->size, input->data, NULL);
+    if (res != SQUASH_OK) {
+      fprintf (stderr, "%s: unable to compress data [%d]: %s\n", name, res, squash_status_to_string (res));
+    } else {
+      safe_time = time_decompress (codec, 0, compressed_size, compressed, input, decompressed);
+      if (safe_time >= 0.0)
+        trusted_time = time_decompress (codec, 1, compressed_size, compressed, input, decompressed);
+    }
+  }
+
+  if (safe_time < 0.0 || trusted_time < 0.0) {
+    input->failures++;
+  } else {
+    const double mib = (double) input->size / (1024.0 * 1024.0);
+    fprintf (stdout, "%-16s %12zu bytes  safe %8.2f MiB/s  trusted %8.2f MiB/s  speedup %5.2fx%s\n",
+             name, compressed_size, mib / safe_time, mib / trusted_time, safe_time / trusted_time,
+             (squash_codec_get_info (codec) & SQUASH_CODEC_INFO_DECOMPRESS_TRUSTED) ? "" : "  (no trusted decoder)");
+  }
+
+  free (compressed);
+  free (decompressed);
+}
+
+static void
+benchmark_trusted_codec (SquashCodec* codec, void* data) {
+  if (squash_codec_get_info (codec) & SQUASH_CODEC_INFO_DECOMPRESS_TRUSTED)
+    benchmark_codec (codec, data);
+}
+
+int main (int argc, char** argv) {
+  if (argc < 2) {
+    fprintf (stderr, "USAGE: %s FILE [CODEC...]\n", argv[0]);
+    fprintf (stderr, "Without a list of codecs, every codec with a trusted decoder is used.\n");
+    return EXIT_FAILURE;
+  }
+
+  struct Input input = { 0, NULL, 0 };
+  input.data = read_file (argv[1], &input.size);
+  if (input.data == NULL) {
+    fprintf (stderr, "Unable to read %s: %s\n", argv[1], strerror (errno));
+    return EXIT_FAILURE;
+  }
+
+  if (argc == 2) {
+    squash_foreach_codec (benchmark_trusted_codec, &input);
+  } else {
+    for (int i = 2 ; i < argc ; i++) {
+      SquashCodec* codec = squash_get_codec (argv[i]);
+      if (codec == NULL) {
+        fprintf (stderr, "Unable to find codec '%s'\n", argv[i]);
+        input.failures++;
+        continue;
+      }
+      benchmark_codec (codec, &input);
+    }
+  }
+
+  free (input.data);
+
+  return (input.failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
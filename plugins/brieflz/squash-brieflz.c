@@ -88,6 +88,28 @@ squash_brieflz_decompress_buffer (SquashCodec* codec,
   return SQUASH_OK;
 }
 
+static SquashStatus
+squash_brieflz_decompress_buffer_unsafe (SquashCodec* codec,
+                                         size_t* decompressed_size,
+                                         uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                         size_t compressed_size,
+                                         const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                         SquashOptions* options) {
+#if ULONG_MAX < SIZE_MAX
+  if (HEDLEY_UNLIKELY(ULONG_MAX < *decompressed_size))
+    return squash_error (SQUASH_RANGE);
+#endif
+
+  /* The size comes from the wrapper, so it is exactly what blz_depack
+     needs. */
+  const unsigned long size = blz_depack (compressed, decompressed, (unsigned long) *decompressed_size);
+
+  if (HEDLEY_UNLIKELY(size != *decompressed_size))
+    return squash_error (SQUASH_FAILED);
+
+  return SQUASH_OK;
+}
+
 static SquashStatus
 squash_brieflz_compress_buffer (SquashCodec* codec,
                                 size_t* compressed_size,
@@ -141,6 +163,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     /* impl->get_uncompressed_size = squash_brieflz_get_uncompressed_size; */
     impl->get_max_compressed_size = squash_brieflz_get_max_compressed_size;
     impl->decompress_buffer = squash_brieflz_decompress_buffer;
+    impl->decompress_buffer_unsafe = squash_brieflz_decompress_buffer_unsafe;
     impl->compress_buffer_unsafe = squash_brieflz_compress_buffer;
   } else {
     return squash_error (SQUASH_UNABLE_TO_LOAD);
@@ -37,7 +37,11 @@ enum SquashBrotliOptionIndex {
   SQUASH_BROTLI_OPT_LEVEL = 0,
   SQUASH_BROTLI_OPT_WINDOW_SIZE,
   SQUASH_BROTLI_OPT_BLOCK_SIZE,
-  SQUASH_BROTLI_OPT_MODE
+  SQUASH_BROTLI_OPT_MODE,
+  SQUASH_BROTLI_OPT_LARGE_WINDOW,
+  SQUASH_BROTLI_OPT_DISABLE_LITERAL_CONTEXT_MODELING,
+  SQUASH_BROTLI_OPT_NPOSTFIX,
+  SQUASH_BROTLI_OPT_NDIRECT
 };
 
 static SquashOptionInfo squash_brotli_options[] = {
@@ -50,8 +54,8 @@ static SquashOptionInfo squash_brotli_options[] = {
   { "window-size",
     SQUASH_OPTION_TYPE_RANGE_INT,
     .info.range_int = {
-      .min = 10,
-      .max = 24 },
+      .min = BROTLI_MIN_WINDOW_BITS,
+      .max = BROTLI_LARGE_MAX_WINDOW_BITS },
     .default_value.int_value = BROTLI_DEFAULT_WINDOW },
   { "block-size",
     SQUASH_OPTION_TYPE_RANGE_INT,
@@ -70,6 +74,24 @@ static SquashOptionInfo squash_brotli_options[] = {
         { "font", BROTLI_MODE_FONT },
         { NULL, 0 } } },
     .default_value.int_value = BROTLI_MODE_GENERIC },
+  { "large-window",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = false },
+  { "disable-literal-context-modeling",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = false },
+  { "npostfix",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 3 },
+    .default_value.int_value = 0 },
+  { "ndirect",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 15 << 3 },
+    .default_value.int_value = 0 },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -105,6 +127,37 @@ squash_brotli_free (void* opaque, void* ptr) {
   squash_free (ptr);
 }
 
+static void
+squash_brotli_encoder_set_options (BrotliEncoderState* encoder, SquashCodec* codec, SquashOptions* options) {
+  const bool large_window = squash_options_get_bool_at (options, codec, SQUASH_BROTLI_OPT_LARGE_WINDOW);
+  int lgwin = squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_WINDOW_SIZE);
+
+  /* Windows over 16 MiB are only possible in large-window mode. */
+  if (!large_window && lgwin > BROTLI_MAX_WINDOW_BITS)
+    lgwin = BROTLI_MAX_WINDOW_BITS;
+
+  BrotliEncoderSetParameter(encoder, BROTLI_PARAM_QUALITY, squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_LEVEL));
+  BrotliEncoderSetParameter(encoder, BROTLI_PARAM_LGWIN, lgwin);
+  BrotliEncoderSetParameter(encoder, BROTLI_PARAM_LGBLOCK, squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_BLOCK_SIZE));
+  BrotliEncoderSetParameter(encoder, BROTLI_PARAM_MODE, squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_MODE));
+  BrotliEncoderSetParameter(encoder, BROTLI_PARAM_LARGE_WINDOW, large_window ? BROTLI_TRUE : BROTLI_FALSE);
+  BrotliEncoderSetParameter(encoder, BROTLI_PARAM_DISABLE_LITERAL_CONTEXT_MODELING,
+                            squash_options_get_bool_at (options, codec, SQUASH_BROTLI_OPT_DISABLE_LITERAL_CONTEXT_MODELING) ? BROTLI_TRUE : BROTLI_FALSE);
+  BrotliEncoderSetParameter(encoder, BROTLI_PARAM_NPOSTFIX, squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_NPOSTFIX));
+  BrotliEncoderSetParameter(encoder, BROTLI_PARAM_NDIRECT, squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_NDIRECT));
+}
+
+static BrotliDecoderState*
+squash_brotli_decoder_new (SquashCodec* codec, SquashOptions* options) {
+  BrotliDecoderState* decoder = BrotliDecoderCreateInstance(squash_brotli_malloc, squash_brotli_free, NULL);
+
+  if (HEDLEY_LIKELY(decoder != NULL))
+    BrotliDecoderSetParameter(decoder, BROTLI_DECODER_PARAM_LARGE_WINDOW,
+                              squash_options_get_bool_at (options, codec, SQUASH_BROTLI_OPT_LARGE_WINDOW) ? 1 : 0);
+
+  return decoder;
+}
+
 static SquashBrotliStream*
 squash_brotli_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
   SquashBrotliStream* stream;
@@ -129,13 +182,9 @@ squash_brotli_stream_init (SquashBrotliStream* s,
 
   if (stream_type == SQUASH_STREAM_COMPRESS) {
     s->ctx.encoder = BrotliEncoderCreateInstance(squash_brotli_malloc, squash_brotli_free, NULL);
-
-    BrotliEncoderSetParameter(s->ctx.encoder, BROTLI_PARAM_QUALITY, squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_LEVEL));
-    BrotliEncoderSetParameter(s->ctx.encoder, BROTLI_PARAM_LGWIN, squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_WINDOW_SIZE));
-    BrotliEncoderSetParameter(s->ctx.encoder, BROTLI_PARAM_LGBLOCK, squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_BLOCK_SIZE));
-    BrotliEncoderSetParameter(s->ctx.encoder, BROTLI_PARAM_MODE, squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_MODE));
+    squash_brotli_encoder_set_options (s->ctx.encoder, codec, options);
   } else if (stream_type == SQUASH_STREAM_DECOMPRESS) {
-    s->ctx.decoder = BrotliDecoderCreateInstance(squash_brotli_malloc, squash_brotli_free, NULL);
+    s->ctx.decoder = squash_brotli_decoder_new (codec, options);
   } else {
     HEDLEY_UNREACHABLE();
   }
@@ -233,14 +282,50 @@ squash_brotli_compress_buffer (SquashCodec* codec,
                                size_t uncompressed_size,
                                const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
                                SquashOptions* options) {
-  const int quality = squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_LEVEL);
-  const int lgwin = squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_WINDOW_SIZE);
-  const BrotliEncoderMode mode = (BrotliEncoderMode)
-    squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_MODE);
+  BrotliEncoderState* encoder = BrotliEncoderCreateInstance(squash_brotli_malloc, squash_brotli_free, NULL);
+  if (HEDLEY_UNLIKELY(encoder == NULL))
+    return squash_error (SQUASH_MEMORY);
 
-  const int res = BrotliEncoderCompress (quality, lgwin, mode, uncompressed_size, uncompressed, compressed_size, compressed);
+  squash_brotli_encoder_set_options (encoder, codec, options);
 
-  return HEDLEY_LIKELY(res == 1) ? SQUASH_OK : squash_error (SQUASH_BUFFER_FULL);
+  /* Knowing the size lets the encoder pick a smaller window and
+     better block splitting. */
+  BrotliEncoderSetParameter(encoder, BROTLI_PARAM_SIZE_HINT,
+                            (uncompressed_size > (1U << 30)) ? (1U << 30) : (uint32_t) uncompressed_size);
+
+  size_t avail_in = uncompressed_size;
+  const uint8_t* next_in = uncompressed;
+  size_t avail_out = *compressed_size;
+  uint8_t* next_out = compressed;
+
+  const BROTLI_BOOL be_ret =
+    BrotliEncoderCompressStream(encoder, BROTLI_OPERATION_FINISH,
+                                &avail_in, &next_in, &avail_out, &next_out, NULL);
+  const bool finished = be_ret && BrotliEncoderIsFinished(encoder);
+
+  BrotliEncoderDestroyInstance(encoder);
+
+  if (HEDLEY_LIKELY(finished)) {
+    *compressed_size = (size_t) (next_out - compressed);
+    return SQUASH_OK;
+  }
+
+  /* BrotliEncoderMaxCompressedSize is only a guarantee for the
+     one-shot encoder, which stores the input uncompressed when it
+     doesn't fit, so let it have a go before giving up. */
+  if (be_ret && *compressed_size >= BrotliEncoderMaxCompressedSize (uncompressed_size) &&
+      !squash_options_get_bool_at (options, codec, SQUASH_BROTLI_OPT_LARGE_WINDOW)) {
+    const int quality = squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_LEVEL);
+    const int lgwin = squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_WINDOW_SIZE);
+    const BrotliEncoderMode mode = (BrotliEncoderMode)
+      squash_options_get_int_at (options, codec, SQUASH_BROTLI_OPT_MODE);
+
+    if (BrotliEncoderCompress (quality, lgwin > BROTLI_MAX_WINDOW_BITS ? BROTLI_MAX_WINDOW_BITS : lgwin, mode,
+                               uncompressed_size, uncompressed, compressed_size, compressed) == BROTLI_TRUE)
+      return SQUASH_OK;
+  }
+
+  return squash_error (be_ret ? SQUASH_BUFFER_FULL : SQUASH_FAILED);
 }
 
 static SquashStatus
@@ -250,9 +335,31 @@ squash_brotli_decompress_buffer (SquashCodec* codec,
                                  size_t compressed_size,
                                  const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
                                  SquashOptions* options) {
-  const BrotliDecoderResult res = BrotliDecoderDecompress(compressed_size, compressed, decompressed_size, decompressed);
+  BrotliDecoderState* decoder = squash_brotli_decoder_new (codec, options);
+  if (HEDLEY_UNLIKELY(decoder == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  size_t avail_in = compressed_size;
+  const uint8_t* next_in = compressed;
+  size_t avail_out = *decompressed_size;
+  uint8_t* next_out = decompressed;
+
+  const BrotliDecoderResult res =
+    BrotliDecoderDecompressStream(decoder, &avail_in, &next_in, &avail_out, &next_out, NULL);
+
+  BrotliDecoderDestroyInstance(decoder);
 
-  return HEDLEY_LIKELY(res == BROTLI_DECODER_RESULT_SUCCESS) ? SQUASH_OK : squash_error (SQUASH_BUFFER_FULL);
+  switch (res) {
+    case BROTLI_DECODER_RESULT_SUCCESS:
+      *decompressed_size = (size_t) (next_out - decompressed);
+      return SQUASH_OK;
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT:
+      return squash_error (SQUASH_BUFFER_FULL);
+    case BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT:
+    case BROTLI_DECODER_RESULT_ERROR:
+    default:
+      return squash_error (SQUASH_FAILED);
+  }
 }
 
 SquashStatus
@@ -25,6 +25,7 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -35,7 +36,8 @@
 enum SquashBZ2OptIndex {
   SQUASH_BZ2_OPT_LEVEL = 0,
   SQUASH_BZ2_OPT_WORK_FACTOR,
-  SQUASH_BZ2_OPT_SMALL
+  SQUASH_BZ2_OPT_SMALL,
+  SQUASH_BZ2_OPT_THREADS
 };
 
 static SquashOptionInfo squash_bz2_options[] = {
@@ -54,6 +56,12 @@ static SquashOptionInfo squash_bz2_options[] = {
   { "small",
     SQUASH_OPTION_TYPE_BOOL,
     .default_value.bool_value = false },
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 1 },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -61,8 +69,26 @@ typedef struct SquashBZ2Stream_s {
   SquashStream base_object;
 
   bz_stream stream;
+
+  /* A bzip2 stream has ended; another may follow. */
+  bool stream_done;
 } SquashBZ2Stream;
 
+/* Every block starts with the first 48 bits of pi in BCD, and the
+   end-of-stream marker is sqrt(pi).  Neither is byte aligned except
+   at the start of a stream. */
+#define SQUASH_BZ2_BLOCK_MAGIC UINT64_C(0x314159265359)
+#define SQUASH_BZ2_EOS_MAGIC   UINT64_C(0x177245385090)
+#define SQUASH_BZ2_MAGIC_BITS  48
+
+/* The encoder stops a block 19 bytes short of level * 100000 (see
+   nblockMAX in bzlib.c), so cutting the input there keeps most
+   chunks in a single block. */
+#define SQUASH_BZ2_CHUNK_SIZE(level) (((size_t) (level) * 100000) - 19)
+
+/* Amount of compressed data each task searches for block magic. */
+#define SQUASH_BZ2_SCAN_SIZE ((size_t) (1024 * 1024))
+
 SQUASH_PLUGIN_EXPORT
 SquashStatus             squash_plugin_init_codec   (SquashCodec* codec, SquashCodecImpl* impl);
 
@@ -130,6 +156,7 @@ squash_bz2_stream_init (SquashBZ2Stream* stream,
   tmp.bzfree      = squash_bz2_free;
   tmp.opaque      = squash_codec_get_context (codec);
   stream->stream  = tmp;
+  stream->stream_done = false;
 }
 
 static void
@@ -198,7 +225,26 @@ squash_bz2_process_stream_ex (SquashStream* stream, int action) {
   if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
     bz2_res = BZ2_bzCompress (bz2_stream, action);
   } else {
+    SquashBZ2Stream* s = (SquashBZ2Stream*) stream;
+
+    /* Like bunzip2, decode streams which have been concatenated (which
+       is what lbzip2, pbzip2, and our own threaded encoder produce). */
+    if (s->stream_done) {
+      if (bz2_stream->avail_in == 0 || bz2_stream->next_in[0] != 'B')
+        return SQUASH_END_OF_STREAM;
+
+      BZ2_bzDecompressEnd (bz2_stream);
+      bz2_res = BZ2_bzDecompressInit (bz2_stream, 0,
+                                      squash_options_get_bool_at (stream->options, stream->codec, SQUASH_BZ2_OPT_SMALL));
+      if (HEDLEY_UNLIKELY(bz2_res != BZ_OK))
+        return squash_error (bz2_res == BZ_MEM_ERROR ? SQUASH_MEMORY : SQUASH_FAILED);
+      s->stream_done = false;
+    }
+
     bz2_res = BZ2_bzDecompress (bz2_stream);
+
+    if (bz2_res == BZ_STREAM_END)
+      s->stream_done = true;
   }
 
   if (bz2_res == BZ_RUN_OK || bz2_res == BZ_OK) {
@@ -208,7 +254,8 @@ squash_bz2_process_stream_ex (SquashStream* stream, int action) {
       res = SQUASH_PROCESSING;
     }
   } else if (bz2_res == BZ_STREAM_END) {
-    res = SQUASH_END_OF_STREAM;
+    res = (stream->stream_type == SQUASH_STREAM_DECOMPRESS && bz2_stream->avail_in != 0 && bz2_stream->next_in[0] == 'B') ?
+      SQUASH_PROCESSING : SQUASH_END_OF_STREAM;
   } else {
     res = squash_bz2_status_to_squash_status (bz2_res);
   }
@@ -275,10 +322,627 @@ squash_bz2_process_stream (SquashStream* stream, SquashOperation operation) {
 
 static size_t
 squash_bz2_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
+  /* The threaded encoder writes one stream per chunk, and each of
+     those gets its own slack. */
   return
     uncompressed_size +
     (uncompressed_size / 100) + ((uncompressed_size % 100) > 0 ? 1 : 0) +
-    600;
+    600 +
+    ((uncompressed_size / SQUASH_BZ2_CHUNK_SIZE(1)) * 601);
+}
+
+static unsigned int
+squash_bz2_get_threads (SquashCodec* codec, SquashOptions* options) {
+  unsigned int threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_BZ2_OPT_THREADS);
+
+  if (threads == 0)
+    threads = squash_get_cpu_count ();
+
+  return (threads == 0) ? 1 : threads;
+}
+
+static SquashStatus
+squash_bz2_compress_chunk (int level,
+                           int work_factor,
+                           size_t* compressed_size,
+                           uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                           size_t uncompressed_size,
+                           const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)]) {
+  bz_stream stream = { 0, };
+  size_t in_remaining = uncompressed_size;
+  size_t out_remaining = *compressed_size;
+  SquashStatus res = SQUASH_OK;
+  int bz2_e;
+
+  stream.bzalloc = squash_bz2_malloc;
+  stream.bzfree = squash_bz2_free;
+
+  bz2_e = BZ2_bzCompressInit (&stream, level, 0, work_factor);
+  if (HEDLEY_UNLIKELY(bz2_e != BZ_OK))
+    return squash_error (bz2_e == BZ_MEM_ERROR ? SQUASH_MEMORY : SQUASH_FAILED);
+
+  /* libbzip2 counts in unsigned ints, so big buffers are fed in
+     pieces. */
+  while (true) {
+    const unsigned int avail_in = (in_remaining > UINT_MAX) ? UINT_MAX : (unsigned int) in_remaining;
+    const unsigned int avail_out = (out_remaining > UINT_MAX) ? UINT_MAX : (unsigned int) out_remaining;
+
+    stream.next_in = (char*) (uncompressed + (uncompressed_size - in_remaining));
+    stream.avail_in = avail_in;
+    stream.next_out = (char*) (compressed + (*compressed_size - out_remaining));
+    stream.avail_out = avail_out;
+
+    bz2_e = BZ2_bzCompress (&stream, (in_remaining > UINT_MAX) ? BZ_RUN : BZ_FINISH);
+
+    in_remaining -= avail_in - stream.avail_in;
+    out_remaining -= avail_out - stream.avail_out;
+
+    if (bz2_e == BZ_STREAM_END) {
+      break;
+    } else if (HEDLEY_UNLIKELY(bz2_e != BZ_RUN_OK && bz2_e != BZ_FINISH_OK)) {
+      res = squash_bz2_status_to_squash_status (bz2_e);
+      break;
+    } else if (out_remaining == 0) {
+      res = squash_error (SQUASH_BUFFER_FULL);
+      break;
+    }
+  }
+
+  BZ2_bzCompressEnd (&stream);
+
+  if (HEDLEY_LIKELY(res == SQUASH_OK))
+    *compressed_size -= out_remaining;
+
+  return res;
+}
+
+typedef struct SquashBZ2CompressData_s {
+  SquashCodec* codec;
+  int level;
+  int work_factor;
+  size_t chunk_size;
+  size_t uncompressed_size;
+  const uint8_t* uncompressed;
+  uint8_t** chunks;
+  size_t* chunk_sizes;
+} SquashBZ2CompressData;
+
+static SquashStatus
+squash_bz2_compress_task (size_t task, void* user_data) {
+  SquashBZ2CompressData* data = (SquashBZ2CompressData*) user_data;
+  const size_t offset = task * data->chunk_size;
+  const size_t remaining = data->uncompressed_size - offset;
+  const size_t chunk_size = (remaining < data->chunk_size) ? remaining : data->chunk_size;
+
+  data->chunk_sizes[task] = squash_bz2_get_max_compressed_size (data->codec, chunk_size);
+  data->chunks[task] = squash_malloc (data->chunk_sizes[task]);
+  if (HEDLEY_UNLIKELY(data->chunks[task] == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  return squash_bz2_compress_chunk (data->level, data->work_factor,
+                                    &(data->chunk_sizes[task]), data->chunks[task],
+                                    chunk_size, data->uncompressed + offset);
+}
+
+/* With more than one thread the input is cut into chunks of about one
+   block, each of which becomes a complete bzip2 stream.  Concatenated
+   streams are valid .bz2 data (bunzip2 decodes them all), which is
+   also how lbzip2 and pbzip2 work. */
+static SquashStatus
+squash_bz2_compress_buffer (SquashCodec* codec,
+                            size_t* compressed_size,
+                            uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                            size_t uncompressed_size,
+                            const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                            SquashOptions* options) {
+  const int level = squash_options_get_int_at (options, codec, SQUASH_BZ2_OPT_LEVEL);
+  const int work_factor = squash_options_get_int_at (options, codec, SQUASH_BZ2_OPT_WORK_FACTOR);
+  const unsigned int threads = squash_bz2_get_threads (codec, options);
+  const size_t chunk_size = SQUASH_BZ2_CHUNK_SIZE(level);
+
+  if (threads == 1 || uncompressed_size <= chunk_size)
+    return squash_bz2_compress_chunk (level, work_factor, compressed_size, compressed, uncompressed_size, uncompressed);
+
+  const size_t n_chunks = (uncompressed_size / chunk_size) + ((uncompressed_size % chunk_size) != 0);
+  SquashBZ2CompressData data = {
+    codec,
+    level,
+    work_factor,
+    chunk_size,
+    uncompressed_size,
+    uncompressed,
+    squash_calloc (n_chunks, sizeof (uint8_t*)),
+    squash_calloc (n_chunks, sizeof (size_t))
+  };
+  SquashStatus res;
+
+  if (HEDLEY_UNLIKELY(data.chunks == NULL || data.chunk_sizes == NULL)) {
+    res = squash_error (SQUASH_MEMORY);
+  } else {
+    res = squash_parallel_run (n_chunks, threads, squash_bz2_compress_task, &data);
+  }
+
+  if (HEDLEY_LIKELY(res == SQUASH_OK)) {
+    size_t pos = 0;
+
+    for (size_t chunk = 0 ; chunk < n_chunks ; chunk++) {
+      if (HEDLEY_UNLIKELY(*compressed_size - pos < data.chunk_sizes[chunk])) {
+        res = squash_error (SQUASH_BUFFER_FULL);
+        break;
+      }
+
+      memcpy (compressed + pos, data.chunks[chunk], data.chunk_sizes[chunk]);
+      pos += data.chunk_sizes[chunk];
+    }
+
+    if (HEDLEY_LIKELY(res == SQUASH_OK))
+      *compressed_size = pos;
+  }
+
+  if (data.chunks != NULL) {
+    for (size_t chunk = 0 ; chunk < n_chunks ; chunk++) {
+      if (data.chunks[chunk] != NULL)
+        squash_free (data.chunks[chunk]);
+    }
+    squash_free (data.chunks);
+  }
+  if (data.chunk_sizes != NULL)
+    squash_free (data.chunk_sizes);
+
+  return res;
+}
+
+static bool
+squash_bz2_is_stream_header (size_t size, const uint8_t data[HEDLEY_ARRAY_PARAM(size)]) {
+  return size >= 4 && data[0] == 'B' && data[1] == 'Z' && data[2] == 'h' && data[3] >= '1' && data[3] <= '9';
+}
+
+/* Decode one or more concatenated streams, one after the other. */
+static SquashStatus
+squash_bz2_decompress_serial (bool small,
+                              size_t* decompressed_size,
+                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                              size_t compressed_size,
+                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]) {
+  size_t in_remaining = compressed_size;
+  size_t out_remaining = *decompressed_size;
+
+  do {
+    bz_stream stream = { 0, };
+    SquashStatus res = SQUASH_OK;
+    int bz2_e;
+
+    stream.bzalloc = squash_bz2_malloc;
+    stream.bzfree = squash_bz2_free;
+
+    bz2_e = BZ2_bzDecompressInit (&stream, 0, small);
+    if (HEDLEY_UNLIKELY(bz2_e != BZ_OK))
+      return squash_error (bz2_e == BZ_MEM_ERROR ? SQUASH_MEMORY : SQUASH_FAILED);
+
+    while (true) {
+      const unsigned int avail_in = (in_remaining > UINT_MAX) ? UINT_MAX : (unsigned int) in_remaining;
+      const unsigned int avail_out = (out_remaining > UINT_MAX) ? UINT_MAX : (unsigned int) out_remaining;
+
+      stream.next_in = (char*) (compressed + (compressed_size - in_remaining));
+      stream.avail_in = avail_in;
+      stream.next_out = (char*) (decompressed + (*decompressed_size - out_remaining));
+      stream.avail_out = avail_out;
+
+      bz2_e = BZ2_bzDecompress (&stream);
+
+      in_remaining -= avail_in - stream.avail_in;
+      out_remaining -= avail_out - stream.avail_out;
+
+      if (bz2_e == BZ_STREAM_END) {
+        break;
+      } else if (HEDLEY_UNLIKELY(bz2_e != BZ_OK)) {
+        res = squash_bz2_status_to_squash_status (bz2_e);
+        break;
+      } else if (stream.avail_in == avail_in && stream.avail_out == avail_out) {
+        /* No progress: either we're out of room or the input is
+           truncated. */
+        res = squash_error ((out_remaining == 0) ? SQUASH_BUFFER_FULL : SQUASH_INVALID_BUFFER);
+        break;
+      }
+    }
+
+    BZ2_bzDecompressEnd (&stream);
+
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+  } while (squash_bz2_is_stream_header (in_remaining, compressed + (compressed_size - in_remaining)));
+
+  *decompressed_size -= out_remaining;
+
+  return SQUASH_OK;
+}
+
+typedef struct SquashBZ2Mark_s {
+  uint64_t bit;
+  bool eos;
+} SquashBZ2Mark;
+
+typedef struct SquashBZ2ScanData_s {
+  size_t compressed_size;
+  const uint8_t* compressed;
+  SquashBZ2Mark** marks;
+  size_t* n_marks;
+} SquashBZ2ScanData;
+
+static uint64_t
+squash_bz2_read_bits (const uint8_t* data, uint64_t bit, unsigned int n_bits) {
+  uint64_t value = 0;
+
+  for (unsigned int i = 0 ; i < n_bits ; i++, bit++)
+    value = (value << 1) | ((data[bit / 8] >> (7 - (bit % 8))) & 1);
+
+  return value;
+}
+
+static void
+squash_bz2_write_bits (uint8_t* data, uint64_t* bit, uint64_t value, unsigned int n_bits) {
+  while (n_bits-- > 0) {
+    if ((value >> n_bits) & 1)
+      data[*bit / 8] |= (uint8_t) (0x80 >> (*bit % 8));
+    (*bit)++;
+  }
+}
+
+/* Find every bit position in one slice of the input where a block
+   or end-of-stream magic starts.  A magic may run past the end of
+   the slice, but not past the end of the input. */
+static SquashStatus
+squash_bz2_scan_task (size_t task, void* user_data) {
+  SquashBZ2ScanData* data = (SquashBZ2ScanData*) user_data;
+  const uint64_t mask = (UINT64_C(1) << SQUASH_BZ2_MAGIC_BITS) - 1;
+  const size_t start = task * SQUASH_BZ2_SCAN_SIZE;
+  const size_t end = (data->compressed_size - start < SQUASH_BZ2_SCAN_SIZE) ? data->compressed_size : start + SQUASH_BZ2_SCAN_SIZE;
+  const uint64_t last_bit = ((uint64_t) data->compressed_size * 8) - SQUASH_BZ2_MAGIC_BITS;
+  SquashBZ2Mark* marks = NULL;
+  size_t n_marks = 0, allocated = 0;
+  uint64_t window = 0;
+
+  if (data->compressed_size < 6)
+    return SQUASH_OK;
+
+  /* The window holds the 56 bits starting at byte i. */
+  for (size_t i = start ; i < start + 6 && i < data->compressed_size ; i++)
+    window = (window << 8) | data->compressed[i];
+
+  for (size_t i = start ; i < end ; i++) {
+    window = (window << 8) | ((i + 6 < data->compressed_size) ? data->compressed[i + 6] : 0);
+
+    for (unsigned int shift = 0 ; shift < 8 ; shift++) {
+      const uint64_t bit = ((uint64_t) i * 8) + shift;
+      const uint64_t candidate = (window >> (8 - shift)) & mask;
+
+      if (HEDLEY_LIKELY(candidate != SQUASH_BZ2_BLOCK_MAGIC && candidate != SQUASH_BZ2_EOS_MAGIC))
+        continue;
+      if (bit > last_bit)
+        break;
+
+      if (n_marks == allocated) {
+        allocated = (allocated == 0) ? 64 : allocated * 2;
+        SquashBZ2Mark* tmp = squash_realloc (marks, allocated * sizeof (SquashBZ2Mark));
+        if (HEDLEY_UNLIKELY(tmp == NULL)) {
+          if (marks != NULL)
+            squash_free (marks);
+          return squash_error (SQUASH_MEMORY);
+        }
+        marks = tmp;
+      }
+
+      marks[n_marks].bit = bit;
+      marks[n_marks].eos = candidate == SQUASH_BZ2_EOS_MAGIC;
+      n_marks++;
+    }
+  }
+
+  data->marks[task] = marks;
+  data->n_marks[task] = n_marks;
+
+  return SQUASH_OK;
+}
+
+typedef struct SquashBZ2Block_s {
+  /* Bits from the block magic up to the next magic. */
+  uint64_t start;
+  uint64_t end;
+  int level;
+  uint32_t crc;
+
+  uint8_t* decompressed;
+  size_t decompressed_size;
+} SquashBZ2Block;
+
+typedef struct SquashBZ2DecompressData_s {
+  bool small;
+  const uint8_t* compressed;
+  size_t max_decompressed_size;
+  SquashBZ2Block* blocks;
+} SquashBZ2DecompressData;
+
+/* Rebuild a block as a stream of its own (header, block, end of
+   stream marker, and a combined CRC which for a single block is just
+   the block CRC), the same trick bzip2recover uses, and decode it. */
+static SquashStatus
+squash_bz2_decompress_task (size_t task, void* user_data) {
+  SquashBZ2DecompressData* data = (SquashBZ2DecompressData*) user_data;
+  SquashBZ2Block* block = &(data->blocks[task]);
+  const uint64_t n_bits = block->end - block->start;
+  const size_t stream_size = 4 + (size_t) ((n_bits + 7) / 8) + 11;
+  uint8_t* stream_data;
+  uint64_t bit;
+  size_t out_size, out_pos = 0;
+  bz_stream stream = { 0, };
+  SquashStatus res = SQUASH_OK;
+  int bz2_e;
+
+  stream_data = squash_calloc (stream_size, 1);
+  if (HEDLEY_UNLIKELY(stream_data == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  stream_data[0] = 'B';
+  stream_data[1] = 'Z';
+  stream_data[2] = 'h';
+  stream_data[3] = (uint8_t) ('0' + block->level);
+
+  {
+    const uint8_t* src = data->compressed + (size_t) (block->start / 8);
+    const unsigned int shift = (unsigned int) (block->start % 8);
+
+    if (shift == 0) {
+      memcpy (stream_data + 4, src, (size_t) (n_bits / 8));
+    } else {
+      for (size_t i = 0 ; i < (size_t) (n_bits / 8) ; i++)
+        stream_data[4 + i] = (uint8_t) ((src[i] << shift) | (src[i + 1] >> (8 - shift)));
+    }
+  }
+  bit = 32 + ((n_bits / 8) * 8);
+  squash_bz2_write_bits (stream_data, &bit, squash_bz2_read_bits (data->compressed, block->end - (n_bits % 8), n_bits % 8), n_bits % 8);
+  squash_bz2_write_bits (stream_data, &bit, SQUASH_BZ2_EOS_MAGIC, SQUASH_BZ2_MAGIC_BITS);
+  squash_bz2_write_bits (stream_data, &bit, block->crc, 32);
+
+  /* Runs make the output of a block up to about 50 times larger than
+     the block, so start with the block size and grow as needed. */
+  out_size = (size_t) block->level * 100000;
+  if (out_size > data->max_decompressed_size)
+    out_size = data->max_decompressed_size;
+  block->decompressed = squash_malloc (out_size);
+  if (HEDLEY_UNLIKELY(block->decompressed == NULL)) {
+    squash_free (stream_data);
+    return squash_error (SQUASH_MEMORY);
+  }
+
+  stream.bzalloc = squash_bz2_malloc;
+  stream.bzfree = squash_bz2_free;
+  bz2_e = BZ2_bzDecompressInit (&stream, 0, data->small);
+  if (HEDLEY_UNLIKELY(bz2_e != BZ_OK)) {
+    squash_free (stream_data);
+    return squash_error (bz2_e == BZ_MEM_ERROR ? SQUASH_MEMORY : SQUASH_FAILED);
+  }
+
+  stream.next_in = (char*) stream_data;
+  stream.avail_in = (unsigned int) stream_size;
+
+  while (true) {
+    if (out_pos == out_size) {
+      if (out_size == data->max_decompressed_size) {
+        res = SQUASH_BUFFER_FULL;
+        break;
+      }
+
+      out_size = (out_size > data->max_decompressed_size / 2) ? data->max_decompressed_size : out_size * 2;
+      uint8_t* tmp = squash_realloc (block->decompressed, out_size);
+      if (HEDLEY_UNLIKELY(tmp == NULL)) {
+        res = squash_error (SQUASH_MEMORY);
+        break;
+      }
+      block->decompressed = tmp;
+    }
+
+    const unsigned int avail_out = (out_size - out_pos > UINT_MAX) ? UINT_MAX : (unsigned int) (out_size - out_pos);
+    stream.next_out = (char*) (block->decompressed + out_pos);
+    stream.avail_out = avail_out;
+
+    bz2_e = BZ2_bzDecompress (&stream);
+
+    out_pos += avail_out - stream.avail_out;
+
+    if (bz2_e == BZ_STREAM_END) {
+      break;
+    } else if (bz2_e != BZ_OK || (stream.avail_in == 0 && stream.avail_out != 0)) {
+      /* Not necessarily an error in the input; we may have cut it
+         in the wrong place.  Let the serial decoder decide. */
+      res = SQUASH_FAILED;
+      break;
+    }
+  }
+
+  BZ2_bzDecompressEnd (&stream);
+  squash_free (stream_data);
+
+  block->decompressed_size = out_pos;
+
+  return res;
+}
+
+/* Split the input into blocks and decode them concurrently.  This
+   relies on finding the block magic, which can also turn up inside
+   compressed data, so the structure of each stream and its combined
+   CRC are checked, and every block has its own CRC.  If anything
+   doesn't add up, false is returned and the caller should decode the
+   input serially. */
+static bool
+squash_bz2_decompress_parallel (bool small,
+                                unsigned int threads,
+                                size_t* decompressed_size,
+                                uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                size_t compressed_size,
+                                const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                SquashStatus* res) {
+  const size_t n_tasks = (compressed_size / SQUASH_BZ2_SCAN_SIZE) + ((compressed_size % SQUASH_BZ2_SCAN_SIZE) != 0);
+  SquashBZ2ScanData scan = {
+    compressed_size,
+    compressed,
+    squash_calloc (n_tasks, sizeof (SquashBZ2Mark*)),
+    squash_calloc (n_tasks, sizeof (size_t))
+  };
+  SquashBZ2Block* blocks = NULL;
+  size_t n_blocks = 0, n_marks = 0;
+  bool handled = false;
+
+  if (HEDLEY_UNLIKELY(scan.marks == NULL || scan.n_marks == NULL))
+    goto cleanup;
+
+  if (squash_parallel_run (n_tasks, threads, squash_bz2_scan_task, &scan) != SQUASH_OK)
+    goto cleanup;
+
+  for (size_t task = 0 ; task < n_tasks ; task++)
+    n_marks += scan.n_marks[task];
+
+  blocks = squash_calloc (n_marks + 1, sizeof (SquashBZ2Block));
+  if (HEDLEY_UNLIKELY(blocks == NULL))
+    goto cleanup;
+
+  {
+    size_t task = 0, mark = 0, pos = 0;
+
+#define SQUASH_BZ2_NEXT_MARK() \
+    do { \
+      mark++; \
+      while (task < n_tasks && mark >= scan.n_marks[task]) { task++; mark = 0; } \
+    } while (0)
+
+    mark = (size_t) -1;
+    SQUASH_BZ2_NEXT_MARK();
+
+    while (squash_bz2_is_stream_header (compressed_size - pos, compressed + pos)) {
+      const int level = compressed[pos + 3] - '0';
+      uint64_t bit = ((uint64_t) pos + 4) * 8;
+      uint32_t combined_crc = 0;
+
+      while (true) {
+        if (task == n_tasks || scan.marks[task][mark].bit != bit)
+          goto cleanup;
+
+        if (scan.marks[task][mark].eos)
+          break;
+
+        blocks[n_blocks].start = bit;
+        blocks[n_blocks].level = level;
+        blocks[n_blocks].crc = (uint32_t) squash_bz2_read_bits (compressed, bit + SQUASH_BZ2_MAGIC_BITS, 32);
+        combined_crc = ((combined_crc << 1) | (combined_crc >> 31)) ^ blocks[n_blocks].crc;
+
+        SQUASH_BZ2_NEXT_MARK();
+        if (task == n_tasks)
+          goto cleanup;
+
+        bit = scan.marks[task][mark].bit;
+        blocks[n_blocks].end = bit;
+        n_blocks++;
+      }
+
+      /* End of stream marker, combined CRC, then padding to a byte
+         boundary. */
+      if (bit + SQUASH_BZ2_MAGIC_BITS + 32 > (uint64_t) compressed_size * 8 ||
+          squash_bz2_read_bits (compressed, bit + SQUASH_BZ2_MAGIC_BITS, 32) != combined_crc)
+        goto cleanup;
+
+      pos = (size_t) ((bit + SQUASH_BZ2_MAGIC_BITS + 32 + 7) / 8);
+      SQUASH_BZ2_NEXT_MARK();
+    }
+
+#undef SQUASH_BZ2_NEXT_MARK
+
+    /* Anything after the last stream is ignored, just like the
+       serial decoder does, but there has to be a stream. */
+    if (pos == 0 || n_blocks < 2)
+      goto cleanup;
+  }
+
+  /* Decode a few blocks per thread at a time so we don't hold much
+     more than the output in memory. */
+  {
+    SquashBZ2DecompressData data = { small, compressed, *decompressed_size, NULL };
+    const size_t batch_size = (size_t) threads * 2;
+    size_t out_pos = 0;
+
+    for (size_t first = 0 ; first < n_blocks ; first += batch_size) {
+      const size_t batch = (n_blocks - first < batch_size) ? n_blocks - first : batch_size;
+
+      data.blocks = blocks + first;
+      data.max_decompressed_size = *decompressed_size - out_pos;
+      if (data.max_decompressed_size == 0)
+        data.max_decompressed_size = 1;
+
+      const SquashStatus batch_res = squash_parallel_run (batch, threads, squash_bz2_decompress_task, &data);
+
+      for (size_t block = first ; block < first + batch && batch_res == SQUASH_OK ; block++) {
+        if (*decompressed_size - out_pos < blocks[block].decompressed_size) {
+          *res = squash_error (SQUASH_BUFFER_FULL);
+          handled = true;
+          goto cleanup;
+        }
+
+        memcpy (decompressed + out_pos, blocks[block].decompressed, blocks[block].decompressed_size);
+        out_pos += blocks[block].decompressed_size;
+      }
+
+      for (size_t block = first ; block < first + batch ; block++) {
+        if (blocks[block].decompressed != NULL) {
+          squash_free (blocks[block].decompressed);
+          blocks[block].decompressed = NULL;
+        }
+      }
+
+      if (batch_res != SQUASH_OK)
+        goto cleanup;
+    }
+
+    *decompressed_size = out_pos;
+    *res = SQUASH_OK;
+    handled = true;
+  }
+
+ cleanup:
+
+  if (blocks != NULL) {
+    for (size_t block = 0 ; block < n_blocks ; block++) {
+      if (blocks[block].decompressed != NULL)
+        squash_free (blocks[block].decompressed);
+    }
+    squash_free (blocks);
+  }
+  if (scan.marks != NULL) {
+    for (size_t task = 0 ; task < n_tasks ; task++) {
+      if (scan.marks[task] != NULL)
+        squash_free (scan.marks[task]);
+    }
+    squash_free (scan.marks);
+  }
+  if (scan.n_marks != NULL)
+    squash_free (scan.n_marks);
+
+  return handled;
+}
+
+static SquashStatus
+squash_bz2_decompress_buffer (SquashCodec* codec,
+                              size_t* decompressed_size,
+                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                              size_t compressed_size,
+                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                              SquashOptions* options) {
+  const bool small = squash_options_get_bool_at (options, codec, SQUASH_BZ2_OPT_SMALL);
+  const unsigned int threads = squash_bz2_get_threads (codec, options);
+  SquashStatus res;
+
+  if (threads > 1 &&
+      squash_bz2_decompress_parallel (small, threads, decompressed_size, decompressed, compressed_size, compressed, &res))
+    return res;
+
+  return squash_bz2_decompress_serial (small, decompressed_size, decompressed, compressed_size, compressed);
 }
 
 SquashStatus
@@ -290,6 +954,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->create_stream = squash_bz2_create_stream;
     impl->process_stream = squash_bz2_process_stream;
     impl->get_max_compressed_size = squash_bz2_get_max_compressed_size;
+    impl->compress_buffer = squash_bz2_compress_buffer;
+    impl->decompress_buffer = squash_bz2_decompress_buffer;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
   }
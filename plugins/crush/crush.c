@@ -164,6 +164,12 @@ crush_free (void* ptr, void* user_data) {
   return free(ptr);
 }
 
+enum {
+	CRUSH_STATE_IDLE = 0, /* Compress: buffering input.  Decompress: reading a block header. */
+	CRUSH_STATE_BLOCK,    /* Encoding or decoding a block */
+	CRUSH_STATE_OUTPUT    /* Decompress: writing out a decoded block */
+};
+
 int crush_init_full(CrushContext* ctx, CrushReadFunc reader, CrushWriteFunc writer, CrushMalloc alloc, CrushFree dealloc, void* user_data, CrushDestroyNotify destroy_data)
 {
 	ctx->bit_buf = 0;
@@ -176,10 +182,32 @@ int crush_init_full(CrushContext* ctx, CrushReadFunc reader, CrushWriteFunc writ
 	ctx->alloc = alloc;
 	ctx->dealloc = dealloc;
 
+	ctx->state = CRUSH_STATE_IDLE;
+	ctx->head = NULL;
+	ctx->prev = NULL;
+	ctx->size = 0;
+	ctx->p = 0;
+	ctx->h1 = 0;
+	ctx->h2 = 0;
+	ctx->obuf_out = 0;
+	ctx->header_pos = 0;
+	ctx->emitted = 0;
+
 	ctx->buf = (unsigned char*)alloc(BUF_SIZE+MAX_MATCH, user_data);
 	ctx->obuf = (unsigned char*)alloc(OBUF_SIZE, user_data);
 	ctx->obuf_pos = 0;
 
+	if (ctx->buf == NULL || ctx->obuf == NULL)
+	{
+		if (ctx->buf != NULL)
+			dealloc(ctx->buf, user_data);
+		if (ctx->obuf != NULL)
+			dealloc(ctx->obuf, user_data);
+		ctx->buf = NULL;
+		ctx->obuf = NULL;
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -202,9 +230,6 @@ static void crush_stdio_destroy (void* user_data)
 	free(user_data);
 }
 
-static size_t total_read = 0;
-static size_t total_written = 0;
-
 static size_t crush_stdio_fread (void* ptr, size_t size, void* user_data)
 {
 	return fread(ptr, 1, size, ((struct CrushStdioData*) user_data)->in);
@@ -235,29 +260,37 @@ void crush_destroy(CrushContext* ctx)
 	}
 	ctx->dealloc(ctx->buf, ctx->user_data);
 	ctx->dealloc(ctx->obuf, ctx->user_data);
+	if (ctx->head != NULL)
+		ctx->dealloc(ctx->head, ctx->user_data);
+	if (ctx->prev != NULL)
+		ctx->dealloc(ctx->prev, ctx->user_data);
 }
 
-static void init_bits(CrushContext* ctx)
+/* Copy as much of the pending output in obuf as will fit. */
+static void drain_obuf(CrushContext* ctx, unsigned char** next_out, size_t* avail_out)
 {
-	ctx->bit_count=ctx->bit_buf=0;
-}
+	size_t n = (size_t)(ctx->obuf_pos - ctx->obuf_out);
+	if (n > *avail_out)
+		n = *avail_out;
 
-static void write_obuf(CrushContext* ctx) {
-	if (ctx->obuf_pos != 0) {
-		ctx->writer(ctx->obuf, ctx->obuf_pos, ctx->user_data);
-		ctx->obuf_pos = 0;
-	}
+	memcpy(*next_out, ctx->obuf + ctx->obuf_out, n);
+	*next_out += n;
+	*avail_out -= n;
+	ctx->obuf_out += (int)n;
+
+	if (ctx->obuf_out == ctx->obuf_pos)
+		ctx->obuf_out = ctx->obuf_pos = 0;
 }
 
+/* The caller must make sure there is room in obuf for the whole
+ * value; a single token never needs more than 5 bytes. */
 static void put_bits(CrushContext* ctx, int n, int x)
 {
-	ctx->bit_buf|=x<<ctx->bit_count;
+	ctx->bit_buf|=(uint64_t)x<<ctx->bit_count;
 	ctx->bit_count+=n;
 	while (ctx->bit_count>=8)
 	{
 		ctx->obuf[ctx->obuf_pos++] = (unsigned char) (ctx->bit_buf & 0xff);
-		if(ctx->obuf_pos == OBUF_SIZE)
-			write_obuf(ctx);
 		ctx->bit_buf>>=8;
 		ctx->bit_count-=8;
 	}
@@ -266,24 +299,8 @@ static void put_bits(CrushContext* ctx, int n, int x)
 static void flush_bits(CrushContext* ctx)
 {
 	put_bits(ctx, 7, 0);
-	ctx->bit_count=ctx->bit_buf=0;
-	write_obuf(ctx);
-}
-
-static int get_bits(CrushContext* ctx, int n)
-{
-	int x;
-	while (ctx->bit_count<n)
-	{
-		unsigned char c;
-		ctx->reader(&c, 1, ctx->user_data);
-		ctx->bit_buf|=c<<ctx->bit_count;
-		ctx->bit_count+=8;
-	}
-	x=ctx->bit_buf&((1<<n)-1);
-	ctx->bit_buf>>=n;
-	ctx->bit_count-=n;
-	return x;
+	ctx->bit_count=0;
+	ctx->bit_buf=0;
 }
 
 static int update_hash1(int h, int c)
@@ -317,247 +334,562 @@ static int get_penalty(int a, int b)
 	return p;
 }
 
-int crush_compress(CrushContext* ctx, int level)
-{
-  int* head = (int*)ctx->alloc((HASH1_SIZE+HASH2_SIZE) * sizeof(int), ctx->user_data);
-  int* prev = (int*)ctx->alloc(W_SIZE * sizeof(int), ctx->user_data);
-
-  if (head == NULL || prev == NULL) {
-    free (head);
-    free (prev);
-    return -1;
-  }
+static const int max_chain[]={4, 256, 1<<12};
 
-	const int max_chain[]={4, 256, 1<<12};
-
-	int32_t size;
-	while ((size=ctx->reader(ctx->buf, BUF_SIZE, ctx->user_data))>0)
-	{
-		int i;
-		int h1=0;
-		int h2=0;
-		int p=0;
+static void start_block(CrushContext* ctx)
+{
+	int i;
+	const uint32_t size_le = ENDIAN_TO_LE32((uint32_t)ctx->size);
+
+	memcpy(ctx->obuf + ctx->obuf_pos, &size_le, sizeof(size_le)); /* Little-endian */
+	ctx->obuf_pos += sizeof(size_le);
+
+	for (i=0; i<HASH1_SIZE+HASH2_SIZE; ++i)
+		ctx->head[i]=-1;
+
+	ctx->h1=0;
+	ctx->h2=0;
+	ctx->p=0;
+	for (i=0; i<HASH1_LEN; ++i)
+		ctx->h1=update_hash1(ctx->h1, ctx->buf[i]);
+	for (i=0; i<HASH2_LEN; ++i)
+		ctx->h2=update_hash2(ctx->h2, ctx->buf[i]);
+}
 
-    const int32_t size_le = ENDIAN_TO_LE32(size);
-		ctx->writer(&size_le, sizeof(size_le), ctx->user_data); /* Little-endian */
+/* Encode a single literal or match at ctx->p. */
+static void encode_token(CrushContext* ctx, int level)
+{
+	const unsigned char* buf=ctx->buf;
+	int* head=ctx->head;
+	int* prev=ctx->prev;
+	const int size=ctx->size;
+	int p=ctx->p;
+	int h1=ctx->h1;
+	int h2=ctx->h2;
 
-		for (i=0; i<HASH1_SIZE+HASH2_SIZE; ++i)
-			head[i]=-1;
+	int len=MIN_MATCH-1;
+	int offset=W_SIZE;
 
-		for (i=0; i<HASH1_LEN; ++i)
-			h1=update_hash1(h1, ctx->buf[i]);
-		for (i=0; i<HASH2_LEN; ++i)
-			h2=update_hash2(h2, ctx->buf[i]);
+	const int max_match=get_min(MAX_MATCH, size-p);
+	const int limit=get_max(p-W_SIZE, 0);
 
-		while (p<size)
+	if (head[h1]>=limit)
+	{
+		int s=head[h1];
+		if (buf[s]==buf[p])
 		{
-			int len=MIN_MATCH-1;
-			int offset=W_SIZE;
+			int l=0;
+			while (++l<max_match)
+				if (buf[s+l]!=buf[p+l])
+					break;
+			if (l>len)
+			{
+				len=l;
+				offset=p-s;
+			}
+		}
+	}
 
-			const int max_match=get_min(MAX_MATCH, size-p);
-			const int limit=get_max(p-W_SIZE, 0);
+	if (len<MAX_MATCH)
+	{
+		int chain_len=max_chain[level];
+		int s=head[h2+HASH1_SIZE];
 
-			if (head[h1]>=limit)
+		while ((chain_len--!=0)&&(s>=limit))
+		{
+			if ((buf[s+len]==buf[p+len])&&(buf[s]==buf[p]))
 			{
-				int s=head[h1];
-				if (ctx->buf[s]==ctx->buf[p])
+				int l=0;
+				while (++l<max_match)
+					if (buf[s+l]!=buf[p+l])
+						break;
+				if (l>len+get_penalty((p-s)>>4, offset))
 				{
-					int l=0;
-					while (++l<max_match)
-						if (ctx->buf[s+l]!=ctx->buf[p+l])
-							break;
-					if (l>len)
-					{
-						len=l;
-						offset=p-s;
-					}
+					len=l;
+					offset=p-s;
 				}
+				if (l==max_match)
+					break;
 			}
+			s=prev[s&W_MASK];
+		}
+	}
 
-			if (len<MAX_MATCH)
-			{
-				int chain_len=max_chain[level];
-				int s=head[h2+HASH1_SIZE];
+	if ((len==MIN_MATCH)&&(offset>TOO_FAR))
+		len=0;
+
+	if ((level>=2)&&(len>=MIN_MATCH)&&(len<max_match))
+	{
+		const int next_p=p+1;
+		const int max_lazy=get_min(len+4, max_match);
+
+		int chain_len=max_chain[level];
+		int s=head[update_hash2(h2, buf[next_p+(HASH2_LEN-1)])+HASH1_SIZE];
 
-				while ((chain_len--!=0)&&(s>=limit))
+		while ((chain_len--!=0)&&(s>=limit))
+		{
+			if ((buf[s+len]==buf[next_p+len])&&(buf[s]==buf[next_p]))
+			{
+				int l=0;
+				while (++l<max_lazy)
+					if (buf[s+l]!=buf[next_p+l])
+						break;
+				if (l>len+get_penalty(next_p-s, offset))
 				{
-					if ((ctx->buf[s+len]==ctx->buf[p+len])&&(ctx->buf[s]==ctx->buf[p]))
-					{
-						int l=0;
-						while (++l<max_match)
-							if (ctx->buf[s+l]!=ctx->buf[p+l])
-								break;
-						if (l>len+get_penalty((p-s)>>4, offset))
-						{
-							len=l;
-							offset=p-s;
-						}
-						if (l==max_match)
-							break;
-					}
-					s=prev[s&W_MASK];
+					len=0;
+					break;
 				}
+				if (l==max_lazy)
+					break;
 			}
+			s=prev[s&W_MASK];
+		}
+	}
+
+	if (len>=MIN_MATCH) /* Match */
+	{
+		const int l=len-MIN_MATCH;
+		int log=W_BITS-NUM_SLOTS;
+
+		put_bits(ctx, 1, 1);
+
+		if (l<A)
+		{
+			put_bits(ctx, 1, 1); /* 1 */
+			put_bits(ctx, A_BITS, l);
+		}
+		else if (l<B)
+		{
+			put_bits(ctx, 2, 1<<1); /* 01 */
+			put_bits(ctx, B_BITS, l-A);
+		}
+		else if (l<C)
+		{
+			put_bits(ctx, 3, 1<<2); /* 001 */
+			put_bits(ctx, C_BITS, l-B);
+		}
+		else if (l<D)
+		{
+			put_bits(ctx, 4, 1<<3); /* 0001 */
+			put_bits(ctx, D_BITS, l-C);
+		}
+		else if (l<E)
+		{
+			put_bits(ctx, 5, 1<<4); /* 00001 */
+			put_bits(ctx, E_BITS, l-D);
+		}
+		else
+		{
+			put_bits(ctx, 5, 0); /* 00000 */
+			put_bits(ctx, F_BITS, l-E);
+		}
+
+		--offset;
+		while (offset>=(2<<log))
+			++log;
+		put_bits(ctx, SLOT_BITS, log-(W_BITS-NUM_SLOTS));
+		if (log>(W_BITS-NUM_SLOTS))
+			put_bits(ctx, log, offset-(1<<log));
+		else
+			put_bits(ctx, W_BITS-(NUM_SLOTS-1), offset);
+	}
+	else /* Literal */
+	{
+		len=1;
+		put_bits(ctx, 9, buf[p]<<1); /* 0 xxxxxxxx */
+	}
+
+	while (len--!=0) /* Insert new strings */
+	{
+		head[h1]=p;
+		prev[p&W_MASK]=head[h2+HASH1_SIZE];
+		head[h2+HASH1_SIZE]=p;
+		++p;
+		h1=update_hash1(h1, buf[p+(HASH1_LEN-1)]);
+		h2=update_hash2(h2, buf[p+(HASH2_LEN-1)]);
+	}
+
+	ctx->p=p;
+	ctx->h1=h1;
+	ctx->h2=h2;
+}
+
+/* Room the encoder wants in obuf before encoding another token. */
+#define TOKEN_SPACE 8
+
+int crush_compress_stream(CrushContext* ctx, int level,
+                          const unsigned char** next_in, size_t* avail_in,
+                          unsigned char** next_out, size_t* avail_out,
+                          CrushAction action)
+{
+	if (ctx->head == NULL)
+	{
+		ctx->head = (int*)ctx->alloc((HASH1_SIZE+HASH2_SIZE) * sizeof(int), ctx->user_data);
+		if (ctx->head == NULL)
+			return CRUSH_MEM_ERROR;
+	}
+	if (ctx->prev == NULL)
+	{
+		ctx->prev = (int*)ctx->alloc(W_SIZE * sizeof(int), ctx->user_data);
+		if (ctx->prev == NULL)
+			return CRUSH_MEM_ERROR;
+	}
 
-			if ((len==MIN_MATCH)&&(offset>TOO_FAR))
-				len=0;
+	for (;;)
+	{
+		if (ctx->obuf_pos != 0)
+		{
+			drain_obuf(ctx, next_out, avail_out);
+			if (ctx->obuf_pos != 0)
+				return CRUSH_BUF_FULL;
+		}
+
+		if (ctx->state == CRUSH_STATE_IDLE)
+		{
+			/* Blocks are only cut when the buffer is full or the caller
+			 * asks for it, so the output doesn't depend on how the
+			 * input was split up. */
+			size_t n = (size_t)(BUF_SIZE - ctx->size);
+			if (n > *avail_in)
+				n = *avail_in;
+			if (n != 0)
+				memcpy(ctx->buf + ctx->size, *next_in, n);
+			*next_in += n;
+			*avail_in -= n;
+			ctx->size += (int)n;
+
+			if (ctx->size == BUF_SIZE || (ctx->size != 0 && action != CRUSH_RUN))
+			{
+				start_block(ctx);
+				ctx->state = CRUSH_STATE_BLOCK;
+			}
+			else
+			{
+				return CRUSH_OK;
+			}
+		}
+		else
+		{
+			while (ctx->p < ctx->size && (OBUF_SIZE - ctx->obuf_pos) >= TOKEN_SPACE)
+				encode_token(ctx, level);
 
-			if ((level>=2)&&(len>=MIN_MATCH)&&(len<max_match))
+			if (ctx->p == ctx->size && ctx->obuf_pos < OBUF_SIZE)
 			{
-				const int next_p=p+1;
-				const int max_lazy=get_min(len+4, max_match);
+				flush_bits(ctx);
+				ctx->size = 0;
+				ctx->state = CRUSH_STATE_IDLE;
+			}
+		}
+	}
+}
 
-				int chain_len=max_chain[level];
-				int s=head[update_hash2(h2, ctx->buf[next_p+(HASH2_LEN-1)])+HASH1_SIZE];
+/* Decode a single token from the low bits of bits, returning the
+ * number of bits used or 0 if there aren't enough of them. */
+static int decode_token(uint64_t bits, int count, int* len, int* dist)
+{
+	int used = 0;
+	int log;
+
+#define CRUSH_PEEK(n, dest) do { \
+		if (used + (n) > count) \
+			return 0; \
+		(dest) = (int)((bits >> used) & ((UINT64_C(1) << (n)) - 1)); \
+		used += (n); \
+	} while (0)
+
+	int flag;
+	CRUSH_PEEK(1, flag);
+	if (!flag)
+	{
+		CRUSH_PEEK(8, *dist);
+		*len = 0;
+		return used;
+	}
 
-				while ((chain_len--!=0)&&(s>=limit))
+	CRUSH_PEEK(1, flag);
+	if (flag)
+	{
+		CRUSH_PEEK(A_BITS, *len);
+	}
+	else
+	{
+		CRUSH_PEEK(1, flag);
+		if (flag)
+		{
+			CRUSH_PEEK(B_BITS, *len);
+			*len += A;
+		}
+		else
+		{
+			CRUSH_PEEK(1, flag);
+			if (flag)
+			{
+				CRUSH_PEEK(C_BITS, *len);
+				*len += B;
+			}
+			else
+			{
+				CRUSH_PEEK(1, flag);
+				if (flag)
 				{
-					if ((ctx->buf[s+len]==ctx->buf[next_p+len])&&(ctx->buf[s]==ctx->buf[next_p]))
+					CRUSH_PEEK(D_BITS, *len);
+					*len += C;
+				}
+				else
+				{
+					CRUSH_PEEK(1, flag);
+					if (flag)
+					{
+						CRUSH_PEEK(E_BITS, *len);
+						*len += D;
+					}
+					else
 					{
-						int l=0;
-						while (++l<max_lazy)
-							if (ctx->buf[s+l]!=ctx->buf[next_p+l])
-								break;
-						if (l>len+get_penalty(next_p-s, offset))
-						{
-							len=0;
-							break;
-						}
-						if (l==max_lazy)
-							break;
+						CRUSH_PEEK(F_BITS, *len);
+						*len += E;
 					}
-					s=prev[s&W_MASK];
 				}
 			}
+		}
+	}
+	*len += MIN_MATCH;
 
-			if (len>=MIN_MATCH) /* Match */
-			{
-				const int l=len-MIN_MATCH;
-				int log=W_BITS-NUM_SLOTS;
+	CRUSH_PEEK(SLOT_BITS, log);
+	log += W_BITS-NUM_SLOTS;
+	if (log>(W_BITS-NUM_SLOTS))
+	{
+		CRUSH_PEEK(log, *dist);
+		*dist += 1<<log;
+	}
+	else
+	{
+		CRUSH_PEEK(W_BITS-(NUM_SLOTS-1), *dist);
+	}
+	*dist += 1;
+
+#undef CRUSH_PEEK
 
-				put_bits(ctx, 1, 1);
+	return used;
+}
 
-				if (l<A)
+/* Copy as much of the decoded block as will fit. */
+static void drain_buf(CrushContext* ctx, unsigned char** next_out, size_t* avail_out)
+{
+	size_t n = (size_t)(ctx->p - ctx->emitted);
+	if (n > *avail_out)
+		n = *avail_out;
+
+	memcpy(*next_out, ctx->buf + ctx->emitted, n);
+	*next_out += n;
+	*avail_out -= n;
+	ctx->emitted += (int)n;
+}
+
+int crush_decompress_stream(CrushContext* ctx,
+                            const unsigned char** next_in, size_t* avail_in,
+                            unsigned char** next_out, size_t* avail_out,
+                            CrushAction action)
+{
+	for (;;)
+	{
+		if (ctx->state == CRUSH_STATE_IDLE)
+		{
+			uint32_t size;
+
+			/* Whole bytes left over in bit_buf after the end of the
+			 * previous block come first. */
+			while (ctx->header_pos < 4)
+			{
+				if (ctx->bit_count >= 8)
 				{
-					put_bits(ctx, 1, 1); /* 1 */
-					put_bits(ctx, A_BITS, l);
+					ctx->header[ctx->header_pos++] = (unsigned char)(ctx->bit_buf & 0xff);
+					ctx->bit_buf >>= 8;
+					ctx->bit_count -= 8;
 				}
-				else if (l<B)
+				else if (*avail_in != 0)
 				{
-					put_bits(ctx, 2, 1<<1); /* 01 */
-					put_bits(ctx, B_BITS, l-A);
+					ctx->header[ctx->header_pos++] = **next_in;
+					*next_in += 1;
+					*avail_in -= 1;
 				}
-				else if (l<C)
+				else
 				{
-					put_bits(ctx, 3, 1<<2); /* 001 */
-					put_bits(ctx, C_BITS, l-B);
+					break;
 				}
-				else if (l<D)
+			}
+
+			if (ctx->header_pos < 4)
+				return (ctx->header_pos != 0 && action == CRUSH_FINISH) ? CRUSH_DATA_ERROR : CRUSH_OK;
+
+			memcpy(&size, ctx->header, sizeof(size));
+			size = ENDIAN_FROM_LE32(size); /* Little-endian */
+			if ((size<1)||(size>BUF_SIZE))
+				return CRUSH_DATA_ERROR;
+
+			ctx->size = (int)size;
+			ctx->p = 0;
+			ctx->emitted = 0;
+			ctx->header_pos = 0;
+			ctx->state = CRUSH_STATE_BLOCK;
+		}
+		else if (ctx->state == CRUSH_STATE_BLOCK)
+		{
+			unsigned char* buf = ctx->buf;
+			const int size = ctx->size;
+			uint64_t bits = ctx->bit_buf;
+			int count = ctx->bit_count;
+			const unsigned char* in = *next_in;
+			const unsigned char* in_end = in + *avail_in;
+			int p = ctx->p;
+
+			while (p<size)
+			{
+				int len;
+				int dist;
+				int used;
+
+				while (count <= 56 && in != in_end)
 				{
-					put_bits(ctx, 4, 1<<3); /* 0001 */
-					put_bits(ctx, D_BITS, l-C);
+					bits |= (uint64_t)(*in++) << count;
+					count += 8;
 				}
-				else if (l<E)
+
+				used = decode_token(bits, count, &len, &dist);
+				if (used == 0)
+					break;
+				bits >>= used;
+				count -= used;
+
+				if (len == 0)
 				{
-					put_bits(ctx, 5, 1<<4); /* 00001 */
-					put_bits(ctx, E_BITS, l-D);
+					buf[p++] = (unsigned char)dist;
 				}
 				else
 				{
-					put_bits(ctx, 5, 0); /* 00000 */
-					put_bits(ctx, F_BITS, l-E);
+					int s = p - dist;
+					if (s<0 || len>size-p)
+					{
+						ctx->p = p;
+						return CRUSH_DATA_ERROR;
+					}
+					while (len--!=0)
+						buf[p++]=buf[s++];
 				}
-
-				--offset;
-				while (offset>=(2<<log))
-					++log;
-				put_bits(ctx, SLOT_BITS, log-(W_BITS-NUM_SLOTS));
-				if (log>(W_BITS-NUM_SLOTS))
-					put_bits(ctx, log, offset-(1<<log));
-				else
-					put_bits(ctx, W_BITS-(NUM_SLOTS-1), offset);
-			}
-			else /* Literal */
-			{
-				len=1;
-				put_bits(ctx, 9, ctx->buf[p]<<1); /* 0 xxxxxxxx */
 			}
 
-			while (len--!=0) /* Insert new strings */
+			*avail_in -= (size_t)(in - *next_in);
+			*next_in = in;
+			ctx->p = p;
+
+			if (p<size)
 			{
-				head[h1]=p;
-				prev[p&W_MASK]=head[h2+HASH1_SIZE];
-				head[h2+HASH1_SIZE]=p;
-				++p;
-				h1=update_hash1(h1, ctx->buf[p+(HASH1_LEN-1)]);
-				h2=update_hash2(h2, ctx->buf[p+(HASH2_LEN-1)]);
+				/* Out of input in the middle of a block. */
+				ctx->bit_buf = bits;
+				ctx->bit_count = count;
+
+				drain_buf(ctx, next_out, avail_out);
+				if (ctx->emitted != ctx->p)
+					return CRUSH_BUF_FULL;
+				return action == CRUSH_FINISH ? CRUSH_DATA_ERROR : CRUSH_OK;
 			}
-		}
 
-		flush_bits(ctx);
+			/* Skip the padding at the end of the block */
+			ctx->bit_buf = bits >> (count & 7);
+			ctx->bit_count = count & ~7;
+			ctx->state = CRUSH_STATE_OUTPUT;
+		}
+		else
+		{
+			drain_buf(ctx, next_out, avail_out);
+			if (ctx->emitted != ctx->size)
+				return CRUSH_BUF_FULL;
+			ctx->state = CRUSH_STATE_IDLE;
+		}
 	}
-	ctx->dealloc(head, ctx->user_data);
-	ctx->dealloc(prev, ctx->user_data);
-	return 0;
 }
 
-int crush_decompress(CrushContext* ctx)
+/* Size of the buffers the callback-based API uses to pass data to the
+ * resumable one. */
+#define CRUSH_IO_SIZE (1<<16)
+
+int crush_compress(CrushContext* ctx, int level)
 {
-	int32_t size;
-	while (ctx->reader(&size, sizeof(size), ctx->user_data)>0) /* Little-endian */
+	unsigned char* in = (unsigned char*)ctx->alloc(CRUSH_IO_SIZE, ctx->user_data);
+	unsigned char* out = (unsigned char*)ctx->alloc(CRUSH_IO_SIZE, ctx->user_data);
+	int res = 0;
+
+	if (in == NULL || out == NULL)
 	{
-    size = ENDIAN_FROM_LE32(size);
-		int p=0;
+		res = CRUSH_MEM_ERROR;
+		goto cleanup;
+	}
+
+	for (;;)
+	{
+		const size_t in_size = ctx->reader(in, CRUSH_IO_SIZE, ctx->user_data);
+		const unsigned char* next_in = in;
+		size_t avail_in = in_size;
 
-		if ((size<1)||(size>BUF_SIZE))
+		do
 		{
-			return -1;
-		}
+			unsigned char* next_out = out;
+			size_t avail_out = CRUSH_IO_SIZE;
+			res = crush_compress_stream(ctx, level, &next_in, &avail_in, &next_out, &avail_out,
+			                            in_size == 0 ? CRUSH_FINISH : CRUSH_RUN);
+			if (next_out != out)
+				ctx->writer(out, (size_t)(next_out - out), ctx->user_data);
+		} while (res == CRUSH_BUF_FULL);
+
+		if (res < 0 || in_size == 0)
+			break;
+	}
 
-		init_bits(ctx);
+cleanup:
+	if (in != NULL)
+		ctx->dealloc(in, ctx->user_data);
+	if (out != NULL)
+		ctx->dealloc(out, ctx->user_data);
+	return res;
+}
 
-		while (p<size)
-		{
-			if (get_bits(ctx, 1))
-			{
-				int len;
-				int log;
-				int s;
-				if (get_bits(ctx, 1))
-					len=get_bits(ctx, A_BITS);
-				else if (get_bits(ctx, 1))
-					len=get_bits(ctx, B_BITS)+A;
-				else if (get_bits(ctx, 1))
-					len=get_bits(ctx, C_BITS)+B;
-				else if (get_bits(ctx, 1))
-					len=get_bits(ctx, D_BITS)+C;
-				else if (get_bits(ctx, 1))
-					len=get_bits(ctx, E_BITS)+D;
-				else
-					len=get_bits(ctx, F_BITS)+E;
+int crush_decompress(CrushContext* ctx)
+{
+	unsigned char* in = (unsigned char*)ctx->alloc(CRUSH_IO_SIZE, ctx->user_data);
+	unsigned char* out = (unsigned char*)ctx->alloc(CRUSH_IO_SIZE, ctx->user_data);
+	int res = 0;
 
-				log=get_bits(ctx, SLOT_BITS)+(W_BITS-NUM_SLOTS);
-				s=~(log>(W_BITS-NUM_SLOTS)
-					?get_bits(ctx, log)+(1<<log)
-					:get_bits(ctx, W_BITS-(NUM_SLOTS-1)))+p;
-				if (s<0)
-				{
-					return -2;
-				}
+	if (in == NULL || out == NULL)
+	{
+		res = CRUSH_MEM_ERROR;
+		goto cleanup;
+	}
 
-				ctx->buf[p++]=ctx->buf[s++];
-				ctx->buf[p++]=ctx->buf[s++];
-				ctx->buf[p++]=ctx->buf[s++];
-				while (len--!=0)
-					ctx->buf[p++]=ctx->buf[s++];
-			}
-			else
-				ctx->buf[p++]=get_bits(ctx, 8);
-		}
+	for (;;)
+	{
+		const size_t in_size = ctx->reader(in, CRUSH_IO_SIZE, ctx->user_data);
+		const unsigned char* next_in = in;
+		size_t avail_in = in_size;
 
-		ctx->writer(ctx->buf, p, ctx->user_data);
+		do
+		{
+			unsigned char* next_out = out;
+			size_t avail_out = CRUSH_IO_SIZE;
+			res = crush_decompress_stream(ctx, &next_in, &avail_in, &next_out, &avail_out,
+			                              in_size == 0 ? CRUSH_FINISH : CRUSH_RUN);
+			if (next_out != out)
+				ctx->writer(out, (size_t)(next_out - out), ctx->user_data);
+		} while (res == CRUSH_BUF_FULL);
+
+		if (res < 0 || in_size == 0)
+			break;
 	}
-	return 0;
+
+cleanup:
+	if (in != NULL)
+		ctx->dealloc(in, ctx->user_data);
+	if (out != NULL)
+		ctx->dealloc(out, ctx->user_data);
+	return res;
 }
 
 #if defined(CRUSH_CLI)
@@ -2,6 +2,7 @@
 #define CRUSH_H
 
 #include <stdio.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,8 +14,26 @@ typedef void (*CrushDestroyNotify)(void* ptr);
 typedef void* (*CrushMalloc)(size_t size, void* user_data);
 typedef void (*CrushFree)(void* ptr, void* user_data);
 
+typedef enum {
+	CRUSH_RUN = 0,
+	CRUSH_FLUSH = 1,
+	CRUSH_FINISH = 2
+} CrushAction;
+
+/* Return values for crush_compress_stream and crush_decompress_stream.
+ * CRUSH_OK means all the input has been consumed (and, for
+ * CRUSH_FLUSH/CRUSH_FINISH, all the output written); CRUSH_BUF_FULL
+ * means the function needs to be called again with more room for
+ * output. */
+enum {
+	CRUSH_OK = 0,
+	CRUSH_BUF_FULL = 1,
+	CRUSH_MEM_ERROR = -1,
+	CRUSH_DATA_ERROR = -2
+};
+
 typedef struct {
-	int bit_buf;
+	uint64_t bit_buf;
 	int bit_count;
 	unsigned char* buf;
   unsigned char* obuf;
@@ -25,6 +44,19 @@ typedef struct {
   CrushFree dealloc;
 	void* user_data;
 	CrushDestroyNotify user_data_destroy;
+
+	/* State for the resumable API */
+	int state;
+	int* head;
+	int* prev;
+	int size;
+	int p;
+	int h1;
+	int h2;
+	int obuf_out;
+	unsigned char header[4];
+	int header_pos;
+	int emitted;
 } CrushContext;
 
 int crush_init (CrushContext* ctx, CrushReadFunc reader, CrushWriteFunc writer, void* user_data, CrushDestroyNotify destroy_data);
@@ -34,6 +66,21 @@ void crush_destroy (CrushContext* ctx);
 int crush_compress (CrushContext* ctx, int level);
 int crush_decompress (CrushContext* ctx);
 
+/* Resumable versions of crush_compress and crush_decompress.  They
+ * consume input from *next_in and write output to *next_out, advancing
+ * both, and keep whatever they need between calls in the context (the
+ * reader and writer are not used).  Compressing with CRUSH_FLUSH ends
+ * the current block, CRUSH_FINISH does the same and indicates there
+ * is no more input.  A context may only be used for one direction. */
+int crush_compress_stream (CrushContext* ctx, int level,
+                           const unsigned char** next_in, size_t* avail_in,
+                           unsigned char** next_out, size_t* avail_out,
+                           CrushAction action);
+int crush_decompress_stream (CrushContext* ctx,
+                             const unsigned char** next_in, size_t* avail_in,
+                             unsigned char** next_out, size_t* avail_out,
+                             CrushAction action);
+
 #ifdef __cplusplus
 }
 #endif
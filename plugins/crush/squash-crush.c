@@ -32,13 +32,11 @@
 
 #include "crush.h"
 
-struct SquashCrushData {
-  void* user_data;
-  SquashReadFunc reader;
-  SquashWriteFunc writer;
-  SquashStatus last_res;
-  SquashContext* context;
-};
+typedef struct SquashCrushStream_s {
+  SquashStream base_object;
+
+  CrushContext ctx;
+} SquashCrushStream;
 
 enum SquashCrushOptIndex {
   SQUASH_CRUSH_OPT_LEVEL = 0
@@ -67,72 +65,81 @@ squash_crush_free (void* ptr, void* user_data) {
   squash_free (ptr);
 }
 
-static size_t
-squash_crush_reader (void* buffer, size_t size, void* user_data) {
-  struct SquashCrushData* data = (struct SquashCrushData*) user_data;
+static void
+squash_crush_stream_destroy (void* stream) {
+  SquashCrushStream* s = (SquashCrushStream*) stream;
 
-  /* CRUSH doesn't check the return value from write calls, so it
-     doesn't detect that there is a problem.  We need to be able to
-     report the error instead, though, so just act like we have read
-     all the input we want and don't clobber the last status code. */
+  if (s->ctx.buf != NULL)
+    crush_destroy (&(s->ctx));
 
-  if (data->last_res > 0) {
-    data->last_res = data->reader (&size, buffer, data->user_data);
-    return size;
-  } else {
-    return 0;
-  }
+  squash_stream_destroy (stream);
 }
 
-static size_t
-squash_crush_writer (const void* buffer, size_t size, void* user_data) {
-  struct SquashCrushData* data = (struct SquashCrushData*) user_data;
+static SquashStream*
+squash_crush_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashCrushStream* stream;
 
-  if (data->last_res > 0) {
-    data->last_res = data->writer (&size, buffer, data->user_data);
-    return size;
-  } else {
-    return 0;
+  assert (codec != NULL);
+  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
+
+  stream = squash_malloc (sizeof (SquashCrushStream));
+  if (HEDLEY_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  stream->ctx.buf = NULL;
+  squash_stream_init ((SquashStream*) stream, codec, stream_type, options, squash_crush_stream_destroy);
+
+  if (HEDLEY_UNLIKELY(crush_init_full (&(stream->ctx), NULL, NULL, squash_crush_malloc, squash_crush_free, NULL, NULL) != 0)) {
+    squash_object_unref (stream);
+    return (squash_error (SQUASH_MEMORY), NULL);
   }
+
+  return (SquashStream*) stream;
 }
 
 static SquashStatus
-squash_crush_splice (SquashCodec* codec,
-                     SquashOptions* options,
-                     SquashStreamType stream_type,
-                     SquashReadFunc read_cb,
-                     SquashWriteFunc write_cb,
-                     void* user_data) {
-  assert (codec != NULL);
-
-  struct SquashCrushData data = {
-    user_data,
-    read_cb,
-    write_cb,
-    SQUASH_OK,
-    squash_codec_get_context (codec)
-  };
-  CrushContext ctx;
+squash_crush_process_stream (SquashStream* stream, SquashOperation operation) {
+  CrushContext* ctx = &(((SquashCrushStream*) stream)->ctx);
+  CrushAction action = CRUSH_RUN;
   int res;
 
-  res = crush_init_full (&ctx, squash_crush_reader, squash_crush_writer, squash_crush_malloc, squash_crush_free, &data, NULL);
-  if (res != 0)
-    return squash_error (SQUASH_FAILED);
+  switch (operation) {
+    case SQUASH_OPERATION_PROCESS:
+      action = CRUSH_RUN;
+      break;
+    case SQUASH_OPERATION_FLUSH:
+      action = CRUSH_FLUSH;
+      break;
+    case SQUASH_OPERATION_FINISH:
+      action = CRUSH_FINISH;
+      break;
+    case SQUASH_OPERATION_TERMINATE:
+      HEDLEY_UNREACHABLE ();
+      break;
+  }
 
-  if (stream_type == SQUASH_STREAM_COMPRESS) {
-    res = crush_compress (&ctx, squash_options_get_int_at (options, codec, SQUASH_CRUSH_OPT_LEVEL));
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
+    res = crush_compress_stream (ctx, squash_options_get_int_at (stream->options, stream->codec, SQUASH_CRUSH_OPT_LEVEL),
+                                 (const unsigned char**) &(stream->next_in), &(stream->avail_in),
+                                 (unsigned char**) &(stream->next_out), &(stream->avail_out),
+                                 action);
   } else {
-    res = crush_decompress (&ctx);
+    res = crush_decompress_stream (ctx,
+                                   (const unsigned char**) &(stream->next_in), &(stream->avail_in),
+                                   (unsigned char**) &(stream->next_out), &(stream->avail_out),
+                                   action);
   }
 
-  crush_destroy (&ctx);
-
-  if (data.last_res < 0)
-    return data.last_res;
-  else if (HEDLEY_UNLIKELY(res != 0))
-    return squash_error (SQUASH_FAILED);
-  else
-    return SQUASH_OK;
+  switch (res) {
+    case CRUSH_OK:
+      return SQUASH_OK;
+    case CRUSH_BUF_FULL:
+      return SQUASH_PROCESSING;
+    case CRUSH_MEM_ERROR:
+      return squash_error (SQUASH_MEMORY);
+    default:
+      return squash_error (SQUASH_FAILED);
+  }
 }
 
 static size_t
@@ -146,8 +153,10 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   const char* name = squash_codec_get_name (codec);
 
   if (HEDLEY_LIKELY(strcmp ("crush", name) == 0)) {
+    impl->info = SQUASH_CODEC_INFO_CAN_FLUSH;
     impl->options = squash_crush_options;
-    impl->splice = squash_crush_splice;
+    impl->create_stream = squash_crush_create_stream;
+    impl->process_stream = squash_crush_process_stream;
     impl->get_max_compressed_size = squash_crush_get_max_compressed_size;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
@@ -177,6 +177,301 @@ squash_csc_splice (SquashCodec* codec,
   return res;
 }
 
+/* Input is handed to the encoder this much at a time.  CSCEnc_Encode
+   keeps reading until its input stream is empty and keeps its state
+   between calls, so this only limits how much is buffered. */
+#define SQUASH_CSC_BLOCK_SIZE ((size_t) (1024 * 1024))
+
+typedef struct SquashCscStream_s SquashCscStream;
+
+struct SquashCscBlockOutStream {
+  ISeqOutStream os;
+  SquashCscStream* stream;
+};
+
+struct SquashCscBlockInStream {
+  ISeqInStream stream;
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+};
+
+struct SquashCscStream_s {
+  SquashStream base_object;
+
+  CSCEncHandle enc;
+  struct SquashCscBlockOutStream out_stream;
+  bool out_failed;
+
+  /* When compressing, the input for the current block.  The decoder
+     can't stop part way through, so when decompressing this is all of
+     the input until the stream is finished. */
+  uint8_t* input;
+  size_t input_size;
+  size_t input_allocated;
+
+  /* Output which didn't fit in next_out yet. */
+  uint8_t* output;
+  size_t output_size;
+  size_t output_pos;
+  size_t output_allocated;
+
+  bool decoded;
+};
+
+static bool
+squash_csc_append (uint8_t** buf, size_t* size, size_t* allocated, const uint8_t* data, size_t data_size) {
+  if (data_size == 0)
+    return true;
+
+  if (*allocated - *size < data_size) {
+    size_t new_size = (*allocated != 0) ? *allocated : 4096;
+    while (new_size - *size < data_size)
+      new_size *= 2;
+
+    uint8_t* new_buf = (uint8_t*) squash_realloc (*buf, new_size);
+    if (HEDLEY_UNLIKELY(new_buf == NULL))
+      return false;
+
+    *buf = new_buf;
+    *allocated = new_size;
+  }
+
+  memcpy (*buf + *size, data, data_size);
+  *size += data_size;
+
+  return true;
+}
+
+/* Copy pending output to next_out; returns true once none is left. */
+static bool
+squash_csc_stream_drain (SquashCscStream* s) {
+  SquashStream* stream = &(s->base_object);
+  const size_t n = (s->output_size - s->output_pos < stream->avail_out) ? s->output_size - s->output_pos : stream->avail_out;
+
+  if (n != 0) {
+    memcpy (stream->next_out, s->output + s->output_pos, n);
+    stream->next_out += n;
+    stream->avail_out -= n;
+    s->output_pos += n;
+  }
+
+  if (s->output_pos != s->output_size)
+    return false;
+
+  s->output_size = s->output_pos = 0;
+  return true;
+}
+
+static SRes
+squash_csc_block_reader (void* istream, void* buf, size_t* size) {
+  struct SquashCscBlockInStream* s = (struct SquashCscBlockInStream*) istream;
+
+  if (*size > s->size - s->pos)
+    *size = s->size - s->pos;
+
+  if (*size != 0)
+    memcpy (buf, s->data + s->pos, *size);
+  s->pos += *size;
+
+  return 0;
+}
+
+/* Writes straight to next_out, keeping whatever doesn't fit for
+   later. */
+static size_t
+squash_csc_block_writer (void* ostream, const void* buf, size_t size) {
+  SquashCscStream* s = ((struct SquashCscBlockOutStream*) ostream)->stream;
+  SquashStream* stream = &(s->base_object);
+  size_t direct = 0;
+
+  if (s->output_size == 0) {
+    direct = (size < stream->avail_out) ? size : stream->avail_out;
+    if (direct != 0) {
+      memcpy (stream->next_out, buf, direct);
+      stream->next_out += direct;
+      stream->avail_out -= direct;
+    }
+  }
+
+  if (direct != size &&
+      !squash_csc_append (&(s->output), &(s->output_size), &(s->output_allocated), (const uint8_t*) buf + direct, size - direct)) {
+    s->out_failed = true;
+    return 0;
+  }
+
+  return size;
+}
+
+static SquashStatus
+squash_csc_stream_encode (SquashCscStream* s) {
+  struct SquashCscBlockInStream in_stream = {
+    { squash_csc_block_reader },
+    s->input,
+    s->input_size,
+    0
+  };
+
+  const int csc_res = CSCEnc_Encode (s->enc, (ISeqInStream*) &in_stream, NULL);
+  s->input_size = 0;
+
+  if (HEDLEY_UNLIKELY(s->out_failed))
+    return squash_error (SQUASH_MEMORY);
+  else if (HEDLEY_UNLIKELY(csc_res != 0))
+    return squash_error (SQUASH_FAILED);
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_csc_stream_decode (SquashCscStream* s) {
+  if (HEDLEY_UNLIKELY(s->input_size < CSC_PROP_SIZE))
+    return squash_error (SQUASH_FAILED);
+
+  CSCProps props;
+  CSCDec_ReadProperties (&props, s->input);
+
+  struct SquashCscBlockInStream in_stream = {
+    { squash_csc_block_reader },
+    s->input + CSC_PROP_SIZE,
+    s->input_size - CSC_PROP_SIZE,
+    0
+  };
+
+  CSCDecHandle decomp = CSCDec_Create (&props, (ISeqInStream*) &in_stream, (ISzAlloc*) &squash_csc_allocator);
+  if (HEDLEY_UNLIKELY(decomp == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  const int csc_res = CSCDec_Decode (decomp, (ISeqOutStream*) &(s->out_stream), NULL);
+  CSCDec_Destroy (decomp);
+
+  if (HEDLEY_UNLIKELY(s->out_failed))
+    return squash_error (SQUASH_MEMORY);
+  else if (HEDLEY_UNLIKELY(csc_res != 0))
+    return squash_error (SQUASH_FAILED);
+
+  return SQUASH_OK;
+}
+
+static void
+squash_csc_stream_destroy (void* stream) {
+  SquashCscStream* s = (SquashCscStream*) stream;
+
+  if (s->enc != NULL)
+    CSCEnc_Destroy (s->enc);
+  if (s->input != NULL)
+    squash_free (s->input);
+  if (s->output != NULL)
+    squash_free (s->output);
+
+  squash_stream_destroy (stream);
+}
+
+static SquashStream*
+squash_csc_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashCscStream* stream;
+
+  assert (codec != NULL);
+  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
+
+  stream = (SquashCscStream*) squash_malloc (sizeof (SquashCscStream));
+  if (HEDLEY_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), (SquashStream*) NULL);
+
+  stream->enc = NULL;
+  stream->out_stream.os.Write = squash_csc_block_writer;
+  stream->out_stream.stream = stream;
+  stream->out_failed = false;
+  stream->input = NULL;
+  stream->input_size = stream->input_allocated = 0;
+  stream->output = NULL;
+  stream->output_size = stream->output_pos = stream->output_allocated = 0;
+  stream->decoded = false;
+  squash_stream_init ((SquashStream*) stream, codec, stream_type, options, squash_csc_stream_destroy);
+
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    CSCProps props;
+    unsigned char props_buf[CSC_PROP_SIZE];
+
+    CSCEncProps_Init (&props,
+                      squash_options_get_size_at (options, codec, SQUASH_CSC_OPT_DICT_SIZE),
+                      squash_options_get_int_at (options, codec, SQUASH_CSC_OPT_LEVEL));
+    props.DLTFilter = squash_options_get_bool_at (options, codec, SQUASH_CSC_OPT_DELTA_FILTER);
+    props.EXEFilter = squash_options_get_bool_at (options, codec, SQUASH_CSC_OPT_EXE_FILTER);
+    props.TXTFilter = squash_options_get_bool_at (options, codec, SQUASH_CSC_OPT_TXT_FILTER);
+
+    CSCEnc_WriteProperties (&props, props_buf, 0);
+    stream->enc = CSCEnc_Create (&props, (ISeqOutStream*) &(stream->out_stream), (ISzAlloc*) &squash_csc_allocator);
+    if (HEDLEY_UNLIKELY(stream->enc == NULL ||
+                        !squash_csc_append (&(stream->output), &(stream->output_size), &(stream->output_allocated), props_buf, CSC_PROP_SIZE))) {
+      squash_object_unref (stream);
+      return (squash_error (SQUASH_MEMORY), (SquashStream*) NULL);
+    }
+  }
+
+  return (SquashStream*) stream;
+}
+
+static SquashStatus
+squash_csc_process_stream (SquashStream* stream, SquashOperation operation) {
+  SquashCscStream* s = (SquashCscStream*) stream;
+  SquashStatus res;
+
+  if (!squash_csc_stream_drain (s))
+    return SQUASH_PROCESSING;
+
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
+    while (stream->avail_in != 0) {
+      const size_t n = (stream->avail_in < SQUASH_CSC_BLOCK_SIZE - s->input_size) ? stream->avail_in : SQUASH_CSC_BLOCK_SIZE - s->input_size;
+      if (HEDLEY_UNLIKELY(!squash_csc_append (&(s->input), &(s->input_size), &(s->input_allocated), stream->next_in, n)))
+        return squash_error (SQUASH_MEMORY);
+      stream->next_in += n;
+      stream->avail_in -= n;
+
+      if (s->input_size == SQUASH_CSC_BLOCK_SIZE) {
+        res = squash_csc_stream_encode (s);
+        if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+          return res;
+        if (!squash_csc_stream_drain (s))
+          return SQUASH_PROCESSING;
+      }
+    }
+
+    if (operation == SQUASH_OPERATION_FINISH && s->enc != NULL) {
+      if (s->input_size != 0) {
+        res = squash_csc_stream_encode (s);
+        if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+          return res;
+      }
+
+      const int csc_res = CSCEnc_Encode_Flush (s->enc);
+      CSCEnc_Destroy (s->enc);
+      s->enc = NULL;
+      if (HEDLEY_UNLIKELY(s->out_failed))
+        return squash_error (SQUASH_MEMORY);
+      else if (HEDLEY_UNLIKELY(csc_res != 0))
+        return squash_error (SQUASH_FAILED);
+    }
+  } else {
+    if (HEDLEY_UNLIKELY(!squash_csc_append (&(s->input), &(s->input_size), &(s->input_allocated), stream->next_in, stream->avail_in)))
+      return squash_error (SQUASH_MEMORY);
+    stream->next_in += stream->avail_in;
+    stream->avail_in = 0;
+
+    if (operation == SQUASH_OPERATION_FINISH && !s->decoded) {
+      s->decoded = true;
+      res = squash_csc_stream_decode (s);
+      squash_free (s->input);
+      s->input = NULL;
+      s->input_size = s->input_allocated = 0;
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        return res;
+    }
+  }
+
+  return squash_csc_stream_drain (s) ? SQUASH_OK : SQUASH_PROCESSING;
+}
+
 static size_t
 squash_csc_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
   // TODO: this could probably be improved
@@ -206,6 +501,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
 
   if (HEDLEY_LIKELY(strcmp ("csc", name) == 0)) {
     impl->options = squash_csc_options;
+    impl->create_stream = squash_csc_create_stream;
+    impl->process_stream = squash_csc_process_stream;
     impl->splice = squash_csc_splice;
     impl->get_max_compressed_size = squash_csc_get_max_compressed_size;
   } else {
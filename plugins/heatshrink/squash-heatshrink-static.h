@@ -0,0 +1,92 @@
+/* Copyright (c) 2015-2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+/* Builds heatshrink's encoder for a single window and lookahead size.
+ * With the sizes known at compile time the state is a plain struct
+ * and the match search runs with constant bounds.  Define
+ * SQUASH_HEATSHRINK_WINDOW_BITS and SQUASH_HEATSHRINK_LOOKAHEAD_BITS,
+ * then include this file; the result is
+ * squash_heatshrink_<window>_<lookahead>_encoder.
+ *
+ * heatshrink_config.h sets these unconditionally, so its include guard
+ * is defined here to keep it out. */
+
+#if !defined(SQUASH_HEATSHRINK_WINDOW_BITS) || !defined(SQUASH_HEATSHRINK_LOOKAHEAD_BITS)
+#  error SQUASH_HEATSHRINK_WINDOW_BITS and SQUASH_HEATSHRINK_LOOKAHEAD_BITS must be defined
+#endif
+
+#define HEATSHRINK_CONFIG_H
+#define HEATSHRINK_DYNAMIC_ALLOC 0
+#define HEATSHRINK_STATIC_INPUT_BUFFER_SIZE 256
+#define HEATSHRINK_STATIC_WINDOW_BITS SQUASH_HEATSHRINK_WINDOW_BITS
+#define HEATSHRINK_STATIC_LOOKAHEAD_BITS SQUASH_HEATSHRINK_LOOKAHEAD_BITS
+#define HEATSHRINK_DEBUGGING_LOGS 0
+#define HEATSHRINK_USE_INDEX 1
+
+#define SQUASH_HEATSHRINK_SYMBOL_EX(w, l, name) squash_heatshrink_##w##_##l##_##name
+#define SQUASH_HEATSHRINK_SYMBOL_(w, l, name) SQUASH_HEATSHRINK_SYMBOL_EX(w, l, name)
+#define SQUASH_HEATSHRINK_SYMBOL(name) \
+  SQUASH_HEATSHRINK_SYMBOL_(SQUASH_HEATSHRINK_WINDOW_BITS, SQUASH_HEATSHRINK_LOOKAHEAD_BITS, name)
+
+/* Every build exports the same functions, so give them unique names. */
+#define heatshrink_encoder_reset  SQUASH_HEATSHRINK_SYMBOL(encoder_reset)
+#define heatshrink_encoder_sink   SQUASH_HEATSHRINK_SYMBOL(encoder_sink)
+#define heatshrink_encoder_poll   SQUASH_HEATSHRINK_SYMBOL(encoder_poll)
+#define heatshrink_encoder_finish SQUASH_HEATSHRINK_SYMBOL(encoder_finish)
+
+#include "heatshrink/heatshrink_encoder.c"
+
+#include "squash-heatshrink.h"
+
+static void
+squash_heatshrink_static_reset (void* hse) {
+  heatshrink_encoder_reset ((heatshrink_encoder*) hse);
+}
+
+static HSE_sink_res
+squash_heatshrink_static_sink (void* hse, uint8_t* in_buf, size_t size, size_t* input_size) {
+  return heatshrink_encoder_sink ((heatshrink_encoder*) hse, in_buf, size, input_size);
+}
+
+static HSE_poll_res
+squash_heatshrink_static_poll (void* hse, uint8_t* out_buf, size_t out_buf_size, size_t* output_size) {
+  return heatshrink_encoder_poll ((heatshrink_encoder*) hse, out_buf, out_buf_size, output_size);
+}
+
+static HSE_finish_res
+squash_heatshrink_static_finish (void* hse) {
+  return heatshrink_encoder_finish ((heatshrink_encoder*) hse);
+}
+
+const SquashHeatshrinkEncoder SQUASH_HEATSHRINK_SYMBOL(encoder) = {
+  SQUASH_HEATSHRINK_WINDOW_BITS,
+  SQUASH_HEATSHRINK_LOOKAHEAD_BITS,
+  sizeof (heatshrink_encoder),
+  squash_heatshrink_static_reset,
+  squash_heatshrink_static_sink,
+  squash_heatshrink_static_poll,
+  squash_heatshrink_static_finish
+};
@@ -33,18 +33,24 @@
 #include "heatshrink/heatshrink_encoder.h"
 #include "heatshrink/heatshrink_decoder.h"
 
+#include "squash-heatshrink.h"
+
 typedef struct SquashHeatshrinkStream_s {
   SquashStream base_object;
 
   union {
-    heatshrink_encoder* comp;
+    struct {
+      const SquashHeatshrinkEncoder* impl;
+      void* hse;
+    } comp;
     heatshrink_decoder* decomp;
   } ctx;
 } SquashHeatshrinkStream;
 
 enum SquashHeatshrinkOptIndex {
   SQUASH_HEATSHRINK_OPT_WINDOW_SIZE = 0,
-  SQUASH_HEATSHRINK_OPT_LOOKAHEAD_SIZE
+  SQUASH_HEATSHRINK_OPT_LOOKAHEAD_SIZE,
+  SQUASH_HEATSHRINK_OPT_INPUT_BUFFER_SIZE
 };
 
 static SquashOptionInfo squash_heatshrink_options[] = {
@@ -60,6 +66,12 @@ static SquashOptionInfo squash_heatshrink_options[] = {
       .min = 3,
       .max = 14 },
     .default_value.int_value = 4 },
+  { "input-buffer-size",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 16,
+      .max = 32768 },
+    .default_value.int_value = 256 },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -74,6 +86,54 @@ static void                    squash_heatshrink_stream_init     (SquashHeatshri
 static SquashHeatshrinkStream* squash_heatshrink_stream_new      (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options);
 static void                    squash_heatshrink_stream_destroy  (void* stream);
 
+static void
+squash_heatshrink_dynamic_reset (void* hse) {
+  heatshrink_encoder_reset ((heatshrink_encoder*) hse);
+}
+
+static HSE_sink_res
+squash_heatshrink_dynamic_sink (void* hse, uint8_t* in_buf, size_t size, size_t* input_size) {
+  return heatshrink_encoder_sink ((heatshrink_encoder*) hse, in_buf, size, input_size);
+}
+
+static HSE_poll_res
+squash_heatshrink_dynamic_poll (void* hse, uint8_t* out_buf, size_t out_buf_size, size_t* output_size) {
+  return heatshrink_encoder_poll ((heatshrink_encoder*) hse, out_buf, out_buf_size, output_size);
+}
+
+static HSE_finish_res
+squash_heatshrink_dynamic_finish (void* hse) {
+  return heatshrink_encoder_finish ((heatshrink_encoder*) hse);
+}
+
+static const SquashHeatshrinkEncoder squash_heatshrink_dynamic_encoder = {
+  0, 0, 0,
+  squash_heatshrink_dynamic_reset,
+  squash_heatshrink_dynamic_sink,
+  squash_heatshrink_dynamic_poll,
+  squash_heatshrink_dynamic_finish
+};
+
+/* Encoders built for a fixed window and lookahead size; anything else
+   uses the dynamically allocated one. */
+static const SquashHeatshrinkEncoder* const squash_heatshrink_static_encoders[] = {
+  &squash_heatshrink_8_4_encoder,
+  &squash_heatshrink_10_4_encoder,
+  &squash_heatshrink_11_4_encoder,
+  &squash_heatshrink_12_4_encoder
+};
+
+static const SquashHeatshrinkEncoder*
+squash_heatshrink_find_static_encoder (uint8_t window_size, uint8_t lookahead_size) {
+  for (size_t i = 0 ; i < sizeof (squash_heatshrink_static_encoders) / sizeof (squash_heatshrink_static_encoders[0]) ; i++) {
+    const SquashHeatshrinkEncoder* impl = squash_heatshrink_static_encoders[i];
+    if (impl->window_size == window_size && impl->lookahead_size == lookahead_size)
+      return impl;
+  }
+
+  return NULL;
+}
+
 static SquashHeatshrinkStream*
 squash_heatshrink_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
   SquashHeatshrinkStream* stream;
@@ -91,13 +151,26 @@ squash_heatshrink_stream_new (SquashCodec* codec, SquashStreamType stream_type,
   const uint8_t lookahead_size = (uint8_t) squash_options_get_int_at (options, codec, SQUASH_HEATSHRINK_OPT_LOOKAHEAD_SIZE);
 
   if (stream_type == SQUASH_STREAM_COMPRESS) {
-    stream->ctx.comp = heatshrink_encoder_alloc (window_size, lookahead_size);
-    if (HEDLEY_UNLIKELY(stream->ctx.comp == NULL)) {
+    const SquashHeatshrinkEncoder* impl = squash_heatshrink_find_static_encoder (window_size, lookahead_size);
+
+    if (impl != NULL) {
+      stream->ctx.comp.hse = squash_malloc (impl->size);
+      if (HEDLEY_LIKELY(stream->ctx.comp.hse != NULL))
+        impl->reset (stream->ctx.comp.hse);
+    } else {
+      impl = &squash_heatshrink_dynamic_encoder;
+      stream->ctx.comp.hse = heatshrink_encoder_alloc (window_size, lookahead_size);
+    }
+    stream->ctx.comp.impl = impl;
+
+    if (HEDLEY_UNLIKELY(stream->ctx.comp.hse == NULL)) {
       squash_object_unref (stream);
       return (squash_error (SQUASH_MEMORY), NULL);
     }
   } else {
-    stream->ctx.decomp = heatshrink_decoder_alloc (256, window_size, lookahead_size);
+    const uint16_t input_buffer_size = (uint16_t) squash_options_get_int_at (options, codec, SQUASH_HEATSHRINK_OPT_INPUT_BUFFER_SIZE);
+
+    stream->ctx.decomp = heatshrink_decoder_alloc (input_buffer_size, window_size, lookahead_size);
     if (HEDLEY_UNLIKELY(stream->ctx.decomp == NULL)) {
       squash_object_unref (stream);
       return (squash_error (SQUASH_MEMORY), NULL);
@@ -114,16 +187,29 @@ squash_heatshrink_stream_init (SquashHeatshrinkStream* stream,
                                SquashOptions* options,
                                SquashDestroyNotify destroy_notify) {
   squash_stream_init ((SquashStream*) stream, codec, stream_type, (SquashOptions*) options, destroy_notify);
+
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    stream->ctx.comp.impl = NULL;
+    stream->ctx.comp.hse = NULL;
+  } else {
+    stream->ctx.decomp = NULL;
+  }
 }
 
 static void
 squash_heatshrink_stream_destroy (void* stream) {
   const SquashHeatshrinkStream* s = (SquashHeatshrinkStream*) stream;
 
-  if (s->base_object.stream_type == SQUASH_STREAM_COMPRESS)
-    heatshrink_encoder_free (s->ctx.comp);
-  else
+  if (s->base_object.stream_type == SQUASH_STREAM_COMPRESS) {
+    if (s->ctx.comp.hse != NULL) {
+      if (s->ctx.comp.impl->size != 0)
+        squash_free (s->ctx.comp.hse);
+      else
+        heatshrink_encoder_free (s->ctx.comp.hse);
+    }
+  } else if (s->ctx.decomp != NULL) {
     heatshrink_decoder_free (s->ctx.decomp);
+  }
 
   squash_stream_destroy (stream);
 }
@@ -138,13 +224,15 @@ squash_heatshrink_process_stream (SquashStream* stream, SquashOperation operatio
   SquashHeatshrinkStream* s = (SquashHeatshrinkStream*) stream;
 
   if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
+    const SquashHeatshrinkEncoder* impl = s->ctx.comp.impl;
+    void* hse = s->ctx.comp.hse;
     HSE_poll_res hsp;
     HSE_sink_res hss;
     size_t processed;
 
     assert (stream->avail_out != 0);
 
-    hsp = heatshrink_encoder_poll (s->ctx.comp, stream->next_out, stream->avail_out, &processed);
+    hsp = impl->poll (hse, stream->next_out, stream->avail_out, &processed);
     if (HEDLEY_UNLIKELY(0 > hsp))
       return squash_error (SQUASH_FAILED);
 
@@ -156,7 +244,7 @@ squash_heatshrink_process_stream (SquashStream* stream, SquashOperation operatio
     if (HSER_POLL_MORE == hsp || 0 == stream->avail_out) {
       return SQUASH_PROCESSING;
     } else if (SQUASH_OPERATION_FINISH == operation) {
-      HSE_finish_res hsf = heatshrink_encoder_finish (s->ctx.comp);
+      HSE_finish_res hsf = impl->finish (hse);
       if (HEDLEY_UNLIKELY(hsf < 0))
         return squash_error (SQUASH_FAILED);
 
@@ -165,14 +253,14 @@ squash_heatshrink_process_stream (SquashStream* stream, SquashOperation operatio
 
     {
       if (stream->avail_in != 0) {
-        hss = heatshrink_encoder_sink (s->ctx.comp, (uint8_t*) stream->next_in, stream->avail_in, &processed);
+        hss = impl->sink (hse, (uint8_t*) stream->next_in, stream->avail_in, &processed);
         if (HEDLEY_UNLIKELY(0 > hss))
           return squash_error (SQUASH_FAILED);
         stream->next_in += processed;
         stream->avail_in -= processed;
       }
 
-      hsp = heatshrink_encoder_poll (s->ctx.comp, stream->next_out, stream->avail_out, &processed);
+      hsp = impl->poll (hse, stream->next_out, stream->avail_out, &processed);
       if (HEDLEY_UNLIKELY(0 > hsp))
         return squash_error (SQUASH_FAILED);
 
@@ -183,7 +271,7 @@ squash_heatshrink_process_stream (SquashStream* stream, SquashOperation operatio
         assert(SQUASH_OPERATION_FINISH != operation);
       /* } else if (SQUASH_OPERATION_FINISH == operation) { */
       /*   abort(); */
-      /*   HSE_finish_res hsf = heatshrink_encoder_finish (s->ctx.comp); */
+      /*   HSE_finish_res hsf = impl->finish (hse); */
       /*   if (HEDLEY_UNLIKELY(hsf < 0)) */
       /*     return squash_error (SQUASH_FAILED); */
 
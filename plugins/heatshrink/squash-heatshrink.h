@@ -0,0 +1,58 @@
+/* Copyright (c) 2015-2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#if !defined(SQUASH_HEATSHRINK_H)
+#define SQUASH_HEATSHRINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "heatshrink/heatshrink_encoder.h"
+
+/* heatshrink's encoder state is a different type depending on whether
+ * it was built for dynamic allocation or for a fixed window and
+ * lookahead size, so the plugin goes through a table of functions
+ * which take an opaque pointer.  size is the size of the state for
+ * static builds, or 0 if it has to be created with
+ * heatshrink_encoder_alloc. */
+typedef struct SquashHeatshrinkEncoder_s {
+  uint8_t window_size;
+  uint8_t lookahead_size;
+  size_t size;
+
+  void           (* reset)  (void* hse);
+  HSE_sink_res   (* sink)   (void* hse, uint8_t* in_buf, size_t size, size_t* input_size);
+  HSE_poll_res   (* poll)   (void* hse, uint8_t* out_buf, size_t out_buf_size, size_t* output_size);
+  HSE_finish_res (* finish) (void* hse);
+} SquashHeatshrinkEncoder;
+
+/* Static builds, see squash-heatshrink-static.h */
+extern const SquashHeatshrinkEncoder squash_heatshrink_8_4_encoder;
+extern const SquashHeatshrinkEncoder squash_heatshrink_10_4_encoder;
+extern const SquashHeatshrinkEncoder squash_heatshrink_11_4_encoder;
+extern const SquashHeatshrinkEncoder squash_heatshrink_12_4_encoder;
+
+#endif /* !defined(SQUASH_HEATSHRINK_H) */
@@ -0,0 +1,511 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <squash/squash.h>
+#include <lz4.h>
+#include <lz4hc.h>
+
+#include "squash-lz4.h"
+
+/* lz4-linked is a sequence of LZ4 blocks, each preceded by its
+ * compressed size as a 32-bit little-endian integer.  Each block
+ * decodes to at most SQUASH_LZ4_LINKED_BLOCK_SIZE bytes and may
+ * reference up to 64 KiB of the data before it, so a stream of small
+ * messages (one flush per message) compresses almost as well as one
+ * large buffer. */
+
+#define SQUASH_LZ4_LINKED_BLOCK_SIZE  ((size_t) (64 * 1024))
+#define SQUASH_LZ4_LINKED_DICT_SIZE   ((size_t) (64 * 1024))
+#define SQUASH_LZ4_LINKED_HEADER_SIZE ((size_t) 4)
+#define SQUASH_LZ4_LINKED_MAX_BLOCK   (SQUASH_LZ4_LINKED_HEADER_SIZE + (size_t) LZ4_COMPRESSBOUND(SQUASH_LZ4_LINKED_BLOCK_SIZE))
+
+/* The compressor appends blocks to a ring buffer, wrapping when there
+ * isn't room for another full block.  When a new block overwrites the
+ * oldest history LZ4 notices and stops referencing it.  The decoder's
+ * ring needs to hold a full dictionary plus a block, plus 14 bytes (see
+ * LZ4_decoderRingBufferSize), and it doesn't have to match the
+ * encoder's. */
+#define SQUASH_LZ4_LINKED_RING_SIZE        (SQUASH_LZ4_LINKED_DICT_SIZE + SQUASH_LZ4_LINKED_BLOCK_SIZE)
+#define SQUASH_LZ4_LINKED_DECODE_RING_SIZE (SQUASH_LZ4_LINKED_DICT_SIZE + 14 + SQUASH_LZ4_LINKED_BLOCK_SIZE)
+
+#if LZ4_VERSION_NUMBER >= 10700
+
+enum SquashLZ4LinkedOptIndex {
+  SQUASH_LZ4_LINKED_OPT_LEVEL = 0
+};
+
+static SquashOptionInfo squash_lz4_linked_options[] = {
+  { "level",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 1,
+      .max = 14 },
+    .default_value.int_value = 7 },
+  { NULL, SQUASH_OPTION_TYPE_NONE, }
+};
+
+typedef struct SquashLZ4LinkedStream_s {
+  SquashStream base_object;
+
+  LZ4_stream_t* fast;
+  LZ4_streamHC_t* hc;
+  int acceleration;
+  LZ4_streamDecode_t decode;
+
+  /* Uncompressed data; when compressing, fill bytes at ring_pos are
+     waiting to be compressed.  When decompressing, pending_length
+     bytes at pending_pos are waiting to be copied to next_out. */
+  uint8_t* ring;
+  size_t ring_pos;
+  size_t fill;
+  size_t pending_pos;
+  size_t pending_length;
+
+  /* Compressed data; a block waiting to be written (when compressing)
+     or a partial block we've been given so far (when
+     decompressing). */
+  uint8_t block[SQUASH_LZ4_LINKED_MAX_BLOCK];
+  size_t block_pos;
+  size_t block_length;
+} SquashLZ4LinkedStream;
+
+static void
+squash_lz4_linked_write_header (uint8_t dest[4], uint32_t value) {
+  dest[0] = (uint8_t) (value      );
+  dest[1] = (uint8_t) (value >>  8);
+  dest[2] = (uint8_t) (value >> 16);
+  dest[3] = (uint8_t) (value >> 24);
+}
+
+static uint32_t
+squash_lz4_linked_read_header (const uint8_t src[4]) {
+  return
+    ((uint32_t) src[0]      ) |
+    ((uint32_t) src[1] <<  8) |
+    ((uint32_t) src[2] << 16) |
+    ((uint32_t) src[3] << 24);
+}
+
+static bool
+squash_lz4_linked_block_size_is_valid (uint32_t compressed_size) {
+  return compressed_size != 0 && compressed_size <= (uint32_t) LZ4_COMPRESSBOUND(SQUASH_LZ4_LINKED_BLOCK_SIZE);
+}
+
+static size_t
+squash_lz4_linked_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
+  const size_t full_blocks = uncompressed_size / SQUASH_LZ4_LINKED_BLOCK_SIZE;
+  const size_t remainder = uncompressed_size % SQUASH_LZ4_LINKED_BLOCK_SIZE;
+
+  return
+    (full_blocks * SQUASH_LZ4_LINKED_MAX_BLOCK) +
+    ((remainder != 0) ? (SQUASH_LZ4_LINKED_HEADER_SIZE + (size_t) LZ4_COMPRESSBOUND(remainder)) : 0);
+}
+
+static int
+squash_lz4_linked_level_to_acceleration (int level) {
+  return (level == 7) ? 1 : squash_lz4_level_to_fast_mode (level);
+}
+
+static void
+squash_lz4_linked_stream_destroy (void* stream) {
+  SquashLZ4LinkedStream* s = (SquashLZ4LinkedStream*) stream;
+
+  if (s->fast != NULL)
+    LZ4_freeStream (s->fast);
+  if (s->hc != NULL)
+    LZ4_freeStreamHC (s->hc);
+  squash_free (s->ring);
+
+  squash_stream_destroy (stream);
+}
+
+/* Create the LZ4 (or LZ4HC) state for compressing a new sequence of
+   blocks. */
+static bool
+squash_lz4_linked_encoder_init (SquashCodec* codec, SquashOptions* options,
+                                LZ4_stream_t** fast, LZ4_streamHC_t** hc, int* acceleration) {
+  const int level = squash_options_get_int_at (options, codec, SQUASH_LZ4_LINKED_OPT_LEVEL);
+
+  *fast = NULL;
+  *hc = NULL;
+
+  if (level > 7) {
+    *hc = LZ4_createStreamHC ();
+    if (HEDLEY_UNLIKELY(*hc == NULL))
+      return false;
+#if LZ4_VERSION_NUMBER >= 10900
+    LZ4_resetStreamHC_fast (*hc, squash_lz4_level_to_hc_level (level));
+#else
+    LZ4_resetStreamHC (*hc, squash_lz4_level_to_hc_level (level));
+#endif
+  } else {
+    *fast = LZ4_createStream ();
+    if (HEDLEY_UNLIKELY(*fast == NULL))
+      return false;
+    *acceleration = squash_lz4_linked_level_to_acceleration (level);
+  }
+
+  return true;
+}
+
+static int
+squash_lz4_linked_compress_block (LZ4_stream_t* fast, LZ4_streamHC_t* hc, int acceleration,
+                                  const uint8_t* src, size_t src_size,
+                                  uint8_t* dest, size_t dest_size) {
+  assert (src_size <= SQUASH_LZ4_LINKED_BLOCK_SIZE);
+
+  const int dest_capacity = (dest_size > INT_MAX) ? INT_MAX : (int) dest_size;
+
+  if (hc != NULL)
+    return LZ4_compress_HC_continue (hc, (const char*) src, (char*) dest, (int) src_size, dest_capacity);
+  else
+    return LZ4_compress_fast_continue (fast, (const char*) src, (char*) dest, (int) src_size, dest_capacity, acceleration);
+}
+
+static SquashLZ4LinkedStream*
+squash_lz4_linked_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashLZ4LinkedStream* stream = squash_malloc (sizeof (SquashLZ4LinkedStream));
+  if (HEDLEY_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  squash_stream_init (stream, codec, stream_type, options, squash_lz4_linked_stream_destroy);
+
+  stream->fast = NULL;
+  stream->hc = NULL;
+  stream->acceleration = 1;
+  stream->ring_pos = 0;
+  stream->fill = 0;
+  stream->pending_pos = 0;
+  stream->pending_length = 0;
+  stream->block_pos = 0;
+  stream->block_length = 0;
+
+  bool success;
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    stream->ring = squash_malloc (SQUASH_LZ4_LINKED_RING_SIZE);
+    success = squash_lz4_linked_encoder_init (codec, options, &(stream->fast), &(stream->hc), &(stream->acceleration));
+  } else {
+    stream->ring = squash_malloc (SQUASH_LZ4_LINKED_DECODE_RING_SIZE);
+    success = LZ4_setStreamDecode (&(stream->decode), NULL, 0) != 0;
+  }
+
+  if (HEDLEY_UNLIKELY(!success || stream->ring == NULL)) {
+    squash_object_unref (stream);
+    return (squash_error (SQUASH_MEMORY), NULL);
+  }
+
+  return stream;
+}
+
+static SquashStream*
+squash_lz4_linked_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  return (SquashStream*) squash_lz4_linked_stream_new (codec, stream_type, options);
+}
+
+static SquashStatus
+squash_lz4_linked_compress_pending (SquashLZ4LinkedStream* s) {
+  assert (s->block_pos == s->block_length);
+  assert (s->fill != 0);
+
+  const int lz4_r = squash_lz4_linked_compress_block (s->fast, s->hc, s->acceleration,
+                                                      s->ring + s->ring_pos, s->fill,
+                                                      s->block + SQUASH_LZ4_LINKED_HEADER_SIZE,
+                                                      sizeof (s->block) - SQUASH_LZ4_LINKED_HEADER_SIZE);
+  if (HEDLEY_UNLIKELY(lz4_r <= 0))
+    return squash_error (SQUASH_FAILED);
+
+  squash_lz4_linked_write_header (s->block, (uint32_t) lz4_r);
+  s->block_pos = 0;
+  s->block_length = SQUASH_LZ4_LINKED_HEADER_SIZE + (size_t) lz4_r;
+
+  /* The block has to stay where it is so the next one can refer to
+     it. */
+  s->ring_pos += s->fill;
+  s->fill = 0;
+  if (s->ring_pos + SQUASH_LZ4_LINKED_BLOCK_SIZE > SQUASH_LZ4_LINKED_RING_SIZE)
+    s->ring_pos = 0;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_lz4_linked_decompress_block (SquashLZ4LinkedStream* s, const uint8_t* src, uint32_t src_size) {
+  assert (s->pending_length == 0);
+
+  const int lz4_r = LZ4_decompress_safe_continue (&(s->decode),
+                                                  (const char*) src,
+                                                  (char*) s->ring + s->ring_pos,
+                                                  (int) src_size,
+                                                  (int) SQUASH_LZ4_LINKED_BLOCK_SIZE);
+  if (HEDLEY_UNLIKELY(lz4_r < 0))
+    return squash_error (SQUASH_FAILED);
+
+  s->pending_pos = s->ring_pos;
+  s->pending_length = (size_t) lz4_r;
+
+  s->ring_pos += (size_t) lz4_r;
+  if (s->ring_pos + SQUASH_LZ4_LINKED_BLOCK_SIZE > SQUASH_LZ4_LINKED_DECODE_RING_SIZE)
+    s->ring_pos = 0;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_lz4_linked_process_stream_compress (SquashStream* stream, SquashOperation operation) {
+  SquashLZ4LinkedStream* s = (SquashLZ4LinkedStream*) stream;
+  SquashStatus res;
+
+  while (true) {
+    if (s->block_pos != s->block_length) {
+      const size_t cp_size = HEDLEY_UNLIKELY(stream->avail_out < (s->block_length - s->block_pos)) ?
+        stream->avail_out : (s->block_length - s->block_pos);
+      memcpy (stream->next_out, s->block + s->block_pos, cp_size);
+      stream->next_out += cp_size;
+      stream->avail_out -= cp_size;
+      s->block_pos += cp_size;
+
+      if (s->block_pos != s->block_length)
+        return SQUASH_PROCESSING;
+    }
+
+    if (stream->avail_in != 0) {
+      const size_t space = SQUASH_LZ4_LINKED_BLOCK_SIZE - s->fill;
+      const size_t cp_size = (stream->avail_in < space) ? stream->avail_in : space;
+      memcpy (s->ring + s->ring_pos + s->fill, stream->next_in, cp_size);
+      stream->next_in += cp_size;
+      stream->avail_in -= cp_size;
+      s->fill += cp_size;
+
+      if (s->fill != SQUASH_LZ4_LINKED_BLOCK_SIZE)
+        continue;
+    } else if (operation == SQUASH_OPERATION_PROCESS || s->fill == 0) {
+      return SQUASH_OK;
+    }
+
+    res = squash_lz4_linked_compress_pending (s);
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+  }
+}
+
+static SquashStatus
+squash_lz4_linked_process_stream_decompress (SquashStream* stream, SquashOperation operation) {
+  SquashLZ4LinkedStream* s = (SquashLZ4LinkedStream*) stream;
+  SquashStatus res;
+
+  while (true) {
+    if (s->pending_length != 0) {
+      const size_t cp_size = HEDLEY_UNLIKELY(stream->avail_out < s->pending_length) ?
+        stream->avail_out : s->pending_length;
+      memcpy (stream->next_out, s->ring + s->pending_pos, cp_size);
+      stream->next_out += cp_size;
+      stream->avail_out -= cp_size;
+      s->pending_pos += cp_size;
+      s->pending_length -= cp_size;
+
+      if (s->pending_length != 0)
+        return SQUASH_PROCESSING;
+    }
+
+    if (s->block_length == 0 && stream->avail_in >= SQUASH_LZ4_LINKED_HEADER_SIZE) {
+      /* If the whole block is in next_in we can decode it without
+         copying it first. */
+      const uint32_t compressed_size = squash_lz4_linked_read_header (stream->next_in);
+      if (HEDLEY_UNLIKELY(!squash_lz4_linked_block_size_is_valid (compressed_size)))
+        return squash_error (SQUASH_FAILED);
+
+      if (stream->avail_in - SQUASH_LZ4_LINKED_HEADER_SIZE >= compressed_size) {
+        res = squash_lz4_linked_decompress_block (s, stream->next_in + SQUASH_LZ4_LINKED_HEADER_SIZE, compressed_size);
+        if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+          return res;
+        stream->next_in += SQUASH_LZ4_LINKED_HEADER_SIZE + compressed_size;
+        stream->avail_in -= SQUASH_LZ4_LINKED_HEADER_SIZE + compressed_size;
+        continue;
+      }
+    }
+
+    if (stream->avail_in == 0)
+      break;
+
+    /* Accumulate a partial block: first the header, then the rest. */
+    size_t wanted = SQUASH_LZ4_LINKED_HEADER_SIZE;
+    if (s->block_length >= SQUASH_LZ4_LINKED_HEADER_SIZE) {
+      const uint32_t compressed_size = squash_lz4_linked_read_header (s->block);
+      if (HEDLEY_UNLIKELY(!squash_lz4_linked_block_size_is_valid (compressed_size)))
+        return squash_error (SQUASH_FAILED);
+      wanted += compressed_size;
+    }
+
+    const size_t cp_size = (stream->avail_in < (wanted - s->block_length)) ?
+      stream->avail_in : (wanted - s->block_length);
+    memcpy (s->block + s->block_length, stream->next_in, cp_size);
+    stream->next_in += cp_size;
+    stream->avail_in -= cp_size;
+    s->block_length += cp_size;
+
+    if (s->block_length == wanted && wanted > SQUASH_LZ4_LINKED_HEADER_SIZE) {
+      res = squash_lz4_linked_decompress_block (s, s->block + SQUASH_LZ4_LINKED_HEADER_SIZE,
+                                                (uint32_t) (wanted - SQUASH_LZ4_LINKED_HEADER_SIZE));
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        return res;
+      s->block_length = 0;
+    }
+  }
+
+  /* A truncated block at the end of the data. */
+  if (operation == SQUASH_OPERATION_FINISH && s->block_length != 0)
+    return squash_error (SQUASH_FAILED);
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_lz4_linked_process_stream (SquashStream* stream, SquashOperation operation) {
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS)
+    return squash_lz4_linked_process_stream_compress (stream, operation);
+  else
+    return squash_lz4_linked_process_stream_decompress (stream, operation);
+}
+
+static SquashStatus
+squash_lz4_linked_compress_buffer (SquashCodec* codec,
+                                   size_t* compressed_size,
+                                   uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                                   size_t uncompressed_size,
+                                   const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                                   SquashOptions* options) {
+  LZ4_stream_t* fast;
+  LZ4_streamHC_t* hc;
+  int acceleration = 1;
+  SquashStatus res = SQUASH_OK;
+
+  if (HEDLEY_UNLIKELY(!squash_lz4_linked_encoder_init (codec, options, &fast, &hc, &acceleration)))
+    return squash_error (SQUASH_MEMORY);
+
+  /* The input is contiguous, so each block can refer directly to the
+     ones before it. */
+  size_t in_pos = 0, out_pos = 0;
+  while (in_pos < uncompressed_size) {
+    const size_t block_size = ((uncompressed_size - in_pos) < SQUASH_LZ4_LINKED_BLOCK_SIZE) ?
+      (uncompressed_size - in_pos) : SQUASH_LZ4_LINKED_BLOCK_SIZE;
+
+    if (HEDLEY_UNLIKELY((*compressed_size - out_pos) <= SQUASH_LZ4_LINKED_HEADER_SIZE)) {
+      res = squash_error (SQUASH_BUFFER_FULL);
+      break;
+    }
+
+    const int lz4_r = squash_lz4_linked_compress_block (fast, hc, acceleration,
+                                                        uncompressed + in_pos, block_size,
+                                                        compressed + out_pos + SQUASH_LZ4_LINKED_HEADER_SIZE,
+                                                        *compressed_size - out_pos - SQUASH_LZ4_LINKED_HEADER_SIZE);
+    if (HEDLEY_UNLIKELY(lz4_r <= 0)) {
+      res = squash_error (SQUASH_BUFFER_FULL);
+      break;
+    }
+
+    squash_lz4_linked_write_header (compressed + out_pos, (uint32_t) lz4_r);
+    out_pos += SQUASH_LZ4_LINKED_HEADER_SIZE + (size_t) lz4_r;
+    in_pos += block_size;
+  }
+
+  if (fast != NULL)
+    LZ4_freeStream (fast);
+  if (hc != NULL)
+    LZ4_freeStreamHC (hc);
+
+  if (HEDLEY_LIKELY(res == SQUASH_OK))
+    *compressed_size = out_pos;
+
+  return res;
+}
+
+static SquashStatus
+squash_lz4_linked_decompress_buffer (SquashCodec* codec,
+                                     size_t* decompressed_size,
+                                     uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                     size_t compressed_size,
+                                     const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                     SquashOptions* options) {
+  LZ4_streamDecode_t decode;
+  size_t in_pos = 0, out_pos = 0;
+
+  LZ4_setStreamDecode (&decode, NULL, 0);
+
+  while (in_pos < compressed_size) {
+    if (HEDLEY_UNLIKELY((compressed_size - in_pos) < SQUASH_LZ4_LINKED_HEADER_SIZE))
+      return squash_error (SQUASH_FAILED);
+
+    const uint32_t block_size = squash_lz4_linked_read_header (compressed + in_pos);
+    in_pos += SQUASH_LZ4_LINKED_HEADER_SIZE;
+    if (HEDLEY_UNLIKELY(!squash_lz4_linked_block_size_is_valid (block_size) || (compressed_size - in_pos) < block_size))
+      return squash_error (SQUASH_FAILED);
+
+    /* The output is contiguous too, so no ring buffer is needed. */
+    const size_t available = *decompressed_size - out_pos;
+    const bool limited = available < SQUASH_LZ4_LINKED_BLOCK_SIZE;
+    const int lz4_r = LZ4_decompress_safe_continue (&decode,
+                                                    (const char*) compressed + in_pos,
+                                                    (char*) decompressed + out_pos,
+                                                    (int) block_size,
+                                                    (int) (limited ? available : SQUASH_LZ4_LINKED_BLOCK_SIZE));
+    if (HEDLEY_UNLIKELY(lz4_r < 0)) {
+      /* LZ4 doesn't distinguish between corrupt data and a short
+         buffer. */
+      return squash_error (limited ? SQUASH_BUFFER_FULL : SQUASH_FAILED);
+    }
+
+    in_pos += block_size;
+    out_pos += (size_t) lz4_r;
+  }
+
+  *decompressed_size = out_pos;
+
+  return SQUASH_OK;
+}
+
+#endif /* LZ4_VERSION_NUMBER >= 10700 */
+
+SquashStatus
+squash_plugin_init_lz4_linked (SquashCodec* codec, SquashCodecImpl* impl) {
+#if LZ4_VERSION_NUMBER >= 10700
+  impl->info = SQUASH_CODEC_INFO_CAN_FLUSH;
+  impl->options = squash_lz4_linked_options;
+  impl->get_max_compressed_size = squash_lz4_linked_get_max_compressed_size;
+  impl->create_stream = squash_lz4_linked_create_stream;
+  impl->process_stream = squash_lz4_linked_process_stream;
+  impl->decompress_buffer = squash_lz4_linked_decompress_buffer;
+  impl->compress_buffer = squash_lz4_linked_compress_buffer;
+
+  return SQUASH_OK;
+#else
+  return squash_error (SQUASH_UNABLE_TO_LOAD);
+#endif
+}
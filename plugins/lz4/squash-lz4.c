@@ -31,14 +31,32 @@
 #include <limits.h>
 
 #include <squash/squash.h>
+
+/* The functions which skip re-initializing a state are only exported
+   from the static library, so we can only use them when embedding. */
+#if defined(SQUASH_LZ4_EMBED)
+#  define LZ4_STATIC_LINKING_ONLY
+#  define LZ4_HC_STATIC_LINKING_ONLY
+#endif
+
+/* LZ4_decompress_fast is deprecated since it can't cope with
+   malformed input, but that is exactly what the trusted path wants. */
+#define LZ4_DISABLE_DEPRECATE_WARNINGS
+
 #include <lz4.h>
 #include <lz4hc.h>
 
+#include "squash-lz4.h"
+
 #if LZ4_VERSION_NUMBER < 10700
 #define LZ4_compress_default LZ4_compress_limitedOutput
 #define LZ4_compress_HC LZ4_compressHC2_limitedOutput
 #endif
 
+#if defined(SQUASH_LZ4_EMBED) && LZ4_VERSION_NUMBER >= 10900
+#  define SQUASH_LZ4_FAST_RESET
+#endif
+
 enum SquashLZ4OptIndex {
   SQUASH_LZ4_OPT_LEVEL = 0
 };
@@ -53,8 +71,6 @@ static SquashOptionInfo squash_lz4_options[] = {
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
-SquashStatus             squash_plugin_init_lz4f    (SquashCodec* codec, SquashCodecImpl* impl);
-
 SQUASH_PLUGIN_EXPORT
 SquashStatus             squash_plugin_init_codec   (SquashCodec* codec, SquashCodecImpl* impl);
 
@@ -93,7 +109,60 @@ squash_lz4_decompress_buffer (SquashCodec* codec,
   }
 }
 
-static int
+static SquashStatus
+squash_lz4_decompress_buffer_unsafe (SquashCodec* codec,
+                                     size_t* decompressed_size,
+                                     uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                     size_t compressed_size,
+                                     const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                     SquashOptions* options) {
+#if INT_MAX < SIZE_MAX
+  if (HEDLEY_UNLIKELY(INT_MAX < compressed_size) ||
+      HEDLEY_UNLIKELY(INT_MAX < *decompressed_size))
+    return squash_error (SQUASH_RANGE);
+#endif
+
+  /* Returns the number of bytes of input consumed, and relies on
+     *decompressed_size being the exact size of the output. */
+  const int lz4_e = LZ4_decompress_fast ((char*) compressed,
+                                         (char*) decompressed,
+                                         (int) *decompressed_size);
+
+  if (HEDLEY_UNLIKELY(lz4_e < 0) || HEDLEY_UNLIKELY((size_t) lz4_e != compressed_size))
+    return squash_error (SQUASH_FAILED);
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_lz4_decompress_prefix (SquashCodec* codec,
+                              size_t* decompressed_size,
+                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                              size_t compressed_size,
+                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                              SquashOptions* options) {
+#if INT_MAX < SIZE_MAX
+  if (HEDLEY_UNLIKELY(INT_MAX < compressed_size))
+    return squash_error (SQUASH_RANGE);
+  if (INT_MAX < *decompressed_size)
+    *decompressed_size = INT_MAX;
+#endif
+
+  const int lz4_e = LZ4_decompress_safe_partial ((char*) compressed,
+                                                 (char*) decompressed,
+                                                 (int) compressed_size,
+                                                 (int) *decompressed_size,
+                                                 (int) *decompressed_size);
+
+  if (HEDLEY_UNLIKELY(lz4_e < 0))
+    return squash_error (SQUASH_FAILED);
+
+  *decompressed_size = (size_t) lz4_e;
+
+  return SQUASH_OK;
+}
+
+int
 squash_lz4_level_to_fast_mode (const int level) {
     switch (level) {
       case 1:
@@ -113,7 +182,7 @@ squash_lz4_level_to_fast_mode (const int level) {
     }
 }
 
-static int
+int
 squash_lz4_level_to_hc_level (const int level) {
   switch (level) {
     case 8:
@@ -135,6 +204,176 @@ squash_lz4_level_to_hc_level (const int level) {
   }
 }
 
+#if LZ4_VERSION_NUMBER >= 10700
+/* Compression states are expensive to allocate (especially the HC
+ * one), so we keep one of each around.  Whoever gets there first
+ * takes it, anyone else allocates their own for the duration of the
+ * call. */
+
+static void* squash_lz4_cached_state = NULL;
+static void* squash_lz4_cached_state_hc = NULL;
+
+#if defined(__GNUC__)
+static void*
+squash_lz4_state_cache_take (void** slot) {
+  return __atomic_exchange_n (slot, NULL, __ATOMIC_ACQ_REL);
+}
+
+static bool
+squash_lz4_state_cache_put (void** slot, void* state) {
+  void* expected = NULL;
+  return __atomic_compare_exchange_n (slot, &expected, state, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+#elif defined(_MSC_VER)
+#include <intrin.h>
+
+static void*
+squash_lz4_state_cache_take (void** slot) {
+  return _InterlockedExchangePointer (slot, NULL);
+}
+
+static bool
+squash_lz4_state_cache_put (void** slot, void* state) {
+  return _InterlockedCompareExchangePointer (slot, state, NULL) == NULL;
+}
+#else
+static void*
+squash_lz4_state_cache_take (void** slot) {
+  (void) slot;
+  return NULL;
+}
+
+static bool
+squash_lz4_state_cache_put (void** slot, void* state) {
+  (void) slot;
+  (void) state;
+  return false;
+}
+#endif
+
+static void*
+squash_lz4_state_acquire (bool hc) {
+  void* state = squash_lz4_state_cache_take (hc ? &squash_lz4_cached_state_hc : &squash_lz4_cached_state);
+  if (state != NULL)
+    return state;
+
+  const int state_size = hc ? LZ4_sizeofStateHC () : LZ4_sizeofState ();
+  state = squash_malloc ((size_t) state_size);
+
+#if defined(SQUASH_LZ4_FAST_RESET)
+  /* The _fastReset functions require a state which has been
+     initialized at least once. */
+  if (HEDLEY_LIKELY(state != NULL)) {
+    if (hc)
+      LZ4_initStreamHC (state, (size_t) state_size);
+    else
+      LZ4_initStream (state, (size_t) state_size);
+  }
+#endif
+
+  return state;
+}
+
+static void
+squash_lz4_state_release (bool hc, void* state) {
+  if (!squash_lz4_state_cache_put (hc ? &squash_lz4_cached_state_hc : &squash_lz4_cached_state, state))
+    squash_free (state);
+}
+
+/* Free whatever is still cached when the plugin is unloaded (or the
+ * process exits). */
+static void
+squash_lz4_state_cache_clear (void) {
+  void* state;
+
+  if ((state = squash_lz4_state_cache_take (&squash_lz4_cached_state)) != NULL)
+    squash_free (state);
+  if ((state = squash_lz4_state_cache_take (&squash_lz4_cached_state_hc)) != NULL)
+    squash_free (state);
+}
+
+#if defined(__GNUC__)
+__attribute__((__destructor__))
+static void
+squash_lz4_unload (void) {
+  squash_lz4_state_cache_clear ();
+}
+#elif defined(_MSC_VER)
+#include <windows.h>
+
+BOOL WINAPI
+DllMain (HINSTANCE instance, DWORD reason, LPVOID reserved) {
+  (void) instance;
+
+  /* reserved is non-NULL when the process is exiting, in which case
+     the heap may already be gone. */
+  if (reason == DLL_PROCESS_DETACH && reserved == NULL)
+    squash_lz4_state_cache_clear ();
+
+  return TRUE;
+}
+#endif
+
+static SquashStatus
+squash_lz4_compress_buffer (SquashCodec* codec,
+                            size_t* compressed_size,
+                            uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                            size_t uncompressed_size,
+                            const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                            SquashOptions* options) {
+  const int level = squash_options_get_int_at (options, codec, SQUASH_LZ4_OPT_LEVEL);
+
+#if INT_MAX < SIZE_MAX
+  if (HEDLEY_UNLIKELY(INT_MAX < uncompressed_size) ||
+      HEDLEY_UNLIKELY(INT_MAX < *compressed_size))
+    return squash_error (SQUASH_RANGE);
+#endif
+
+  const bool hc = level > 7;
+  void* state = squash_lz4_state_acquire (hc);
+  if (HEDLEY_UNLIKELY(state == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  int lz4_r;
+
+  if (hc) {
+#if defined(SQUASH_LZ4_FAST_RESET)
+    lz4_r = LZ4_compress_HC_extStateHC_fastReset
+#else
+    lz4_r = LZ4_compress_HC_extStateHC
+#endif
+      (state,
+       (const char*) uncompressed,
+       (char*) compressed,
+       (int) uncompressed_size,
+       (int) *compressed_size,
+       squash_lz4_level_to_hc_level (level));
+  } else {
+#if defined(SQUASH_LZ4_FAST_RESET)
+    lz4_r = LZ4_compress_fast_extState_fastReset
+#else
+    lz4_r = LZ4_compress_fast_extState
+#endif
+      (state,
+       (const char*) uncompressed,
+       (char*) compressed,
+       (int) uncompressed_size,
+       (int) *compressed_size,
+       (level == 7) ? 1 : squash_lz4_level_to_fast_mode (level));
+  }
+
+  squash_lz4_state_release (hc, state);
+
+#if SIZE_MAX < INT_MAX
+  if (HEDLEY_UNLIKELY(SIZE_MAX < lz4_r))
+    return squash_error (SQUASH_RANGE);
+#endif
+
+  *compressed_size = lz4_r;
+
+  return HEDLEY_UNLIKELY(lz4_r == 0) ? squash_error (SQUASH_BUFFER_FULL) : SQUASH_OK;
+}
+#else
 static SquashStatus
 squash_lz4_compress_buffer (SquashCodec* codec,
                             size_t* compressed_size,
@@ -183,7 +422,6 @@ squash_lz4_compress_buffer (SquashCodec* codec,
   return HEDLEY_UNLIKELY(lz4_r == 0) ? squash_error (SQUASH_BUFFER_FULL) : SQUASH_OK;
 }
 
-#if LZ4_VERSION_NUMBER < 10700
 static SquashStatus
 squash_lz4_compress_buffer_unsafe (SquashCodec* codec,
                                    size_t* compressed_size,
@@ -239,10 +477,18 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->options = squash_lz4_options;
     impl->get_max_compressed_size = squash_lz4_get_max_compressed_size;
     impl->decompress_buffer = squash_lz4_decompress_buffer;
+    /* Since 1.9.4 LZ4_decompress_fast is a simple loop which is much
+       slower than LZ4_decompress_safe, so it only helps with older
+       versions. */
+    if (LZ4_versionNumber () < 10904)
+      impl->decompress_buffer_unsafe = squash_lz4_decompress_buffer_unsafe;
+    impl->decompress_prefix = squash_lz4_decompress_prefix;
     impl->compress_buffer = squash_lz4_compress_buffer;
 #if LZ4_VERSION_NUMBER < 10700
     impl->compress_buffer_unsafe = squash_lz4_compress_buffer_unsafe;
 #endif
+  } else if (strcmp ("lz4-linked", name) == 0) {
+    return squash_plugin_init_lz4_linked (codec, impl);
   } else {
     return squash_plugin_init_lz4f (codec, impl);
   }
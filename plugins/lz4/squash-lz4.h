@@ -0,0 +1,41 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#if !defined(SQUASH_LZ4_H)
+#define SQUASH_LZ4_H
+
+#include <squash/squash.h>
+
+/* Shared between squash-lz4.c, squash-lz4f.c and squash-lz4-linked.c;
+ * everything but squash_plugin_init_codec stays inside the plugin. */
+
+SquashStatus squash_plugin_init_lz4f        (SquashCodec* codec, SquashCodecImpl* impl);
+SquashStatus squash_plugin_init_lz4_linked  (SquashCodec* codec, SquashCodecImpl* impl);
+
+int          squash_lz4_level_to_fast_mode  (const int level);
+int          squash_lz4_level_to_hc_level   (const int level);
+
+#endif /* !defined(SQUASH_LZ4_H) */
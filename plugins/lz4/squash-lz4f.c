@@ -38,21 +38,32 @@
 #  include <lz4frame.h>
 #endif
 
+#include "squash-lz4.h"
+
 #if LZ4_VERSION_NUMBER < 10700
 #define LZ4F_max64KB max64KB
 #define LZ4F_blockLinked blockLinked
+#define LZ4F_blockIndependent blockIndependent
 #define LZ4F_contentChecksumEnabled contentChecksumEnabled
 #define LZ4F_noContentChecksum noContentChecksum
 #endif
 
-SquashStatus squash_plugin_init_lz4f (SquashCodec* codec, SquashCodecImpl* impl);
-
 #define SQUASH_LZ4F_DICT_SIZE ((size_t) 65536)
+#define SQUASH_LZ4F_MAGIC ((uint32_t) 0x184d2204)
+
+/* Below this it isn't worth starting threads to decode blocks. */
+#define SQUASH_LZ4F_PARALLEL_MIN_SIZE (1024 * 1024)
 
 enum SquashLZ4FOptIndex {
   SQUASH_LZ4F_OPT_LEVEL = 0,
   SQUASH_LZ4F_OPT_BLOCK_SIZE,
   SQUASH_LZ4F_OPT_CHECKSUM,
+  SQUASH_LZ4F_OPT_BLOCK_CHECKSUM,
+  SQUASH_LZ4F_OPT_BLOCK_MODE,
+  SQUASH_LZ4F_OPT_CONTENT_SIZE,
+  SQUASH_LZ4F_OPT_AUTO_FLUSH,
+  SQUASH_LZ4F_OPT_FAVOR_DEC_SPEED,
+  SQUASH_LZ4F_OPT_THREADS,
 };
 
 static SquashOptionInfo squash_lz4f_options[] = {
@@ -71,6 +82,32 @@ static SquashOptionInfo squash_lz4f_options[] = {
   { "checksum",
     SQUASH_OPTION_TYPE_BOOL,
     .default_value.bool_value = false },
+  { "block-checksum",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = false },
+  { "block-mode",
+    SQUASH_OPTION_TYPE_ENUM_STRING,
+    .info.enum_string = {
+      .values = (const SquashOptionInfoEnumStringMap []) {
+        { "linked", LZ4F_blockLinked },
+        { "independent", LZ4F_blockIndependent },
+        { NULL, 0 } } },
+    .default_value.int_value = LZ4F_blockLinked },
+  { "content-size",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = true },
+  { "auto-flush",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = false },
+  { "favor-dec-speed",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = false },
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 1 },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -157,6 +194,30 @@ squash_lz4f_get_status (size_t res) {
 #endif
 }
 
+static void
+squash_lz4f_get_preferences (SquashCodec* codec, SquashOptions* options, LZ4F_preferences_t* prefs) {
+  memset (prefs, 0, sizeof (LZ4F_preferences_t));
+
+  prefs->frameInfo.blockSizeID = (LZ4F_blockSizeID_t) squash_options_get_int_at (options, codec, SQUASH_LZ4F_OPT_BLOCK_SIZE);
+  prefs->frameInfo.blockMode = (LZ4F_blockMode_t) squash_options_get_int_at (options, codec, SQUASH_LZ4F_OPT_BLOCK_MODE);
+  prefs->frameInfo.contentChecksumFlag = squash_options_get_bool_at (options, codec, SQUASH_LZ4F_OPT_CHECKSUM) ?
+    LZ4F_contentChecksumEnabled :
+    LZ4F_noContentChecksum;
+  /* LZ4F_compressFrame replaces any non-zero value with the real
+     size; streams never know it up front, so they leave it unset. */
+  prefs->frameInfo.contentSize = squash_options_get_bool_at (options, codec, SQUASH_LZ4F_OPT_CONTENT_SIZE) ? 1 : 0;
+#if LZ4_VERSION_NUMBER >= 10800
+  prefs->frameInfo.blockChecksumFlag = squash_options_get_bool_at (options, codec, SQUASH_LZ4F_OPT_BLOCK_CHECKSUM) ?
+    LZ4F_blockChecksumEnabled :
+    LZ4F_noBlockChecksum;
+#endif
+  prefs->compressionLevel = squash_options_get_int_at (options, codec, SQUASH_LZ4F_OPT_LEVEL);
+  prefs->autoFlush = squash_options_get_bool_at (options, codec, SQUASH_LZ4F_OPT_AUTO_FLUSH) ? 1 : 0;
+#if LZ4_VERSION_NUMBER >= 10802
+  prefs->favorDecSpeed = squash_options_get_bool_at (options, codec, SQUASH_LZ4F_OPT_FAVOR_DEC_SPEED) ? 1 : 0;
+#endif
+}
+
 static SquashLZ4FStream*
 squash_lz4f_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
   SquashLZ4FStream* stream;
@@ -181,16 +242,8 @@ squash_lz4f_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squash
 
     stream->data.comp.input_buffer_size = 0;
 
-    stream->data.comp.prefs = (LZ4F_preferences_t) {
-      {
-        (LZ4F_blockSizeID_t) squash_options_get_int_at (options, codec, SQUASH_LZ4F_OPT_BLOCK_SIZE),
-        LZ4F_blockLinked,
-        squash_options_get_bool_at (options, codec, SQUASH_LZ4F_OPT_CHECKSUM) ?
-          LZ4F_contentChecksumEnabled :
-          LZ4F_noContentChecksum,
-      },
-      squash_options_get_int_at (options, codec, SQUASH_LZ4F_OPT_LEVEL)
-    };
+    squash_lz4f_get_preferences (codec, options, &(stream->data.comp.prefs));
+    stream->data.comp.prefs.frameInfo.contentSize = 0;
   } else {
     ec = LZ4F_createDecompressionContext(&(stream->data.decomp.ctx), LZ4F_VERSION);
   }
@@ -304,7 +357,9 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
     }
   }
 
-  while ((stream->avail_in != 0 || operation != SQUASH_OPERATION_PROCESS) && stream->avail_out != 0) {
+  while ((stream->avail_in != 0 || operation != SQUASH_OPERATION_PROCESS) &&
+         stream->avail_out != 0 &&
+         s->data.comp.state != SQUASH_LZ4F_STATE_FINISHED) {
     if (s->data.comp.state == SQUASH_LZ4F_STATE_INIT) {
       s->data.comp.state = SQUASH_LZ4F_STATE_ACTIVE;
       if (stream->avail_out < 19) {
@@ -325,7 +380,10 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
       const size_t total_input = stream->avail_in + s->data.comp.input_buffer_size;
       const size_t output_buffer_max_size = squash_lz4f_stream_get_output_buffer_size (stream);
 
-      if (progress && (total_input < input_buffer_size || stream->avail_out < output_buffer_max_size))
+      /* Finishing has to reach LZ4F_compressEnd even if nothing was
+         written yet; otherwise an empty stream is just a header. */
+      if (progress && operation != SQUASH_OPERATION_FINISH &&
+          (total_input < input_buffer_size || stream->avail_out < output_buffer_max_size))
         break;
 
       uint8_t* obuf;
@@ -337,7 +395,7 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
         olen = LZ4F_compressUpdate (s->data.comp.ctx, obuf, output_buffer_max_size, stream->next_in, input_size, NULL);
 
         if (!LZ4F_isError (olen)) {
-          if (input_size + s->data.comp.input_buffer_size == input_buffer_size) {
+          if (s->data.comp.prefs.autoFlush || input_size + s->data.comp.input_buffer_size == input_buffer_size) {
             s->data.comp.input_buffer_size = 0;
           } else {
             s->data.comp.input_buffer_size += input_size;
@@ -363,6 +421,7 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
         olen = LZ4F_compressEnd (s->data.comp.ctx, obuf, olen, NULL);
 
         s->data.comp.input_buffer_size = 0;
+        s->data.comp.state = SQUASH_LZ4F_STATE_FINISHED;
       } else if (progress) {
         break;
       } else {
@@ -408,7 +467,12 @@ squash_lz4f_compress_stream (SquashStream* stream, SquashOperation operation) {
     }
   }
 
-  return (stream->avail_in == 0 && s->data.comp.output_buffer_size == 0) ? SQUASH_OK : SQUASH_PROCESSING;
+  if (stream->avail_in != 0 || s->data.comp.output_buffer_size != 0)
+    return SQUASH_PROCESSING;
+  else if (operation == SQUASH_OPERATION_FINISH && s->data.comp.state != SQUASH_LZ4F_STATE_FINISHED)
+    return SQUASH_PROCESSING;
+  else
+    return SQUASH_OK;
 }
 
 static SquashStatus
@@ -452,24 +516,374 @@ squash_lz4f_process_stream (SquashStream* stream, SquashOperation operation) {
 
 static size_t
 squash_lz4f_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
-  static const LZ4F_preferences_t prefs = {
-    { LZ4F_max64KB, LZ4F_blockLinked, LZ4F_contentChecksumEnabled, },
-    0, 0,
-  };
+  /* Worst case for any combination of options: the smallest blocks,
+     both checksums and the content size in the header. */
+  LZ4F_preferences_t prefs;
+
+  memset (&prefs, 0, sizeof (LZ4F_preferences_t));
+  prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+  prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+  prefs.frameInfo.contentSize = 1;
+#if LZ4_VERSION_NUMBER >= 10800
+  prefs.frameInfo.blockChecksumFlag = LZ4F_blockChecksumEnabled;
+#endif
+
+  return LZ4F_compressFrameBound (uncompressed_size, &prefs);
+}
+
+static SquashStatus
+squash_lz4f_compress_buffer_unsafe (SquashCodec* codec,
+                                    size_t* compressed_size,
+                                    uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                                    size_t uncompressed_size,
+                                    const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                                    SquashOptions* options) {
+  LZ4F_preferences_t prefs;
+  size_t res;
+
+  squash_lz4f_get_preferences (codec, options, &prefs);
+
+  res = LZ4F_compressFrame (compressed, *compressed_size, uncompressed, uncompressed_size, &prefs);
+  if (HEDLEY_UNLIKELY(LZ4F_isError (res)))
+    return squash_lz4f_get_status (res);
+
+  *compressed_size = res;
+
+  return SQUASH_OK;
+}
+
+static uint32_t
+squash_lz4f_read_le32 (const uint8_t data[4]) {
+  return
+    ((uint32_t) data[0]      ) |
+    ((uint32_t) data[1] <<  8) |
+    ((uint32_t) data[2] << 16) |
+    ((uint32_t) data[3] << 24);
+}
+
+typedef struct SquashLZ4FBlock_s {
+  const uint8_t* compressed;
+  size_t compressed_size;
+  uint8_t* decompressed;
+  size_t decompressed_size;
+  bool stored;
+} SquashLZ4FBlock;
+
+static SquashStatus
+squash_lz4f_decompress_block_task (size_t task, void* user_data) {
+  const SquashLZ4FBlock* block = ((const SquashLZ4FBlock*) user_data) + task;
+
+  if (block->stored) {
+    if (block->compressed_size != block->decompressed_size)
+      return SQUASH_INVALID_BUFFER;
+
+    memcpy (block->decompressed, block->compressed, block->compressed_size);
+  } else {
+    const int res = LZ4_decompress_safe ((const char*) block->compressed, (char*) block->decompressed,
+                                         (int) block->compressed_size, (int) block->decompressed_size);
+    if (res < 0 || (size_t) res != block->decompressed_size)
+      return SQUASH_INVALID_BUFFER;
+  }
+
+  return SQUASH_OK;
+}
+
+/* Independent blocks don't reference each other, so as long as every
+   block but the last one is full their place in the output is known
+   before decoding, and they can all be decoded at the same time.
+
+   This only handles the common case of a single frame with the
+   content size, no checksums (the linked liblz4 doesn't necessarily
+   export xxHash) and no dictionary.  If the frame doesn't fit, or
+   a block doesn't decode to the size it should, it returns false and
+   the caller decodes serially, which also reports any error. */
+static bool
+squash_lz4f_decompress_blocks (unsigned int threads,
+                               size_t* decompressed_size,
+                               uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                               size_t compressed_size,
+                               const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]) {
+  LZ4F_decompressionContext_t ctx;
+  LZ4F_frameInfo_t info;
+  size_t header_size = compressed_size;
+  size_t res;
+
+  if (compressed_size < 4 || squash_lz4f_read_le32 (compressed) != SQUASH_LZ4F_MAGIC)
+    return false;
+
+  if (HEDLEY_UNLIKELY(LZ4F_isError (LZ4F_createDecompressionContext (&ctx, LZ4F_VERSION))))
+    return false;
+  res = LZ4F_getFrameInfo (ctx, &info, compressed, &header_size);
+  LZ4F_freeDecompressionContext (ctx);
+
+  if (LZ4F_isError (res) ||
+      info.blockMode != LZ4F_blockIndependent ||
+      info.contentChecksumFlag != LZ4F_noContentChecksum ||
+      info.contentSize < SQUASH_LZ4F_PARALLEL_MIN_SIZE ||
+      info.contentSize > *decompressed_size)
+    return false;
+#if LZ4_VERSION_NUMBER >= 10800
+  if (info.blockChecksumFlag != LZ4F_noBlockChecksum || info.dictID != 0)
+    return false;
+#endif
+
+  const size_t content_size = (size_t) info.contentSize;
+  const size_t block_max = squash_lz4f_block_size_id_to_size (info.blockSizeID);
+  const size_t n_blocks = (content_size / block_max) + ((content_size % block_max) != 0);
+  size_t pos = header_size;
+  size_t block;
+
+  SquashLZ4FBlock* blocks = squash_malloc (n_blocks * sizeof (SquashLZ4FBlock));
+  if (HEDLEY_UNLIKELY(blocks == NULL))
+    return false;
+
+  for (block = 0 ; block < n_blocks ; block++) {
+    uint32_t block_size;
+
+    if ((compressed_size - pos) < 4)
+      break;
+
+    block_size = squash_lz4f_read_le32 (compressed + pos);
+    pos += 4;
+
+    /* The high bit marks an uncompressed block. */
+    blocks[block].stored = (block_size & 0x80000000) != 0;
+    block_size &= 0x7fffffff;
+    if (block_size == 0 || (compressed_size - pos) < block_size)
+      break;
+
+    blocks[block].compressed = compressed + pos;
+    blocks[block].compressed_size = block_size;
+    blocks[block].decompressed = decompressed + (block * block_max);
+    blocks[block].decompressed_size = (block == n_blocks - 1) ? content_size - (block * block_max) : block_max;
+    pos += block_size;
+  }
+
+  /* The end mark has to come right after the last block. */
+  const bool decoded =
+    block == n_blocks &&
+    (compressed_size - pos) == 4 &&
+    squash_lz4f_read_le32 (compressed + pos) == 0 &&
+    squash_parallel_run (n_blocks, threads, squash_lz4f_decompress_block_task, blocks) == SQUASH_OK;
+
+  squash_free (blocks);
+
+  if (decoded)
+    *decompressed_size = content_size;
+
+  return decoded;
+}
+
+/* Older versions of the stream encoder never wrote the end mark for
+   empty input, leaving just the frame header. */
+static bool
+squash_lz4f_is_header_only (size_t compressed_size, const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]) {
+  LZ4F_decompressionContext_t ctx;
+  LZ4F_frameInfo_t info;
+  size_t header_size = compressed_size;
+  size_t res;
+
+  if (HEDLEY_UNLIKELY(LZ4F_isError (LZ4F_createDecompressionContext (&ctx, LZ4F_VERSION))))
+    return false;
+  res = LZ4F_getFrameInfo (ctx, &info, compressed, &header_size);
+  LZ4F_freeDecompressionContext (ctx);
+
+  return !LZ4F_isError (res) && header_size == compressed_size && info.contentSize == 0;
+}
+
+static SquashStatus
+squash_lz4f_decompress_buffer (SquashCodec* codec,
+                               size_t* decompressed_size,
+                               uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                               size_t compressed_size,
+                               const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                               SquashOptions* options) {
+  LZ4F_decompressionContext_t ctx;
+  SquashStatus status = SQUASH_OK;
+  size_t compressed_pos = 0, decompressed_pos = 0;
+  size_t hint = 0;
+
+  const unsigned int threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_LZ4F_OPT_THREADS);
+  if (threads != 1 && squash_lz4f_decompress_blocks (threads, decompressed_size, decompressed, compressed_size, compressed))
+    return SQUASH_OK;
+
+  if (HEDLEY_UNLIKELY(LZ4F_isError (LZ4F_createDecompressionContext (&ctx, LZ4F_VERSION))))
+    return squash_error (SQUASH_MEMORY);
+
+  /* LZ4F_decompress writes straight into the destination whenever a
+     whole block fits, so handing it the entire buffer at once avoids
+     the intermediate copies the streaming path needs.  Concatenated
+     frames are decoded one after the other. */
+  while (compressed_pos < compressed_size) {
+    size_t dst_len = *decompressed_size - decompressed_pos;
+    size_t src_len = compressed_size - compressed_pos;
+
+    hint = LZ4F_decompress (ctx,
+                            decompressed + decompressed_pos, &dst_len,
+                            compressed + compressed_pos, &src_len,
+                            NULL);
+    if (HEDLEY_UNLIKELY(LZ4F_isError (hint))) {
+      status = squash_lz4f_get_status (hint);
+      break;
+    }
+
+    compressed_pos += src_len;
+    decompressed_pos += dst_len;
+
+    if (HEDLEY_UNLIKELY(hint != 0 && src_len == 0 && dst_len == 0)) {
+      status = squash_error ((decompressed_pos == *decompressed_size) ? SQUASH_BUFFER_FULL : SQUASH_INVALID_BUFFER);
+      break;
+    }
+  }
+
+  LZ4F_freeDecompressionContext (ctx);
+
+  if (HEDLEY_UNLIKELY(status != SQUASH_OK))
+    return status;
+  else if (HEDLEY_UNLIKELY(hint != 0 && (decompressed_pos != 0 || !squash_lz4f_is_header_only (compressed_size, compressed))))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  *decompressed_size = decompressed_pos;
+
+  return SQUASH_OK;
+}
+
+/* Returns the number of bytes of block data (including the end mark
+   and content checksum) following a frame header, or 0 if the frame
+   is truncated. */
+static size_t
+squash_lz4f_skip_blocks (const LZ4F_frameInfo_t* info, size_t compressed_size, const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]) {
+  size_t block_checksum_size = 0;
+  size_t pos = 0;
+
+#if LZ4_VERSION_NUMBER >= 10800
+  if (info->blockChecksumFlag == LZ4F_blockChecksumEnabled)
+    block_checksum_size = 4;
+#endif
+
+  while (true) {
+    uint32_t block_size;
+
+    if (HEDLEY_UNLIKELY((compressed_size - pos) < 4))
+      return 0;
+
+    block_size = squash_lz4f_read_le32 (compressed + pos);
+    pos += 4;
+
+    if (block_size == 0)
+      break;
 
-  const size_t block_size = squash_lz4f_block_size_id_to_size (prefs.frameInfo.blockSizeID);
-  const size_t full_blocks = uncompressed_size / block_size;
-  const size_t last_block = ((uncompressed_size % block_size) == 0) ? block_size : (uncompressed_size % block_size);
-  const size_t block_overhead = 8;
+    /* The high bit marks an uncompressed block. */
+    block_size &= 0x7fffffff;
+    if (HEDLEY_UNLIKELY((compressed_size - pos) < (block_size + block_checksum_size)))
+      return 0;
+    pos += block_size + block_checksum_size;
+  }
+
+  if (info->contentChecksumFlag == LZ4F_contentChecksumEnabled) {
+    if (HEDLEY_UNLIKELY((compressed_size - pos) < 4))
+      return 0;
+    pos += 4;
+  }
+
+  return pos;
+}
 
-  const size_t res =
-    (full_blocks * (block_overhead + block_size)) +
-    (last_block == 0 ? 0 : (block_overhead + last_block))
-    + 7;
+static SquashStatus
+squash_lz4f_scan_frames (SquashCodec* codec,
+                         size_t compressed_size,
+                         const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                         SquashFrameFunc func,
+                         void* user_data) {
+  LZ4F_decompressionContext_t ctx;
+  SquashStatus res = SQUASH_OK;
+  size_t pos = 0;
+
+  if (HEDLEY_UNLIKELY(LZ4F_isError (LZ4F_createDecompressionContext (&ctx, LZ4F_VERSION))))
+    return SQUASH_MEMORY;
+
+  /* The content size is optional in the frame header, so this only
+     succeeds if every frame carries it. */
+  while (pos < compressed_size) {
+    LZ4F_frameInfo_t info;
+    size_t header_size = compressed_size - pos;
+    size_t blocks_size;
+
+    if (HEDLEY_UNLIKELY((compressed_size - pos) < 8)) {
+      res = SQUASH_INVALID_BUFFER;
+      break;
+    }
+
+    /* Skippable frames carry no data; leave them out. */
+    if ((squash_lz4f_read_le32 (compressed + pos) & 0xfffffff0) == 0x184d2a50) {
+      const size_t skip_size = squash_lz4f_read_le32 (compressed + pos + 4);
+      if (HEDLEY_UNLIKELY((compressed_size - pos - 8) < skip_size)) {
+        res = SQUASH_INVALID_BUFFER;
+        break;
+      }
+      pos += 8 + skip_size;
+      continue;
+    }
+
+    if (LZ4F_isError (LZ4F_getFrameInfo (ctx, &info, compressed + pos, &header_size))) {
+      res = SQUASH_INVALID_BUFFER;
+      break;
+    } else if (info.contentSize == 0 || info.contentSize > SIZE_MAX) {
+      res = SQUASH_RANGE;
+      break;
+    }
+
+    blocks_size = squash_lz4f_skip_blocks (&info, compressed_size - pos - header_size, compressed + pos + header_size);
+    if (blocks_size == 0) {
+      res = SQUASH_INVALID_BUFFER;
+      break;
+    }
+
+    const SquashFrame frame = { pos, header_size + blocks_size, (size_t) info.contentSize };
+    res = func (&frame, user_data);
+    if (res != SQUASH_OK)
+      break;
+
+    pos += header_size + blocks_size;
+
+#if LZ4_VERSION_NUMBER >= 10800
+    LZ4F_resetDecompressionContext (ctx);
+#else
+    LZ4F_freeDecompressionContext (ctx);
+    if (HEDLEY_UNLIKELY(LZ4F_isError (LZ4F_createDecompressionContext (&ctx, LZ4F_VERSION))))
+      return SQUASH_MEMORY;
+#endif
+  }
+
+  LZ4F_freeDecompressionContext (ctx);
 
   return res;
 }
 
+static SquashStatus
+squash_lz4f_add_frame_size (const SquashFrame* frame, void* user_data) {
+  size_t* total = (size_t*) user_data;
+
+  if (HEDLEY_UNLIKELY((SIZE_MAX - *total) < frame->decompressed_size))
+    return SQUASH_RANGE;
+
+  *total += frame->decompressed_size;
+
+  return SQUASH_OK;
+}
+
+static size_t
+squash_lz4f_get_uncompressed_size (SquashCodec* codec,
+                                   size_t compressed_size,
+                                   const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]) {
+  size_t total = 0;
+
+  if (squash_lz4f_scan_frames (codec, compressed_size, compressed, squash_lz4f_add_frame_size, &total) != SQUASH_OK)
+    return 0;
+
+  return total;
+}
+
 SquashStatus
 squash_plugin_init_lz4f (SquashCodec* codec, SquashCodecImpl* impl) {
   const char* name = squash_codec_get_name (codec);
@@ -478,6 +892,10 @@ squash_plugin_init_lz4f (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->info = SQUASH_CODEC_INFO_CAN_FLUSH;
     impl->options = squash_lz4f_options;
     impl->get_max_compressed_size = squash_lz4f_get_max_compressed_size;
+    impl->get_uncompressed_size = squash_lz4f_get_uncompressed_size;
+    impl->scan_frames = squash_lz4f_scan_frames;
+    impl->decompress_buffer = squash_lz4f_decompress_buffer;
+    impl->compress_buffer_unsafe = squash_lz4f_compress_buffer_unsafe;
     impl->create_stream = squash_lz4f_create_stream;
     impl->process_stream = squash_lz4f_process_stream;
   } else {
@@ -39,14 +39,51 @@ typedef enum SquashLZMAType_e {
   SQUASH_LZMA_TYPE_LZMA2
 } SquashLZMAType;
 
+/* State for decompressing from a block in the middle of an xz
+   stream; see squash_lzma_create_stream_at. */
+typedef struct SquashLZMASeek_s {
+  uint64_t memlimit;
+  lzma_check check;
+
+  /* Blocks left in the current stream, and the size of the index and
+     footer which follow them. */
+  lzma_vli blocks_remaining;
+  lzma_vli skip;
+
+  bool in_block;
+  lzma_block block;
+  lzma_filter filters[LZMA_FILTERS_MAX + 1];
+  uint8_t header[LZMA_BLOCK_HEADER_SIZE_MAX];
+  size_t header_pos;
+} SquashLZMASeek;
+
 typedef struct SquashLZMAStream_s {
   SquashStream base_object;
 
   SquashLZMAType type;
   lzma_stream stream;
   lzma_allocator allocator;
+
+  /* The multi-threaded encoder can't do LZMA_SYNC_FLUSH. */
+  bool threaded;
+
+  SquashLZMASeek* seek;
 } SquashLZMAStream;
 
+/* lzma_stream_encoder_mt was stabilized in 5.2.0, and
+   lzma_stream_decoder_mt in 5.4.0. */
+#if LZMA_VERSION >= 50020002
+#  define SQUASH_LZMA_HAVE_ENCODER_MT
+#endif
+#if LZMA_VERSION >= 50040002
+#  define SQUASH_LZMA_HAVE_DECODER_MT
+#endif
+
+/* Each block in a multi-threaded stream costs a block header, check,
+   and index record on top of what lzma_stream_buffer_bound allows
+   for, so don't let them get too small. */
+#define SQUASH_LZMA_MIN_BLOCK_SIZE ((size_t) (1024 * 1024))
+
 enum SquashLZMAOptIndex {
   SQUASH_LZMA_OPT_LEVEL = 0,
   SQUASH_LZMA_OPT_DICT_SIZE,
@@ -56,6 +93,9 @@ enum SquashLZMAOptIndex {
   SQUASH_LZMA_OPT_MF,
   SQUASH_LZMA_OPT_MEM_LIMIT,
   SQUASH_LZMA_OPT_CHECK,
+  SQUASH_LZMA_OPT_THREADS,
+  SQUASH_LZMA_OPT_BLOCK_SIZE,
+  SQUASH_LZMA_OPT_MEM_LIMIT_THREADING
 };
 
 static SquashOptionInfo squash_lzma_options[] = {
@@ -212,6 +252,25 @@ static SquashOptionInfo squash_lzma_xz_options[] = {
         { "sha256", LZMA_CHECK_SHA256 },
         { NULL, 0 } } },
     .default_value.int_value = LZMA_CHECK_CRC64 },
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 16384 },
+    .default_value.int_value = 1 },
+  { "block-size",
+    SQUASH_OPTION_TYPE_RANGE_SIZE,
+    .info.range_size = {
+      .min = SQUASH_LZMA_MIN_BLOCK_SIZE,
+      .max = SIZE_MAX,
+      .allow_zero = true },
+    .default_value.size_value = 0 },
+  { "mem-limit-threading",
+    SQUASH_OPTION_TYPE_RANGE_SIZE,
+    .info.range_size = {
+      .min = 0,
+      .max = SIZE_MAX },
+    .default_value.size_value = 0 },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -273,11 +332,29 @@ squash_lzma_stream_init (SquashLZMAStream* stream,
 
   stream->stream = s;
   stream->type = type;
+  stream->threaded = false;
+  stream->seek = NULL;
+}
+
+static void
+squash_lzma_seek_free_filters (SquashLZMASeek* seek) {
+  for (size_t i = 0 ; seek->filters[i].id != LZMA_VLI_UNKNOWN ; i++) {
+    if (seek->filters[i].options != NULL)
+      squash_free (seek->filters[i].options);
+  }
+  seek->filters[0].id = LZMA_VLI_UNKNOWN;
 }
 
 static void
 squash_lzma_stream_destroy (void* stream) {
-  lzma_end (&((SquashLZMAStream*) stream)->stream);
+  SquashLZMAStream* s = (SquashLZMAStream*) stream;
+
+  if (s->seek != NULL) {
+    squash_lzma_seek_free_filters (s->seek);
+    squash_free (s->seek);
+  }
+
+  lzma_end (&(s->stream));
   squash_stream_destroy (stream);
 }
 
@@ -324,8 +401,31 @@ squash_lzma_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squash
   stream = (SquashLZMAStream*) squash_malloc (sizeof (SquashLZMAStream));
   squash_lzma_stream_init (stream, codec, lzma_type, stream_type, options, squash_lzma_stream_destroy);
 
+#if defined(SQUASH_LZMA_HAVE_ENCODER_MT)
+  uint32_t threads = 1;
+  if (lzma_type == SQUASH_LZMA_TYPE_XZ) {
+    threads = (uint32_t) squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_THREADS);
+    if (threads == 0)
+      threads = lzma_cputhreads ();
+    if (threads == 0)
+      threads = 1;
+  }
+#endif
+
   if (stream_type == SQUASH_STREAM_COMPRESS) {
     if (lzma_type == SQUASH_LZMA_TYPE_XZ) {
+#if defined(SQUASH_LZMA_HAVE_ENCODER_MT)
+      if (threads > 1) {
+        lzma_mt mt = { 0, };
+        mt.threads = threads;
+        mt.block_size = (uint64_t) squash_options_get_size_at (options, codec, SQUASH_LZMA_OPT_BLOCK_SIZE);
+        mt.filters = filters;
+        mt.check = (lzma_check) squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_CHECK);
+
+        lzma_e = lzma_stream_encoder_mt (&(stream->stream), &mt);
+        stream->threaded = true;
+      } else
+#endif
       lzma_e = lzma_stream_encoder (&(stream->stream), filters, (lzma_check) squash_options_get_int_at (options, codec, SQUASH_LZMA_OPT_CHECK));
     } else if (lzma_type == SQUASH_LZMA_TYPE_LZMA) {
       lzma_e = lzma_alone_encoder (&(stream->stream), filters[0].options);
@@ -338,7 +438,26 @@ squash_lzma_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squash
   } else if (stream_type == SQUASH_STREAM_DECOMPRESS) {
     if (lzma_type == SQUASH_LZMA_TYPE_XZ) {
       const uint64_t memlimit = squash_options_get_size_at (options, codec, SQUASH_LZMA_OPT_MEM_LIMIT);
-      lzma_e = lzma_stream_decoder(&(stream->stream), memlimit, 0);
+#if defined(SQUASH_LZMA_HAVE_DECODER_MT)
+      if (threads > 1) {
+        lzma_mt mt = { 0, };
+        mt.flags = LZMA_CONCATENATED;
+        mt.threads = threads;
+        mt.memlimit_stop = memlimit;
+        /* Like xz, use up to a quarter of the RAM for threads unless
+           told otherwise.  Past the limit liblzma decodes in a single
+           thread rather than failing. */
+        mt.memlimit_threading = (uint64_t) squash_options_get_size_at (options, codec, SQUASH_LZMA_OPT_MEM_LIMIT_THREADING);
+        if (mt.memlimit_threading == 0)
+          mt.memlimit_threading = lzma_physmem () / 4;
+        if (mt.memlimit_threading == 0 || mt.memlimit_threading > memlimit)
+          mt.memlimit_threading = memlimit;
+
+        lzma_e = lzma_stream_decoder_mt (&(stream->stream), &mt);
+        stream->threaded = true;
+      } else
+#endif
+      lzma_e = lzma_stream_decoder(&(stream->stream), memlimit, LZMA_CONCATENATED);
     } else if (lzma_type == SQUASH_LZMA_TYPE_LZMA) {
       const uint64_t memlimit = squash_options_get_size_at (options, codec, SQUASH_LZMA_OPT_MEM_LIMIT);
       lzma_e = lzma_alone_decoder(&(stream->stream), memlimit);
@@ -377,12 +496,17 @@ squash_lzma_create_stream (SquashCodec* codec, SquashStreamType stream_type, Squ
   stream->next_out = lzma_stream->next_out;                           \
   stream->avail_out = lzma_stream->avail_out
 
+static SquashStatus squash_lzma_process_seek (SquashLZMAStream* stream, SquashOperation operation);
+
 static SquashStatus
 squash_lzma_process_stream (SquashStream* stream, SquashOperation operation) {
   lzma_stream* s;
   lzma_ret lzma_e = LZMA_OK;
 
   assert (stream != NULL);
+  if (((SquashLZMAStream*) stream)->seek != NULL)
+    return squash_lzma_process_seek ((SquashLZMAStream*) stream, operation);
+
   s = &(((SquashLZMAStream*) stream)->stream);
 
   SQUASH_LZMA_STREAM_COPY_TO_LZMA_STREAM(stream, s);
@@ -391,7 +515,7 @@ squash_lzma_process_stream (SquashStream* stream, SquashOperation operation) {
       lzma_e = lzma_code (s, LZMA_RUN);
       break;
     case SQUASH_OPERATION_FLUSH:
-      lzma_e = lzma_code (s, LZMA_SYNC_FLUSH);
+      lzma_e = lzma_code (s, ((SquashLZMAStream*) stream)->threaded ? LZMA_FULL_FLUSH : LZMA_SYNC_FLUSH);
       break;
     case SQUASH_OPERATION_FINISH:
       lzma_e = lzma_code (s, LZMA_FINISH);
@@ -407,7 +531,8 @@ squash_lzma_process_stream (SquashStream* stream, SquashOperation operation) {
         return (stream->avail_in == 0) ? SQUASH_OK : SQUASH_PROCESSING;
         break;
       case SQUASH_OPERATION_FLUSH:
-        return SQUASH_OK;
+        /* Flushing is finished when liblzma returns LZMA_STREAM_END. */
+        return SQUASH_PROCESSING;
         break;
       case SQUASH_OPERATION_FINISH:
         return SQUASH_PROCESSING;
@@ -431,6 +556,9 @@ squash_lzma_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_siz
 
   switch (lzma_type) {
     case SQUASH_LZMA_TYPE_XZ:
+      return lzma_stream_buffer_bound (uncompressed_size) + (uncompressed_size / (256 * 1024)) +
+        ((uncompressed_size / SQUASH_LZMA_MIN_BLOCK_SIZE) * (LZMA_BLOCK_HEADER_SIZE_MAX + 64));
+      break;
     case SQUASH_LZMA_TYPE_LZMA2:
       return lzma_stream_buffer_bound (uncompressed_size) + (uncompressed_size / (256 * 1024));
       break;
@@ -443,6 +571,289 @@ squash_lzma_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_siz
   HEDLEY_UNREACHABLE ();
 }
 
+/* xz streams may be concatenated, with optional padding (a multiple
+   of four zero bytes) between them.  Each stream ends with an index
+   which records its size, so they are found by walking backwards
+   from the end of the buffer.  The indexes are combined into one
+   which covers the whole buffer. */
+static SquashStatus
+squash_lzma_decode_index (size_t compressed_size,
+                          const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                          lzma_index** index) {
+  lzma_index* combined = NULL;
+  size_t pos = compressed_size;
+  SquashStatus res = SQUASH_OK;
+
+  if (compressed_size == 0)
+    return SQUASH_INVALID_BUFFER;
+
+  while (pos > 0) {
+    lzma_stream_flags header_flags, footer_flags;
+    lzma_index* stream_index = NULL;
+    uint64_t memlimit = UINT64_MAX;
+    uint64_t stream_size;
+    size_t index_pos;
+    const size_t end = pos;
+
+    while (pos >= 4 && compressed[pos - 1] == 0 && compressed[pos - 2] == 0 && compressed[pos - 3] == 0 && compressed[pos - 4] == 0)
+      pos -= 4;
+
+    /* Padding is only allowed after a stream, not before the first. */
+    if (pos < (LZMA_STREAM_HEADER_SIZE * 2) ||
+        lzma_stream_footer_decode (&footer_flags, compressed + pos - LZMA_STREAM_HEADER_SIZE) != LZMA_OK ||
+        (pos - (LZMA_STREAM_HEADER_SIZE * 2)) < footer_flags.backward_size) {
+      res = SQUASH_INVALID_BUFFER;
+      break;
+    }
+
+    index_pos = pos - LZMA_STREAM_HEADER_SIZE - (size_t) footer_flags.backward_size;
+    if (lzma_index_buffer_decode (&stream_index, &memlimit, NULL, compressed, &index_pos, pos - LZMA_STREAM_HEADER_SIZE) != LZMA_OK) {
+      res = SQUASH_INVALID_BUFFER;
+      break;
+    }
+    stream_size = lzma_index_stream_size (stream_index);
+
+    if (stream_size > pos || lzma_index_uncompressed_size (stream_index) > SIZE_MAX ||
+        lzma_stream_header_decode (&header_flags, compressed + pos - stream_size) != LZMA_OK ||
+        lzma_stream_flags_compare (&header_flags, &footer_flags) != LZMA_OK) {
+      lzma_index_end (stream_index, NULL);
+      res = SQUASH_INVALID_BUFFER;
+      break;
+    }
+
+    if (lzma_index_stream_flags (stream_index, &footer_flags) != LZMA_OK ||
+        lzma_index_stream_padding (stream_index, end - pos) != LZMA_OK ||
+        (combined != NULL && lzma_index_cat (stream_index, combined, NULL) != LZMA_OK)) {
+      lzma_index_end (stream_index, NULL);
+      res = SQUASH_MEMORY;
+      break;
+    }
+    combined = stream_index;
+
+    pos -= (size_t) stream_size;
+  }
+
+  if (res == SQUASH_OK) {
+    *index = combined;
+  } else if (combined != NULL) {
+    lzma_index_end (combined, NULL);
+  }
+
+  return res;
+}
+
+static SquashStatus
+squash_lzma_scan_frames (SquashCodec* codec,
+                         size_t compressed_size,
+                         const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                         SquashFrameFunc func,
+                         void* user_data) {
+  lzma_index* index = NULL;
+  lzma_index_iter iter;
+
+  SquashStatus res = squash_lzma_decode_index (compressed_size, compressed, &index);
+  if (res != SQUASH_OK)
+    return res;
+
+  lzma_index_iter_init (&iter, index);
+  while (res == SQUASH_OK && !lzma_index_iter_next (&iter, LZMA_INDEX_ITER_STREAM)) {
+    const SquashFrame frame = {
+      (size_t) iter.stream.compressed_offset,
+      (size_t) iter.stream.compressed_size,
+      (size_t) iter.stream.uncompressed_size
+    };
+    res = func (&frame, user_data);
+  }
+
+  lzma_index_end (index, NULL);
+
+  return res;
+}
+
+/* The decoded index of a file, kept by SquashFile between seeks. */
+typedef struct SquashLZMAIndex_s {
+  SquashObject base_object;
+
+  lzma_index* index;
+} SquashLZMAIndex;
+
+static void
+squash_lzma_index_destroy (void* obj) {
+  SquashLZMAIndex* index = (SquashLZMAIndex*) obj;
+
+  lzma_index_end (index->index, NULL);
+
+  squash_object_destroy (obj);
+}
+
+/* Streams written by xz -T (or with the threads option) are made of
+   several blocks, and the index records where each one starts.  The
+   stream returned here begins with a block decoder for the one
+   containing the requested offset, then works its way through the
+   rest of the stream block by block. */
+static SquashStream*
+squash_lzma_create_stream_at (SquashCodec* codec,
+                              SquashOptions* options,
+                              size_t compressed_size,
+                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                              uint64_t uncompressed_offset,
+                              SquashObject** cached_index,
+                              size_t* restart_compressed_offset,
+                              uint64_t* restart_uncompressed_offset) {
+  SquashLZMAStream* stream = NULL;
+  lzma_index* index = NULL;
+  lzma_index_iter iter;
+  lzma_stream_flags footer_flags;
+
+  if (*cached_index == NULL) {
+    if (squash_lzma_decode_index (compressed_size, compressed, &index) != SQUASH_OK)
+      return NULL;
+
+    SquashLZMAIndex* obj = squash_malloc (sizeof (SquashLZMAIndex));
+    if (HEDLEY_UNLIKELY(obj == NULL)) {
+      lzma_index_end (index, NULL);
+      return NULL;
+    }
+    squash_object_init (obj, false, squash_lzma_index_destroy);
+    obj->index = index;
+    *cached_index = (SquashObject*) obj;
+  } else {
+    index = ((SquashLZMAIndex*) *cached_index)->index;
+  }
+
+  /* If the offset is past the end, start from the last block so the
+     caller finds out without decoding the whole buffer. */
+  lzma_index_iter_init (&iter, index);
+  if (lzma_index_iter_locate (&iter, uncompressed_offset)) {
+    const lzma_vli uncompressed_size = lzma_index_uncompressed_size (index);
+    if (uncompressed_size == 0 || lzma_index_iter_locate (&iter, uncompressed_size - 1))
+      return NULL;
+  }
+
+  const size_t stream_end = (size_t) (iter.stream.compressed_offset + iter.stream.compressed_size);
+  if (lzma_stream_footer_decode (&footer_flags, compressed + stream_end - LZMA_STREAM_HEADER_SIZE) != LZMA_OK)
+    return NULL;
+
+  SquashLZMASeek* seek = squash_malloc (sizeof (SquashLZMASeek));
+  if (HEDLEY_UNLIKELY(seek == NULL))
+    return NULL;
+
+  memset (seek, 0, sizeof (SquashLZMASeek));
+  seek->memlimit = squash_options_get_size_at (options, codec, SQUASH_LZMA_OPT_MEM_LIMIT);
+  seek->check = iter.stream.flags->check;
+  seek->blocks_remaining = iter.stream.block_count - iter.block.number_in_stream + 1;
+  seek->skip = footer_flags.backward_size + LZMA_STREAM_HEADER_SIZE;
+  seek->filters[0].id = LZMA_VLI_UNKNOWN;
+
+  stream = squash_lzma_stream_new (codec, SQUASH_STREAM_DECOMPRESS, options);
+  if (HEDLEY_UNLIKELY(stream == NULL)) {
+    squash_free (seek);
+    return NULL;
+  }
+
+  /* The block decoder is set up once its header has been read. */
+  lzma_end (&(stream->stream));
+  stream->threaded = false;
+  stream->seek = seek;
+
+  *restart_compressed_offset = (size_t) iter.block.compressed_file_offset;
+  *restart_uncompressed_offset = (uint64_t) iter.block.uncompressed_file_offset;
+
+  return (SquashStream*) stream;
+}
+
+static SquashStatus
+squash_lzma_process_seek (SquashLZMAStream* stream, SquashOperation operation) {
+  SquashStream* s = (SquashStream*) stream;
+  SquashLZMASeek* seek = stream->seek;
+  lzma_stream* ls = &(stream->stream);
+
+  assert (seek != NULL);
+
+  while (true) {
+    if (seek->in_block) {
+      SQUASH_LZMA_STREAM_COPY_TO_LZMA_STREAM(s, ls);
+      const lzma_ret lzma_e = lzma_code (ls, LZMA_RUN);
+      SQUASH_LZMA_STREAM_COPY_FROM_LZMA_STREAM(s, ls);
+
+      if (lzma_e == LZMA_STREAM_END) {
+        squash_lzma_seek_free_filters (seek);
+        seek->in_block = false;
+        seek->blocks_remaining--;
+        continue;
+      } else if (lzma_e != LZMA_OK && lzma_e != LZMA_BUF_ERROR) {
+        return SQUASH_FAILED;
+      } else if (s->avail_out == 0) {
+        return SQUASH_PROCESSING;
+      }
+    } else if (seek->blocks_remaining != 0) {
+      if (s->avail_in != 0) {
+        if (seek->header_pos == 0) {
+          /* A zero byte would be the index, which shouldn't be here
+             until all the blocks have been decoded. */
+          if (s->next_in[0] == 0x00)
+            return SQUASH_FAILED;
+          seek->block.header_size = lzma_block_header_size_decode (s->next_in[0]);
+        }
+
+        const size_t needed = seek->block.header_size - seek->header_pos;
+        const size_t cp = (needed < s->avail_in) ? needed : s->avail_in;
+        memcpy (seek->header + seek->header_pos, s->next_in, cp);
+        seek->header_pos += cp;
+        s->next_in += cp;
+        s->avail_in -= cp;
+
+        if (seek->header_pos == seek->block.header_size) {
+          seek->header_pos = 0;
+          seek->block.version = 0;
+          seek->block.check = seek->check;
+          seek->block.filters = seek->filters;
+
+          if (lzma_block_header_decode (&(seek->block), &(stream->allocator), seek->header) != LZMA_OK)
+            return SQUASH_FAILED;
+          if (lzma_block_decoder (ls, &(seek->block)) != LZMA_OK) {
+            squash_lzma_seek_free_filters (seek);
+            return SQUASH_FAILED;
+          }
+
+          seek->in_block = true;
+        }
+        continue;
+      }
+    } else if (seek->skip != 0) {
+      if (s->avail_in != 0) {
+        const size_t cp = (seek->skip < s->avail_in) ? (size_t) seek->skip : s->avail_in;
+        s->next_in += cp;
+        s->avail_in -= cp;
+        seek->skip -= cp;
+        continue;
+      }
+    } else {
+      /* Skip the stream padding, then decode any other streams with a
+         regular decoder. */
+      while (s->avail_in != 0 && s->next_in[0] == 0x00) {
+        s->next_in++;
+        s->avail_in--;
+      }
+
+      if (s->avail_in == 0)
+        return SQUASH_OK;
+
+      lzma_end (ls);
+      if (lzma_stream_decoder (ls, seek->memlimit, LZMA_CONCATENATED) != LZMA_OK)
+        return SQUASH_FAILED;
+
+      squash_free (seek);
+      stream->seek = NULL;
+
+      return squash_lzma_process_stream (s, operation);
+    }
+
+    /* Out of input in the middle of the stream. */
+    return (operation == SQUASH_OPERATION_FINISH) ? SQUASH_FAILED : SQUASH_OK;
+  }
+}
+
 SquashStatus
 squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   impl->options = squash_lzma_options;
@@ -451,6 +862,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     case SQUASH_LZMA_TYPE_XZ:
       impl->info = SQUASH_CODEC_INFO_CAN_FLUSH;
       impl->options = squash_lzma_xz_options;
+      impl->scan_frames = squash_lzma_scan_frames;
+      impl->create_stream_at = squash_lzma_create_stream_at;
       break;
     case SQUASH_LZMA_TYPE_LZMA2:
       impl->info = SQUASH_CODEC_INFO_CAN_FLUSH;
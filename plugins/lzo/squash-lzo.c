@@ -54,6 +54,10 @@ typedef struct _SquashLZOCodec {
   int(* decompress) (const lzo_bytep src, lzo_uint src_len,
                      lzo_bytep dst, lzo_uintp dst_len,
                      lzo_voidp wrkmem);
+  /* Decoder without bounds checks, for trusted input */
+  int(* decompress_unsafe) (const lzo_bytep src, lzo_uint src_len,
+                            lzo_bytep dst, lzo_uintp dst_len,
+                            lzo_voidp wrkmem);
   const SquashLZOCompressor* compressors;
 } SquashLZOCodec;
 
@@ -202,14 +206,14 @@ static SquashOptionInfo squash_lzo1z_options[] = {
 };
 
 static const SquashLZOCodec squash_lzo_codecs[] = {
-  { "lzo1", LZO1_MEM_DECOMPRESS, lzo1_decompress, squash_lzo1_compressors },
-  { "lzo1a", LZO1A_MEM_DECOMPRESS, lzo1a_decompress, squash_lzo1a_compressors },
-  { "lzo1b", LZO1B_MEM_DECOMPRESS, lzo1b_decompress_safe, squash_lzo1b_compressors },
-  { "lzo1c", LZO1C_MEM_DECOMPRESS, lzo1c_decompress_safe, squash_lzo1c_compressors },
-  { "lzo1f", LZO1F_MEM_DECOMPRESS, lzo1f_decompress_safe, squash_lzo1f_compressors },
-  { "lzo1x", LZO1X_MEM_DECOMPRESS, lzo1x_decompress_safe, squash_lzo1x_compressors },
-  { "lzo1y", LZO1Y_MEM_DECOMPRESS, lzo1y_decompress_safe, squash_lzo1y_compressors },
-  { "lzo1z", LZO1Z_MEM_DECOMPRESS, lzo1z_decompress_safe, squash_lzo1z_compressors },
+  { "lzo1", LZO1_MEM_DECOMPRESS, lzo1_decompress, NULL, squash_lzo1_compressors },
+  { "lzo1a", LZO1A_MEM_DECOMPRESS, lzo1a_decompress, NULL, squash_lzo1a_compressors },
+  { "lzo1b", LZO1B_MEM_DECOMPRESS, lzo1b_decompress_safe, lzo1b_decompress, squash_lzo1b_compressors },
+  { "lzo1c", LZO1C_MEM_DECOMPRESS, lzo1c_decompress_safe, lzo1c_decompress, squash_lzo1c_compressors },
+  { "lzo1f", LZO1F_MEM_DECOMPRESS, lzo1f_decompress_safe, lzo1f_decompress, squash_lzo1f_compressors },
+  { "lzo1x", LZO1X_MEM_DECOMPRESS, lzo1x_decompress_safe, lzo1x_decompress, squash_lzo1x_compressors },
+  { "lzo1y", LZO1Y_MEM_DECOMPRESS, lzo1y_decompress_safe, lzo1y_decompress, squash_lzo1y_compressors },
+  { "lzo1z", LZO1Z_MEM_DECOMPRESS, lzo1z_decompress_safe, lzo1z_decompress, squash_lzo1z_compressors },
   { NULL, }
 };
 
@@ -286,12 +290,12 @@ squash_lzo_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size
 }
 
 static SquashStatus
-squash_lzo_decompress_buffer (SquashCodec* codec,
-                              size_t* decompressed_size,
-                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
-                              size_t compressed_size,
-                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
-                              SquashOptions* options) {
+squash_lzo_decompress_buffer_ex (SquashCodec* codec,
+                                 size_t* decompressed_size,
+                                 uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                 size_t compressed_size,
+                                 const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                 bool trusted) {
   const SquashLZOCodec* lzo_codec;
   const char* codec_name;
   int lzo_e;
@@ -318,9 +322,9 @@ squash_lzo_decompress_buffer (SquashCodec* codec,
     }
   }
 
-  lzo_e = lzo_codec->decompress (compressed, compressed_len,
-                                 decompressed, &decompressed_len,
-                                 work_mem);
+  lzo_e = (trusted ? lzo_codec->decompress_unsafe : lzo_codec->decompress) (compressed, compressed_len,
+                                                                           decompressed, &decompressed_len,
+                                                                           work_mem);
   squash_free (work_mem);
 
   if (lzo_e != LZO_E_OK)
@@ -336,6 +340,26 @@ squash_lzo_decompress_buffer (SquashCodec* codec,
   return SQUASH_OK;
 }
 
+static SquashStatus
+squash_lzo_decompress_buffer (SquashCodec* codec,
+                              size_t* decompressed_size,
+                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                              size_t compressed_size,
+                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                              SquashOptions* options) {
+  return squash_lzo_decompress_buffer_ex (codec, decompressed_size, decompressed, compressed_size, compressed, false);
+}
+
+static SquashStatus
+squash_lzo_decompress_buffer_unsafe (SquashCodec* codec,
+                                     size_t* decompressed_size,
+                                     uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                     size_t compressed_size,
+                                     const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                     SquashOptions* options) {
+  return squash_lzo_decompress_buffer_ex (codec, decompressed_size, decompressed, compressed_size, compressed, true);
+}
+
 static SquashStatus
 squash_lzo_compress_buffer (SquashCodec* codec,
                             size_t* compressed_size,
@@ -436,6 +460,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   impl->get_max_compressed_size = squash_lzo_get_max_compressed_size;
   impl->decompress_buffer = squash_lzo_decompress_buffer;
   impl->compress_buffer_unsafe = squash_lzo_compress_buffer;
+  if (squash_lzo_codec_from_name (codec_name)->decompress_unsafe != NULL)
+    impl->decompress_buffer_unsafe = squash_lzo_decompress_buffer_unsafe;
 
   return SQUASH_OK;
 }
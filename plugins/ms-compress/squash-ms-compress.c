@@ -40,6 +40,30 @@ typedef struct SquashMSCompStream_s {
   mscomp_stream mscomp;
 } SquashMSCompStream;
 
+enum SquashMSOptIndex {
+  SQUASH_MS_OPT_THREADS = 0
+};
+
+static SquashOptionInfo squash_ms_lznt1_options[] = {
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 0 },
+  { NULL, SQUASH_OPTION_TYPE_NONE, }
+};
+
+/* LZNT1 data is a sequence of chunks, each holding up to 4 KiB of
+   input behind a two byte header.  Matches never cross a chunk, so
+   runs of chunks can be compressed and decompressed separately. */
+#define SQUASH_MS_LZNT1_CHUNK_SIZE ((size_t) 4096)
+
+/* Amount of uncompressed data handled by each task, and the smallest
+   buffer (compressed, when decompressing) worth splitting up. */
+#define SQUASH_MS_TASK_SIZE (SQUASH_MS_LZNT1_CHUNK_SIZE * 64)
+#define SQUASH_MS_PARALLEL_MIN_SIZE ((size_t) (512 * 1024))
+
 SQUASH_PLUGIN_EXPORT
 SquashStatus                squash_plugin_init_codec  (SquashCodec* codec, SquashCodecImpl* impl);
 
@@ -248,6 +272,127 @@ squash_ms_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size)
   return ms_max_compressed_size (squash_ms_format_from_codec (codec), uncompressed_size);
 }
 
+static unsigned int
+squash_ms_get_threads (SquashCodec* codec, SquashOptions* options, size_t size) {
+  if (squash_ms_format_from_codec (codec) != MSCOMP_LZNT1 || size < SQUASH_MS_PARALLEL_MIN_SIZE)
+    return 1;
+
+  return (unsigned int) squash_options_get_int_at (options, codec, SQUASH_MS_OPT_THREADS);
+}
+
+/* Length of the first @a n_chunks LZNT1 chunks in @a data, or 0 if
+   they don't fit or the end marker comes first. */
+static size_t
+squash_ms_lznt1_chunks_length (size_t size, const uint8_t data[HEDLEY_ARRAY_PARAM(size)], size_t n_chunks) {
+  size_t pos = 0;
+
+  while (n_chunks-- > 0) {
+    if (size - pos < 2)
+      return 0;
+
+    const uint16_t header = (uint16_t) (data[pos] | (data[pos + 1] << 8));
+    if (header == 0)
+      return 0;
+
+    pos += (size_t) (header & 0x0fff) + 3;
+    if (pos > size)
+      return 0;
+  }
+
+  return pos;
+}
+
+typedef struct SquashMSCompressData_s {
+  size_t uncompressed_size;
+  const uint8_t* uncompressed;
+  uint8_t** outputs;
+  size_t* output_sizes;
+} SquashMSCompressData;
+
+static SquashStatus
+squash_ms_compress_task (size_t task, void* user_data) {
+  SquashMSCompressData* data = (SquashMSCompressData*) user_data;
+  const size_t offset = task * SQUASH_MS_TASK_SIZE;
+  const size_t remaining = data->uncompressed_size - offset;
+  const size_t size = (remaining < SQUASH_MS_TASK_SIZE) ? remaining : SQUASH_MS_TASK_SIZE;
+
+  data->output_sizes[task] = ms_max_compressed_size (MSCOMP_LZNT1, size);
+  data->outputs[task] = squash_malloc (data->output_sizes[task]);
+  if (HEDLEY_UNLIKELY(data->outputs[task] == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  const MSCompStatus status = ms_compress (MSCOMP_LZNT1, data->uncompressed + offset, size,
+                                           data->outputs[task], &(data->output_sizes[task]));
+  if (HEDLEY_UNLIKELY(status != MSCOMP_OK))
+    return squash_ms_status_to_squash_status (status);
+
+  /* Anything after the chunks (like an end marker) only belongs at
+     the end of the whole buffer. */
+  if (task != (data->uncompressed_size - 1) / SQUASH_MS_TASK_SIZE) {
+    data->output_sizes[task] =
+      squash_ms_lznt1_chunks_length (data->output_sizes[task], data->outputs[task], SQUASH_MS_TASK_SIZE / SQUASH_MS_LZNT1_CHUNK_SIZE);
+    if (HEDLEY_UNLIKELY(data->output_sizes[task] == 0))
+      return SQUASH_FAILED;
+  }
+
+  return SQUASH_OK;
+}
+
+/* Compress runs of chunks on separate threads and join them.  Since
+   each chunk is encoded on its own, the result is the same as
+   compressing the whole buffer at once.  Returns false if the
+   pieces couldn't be joined, in which case the caller should
+   compress serially. */
+static bool
+squash_ms_compress_parallel (unsigned int threads,
+                             size_t* compressed_size,
+                             uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                             size_t uncompressed_size,
+                             const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                             SquashStatus* res) {
+  const size_t n_tasks = (uncompressed_size / SQUASH_MS_TASK_SIZE) + ((uncompressed_size % SQUASH_MS_TASK_SIZE) != 0);
+  SquashMSCompressData data = {
+    uncompressed_size,
+    uncompressed,
+    squash_calloc (n_tasks, sizeof (uint8_t*)),
+    squash_calloc (n_tasks, sizeof (size_t))
+  };
+  bool handled = false;
+
+  if (HEDLEY_LIKELY(data.outputs != NULL && data.output_sizes != NULL) &&
+      squash_parallel_run (n_tasks, threads, squash_ms_compress_task, &data) == SQUASH_OK) {
+    size_t pos = 0;
+
+    handled = true;
+    *res = SQUASH_OK;
+
+    for (size_t task = 0 ; task < n_tasks ; task++) {
+      if (HEDLEY_UNLIKELY(*compressed_size - pos < data.output_sizes[task])) {
+        *res = squash_error (SQUASH_BUFFER_FULL);
+        break;
+      }
+
+      memcpy (compressed + pos, data.outputs[task], data.output_sizes[task]);
+      pos += data.output_sizes[task];
+    }
+
+    if (HEDLEY_LIKELY(*res == SQUASH_OK))
+      *compressed_size = pos;
+  }
+
+  if (data.outputs != NULL) {
+    for (size_t task = 0 ; task < n_tasks ; task++) {
+      if (data.outputs[task] != NULL)
+        squash_free (data.outputs[task]);
+    }
+    squash_free (data.outputs);
+  }
+  if (data.output_sizes != NULL)
+    squash_free (data.output_sizes);
+
+  return handled;
+}
+
 static SquashStatus
 squash_ms_compress_buffer (SquashCodec* codec,
                            size_t* compressed_size,
@@ -255,11 +400,101 @@ squash_ms_compress_buffer (SquashCodec* codec,
                            size_t uncompressed_size,
                            const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
                            SquashOptions* options) {
+  const unsigned int threads = squash_ms_get_threads (codec, options, uncompressed_size);
+  SquashStatus res;
+
+  if (threads != 1 &&
+      squash_ms_compress_parallel (threads, compressed_size, compressed, uncompressed_size, uncompressed, &res))
+    return res;
+
   MSCompStatus status = ms_compress (squash_ms_format_from_codec (codec),
                                      uncompressed, uncompressed_size, compressed, compressed_size);
   return squash_ms_status_to_squash_status (status);
 }
 
+typedef struct SquashMSDecompressTask_s {
+  const uint8_t* compressed;
+  size_t compressed_size;
+  uint8_t* decompressed;
+  size_t decompressed_size;
+} SquashMSDecompressTask;
+
+static SquashStatus
+squash_ms_decompress_task (size_t task, void* user_data) {
+  SquashMSDecompressTask* t = ((SquashMSDecompressTask*) user_data) + task;
+
+  const MSCompStatus status = ms_decompress (MSCOMP_LZNT1, t->compressed, t->compressed_size,
+                                             t->decompressed, &(t->decompressed_size));
+
+  return squash_ms_status_to_squash_status (status);
+}
+
+/* Walk the chunk headers to cut the input into runs of chunks which
+   each decode to exactly SQUASH_MS_TASK_SIZE bytes (except the last,
+   which also gets whatever follows the chunks), and decode those
+   runs into place concurrently.  If the input is damaged, too short,
+   or contains chunks which don't decode to a full 4 KiB, false is
+   returned and the caller should decompress serially, which also
+   takes care of reporting errors. */
+static bool
+squash_ms_decompress_parallel (unsigned int threads,
+                               size_t* decompressed_size,
+                               uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                               size_t compressed_size,
+                               const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]) {
+  const size_t chunks_per_task = SQUASH_MS_TASK_SIZE / SQUASH_MS_LZNT1_CHUNK_SIZE;
+  SquashMSDecompressTask* tasks = NULL;
+  size_t n_tasks = 0, allocated = 0, pos = 0;
+  bool handled = false;
+
+  while (pos < compressed_size) {
+    const size_t out_pos = n_tasks * SQUASH_MS_TASK_SIZE;
+    if (out_pos >= *decompressed_size)
+      goto cleanup;
+
+    if (n_tasks == allocated) {
+      allocated = (allocated == 0) ? 64 : allocated * 2;
+      SquashMSDecompressTask* tmp = squash_realloc (tasks, allocated * sizeof (SquashMSDecompressTask));
+      if (HEDLEY_UNLIKELY(tmp == NULL))
+        goto cleanup;
+      tasks = tmp;
+    }
+
+    size_t length = squash_ms_lznt1_chunks_length (compressed_size - pos, compressed + pos, chunks_per_task);
+    if (length == 0 || length == compressed_size - pos)
+      length = compressed_size - pos;
+
+    tasks[n_tasks].compressed = compressed + pos;
+    tasks[n_tasks].compressed_size = length;
+    tasks[n_tasks].decompressed = decompressed + out_pos;
+    tasks[n_tasks].decompressed_size = *decompressed_size - out_pos;
+    if (pos + length != compressed_size && tasks[n_tasks].decompressed_size > SQUASH_MS_TASK_SIZE)
+      tasks[n_tasks].decompressed_size = SQUASH_MS_TASK_SIZE;
+
+    n_tasks++;
+    pos += length;
+  }
+
+  if (n_tasks < 2 ||
+      squash_parallel_run (n_tasks, threads, squash_ms_decompress_task, tasks) != SQUASH_OK)
+    goto cleanup;
+
+  for (size_t task = 0 ; task < n_tasks - 1 ; task++) {
+    if (tasks[task].decompressed_size != SQUASH_MS_TASK_SIZE)
+      goto cleanup;
+  }
+
+  *decompressed_size = ((n_tasks - 1) * SQUASH_MS_TASK_SIZE) + tasks[n_tasks - 1].decompressed_size;
+  handled = true;
+
+ cleanup:
+
+  if (tasks != NULL)
+    squash_free (tasks);
+
+  return handled;
+}
+
 static SquashStatus
 squash_ms_decompress_buffer (SquashCodec* codec,
                              size_t* decompressed_size,
@@ -267,6 +502,12 @@ squash_ms_decompress_buffer (SquashCodec* codec,
                              size_t compressed_size,
                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
                              SquashOptions* options) {
+  const unsigned int threads = squash_ms_get_threads (codec, options, compressed_size);
+
+  if (threads != 1 &&
+      squash_ms_decompress_parallel (threads, decompressed_size, decompressed, compressed_size, compressed))
+    return SQUASH_OK;
+
   MSCompStatus status = ms_decompress (squash_ms_format_from_codec (codec),
                                        compressed, compressed_size, decompressed, decompressed_size);
   return squash_ms_status_to_squash_status (status);
@@ -284,6 +525,7 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->compress_buffer         = squash_ms_compress_buffer;
     if (strcmp ("lznt1", name) == 0) {
       impl->info                    = SQUASH_CODEC_INFO_CAN_FLUSH;
+      impl->options                 = squash_ms_lznt1_options;
       impl->create_stream           = squash_ms_create_stream;
       impl->process_stream          = squash_ms_process_stream;
     }
@@ -1,27 +1,14 @@
 /* Based on ncompress.  Hacked to use buffers instead of file
-   descriptors, and not use global variables.
+   descriptors, and not use global variables.  Both directions work
+   incrementally on caller-supplied buffers.
  */
 
-#include <sys/types.h>
 #include <string.h>
 
-#include <stdio.h>
 #include <assert.h>
 
 #include "compress.h"
 
-/* Default buffer sizes */
-#ifndef BUFSIZ
-#define BUFSIZ 8192
-#endif
-
-#ifndef	IBUFSIZ
-# define IBUFSIZ BUFSIZ
-#endif
-#ifndef	OBUFSIZ
-# define OBUFSIZ BUFSIZ
-#endif
-
 /* Defines for first few bytes of header */
 #define	MAGIC_1		(char_type)'\037'/* First byte of compressed file				*/
 #define	MAGIC_2		(char_type)'\235'/* Second byte of compressed file				*/
@@ -39,144 +26,25 @@
 
 #define INIT_BITS 9			/* initial number of bits/code */
 
-#if defined(_WIN32)
-#  define BYTEORDER 4321
-#elif defined(sun) || defined(__sun)
-#  include <sys/byteorder.h>
-#  if defined(_BIG_ENDIAN)
-#    define BYTEORDER 1234
-#  else
-#    define BYTEORDER 4321
-#  endif
-#elif defined(__APPLE__)
-#  include <libkern/OSByteOrder.h>
-#  if defined(__BIG_ENDIAN__)
-#    define BYTEORDER 1234
-#  else
-#    define BYTEORDER 4321
-#  endif
-#else
-#  if defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__bsdi__) || defined(__DragonFly__)
-#    include <sys/endian.h>
-#  else
-#    include <endian.h>
-#  endif
-#  if defined(BYTE_ORDER) && defined(BIG_ENDIAN) && (BYTE_ORDER == BIG_ENDIAN)
-#    define BYTEORDER 1234
-#  else
-#    define BYTEORDER 4321
-#  endif
-#endif
-
-#ifndef	NOALLIGN
-# define NOALLIGN 0
-#endif
-
-/* System has no binary mode */
-#ifndef	O_BINARY
-# define O_BINARY 0
-#endif
-
 /* Modern machines should work fine with FAST */
 #define FAST
 
-#ifdef FAST
-#	define	HBITS		17			/* 50% occupancy */
-#	define	HSIZE	   (1<<HBITS)
-#	define	HMASK	   (HSIZE-1)
-#	define	HPRIME		 9941
-#	define	BITS		   16
-#else
-#	if BITS == 16
-#		define HSIZE	69001		/* 95% occupancy */
-#	endif
-#	if BITS == 15
-#		define HSIZE	35023		/* 94% occupancy */
-#	endif
-#	if BITS == 14
-#		define HSIZE	18013		/* 91% occupancy */
-#	endif
-#	if BITS == 13
-#		define HSIZE	9001		/* 91% occupancy */
-#	endif
-#	if BITS <= 12
-#		define HSIZE	5003		/* 80% occupancy */
-#	endif
-#endif
+#define	HBITS		17			/* 50% occupancy */
+#define	HSIZE	   (1<<HBITS)
+#define	HMASK	   (HSIZE-1)
+#define	BITS		   16
 
 #define CHECK_GAP 10000
 
-typedef long int      code_int;
-typedef long int      count_int;
-typedef long int      cmp_code_int;
-typedef unsigned char char_type;
+/* The encoder's internal output buffer is drained when it has less
+   than this much room left, which is enough for a CLEAR code and a
+   code, each followed by a full group of padding. */
+#define OBUF_SLACK 64
 
-#define ARGVAL() (*++(*argv) || (--argc && *++argv))
+typedef unsigned char char_type;
 
 #define MAXCODE(n)	(1L << (n))
 
-union bytes {
-	long word;
-	struct {
-#if BYTEORDER == 4321
-		char_type b1;
-		char_type b2;
-		char_type b3;
-		char_type b4;
-#elif BYTEORDER == 1234
-		char_type b4;
-		char_type b3;
-		char_type b2;
-		char_type b1;
-#else
-		int dummy;
-#endif
-	} bytes;
-};
-#if BYTEORDER == 4321 && NOALLIGN == 1
-# define	output(b,o,c,n)	{													\
-							*(long *)&((b)[(o)>>3]) |= ((long)(c))<<((o)&0x7);\
-							(o) += (n);										\
-						}
-#elif BYTEORDER == 1234
-# define	output(b,o,c,n)	{	char_type	*p = &(b)[(o)>>3];				\
-							union bytes i;									\
-							i.word = ((long)(c))<<((o)&0x7);				\
-							p[0] |= i.bytes.b1;								\
-							p[1] |= i.bytes.b2;								\
-							p[2] |= i.bytes.b3;								\
-							(o) += (n);										\
-						}
-#else
-# define	output(b,o,c,n)	{	char_type	*p = &(b)[(o)>>3];				\
-							long		 i = ((long)(c))<<((o)&0x7);	\
-							p[0] |= (char_type)(i);							\
-							p[1] |= (char_type)(i>>8);						\
-							p[2] |= (char_type)(i>>16);						\
-							(o) += (n);										\
-						}
-#endif
-#if BYTEORDER == 4321 && NOALLIGN == 1
-# define	input(b,o,c,n,m){													\
-							(c) = (*(long *)(&(b)[(o)>>3])>>((o)&0x7))&(m);	\
-							(o) += (n);										\
-						}
-#else
-# define	input(b,o,c,n,m){	char_type 		*p = &(b)[(o)>>3];			\
-							(c) = ((((long)(p[0]))|((long)(p[1])<<8)|		\
-									 ((long)(p[2])<<16))>>((o)&0x7))&(m);	\
-							(o) += (n);										\
-						}
-#endif
-
-#define	htabof(i)				htab[i]
-#define	codetabof(i)			codetab[i]
-#define	tab_prefixof(i)			codetabof(i)
-#define	tab_suffixof(i)			((char_type *)(htab))[i]
-#define	de_stack				((char_type *)&(htab[HSIZE-1]))
-#define	clear_htab()			memset(htab, -1, sizeof(htab))
-#define	clear_tab_prefixof()	memset(codetab, 0, 256);
-
 #ifdef FAST
 static const int primetab[256] =		/* Special secondary hash table.		*/
 {
@@ -216,7 +84,7 @@ static const int primetab[256] =		/* Special secondary hash table.		*/
 #endif
 
 /*
- * compress fdin to fdout
+ * compress
  *
  * Algorithm:  use open addressing double hashing (no chaining) on the
  * prefix code / next character combination.  We do a variant of Knuth's
@@ -226,461 +94,529 @@ static const int primetab[256] =		/* Special secondary hash table.		*/
  * an adaptive reset, whereby the code table is cleared when the compression
  * ratio decreases, but after the table fills.  The variable-length output
  * codes are re-sized at this point, and a special CLEAR code is generated
- * for the decompressor.  Late addition:  construct the table according to
- * file size for noticeable speed improvement on small files.  Please direct
- * questions about this implementation to ames!jaw.
+ * for the decompressor.  Please direct questions about this
+ * implementation to ames!jaw.
+ *
+ * Codes are written in groups of eight; when the code size changes the
+ * rest of the current group is padded out.  The original checks for a
+ * size change or a drop in the compression ratio only before reading
+ * more input, never after the last byte, and the checks here are
+ * deferred the same way so the output is identical.
  */
-enum CompressStatus compress (uint8_t* compressed, size_t* compressed_length, const uint8_t* uncompressed, size_t uncompressed_length) {
-	long hp;
-	size_t rpos;
-	size_t outbits;
-	size_t rlop;
-	int stcode;
-	code_int free_ent;
-	int boff;
-	int n_bits;
-	int ratio;
-	long checkpoint;
-	code_int extcode;
-	union {
-		long code;
-		struct {
-			char_type c;
-			unsigned short ent;
-		} e;
-	} fcode;
-  long bytes_in = 0;
-  size_t bytes_out = 0;
-  int maxbits = BITS;
-  int block_mode = BLOCK_MODE;
-  char_type outbuf[OBUFSIZ+2048];
-  count_int htab[HSIZE] = { 0, };
-  unsigned short codetab[HSIZE];
-
-	ratio = 0;
-	checkpoint = CHECK_GAP;
-	extcode = MAXCODE(n_bits = INIT_BITS)+1;
-	stcode = 1;
-	free_ent = FIRST;
-
-	memset(outbuf, 0, sizeof(outbuf));
-	bytes_out = 0;
-  bytes_in = 0;
-	outbuf[0] = MAGIC_1;
-	outbuf[1] = MAGIC_2;
-	outbuf[2] = (char)(maxbits | block_mode);
-	boff = outbits = (3<<3);
-	fcode.code = 0;
-
-	clear_htab();
-
-  /* while ((rsize = reader(inbuf, IBUFSIZ, user_data)) > 0) { */
-  /*   fprintf (stderr, "bytes in: %zu\n", bytes_in); */
-		if (bytes_in == 0) {
-			fcode.e.ent = uncompressed[0];
-			rpos = 1;
-		} else
-			rpos = 0;
-
-		rlop = 0;
-
-		do {
-			if (free_ent >= extcode && fcode.e.ent < FIRST) {
-				if (n_bits < maxbits) {
-					boff = outbits = (outbits-1)+((n_bits<<3)-
-					                 ((outbits-boff-1+(n_bits<<3))%(n_bits<<3)));
-					if (++n_bits < maxbits)
-						extcode = MAXCODE(n_bits)+1;
-					else
-						extcode = MAXCODE(n_bits);
-				} else {
-					extcode = MAXCODE(16)+OBUFSIZ;
-					stcode = 0;
-				}
-			}
-
-			if (!stcode && bytes_in >= checkpoint && fcode.e.ent < FIRST) {
-				long int rat;
-
-				checkpoint = bytes_in + CHECK_GAP;
-
-				if (bytes_in > 0x007fffff) {
-					/* shift will overflow */
-					rat = (bytes_out+(outbits>>3)) >> 8;
-
-					/* Don't divide by zero */
-					if (rat == 0)
-						rat = 0x7fffffff;
-					else
-						rat = bytes_in / rat;
-				} else
-					/* 8 fractional bits */
-					rat = (bytes_in << 8) / (bytes_out+(outbits>>3));
-				if (rat >= ratio)
-					ratio = (int)rat;
-				else {
-					ratio = 0;
-					clear_htab();
-					output(outbuf, outbits, CLEAR, n_bits);
-					boff = outbits = (outbits-1)+((n_bits<<3)-
-					                 ((outbits-boff-1+(n_bits<<3))%(n_bits<<3)));
-					extcode = MAXCODE(n_bits = INIT_BITS)+1;
-					free_ent = FIRST;
-					stcode = 1;
-				}
-			}
-
-			if (outbits >= (OBUFSIZ<<3)) {
-        if (OBUFSIZ + bytes_out <= *compressed_length) {
-          memcpy(compressed + bytes_out, outbuf, OBUFSIZ);
-        } else {
-          return COMPRESS_WRITE_ERROR;
-        }
-
-				outbits -= (OBUFSIZ<<3);
-				boff = -(((OBUFSIZ<<3)-boff)%(n_bits<<3));
-				bytes_out += OBUFSIZ;
 
-				memcpy(outbuf, outbuf+OBUFSIZ, (outbits>>3)+1);
-				memset(outbuf+(outbits>>3)+1, '\0', OBUFSIZ);
-			}
-
-			{
-				int i = uncompressed_length-rlop;
+static void put_code(CompressStream* s, long code, int n)
+{
+	s->bit_buf |= (uint64_t)code << s->bit_count;
+	s->bit_count += n;
+	s->u.enc.outbits += n;
+	while (s->bit_count >= 8) {
+		s->u.enc.obuf[s->u.enc.obuf_len++] = (uint8_t)s->bit_buf;
+		s->bit_buf >>= 8;
+		s->bit_count -= 8;
+	}
+}
 
-				if ((code_int)i > extcode-free_ent)
-					i = (int)(extcode-free_ent);
+/* Skip to the end of the current group of codes. */
+static void pad_group(CompressStream* s)
+{
+	const uint64_t group = (uint64_t)s->n_bits << 3;
+	uint64_t pad = (group - ((s->u.enc.outbits - s->u.enc.boff) % group)) % group;
 
-				if ((size_t)i > ((sizeof(outbuf) - 32)*8 - outbits)/n_bits)
-					i = ((sizeof(outbuf) - 32)*8 - outbits)/n_bits;
+	while (pad > 0) {
+		const int n = pad > 32 ? 32 : (int)pad;
+		put_code(s, 0, n);
+		pad -= n;
+	}
+	s->u.enc.boff = s->u.enc.outbits;
+}
 
-				if (!stcode && (long)i > checkpoint-bytes_in)
-					i = (int)(checkpoint-bytes_in);
+void compress_stream_init(CompressStream* s)
+{
+	s->finished = 0;
+	s->bit_buf = 0;
+	s->bit_count = 0;
+	s->maxbits = BITS;
+	s->n_bits = INIT_BITS;
+	s->free_ent = FIRST;
+
+	s->u.enc.obuf[0] = MAGIC_1;
+	s->u.enc.obuf[1] = MAGIC_2;
+	s->u.enc.obuf[2] = (char_type)(s->maxbits | BLOCK_MODE);
+	s->u.enc.obuf_pos = 0;
+	s->u.enc.obuf_len = 3;
+
+	s->u.enc.have_ent = 0;
+	s->u.enc.ent = 0;
+	s->u.enc.check_pending = 0;
+	s->u.enc.stcode = 1;
+	s->u.enc.extcode = MAXCODE(INIT_BITS)+1;
+	s->u.enc.ratio = 0;
+	s->u.enc.checkpoint = CHECK_GAP;
+	s->u.enc.bytes_in = 0;
+	s->u.enc.outbits = s->u.enc.boff = 3<<3;
+
+	memset(s->u.enc.htab, -1, sizeof(s->u.enc.htab));
+}
 
-				rlop += i;
-				bytes_in += i;
-			}
+/* Grow the codes once the table reaches the current size, and clear
+   the table if the compression ratio has started to drop after it has
+   filled. */
+static void compress_check(CompressStream* s)
+{
+	if (s->free_ent >= s->u.enc.extcode) {
+		if (s->n_bits < s->maxbits) {
+			pad_group(s);
+			if (++s->n_bits < s->maxbits)
+				s->u.enc.extcode = MAXCODE(s->n_bits)+1;
+			else
+				s->u.enc.extcode = MAXCODE(s->n_bits);
+		} else {
+			s->u.enc.extcode = MAXCODE(16)+COMPRESS_OBUF_SIZE;
+			s->u.enc.stcode = 0;
+		}
+	}
 
-			goto next;
-hfound:		fcode.e.ent = codetabof(hp);
-next:		if (rpos >= rlop)
-				goto endlop;
-next2:		fcode.e.c = uncompressed[rpos++];
+	if (!s->u.enc.stcode && s->u.enc.bytes_in >= s->u.enc.checkpoint) {
+		const uint64_t bytes_in = s->u.enc.bytes_in;
+		const uint64_t bytes_out = s->u.enc.outbits >> 3;
+		long rat;
 
-#ifndef FAST
-			{
-				code_int	i;
-				hp = (((long)(fcode.e.c)) << (BITS-8)) ^ (long)(fcode.e.ent);
+		s->u.enc.checkpoint = bytes_in + CHECK_GAP;
 
-				if ((i = htabof(hp)) == fcode.code)
-					goto hfound;
+		if (bytes_in > 0x007fffff) {
+			/* shift will overflow */
+			rat = (long)(bytes_out >> 8);
 
-				if (i != -1) {
-					long disp;
+			/* Don't divide by zero */
+			if (rat == 0)
+				rat = 0x7fffffff;
+			else
+				rat = (long)(bytes_in / (uint64_t)rat);
+		} else
+			/* 8 fractional bits */
+			rat = (long)((bytes_in << 8) / bytes_out);
+		if (rat >= s->u.enc.ratio)
+			s->u.enc.ratio = (int)rat;
+		else {
+			s->u.enc.ratio = 0;
+			memset(s->u.enc.htab, -1, sizeof(s->u.enc.htab));
+			put_code(s, CLEAR, s->n_bits);
+			pad_group(s);
+			s->n_bits = INIT_BITS;
+			s->u.enc.extcode = MAXCODE(INIT_BITS)+1;
+			s->free_ent = FIRST;
+			s->u.enc.stcode = 1;
+		}
+	}
+}
 
-					disp = (HSIZE - hp)-1;	/* secondary hash (after G. Knott) */
+/* Consume input until it runs out or obuf needs to be drained. */
+static const uint8_t* compress_block(CompressStream* s, const uint8_t* in, const uint8_t* in_end)
+{
+	int32_t* htab = s->u.enc.htab;
+	uint16_t* codetab = s->u.enc.codetab;
+	long ent = s->u.enc.ent;
+
+	if (!s->u.enc.have_ent && in != in_end) {
+		ent = *in++;
+		s->u.enc.have_ent = 1;
+		s->u.enc.bytes_in = 1;
+	}
 
-					do {
-						if ((hp -= disp) < 0)
-							hp += HSIZE;
+	while (in != in_end && s->u.enc.obuf_len <= COMPRESS_OBUF_SIZE - OBUF_SLACK) {
+		const int c = *in++;
+		const int32_t fcode = (int32_t)((ent << 8) | c);
+		long hp;
 
-						if ((i = htabof(hp)) == fcode.code)
-							goto hfound;
-					} while (i != -1);
-				}
-			}
-#else
-			{
-				long i, p;
-				hp = ((((long)(fcode.e.c)) << (HBITS-8)) ^ (long)(fcode.e.ent));
-
-				if ((i = htabof(hp)) == fcode.code)  goto hfound;
-				if (i == -1)                         goto out;
-
-				p = primetab[fcode.e.c];
-lookup:			hp = (hp+p)&HMASK;
-				if ((i = htabof(hp)) == fcode.code)  goto hfound;
-				if (i == -1)                         goto out;
-				hp = (hp+p)&HMASK;
-				if ((i = htabof(hp)) == fcode.code)  goto hfound;
-				if (i == -1)                         goto out;
-				hp = (hp+p)&HMASK;
-				if ((i = htabof(hp)) == fcode.code)  goto hfound;
-				if (i == -1)                         goto out;
-				goto lookup;
-			}
-out:		;
-#endif
-			output(outbuf, outbits, fcode.e.ent, n_bits);
+		if (s->u.enc.check_pending) {
+			s->u.enc.check_pending = 0;
+			compress_check(s);
+		}
 
-			{
-				long fc;
-				fc = fcode.code;
-				fcode.e.ent = fcode.e.c;
+		s->u.enc.bytes_in++;
 
-				if (stcode) {
-					codetabof(hp) = (unsigned short)free_ent++;
-					htabof(hp) = fc;
-				}
-			}
+		hp = (((long)c) << (HBITS-8)) ^ ent;
+		if (htab[hp] != fcode && htab[hp] != -1) {
+			const long disp = primetab[c];
+			do {
+				hp = (hp+disp)&HMASK;
+			} while (htab[hp] != fcode && htab[hp] != -1);
+		}
 
-			goto next;
+		if (htab[hp] == fcode) {
+			ent = codetab[hp];
+			continue;
+		}
 
-endlop:		if (fcode.e.ent >= FIRST && rpos < uncompressed_length)
-				goto next2;
+		put_code(s, ent, s->n_bits);
+		if (s->u.enc.stcode) {
+			codetab[hp] = (uint16_t)s->free_ent++;
+			htab[hp] = fcode;
+		}
+		ent = c;
+		s->u.enc.check_pending = 1;
+	}
 
-			if (rpos > rlop) {
-				bytes_in += rpos-rlop;
-				rlop = rpos;
-			}
-		} while (rlop < uncompressed_length);
-	/* } */
+	s->u.enc.ent = ent;
 
-	if (bytes_in > 0)
-		output(outbuf, outbits, fcode.e.ent, n_bits);
+	return in;
+}
 
-  if (((outbits+7)>>3) + bytes_out <= *compressed_length) {
-    memcpy(compressed + bytes_out, outbuf, (outbits+7)>>3);
-  } else {
-    return COMPRESS_WRITE_ERROR;
-  }
+enum CompressStatus compress_stream(CompressStream* s,
+                                    const uint8_t** next_in, size_t* avail_in,
+                                    uint8_t** next_out, size_t* avail_out,
+                                    int finish)
+{
+	for (;;) {
+		if (s->u.enc.obuf_pos != s->u.enc.obuf_len) {
+			size_t n = s->u.enc.obuf_len - s->u.enc.obuf_pos;
+			if (n > *avail_out)
+				n = *avail_out;
+			memcpy(*next_out, s->u.enc.obuf + s->u.enc.obuf_pos, n);
+			*next_out += n;
+			*avail_out -= n;
+			s->u.enc.obuf_pos += n;
+			if (s->u.enc.obuf_pos != s->u.enc.obuf_len)
+				return COMPRESS_PROCESSING;
+		}
+		s->u.enc.obuf_pos = s->u.enc.obuf_len = 0;
 
-	bytes_out += (outbits+7)>>3;
+		if (s->finished)
+			return COMPRESS_OK;
 
-  *compressed_length = bytes_out;
+		if (*avail_in == 0) {
+			if (!finish)
+				return COMPRESS_OK;
 
-	return COMPRESS_OK;
+			if (s->u.enc.have_ent)
+				put_code(s, s->u.enc.ent, s->n_bits);
+			if (s->bit_count > 0) {
+				s->u.enc.obuf[s->u.enc.obuf_len++] = (uint8_t)s->bit_buf;
+				s->bit_buf = 0;
+				s->bit_count = 0;
+			}
+			s->finished = 1;
+		} else {
+			const uint8_t* in = compress_block(s, *next_in, *next_in + *avail_in);
+			*avail_in -= (size_t)(in - *next_in);
+			*next_in = in;
+		}
+	}
 }
 
 /*
- * Decompress stdin to stdout.  This routine adapts to the codes in the
- * file building the "string" table on-the-fly; requiring no table to
- * be stored in the compressed file.  The tables used herein are shared
- * with those of the compress() routine.  See the definitions above.
+ * Decompress.  This routine adapts to the codes in the file building
+ * the "string" table on-the-fly; requiring no table to be stored in
+ * the compressed file.
+ *
+ * Each table entry records where its string last appeared in the
+ * output, so when that is still in the caller's buffer the whole
+ * string is copied from there.  Otherwise the prefix chain is walked
+ * backwards, writing straight into the output when there is room for
+ * the whole string or onto a stack which is drained on later calls.
  */
-enum CompressStatus decompress (uint8_t* decompressed, size_t* decompressed_length,
-                                const uint8_t* compressed, size_t compressed_length)
+
+void decompress_stream_init(CompressStream* s)
 {
-	char_type *stackp;
-	code_int code;
-	int finchar;
-	code_int oldcode;
-	code_int incode;
-	int inbits;
-	int posbits;
-	size_t outpos;
-	size_t insize;
-	int bitmask;
-	code_int free_ent;
-	code_int maxcode;
-	code_int maxmaxcode;
-	int n_bits;
-	int rsize;
-  long bytes_in;
-  size_t bytes_out = 0;
-  size_t bytes_read = 0;
-  int maxbits = BITS;
-  int block_mode = BLOCK_MODE;
-  char_type inbuf[IBUFSIZ+64];
-  char_type outbuf[OBUFSIZ+2048];
-  count_int htab[HSIZE];
-  unsigned short codetab[HSIZE];
-
-	bytes_in = 0;
-	insize = 0;
-
-  bytes_read = insize = rsize = compressed_length < IBUFSIZ ? compressed_length : IBUFSIZ;
-  if (rsize < 0)
-    return COMPRESS_READ_ERROR;
-
-  memcpy (inbuf, compressed, rsize);
-
-	if (insize < 3 || inbuf[0] != MAGIC_1 || inbuf[1] != MAGIC_2) {
-		return COMPRESS_FAILED;
+	int code;
+
+	s->finished = 0;
+	s->bit_buf = 0;
+	s->bit_count = 0;
+	s->u.dec.header_len = 0;
+	s->u.dec.oldcode = -1;
+	s->u.dec.group_bits = 0;
+	s->u.dec.skip_bits = 0;
+	s->u.dec.out_pos = 0;
+	s->u.dec.last_pos = 0;
+	s->u.dec.last_len = 0;
+	s->u.dec.stack_pos = 0;
+	s->u.dec.stack_len = 0;
+
+	for (code = 0; code < 256; code++) {
+		s->u.dec.codes[code].pos = 0;
+		s->u.dec.codes[code].prefix = 0;
+		s->u.dec.codes[code].length = 1;
+		s->u.dec.codes[code].suffix = (uint8_t)code;
+		s->u.dec.codes[code].first = (uint8_t)code;
 	}
+}
 
-	maxbits = inbuf[2] & BIT_MASK;
-	block_mode = inbuf[2] & BLOCK_MODE;
-	maxmaxcode = MAXCODE(maxbits);
+/* Write the string for code to dest, last byte first. */
+static void unwind_code(const CompressCode* codes, long code, uint8_t* dest, size_t length)
+{
+	uint8_t* p = dest + length;
 
-	if (maxbits > BITS) {
-		return COMPRESS_FAILED;
+	while (code >= 256) {
+		*--p = codes[code].suffix;
+		code = codes[code].prefix;
 	}
+	*--p = (uint8_t)code;
+}
 
-	bytes_in = insize;
-	maxcode = MAXCODE(n_bits = INIT_BITS)-1;
-	bitmask = (1<<n_bits)-1;
-	oldcode = -1;
-	finchar = 0;
-	outpos = 0;
-	posbits = 3<<3;
-
-	free_ent = ((block_mode) ? FIRST : 256);
-
-	/* As above, initialize the first
-	 * 256 entries in the table. */
-	clear_tab_prefixof();
-
-	for (code = 255; code >= 0; --code)
-		tab_suffixof(code) = (char_type)code;
+static enum CompressStatus decompress_header(CompressStream* s,
+                                             const uint8_t** next_in, size_t* avail_in,
+                                             int finish)
+{
+	while (s->u.dec.header_len < 3 && *avail_in > 0) {
+		s->u.dec.header[s->u.dec.header_len++] = **next_in;
+		*next_in += 1;
+		*avail_in -= 1;
+	}
 
-	do {
-resetbuf: ;
-		{
-			int i, e, o;
+	if (s->u.dec.header_len < 3)
+		return finish ? COMPRESS_FAILED : COMPRESS_OK;
 
-			e = insize-(o = (posbits>>3));
+	if (s->u.dec.header[0] != MAGIC_1 || s->u.dec.header[1] != MAGIC_2)
+		return COMPRESS_FAILED;
 
-			for (i = 0; i < e; ++i)
-				inbuf[i] = inbuf[i+o];
+	s->maxbits = s->u.dec.header[2] & BIT_MASK;
+	s->u.dec.block_mode = s->u.dec.header[2] & BLOCK_MODE;
+	s->u.dec.maxmaxcode = MAXCODE(s->maxbits);
 
-			insize = e;
-			posbits = 0;
-		}
+	/* compress(1) only writes 9 to 16 bits */
+	if (s->maxbits > BITS || s->maxbits < INIT_BITS)
+		return COMPRESS_FAILED;
 
-		if (insize < sizeof(inbuf)-IBUFSIZ) {
-      const size_t bytes_remaining = compressed_length - bytes_read;
-      rsize = bytes_remaining < IBUFSIZ ? bytes_remaining : IBUFSIZ;
-      if (rsize != 0) {
-        memcpy (inbuf+insize, compressed + bytes_read, rsize);
-        bytes_read += rsize;
-      }
+	s->n_bits = INIT_BITS;
+	s->u.dec.maxcode = MAXCODE(INIT_BITS)-1;
+	s->free_ent = ((s->u.dec.block_mode) ? FIRST : 256);
 
-			insize += rsize;
-		}
+	return COMPRESS_OK;
+}
 
-		inbits = ((rsize > 0) ? (insize - insize%n_bits)<<3 :
-		          (insize<<3)-(n_bits-1));
+/* Copy a string which is already in the output.  Short ones are
+   copied as two words, which may write past the end of the string
+   (but never past out_end) and may overlap it. */
+static void copy_string(uint8_t* dest, const uint8_t* src, size_t length, const uint8_t* out_end)
+{
+	if (length <= 16 && (size_t)(out_end - dest) >= 16) {
+		uint64_t a, b;
+		memcpy(&a, src, 8);
+		memcpy(&b, src + 8, 8);
+		memcpy(dest, &a, 8);
+		memcpy(dest + 8, &b, 8);
+	} else {
+		memcpy(dest, src, length);
+	}
+}
 
-		while (inbits > posbits) {
-			if (free_ent > maxcode) {
-				posbits = ((posbits-1) + ((n_bits<<3) -
-				           (posbits-1+(n_bits<<3))%(n_bits<<3)));
+enum CompressStatus decompress_stream(CompressStream* s,
+                                      const uint8_t** next_in, size_t* avail_in,
+                                      uint8_t** next_out, size_t* avail_out,
+                                      int finish)
+{
+	CompressCode* codes = s->u.dec.codes;
+	uint8_t* stack = s->u.dec.stack;
+	const uint8_t* in;
+	const uint8_t* in_end;
+	uint8_t* out;
+	uint8_t* out_end;
+	uint64_t bit_buf;
+	int bit_count;
+	int n_bits;
+	long free_ent;
+	long maxcode;
+	long oldcode;
+	int group_bits;
+	uint64_t out_pos;
+	uint64_t last_pos;
+	size_t last_len;
+	/* Output position of the start of the caller's buffer; everything
+	   from there on is available to copy from. */
+	uint64_t window_pos;
+	uint8_t* window;
+	enum CompressStatus res = COMPRESS_OK;
+
+	if (s->u.dec.stack_pos != s->u.dec.stack_len) {
+		size_t n = s->u.dec.stack_len - s->u.dec.stack_pos;
+		if (n > *avail_out)
+			n = *avail_out;
+		memcpy(*next_out, stack + s->u.dec.stack_pos, n);
+		*next_out += n;
+		*avail_out -= n;
+		s->u.dec.stack_pos += n;
+		if (s->u.dec.stack_pos != s->u.dec.stack_len)
+			return COMPRESS_PROCESSING;
+	}
 
-				++n_bits;
-				if (n_bits == maxbits)
-					maxcode = maxmaxcode;
-				else
-					maxcode = MAXCODE(n_bits)-1;
+	if (s->u.dec.header_len < 3) {
+		res = decompress_header(s, next_in, avail_in, finish);
+		if (res != COMPRESS_OK || s->u.dec.header_len < 3)
+			return res;
+	}
 
-				bitmask = (1<<n_bits)-1;
-				goto resetbuf;
+	in = *next_in;
+	in_end = in + *avail_in;
+	out = *next_out;
+	out_end = out + *avail_out;
+	bit_buf = s->bit_buf;
+	bit_count = s->bit_count;
+	n_bits = s->n_bits;
+	free_ent = s->free_ent;
+	maxcode = s->u.dec.maxcode;
+	oldcode = s->u.dec.oldcode;
+	group_bits = s->u.dec.group_bits;
+	out_pos = s->u.dec.out_pos;
+	last_pos = s->u.dec.last_pos;
+	last_len = s->u.dec.last_len;
+	window_pos = out_pos;
+	window = out;
+
+	for (;;) {
+		long code;
+		long incode;
+		size_t length;
+		uint8_t* dest;
+
+		/* Padding at the end of a group */
+		while (s->u.dec.skip_bits > 0) {
+			if (bit_count == 0) {
+				if (in == in_end)
+					goto out;
+				bit_buf = *in++;
+				bit_count = 8;
 			}
+			{
+				const int n = s->u.dec.skip_bits < bit_count ? s->u.dec.skip_bits : bit_count;
+				bit_buf >>= n;
+				bit_count -= n;
+				s->u.dec.skip_bits -= n;
+			}
+		}
 
-			input(inbuf, posbits, code, n_bits, bitmask);
-
-			if (oldcode == -1) {
-				if (code >= 256)
-          return COMPRESS_FAILED;
+		if (free_ent > maxcode) {
+			const int group = n_bits << 3;
+			s->u.dec.skip_bits = (group - group_bits) % group;
+			group_bits = 0;
+
+			++n_bits;
+			if (n_bits == s->maxbits)
+				maxcode = s->u.dec.maxmaxcode;
+			else
+				maxcode = MAXCODE(n_bits)-1;
+			continue;
+		}
 
-				outbuf[outpos++] = (char_type)(finchar = (int)(oldcode = code));
-				continue;
+		if (bit_count < n_bits) {
+			while (bit_count <= 56 && in != in_end) {
+				bit_buf |= (uint64_t)(*in++) << bit_count;
+				bit_count += 8;
 			}
+			if (bit_count < n_bits)
+				goto out;
+		}
 
-			if (code == CLEAR && block_mode) {
-				clear_tab_prefixof();
-				free_ent = FIRST - 1;
-				posbits = ((posbits-1) + ((n_bits<<3) -
-				           (posbits-1+(n_bits<<3))%(n_bits<<3)));
-				maxcode = MAXCODE(n_bits = INIT_BITS)-1;
-				bitmask = (1<<n_bits)-1;
-				goto resetbuf;
+		code = (long)(bit_buf & ((UINT64_C(1) << n_bits) - 1));
+		bit_buf >>= n_bits;
+		bit_count -= n_bits;
+		group_bits += n_bits;
+		if (group_bits == (n_bits << 3))
+			group_bits = 0;
+
+		if (oldcode == -1) {
+			if (code >= 256) {
+				res = COMPRESS_FAILED;
+				goto out;
 			}
-
-			incode = code;
-			stackp = de_stack;
-
+			length = 1;
+			dest = (out != out_end) ? out++ : stack;
+			*dest = (uint8_t)code;
+		} else if (code == CLEAR && s->u.dec.block_mode) {
+			const int group = n_bits << 3;
+			s->u.dec.skip_bits = (group - group_bits) % group;
+			group_bits = 0;
+
+			free_ent = FIRST - 1;
+			n_bits = INIT_BITS;
+			maxcode = MAXCODE(INIT_BITS)-1;
+			continue;
+		} else {
 			if (code >= free_ent) { /* Special case for KwKwK string.	*/
 				if (code > free_ent) {
-					return COMPRESS_FAILED;
+					res = COMPRESS_FAILED;
+					goto out;
 				}
-
-				*--stackp = (char_type)finchar;
-				code = oldcode;
+				length = last_len + 1;
+			} else {
+				length = codes[code].length;
 			}
 
-			while ((cmp_code_int)code >= (cmp_code_int)256) {
-				/* Generate output characters in reverse order */
-				*--stackp = tab_suffixof(code);
-				code = tab_prefixof(code);
+			if ((size_t)(out_end - out) >= length) {
+				dest = out;
+				out += length;
+			} else {
+				dest = stack;
 			}
 
-			*--stackp =	(char_type)(finchar = tab_suffixof(code));
-
-			/* And put them out in forward order */
-			{
-				size_t i;
-
-				if (outpos+(i = (de_stack-stackp)) >= OBUFSIZ) {
-					do {
-						if (i > OBUFSIZ-outpos)
-							i = OBUFSIZ-outpos;
-
-						if (i > 0) {
-							memcpy(outbuf+outpos, stackp, i);
-							outpos += i;
-						}
-
-						if (outpos >= OBUFSIZ) {
-              if (outpos + bytes_out > *decompressed_length)
-                return COMPRESS_WRITE_ERROR;
-
-              memcpy (decompressed + bytes_out, outbuf, outpos);
-              bytes_out += outpos;
-							outpos = 0;
-						}
-						stackp+= i;
-					} while ((i = (de_stack-stackp)) > 0);
-				} else {
-					memcpy(outbuf+outpos, stackp, i);
-					outpos += i;
-				}
+			if (code < 256) {
+				*dest = (uint8_t)code;
+			} else if (code == free_ent) {
+				/* The previous string, plus its own first byte */
+				const uint8_t first = codes[oldcode].first;
+				if (last_pos >= window_pos && dest != stack)
+					copy_string(dest, window + (last_pos - window_pos), length - 1, out_end);
+				else
+					unwind_code(codes, oldcode, dest, length - 1);
+				dest[length - 1] = first;
+			} else if (codes[code].pos >= window_pos && dest != stack) {
+				copy_string(dest, window + (codes[code].pos - window_pos), length, out_end);
+			} else {
+				unwind_code(codes, code, dest, length);
 			}
 
 			/* Generate the new entry. */
-			if ((code = free_ent) < maxmaxcode) {
-				tab_prefixof(code) = (unsigned short)oldcode;
-				tab_suffixof(code) = (char_type)finchar;
-				free_ent = code+1;
+			if (free_ent < s->u.dec.maxmaxcode) {
+				CompressCode* entry = &(codes[free_ent]);
+				entry->pos = last_pos;
+				entry->prefix = (uint16_t)oldcode;
+				entry->length = (uint16_t)(last_len + 1);
+				entry->suffix = dest[0];
+				entry->first = codes[oldcode].first;
+				free_ent++;
 			}
-
-			oldcode = incode;	/* Remember previous code.	*/
 		}
 
-		bytes_in += rsize;
-	} while (rsize > 0);
-
-  if (outpos + bytes_out > *decompressed_length)
-    return COMPRESS_WRITE_ERROR;
-
-  if (outpos != 0) {
-    memcpy (decompressed + bytes_out, outbuf, outpos);
-    bytes_out += outpos;
-    outpos = 0;
-  }
-
-  *decompressed_length = bytes_out;
-
-  return COMPRESS_OK;
-}
+		incode = code;
+		last_pos = out_pos;
+		last_len = length;
+		out_pos += length;
+		oldcode = incode;	/* Remember previous code.	*/
+
+		if (dest == stack) {
+			s->u.dec.stack_pos = 0;
+			s->u.dec.stack_len = length;
+			res = COMPRESS_PROCESSING;
+			goto out;
+		}
+	}
 
-void prratio(FILE *stream, long int num, long int den)
-{
-	/* Doesn't need to be long */
-	int q;
-
-	if (den > 0) {
-		if (num > 214748L)
-			q = (int)(num/(den/10000L));	/* 2147483647/10000 */
-		else
-			q = (int)(10000L*num/den);		/* Long calculations, though */
-	} else
-		q = 10000;
-
-	if (q < 0) {
-		putc('-', stream);
-		q = -q;
+out:
+	s->bit_buf = bit_buf;
+	s->bit_count = bit_count;
+	s->n_bits = n_bits;
+	s->free_ent = free_ent;
+	s->u.dec.maxcode = maxcode;
+	s->u.dec.oldcode = oldcode;
+	s->u.dec.group_bits = group_bits;
+	s->u.dec.out_pos = out_pos;
+	s->u.dec.last_pos = last_pos;
+	s->u.dec.last_len = last_len;
+	*avail_in -= (size_t)(in - *next_in);
+	*next_in = in;
+	*avail_out -= (size_t)(out - *next_out);
+	*next_out = out;
+
+	if (res == COMPRESS_PROCESSING) {
+		/* Hand over as much of the string as will fit */
+		size_t n = s->u.dec.stack_len;
+		if (n > *avail_out)
+			n = *avail_out;
+		memcpy(*next_out, stack, n);
+		*next_out += n;
+		*avail_out -= n;
+		s->u.dec.stack_pos = n;
 	}
 
-	fprintf(stream, "%d.%02d%%", q / 100, q % 100);
+	return res;
 }
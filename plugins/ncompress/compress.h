@@ -12,16 +12,99 @@ enum CompressStatus {
   COMPRESS_OK,
   COMPRESS_READ_ERROR,
   COMPRESS_WRITE_ERROR,
-  COMPRESS_FAILED
+  COMPRESS_FAILED,
+  /* More output is pending; call again with more room. */
+  COMPRESS_PROCESSING
 };
 
-typedef size_t (*CompressReadFunc)(void* ptr, size_t size, void* user_data);
-typedef size_t (*CompressWriteFunc)(void* ptr, size_t size, void* user_data);
+#define COMPRESS_HSIZE (1 << 17)
+#define COMPRESS_MAX_CODES (1 << 16)
+#define COMPRESS_OBUF_SIZE 8192
 
-enum CompressStatus compress (uint8_t* compressed, size_t* compressed_length,
-                              const uint8_t* uncompressed, size_t uncompressed_length);
-enum CompressStatus decompress (uint8_t* decompressed, size_t* decompressed_length,
-                                const uint8_t* compressed, size_t compressed_length);
+/* One entry of the decoder's string table.  Every string is the one
+   emitted just before it plus one byte, so it also appears verbatim
+   in the output at pos. */
+typedef struct {
+  uint64_t pos;
+  uint16_t prefix;
+  uint16_t length;
+  uint8_t suffix;
+  uint8_t first;
+} CompressCode;
+
+typedef struct {
+  int finished;
+
+  uint64_t bit_buf;
+  int bit_count;
+
+  int n_bits;
+  int maxbits;
+  long free_ent;
+
+  union {
+    struct {
+      /* Pending output */
+      uint8_t obuf[COMPRESS_OBUF_SIZE];
+      size_t obuf_pos;
+      size_t obuf_len;
+
+      int have_ent;
+      long ent;
+      int check_pending;
+      int stcode;
+      long extcode;
+      long ratio;
+      uint64_t checkpoint;
+      uint64_t bytes_in;
+      uint64_t outbits;
+      uint64_t boff;
+
+      int32_t htab[COMPRESS_HSIZE];
+      uint16_t codetab[COMPRESS_HSIZE];
+    } enc;
+    struct {
+      uint8_t header[3];
+      int header_len;
+      int block_mode;
+      long maxcode;
+      long maxmaxcode;
+      long oldcode;
+      int group_bits;
+      int skip_bits;
+
+      /* Output position of the next byte decoded, and the previous
+         string emitted. */
+      uint64_t out_pos;
+      uint64_t last_pos;
+      size_t last_len;
+
+      /* Strings which didn't fit in the caller's buffer */
+      size_t stack_pos;
+      size_t stack_len;
+
+      CompressCode codes[COMPRESS_MAX_CODES];
+      uint8_t stack[COMPRESS_MAX_CODES];
+    } dec;
+  } u;
+} CompressStream;
+
+/* Incremental interface.  Input is consumed from *next_in and output
+   written to *next_out, advancing both.  Pass a non-zero finish once
+   all the input has been supplied.  Returns COMPRESS_OK once all the
+   input has been consumed (and, when finishing, all the output has
+   been written), or COMPRESS_PROCESSING if there is more output
+   waiting. */
+void compress_stream_init (CompressStream* s);
+enum CompressStatus compress_stream (CompressStream* s,
+                                     const uint8_t** next_in, size_t* avail_in,
+                                     uint8_t** next_out, size_t* avail_out,
+                                     int finish);
+void decompress_stream_init (CompressStream* s);
+enum CompressStatus decompress_stream (CompressStream* s,
+                                       const uint8_t** next_in, size_t* avail_in,
+                                       uint8_t** next_out, size_t* avail_out,
+                                       int finish);
 
 #ifdef __cplusplus
 }
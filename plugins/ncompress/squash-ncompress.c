@@ -33,6 +33,12 @@
 
 #include "compress.h"
 
+typedef struct SquashNCompressStream_s {
+  SquashStream base_object;
+
+  CompressStream stream;
+} SquashNCompressStream;
+
 SQUASH_PLUGIN_EXPORT
 SquashStatus                 squash_plugin_init_codec       (SquashCodec* codec, SquashCodecImpl* impl);
 
@@ -46,15 +52,87 @@ squash_ncompress_status_to_squash_status (enum CompressStatus status) {
   switch (status) {
     case COMPRESS_OK:
       return SQUASH_OK;
+    case COMPRESS_PROCESSING:
+      return SQUASH_PROCESSING;
     case COMPRESS_WRITE_ERROR:
       return squash_error (SQUASH_BUFFER_FULL);
     case COMPRESS_READ_ERROR:
     case COMPRESS_FAILED:
-      return SQUASH_FAILED;
+      return squash_error (SQUASH_FAILED);
   }
   HEDLEY_UNREACHABLE();
 }
 
+static SquashStream*
+squash_ncompress_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashNCompressStream* stream;
+
+  assert (codec != NULL);
+  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
+
+  stream = squash_malloc (sizeof (SquashNCompressStream));
+  if (HEDLEY_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  squash_stream_init ((SquashStream*) stream, codec, stream_type, options, squash_stream_destroy);
+
+  if (stream_type == SQUASH_STREAM_COMPRESS)
+    compress_stream_init (&(stream->stream));
+  else
+    decompress_stream_init (&(stream->stream));
+
+  return (SquashStream*) stream;
+}
+
+static SquashStatus
+squash_ncompress_process_stream (SquashStream* stream, SquashOperation operation) {
+  CompressStream* s = &(((SquashNCompressStream*) stream)->stream);
+  const int finish = (operation == SQUASH_OPERATION_FINISH);
+  enum CompressStatus res;
+
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
+    res = compress_stream (s, &(stream->next_in), &(stream->avail_in), &(stream->next_out), &(stream->avail_out), finish);
+  } else {
+    res = decompress_stream (s, &(stream->next_in), &(stream->avail_in), &(stream->next_out), &(stream->avail_out), finish);
+  }
+
+  return squash_ncompress_status_to_squash_status (res);
+}
+
+static SquashStatus
+squash_ncompress_buffer (SquashStreamType stream_type,
+                         size_t* output_size,
+                         uint8_t* output,
+                         size_t input_size,
+                         const uint8_t* input) {
+  CompressStream* s = squash_malloc (sizeof (CompressStream));
+  if (HEDLEY_UNLIKELY(s == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  uint8_t* next_out = output;
+  size_t avail_out = *output_size;
+  enum CompressStatus res;
+
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    compress_stream_init (s);
+    res = compress_stream (s, &input, &input_size, &next_out, &avail_out, 1);
+  } else {
+    decompress_stream_init (s);
+    res = decompress_stream (s, &input, &input_size, &next_out, &avail_out, 1);
+  }
+
+  squash_free (s);
+
+  if (HEDLEY_UNLIKELY(res == COMPRESS_PROCESSING))
+    return squash_error (SQUASH_BUFFER_FULL);
+  else if (HEDLEY_UNLIKELY(res != COMPRESS_OK))
+    return squash_ncompress_status_to_squash_status (res);
+
+  *output_size = (size_t) (next_out - output);
+
+  return SQUASH_OK;
+}
+
 static SquashStatus
 squash_ncompress_decompress_buffer (SquashCodec* codec,
                                     size_t* decompressed_size,
@@ -62,9 +140,7 @@ squash_ncompress_decompress_buffer (SquashCodec* codec,
                                     size_t compressed_size,
                                     const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
                                     SquashOptions* options) {
-  enum CompressStatus res = decompress (decompressed, decompressed_size, compressed, compressed_size);
-
-  return squash_ncompress_status_to_squash_status (res);
+  return squash_ncompress_buffer (SQUASH_STREAM_DECOMPRESS, decompressed_size, decompressed, compressed_size, compressed);
 }
 
 static SquashStatus
@@ -74,9 +150,7 @@ squash_ncompress_compress_buffer (SquashCodec* codec,
                                   size_t uncompressed_size,
                                   const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
                                   SquashOptions* options) {
-  enum CompressStatus res = compress (compressed, compressed_size, uncompressed, uncompressed_size);
-
-  return squash_ncompress_status_to_squash_status (res);
+  return squash_ncompress_buffer (SQUASH_STREAM_COMPRESS, compressed_size, compressed, uncompressed_size, uncompressed);
 }
 
 SquashStatus
@@ -85,6 +159,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
 
   if (HEDLEY_LIKELY(strcmp ("compress", name) == 0)) {
     impl->get_max_compressed_size = squash_ncompress_get_max_compressed_size;
+    impl->create_stream = squash_ncompress_create_stream;
+    impl->process_stream = squash_ncompress_process_stream;
     impl->decompress_buffer = squash_ncompress_decompress_buffer;
     impl->compress_buffer = squash_ncompress_compress_buffer;
   } else {
@@ -0,0 +1,176 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+/* Cross-checks squash_crc32c and each CRC-32C kernel the CPU
+ * supports against the table-driven implementation in crc32.c, then
+ * compares their throughput.  It is only built when configured with
+ * -DENABLE_CRC32C_BENCH=yes. */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <squash/squash.h>
+
+#include "crc32.h"
+
+#define CRC32C_BENCH_BUFFER_SIZE ((size_t) (1024 * 1024))
+
+typedef uint32_t (* Crc32cBenchFunc) (uint32_t crc, const uint8_t* data, size_t data_length);
+
+static const struct {
+  const char* name;
+  SquashCrc32cKernel kernel;
+} crc32c_bench_kernels[] = {
+  { "slice8", SQUASH_CRC32C_KERNEL_SLICE8 },
+  { "sse4.2", SQUASH_CRC32C_KERNEL_SSE42 },
+  { "pclmul", SQUASH_CRC32C_KERNEL_PCLMUL },
+  { "armv8",  SQUASH_CRC32C_KERNEL_ARMV8 }
+};
+
+static SquashCrc32cKernel crc32c_bench_kernel;
+
+static double
+crc32c_bench_now (void) {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + ((double) ts.tv_nsec / 1000000000.0);
+}
+
+static uint32_t
+crc32c_bench_table (uint32_t crc, const uint8_t* data, size_t data_length) {
+  return (uint32_t) crc_update (crc, data, data_length);
+}
+
+static uint32_t
+crc32c_bench_squash (uint32_t crc, const uint8_t* data, size_t data_length) {
+  return squash_crc32c (crc, data_length, data);
+}
+
+static uint32_t
+crc32c_bench_selected (uint32_t crc, const uint8_t* data, size_t data_length) {
+  squash_crc32c_kernel (crc32c_bench_kernel, &crc, data_length, data);
+  return crc;
+}
+
+static int
+crc32c_bench_check (const char* name, Crc32cBenchFunc func, const uint8_t* buf) {
+  unsigned int seed = 1729;
+  int failures = 0;
+
+  for (int i = 0 ; i < 4096 ; i++) {
+    /* Mostly short lengths, plus enough long ones to cover every
+     * stripe size and alignment. */
+    const size_t offset = (size_t) (rand_r (&seed) % 16);
+    const size_t length = (i & 3) == 0 ?
+      (size_t) (rand_r (&seed) % (CRC32C_BENCH_BUFFER_SIZE - 16)) :
+      (size_t) (rand_r (&seed) % 2048);
+    const crc_t init = (i & 1) ? crc_init () : (crc_t) rand_r (&seed);
+
+    const uint32_t expected = (uint32_t) crc_update (init, buf + offset, length);
+    const uint32_t actual = func ((uint32_t) init, buf + offset, length);
+
+    if (expected != actual) {
+      if (failures++ < 10)
+        fprintf (stderr, "%s: mismatch at offset %zu, length %zu (0x%08x != 0x%08x)\n",
+                 name, offset, length, actual, expected);
+    }
+  }
+
+  return failures;
+}
+
+static void
+crc32c_bench_run (const char* name, Crc32cBenchFunc func, const uint8_t* buf, size_t chunk_size) {
+  const size_t total = (size_t) 256 * 1024 * 1024;
+  volatile uint32_t sink = 0;
+  const double start = crc32c_bench_now ();
+
+  for (size_t done = 0 ; done < total ; done += CRC32C_BENCH_BUFFER_SIZE)
+    for (size_t pos = 0 ; pos + chunk_size <= CRC32C_BENCH_BUFFER_SIZE ; pos += chunk_size)
+      sink ^= func (0xffffffff, buf + pos, chunk_size);
+
+  const double elapsed = crc32c_bench_now () - start;
+  printf ("%-8s %8zu %10.1f MiB/s\n", name, chunk_size, ((double) total / (1024.0 * 1024.0)) / elapsed);
+  (void) sink;
+}
+
+static bool
+crc32c_bench_kernel_available (size_t k) {
+  uint32_t crc = 0;
+  return squash_crc32c_kernel (crc32c_bench_kernels[k].kernel, &crc, 0, (const uint8_t*) "") == SQUASH_OK;
+}
+
+int
+main (void) {
+  static const size_t chunk_sizes[] = { 64, 512, 4096, 65536 };
+  uint8_t* buf = malloc (CRC32C_BENCH_BUFFER_SIZE);
+  int failures = 0;
+
+  if (buf == NULL)
+    return EXIT_FAILURE;
+
+  for (size_t i = 0 ; i < CRC32C_BENCH_BUFFER_SIZE ; i++)
+    buf[i] = (uint8_t) ((i * 2654435761U) >> 13);
+
+  /* Check value from RFC 3720, B.4. */
+  if ((squash_crc32c (crc_init (), 9, (const uint8_t*) "123456789") ^ 0xffffffff) != 0xe3069283) {
+    fprintf (stderr, "check value mismatch\n");
+    failures++;
+  }
+
+  failures += crc32c_bench_check ("squash", crc32c_bench_squash, buf);
+  for (size_t k = 0 ; k < sizeof (crc32c_bench_kernels) / sizeof (crc32c_bench_kernels[0]) ; k++) {
+    if (crc32c_bench_kernel_available (k)) {
+      crc32c_bench_kernel = crc32c_bench_kernels[k].kernel;
+      failures += crc32c_bench_check (crc32c_bench_kernels[k].name, crc32c_bench_selected, buf);
+    }
+  }
+
+  if (failures != 0) {
+    free (buf);
+    return EXIT_FAILURE;
+  }
+
+  for (size_t c = 0 ; c < sizeof (chunk_sizes) / sizeof (chunk_sizes[0]) ; c++) {
+    crc32c_bench_run ("table", crc32c_bench_table, buf, chunk_sizes[c]);
+    crc32c_bench_run ("squash", crc32c_bench_squash, buf, chunk_sizes[c]);
+    for (size_t k = 0 ; k < sizeof (crc32c_bench_kernels) / sizeof (crc32c_bench_kernels[0]) ; k++) {
+      if (crc32c_bench_kernel_available (k)) {
+        crc32c_bench_kernel = crc32c_bench_kernels[k].kernel;
+        crc32c_bench_run (crc32c_bench_kernels[k].name, crc32c_bench_selected, buf, chunk_sizes[c]);
+      }
+    }
+  }
+
+  free (buf);
+
+  return EXIT_SUCCESS;
+}
@@ -59,7 +59,7 @@ squash_snappy_framed_mask_checksum (uint32_t x) {
 static uint32_t
 squash_snappy_framed_generate_checksum (const uint8_t* data, size_t data_length) {
   uint32_t crc = crc_init ();
-  crc = crc_update (crc, data, data_length);
+  crc = squash_crc32c ((uint32_t) crc, data_length, data);
   crc = crc_finalize (crc);
   crc = be32toh (crc);
 
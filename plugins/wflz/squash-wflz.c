@@ -47,7 +47,8 @@ static const union {
 enum SquashWflzOptIndex {
   SQUASH_WFLZ_OPT_LEVEL = 0,
   SQUASH_WFLZ_OPT_CHUNK_SIZE,
-  SQUASH_WFLZ_OPT_ENDIANNESS
+  SQUASH_WFLZ_OPT_ENDIANNESS,
+  SQUASH_WFLZ_OPT_THREADS
 };
 
 static SquashOptionInfo squash_wflz_options[] = {
@@ -73,6 +74,12 @@ static SquashOptionInfo squash_wflz_options[] = {
         { "big", SQUASH_WFLZ_BIG_ENDIAN },
         { NULL, 0 } } },
     .default_value.int_value = SQUASH_WFLZ_LITTLE_ENDIAN },
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 1 },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -81,6 +88,9 @@ static SquashOptionInfo squash_wflz_options[] = {
 #define SQUASH_WFLZ_MIN_CHUNK_SIZE (1024 * 4)
 #define SQUASH_WFLZ_DEFAULT_CHUNK_SIZE (1024 * 32)
 
+/* Below this it isn't worth starting threads to process chunks. */
+#define SQUASH_WFLZ_PARALLEL_MIN_SIZE (1024 * 1024)
+
 SQUASH_PLUGIN_EXPORT
 SquashStatus              squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl);
 
@@ -122,6 +132,183 @@ squash_wflz_get_uncompressed_size (SquashCodec* codec,
   return (size_t) res;
 }
 
+/* A wflz-chunked buffer is a 12-byte header (signature, total size
+   and uncompressed size), the offset of each chunk, then the chunks
+   themselves, each a complete wfLZ block padded to 16 bytes. */
+#define SQUASH_WFLZ_HEADER_SIZE 12
+#define SQUASH_WFLZ_CHUNK_PAD 16
+
+/* Each compression task handles a run of chunks about this long, so
+   the work memory is only allocated once per run. */
+#define SQUASH_WFLZ_TASK_SIZE (1024 * 256)
+
+typedef struct SquashWflzCompressData_s {
+  size_t uncompressed_size;
+  const uint8_t* uncompressed;
+  size_t chunk_size;
+  size_t n_chunks;
+  size_t chunks_per_task;
+  int level;
+  uint8_t** outputs;
+  uint32_t* chunk_sizes;
+} SquashWflzCompressData;
+
+static SquashStatus
+squash_wflz_compress_task (size_t task, void* user_data) {
+  SquashWflzCompressData* data = (SquashWflzCompressData*) user_data;
+  const size_t first = task * data->chunks_per_task;
+  const size_t last = (data->n_chunks - first < data->chunks_per_task) ? data->n_chunks : first + data->chunks_per_task;
+  const size_t max_chunk_size = wfLZ_GetMaxCompressedSize ((uint32_t) data->chunk_size) + SQUASH_WFLZ_CHUNK_PAD;
+
+  data->outputs[task] = squash_malloc ((last - first) * max_chunk_size);
+  if (HEDLEY_UNLIKELY(data->outputs[task] == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  uint8_t* work_mem = squash_malloc (wfLZ_GetWorkMemSize ());
+  if (HEDLEY_UNLIKELY(work_mem == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  uint8_t* dest = data->outputs[task];
+  for (size_t chunk = first ; chunk < last ; chunk++) {
+    const size_t offset = chunk * data->chunk_size;
+    const uint32_t size = (uint32_t) ((data->uncompressed_size - offset < data->chunk_size) ? data->uncompressed_size - offset : data->chunk_size);
+    const uint32_t wres = (data->level == 1) ?
+      wfLZ_CompressFast (data->uncompressed + offset, size, dest, work_mem, 0) :
+      wfLZ_Compress (data->uncompressed + offset, size, dest, work_mem, 0);
+
+    if (HEDLEY_UNLIKELY(wres == 0)) {
+      squash_free (work_mem);
+      return squash_error (SQUASH_FAILED);
+    }
+
+    const uint32_t padded = (wres + (SQUASH_WFLZ_CHUNK_PAD - 1)) & ~((uint32_t) (SQUASH_WFLZ_CHUNK_PAD - 1));
+    memset (dest + wres, 0, padded - wres);
+    data->chunk_sizes[chunk] = padded;
+    dest += padded;
+  }
+
+  squash_free (work_mem);
+
+  return SQUASH_OK;
+}
+
+/* Compress runs of chunks on separate threads, then write the header
+   and chunk table the way wfLZ_ChunkCompress does.  Every chunk is
+   compressed on its own either way, so the result is identical.
+   Returns false if the caller should compress serially. */
+static bool
+squash_wflz_compress_chunks (unsigned int threads,
+                             int level,
+                             const uint8_t signature[4],
+                             size_t chunk_size,
+                             size_t* compressed_size,
+                             uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                             size_t uncompressed_size,
+                             const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                             SquashStatus* res) {
+  const size_t n_chunks = ((uncompressed_size - 1) / chunk_size) + 1;
+  const size_t chunks_per_task = (chunk_size < SQUASH_WFLZ_TASK_SIZE) ? SQUASH_WFLZ_TASK_SIZE / chunk_size : 1;
+  const size_t n_tasks = ((n_chunks - 1) / chunks_per_task) + 1;
+  SquashWflzCompressData data = {
+    uncompressed_size,
+    uncompressed,
+    chunk_size,
+    n_chunks,
+    chunks_per_task,
+    level,
+    squash_calloc (n_tasks, sizeof (uint8_t*)),
+    squash_calloc (n_chunks, sizeof (uint32_t))
+  };
+  bool handled = false;
+
+  if (HEDLEY_LIKELY(data.outputs != NULL && data.chunk_sizes != NULL)) {
+    *res = squash_parallel_run (n_tasks, threads, squash_wflz_compress_task, &data);
+    handled = true;
+  }
+
+  if (handled && HEDLEY_LIKELY(*res == SQUASH_OK)) {
+    uint32_t pos = (uint32_t) (SQUASH_WFLZ_HEADER_SIZE + (n_chunks * sizeof (uint32_t)));
+
+    for (size_t task = 0, chunk = 0 ; task < n_tasks && *res == SQUASH_OK ; task++) {
+      const uint8_t* src = data.outputs[task];
+
+      for (size_t last = chunk + chunks_per_task ; chunk < last && chunk < n_chunks ; chunk++) {
+        const uint32_t size = data.chunk_sizes[chunk];
+
+        if (HEDLEY_UNLIKELY(*compressed_size - pos < size)) {
+          *res = squash_error (SQUASH_BUFFER_FULL);
+          break;
+        }
+
+        memcpy (compressed + SQUASH_WFLZ_HEADER_SIZE + (chunk * sizeof (uint32_t)), &pos, sizeof (uint32_t));
+        memcpy (compressed + pos, src, size);
+        src += size;
+        pos += size;
+      }
+    }
+
+    if (HEDLEY_LIKELY(*res == SQUASH_OK)) {
+      const uint32_t size = (uint32_t) uncompressed_size;
+
+      memcpy (compressed, signature, 4);
+      memcpy (compressed + 4, &pos, sizeof (uint32_t));
+      memcpy (compressed + 8, &size, sizeof (uint32_t));
+      *compressed_size = pos;
+    }
+  }
+
+  if (data.outputs != NULL) {
+    for (size_t task = 0 ; task < n_tasks ; task++) {
+      if (data.outputs[task] != NULL)
+        squash_free (data.outputs[task]);
+    }
+    squash_free (data.outputs);
+  }
+  if (data.chunk_sizes != NULL)
+    squash_free (data.chunk_sizes);
+
+  return handled;
+}
+
+/* Check that squash_wflz_compress_chunks produces exactly what
+   wfLZ_ChunkCompress does by compressing the start of the input both
+   ways.  The sample spans three chunks, so the chunk table isn't a
+   multiple of the padding, and the signature is copied from wfLZ's
+   output. */
+static bool
+squash_wflz_get_signature (int level, const uint8_t* uncompressed, uint8_t signature[4]) {
+  const uint32_t sample_size = (SQUASH_WFLZ_MIN_CHUNK_SIZE * 2) + 100;
+  const size_t max_size = wfLZ_GetMaxChunkCompressedSize (sample_size, SQUASH_WFLZ_MIN_CHUNK_SIZE);
+  uint8_t* expected = squash_malloc (max_size);
+  uint8_t* actual = squash_malloc (max_size);
+  uint8_t* work_mem = squash_malloc (wfLZ_GetWorkMemSize ());
+  bool res = false;
+
+  if (HEDLEY_LIKELY(expected != NULL && actual != NULL && work_mem != NULL)) {
+    const uint32_t wres = wfLZ_ChunkCompress ((uint8_t*) uncompressed, sample_size, SQUASH_WFLZ_MIN_CHUNK_SIZE, expected, work_mem, 0, level == 1 ? 1 : 0);
+    size_t actual_size = max_size;
+    SquashStatus status = SQUASH_OK;
+
+    if (wres != 0 &&
+        squash_wflz_compress_chunks (1, level, expected, SQUASH_WFLZ_MIN_CHUNK_SIZE, &actual_size, actual, sample_size, uncompressed, &status) &&
+        status == SQUASH_OK &&
+        actual_size == wres &&
+        memcmp (actual, expected, wres) == 0) {
+      memcpy (signature, expected, 4);
+      res = true;
+    }
+  }
+
+  if (expected != NULL)
+    squash_free (expected);
+  if (actual != NULL)
+    squash_free (actual);
+  if (work_mem != NULL)
+    squash_free (work_mem);
+
+  return res;
+}
+
 static SquashStatus
 squash_wflz_compress_buffer (SquashCodec* codec,
                              size_t* compressed_size,
@@ -144,6 +331,20 @@ squash_wflz_compress_buffer (SquashCodec* codec,
     return squash_error (SQUASH_BUFFER_FULL);
   }
 
+  /* The chunk table is written in host order, so byte-swapped output
+     is left to wfLZ. */
+  if (codec_name[4] != '\0' && swap == 0 && uncompressed_size >= SQUASH_WFLZ_PARALLEL_MIN_SIZE) {
+    const unsigned int threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_WFLZ_OPT_THREADS);
+    const size_t chunk_size = squash_options_get_size_at (options, codec, SQUASH_WFLZ_OPT_CHUNK_SIZE);
+    SquashStatus res = SQUASH_OK;
+    uint8_t signature[4];
+
+    if (threads != 1 &&
+        squash_wflz_get_signature (level, uncompressed, signature) &&
+        squash_wflz_compress_chunks (threads, level, signature, chunk_size, compressed_size, compressed, uncompressed_size, uncompressed, &res))
+      return res;
+  }
+
   uint8_t* work_mem = (uint8_t*) malloc (wfLZ_GetWorkMemSize ());
   uint32_t wres;
 
@@ -179,6 +380,69 @@ squash_wflz_compress_buffer (SquashCodec* codec,
   return HEDLEY_LIKELY(*compressed_size > 0) ? SQUASH_OK : squash_error (SQUASH_FAILED);
 }
 
+typedef struct SquashWflzChunk_s {
+  const uint8_t* compressed;
+  uint8_t* decompressed;
+} SquashWflzChunk;
+
+static SquashStatus
+squash_wflz_decompress_chunk_task (size_t task, void* user_data) {
+  const SquashWflzChunk* chunk = ((const SquashWflzChunk*) user_data) + task;
+
+  wfLZ_Decompress (chunk->compressed, chunk->decompressed);
+
+  return SQUASH_OK;
+}
+
+/* Every chunk is a complete wfLZ block with its own header, so once
+   the chunk table has been walked to find where each one goes they
+   can all be decoded at the same time.  The output is exactly what
+   the serial loop produces. */
+static SquashStatus
+squash_wflz_decompress_chunks (unsigned int threads,
+                               size_t decompressed_size,
+                               uint8_t decompressed[HEDLEY_ARRAY_PARAM(decompressed_size)],
+                               const uint8_t* compressed) {
+  SquashWflzChunk* chunks = NULL;
+  size_t n_chunks = 0, allocated = 0, pos = 0;
+  uint32_t* chunk = NULL;
+  uint8_t* compressed_block;
+  SquashStatus res;
+
+  while ( (compressed_block = wfLZ_ChunkDecompressLoop ((uint8_t*) compressed, &chunk)) != NULL ) {
+    const uint32_t chunk_size = wfLZ_GetDecompressedSize (compressed_block);
+
+    if (HEDLEY_UNLIKELY(decompressed_size - pos < chunk_size)) {
+      if (chunks != NULL)
+        squash_free (chunks);
+      return squash_error (SQUASH_BUFFER_FULL);
+    }
+
+    if (n_chunks == allocated) {
+      allocated = (allocated == 0) ? 64 : allocated * 2;
+      SquashWflzChunk* tmp = squash_realloc (chunks, allocated * sizeof (SquashWflzChunk));
+      if (HEDLEY_UNLIKELY(tmp == NULL)) {
+        if (chunks != NULL)
+          squash_free (chunks);
+        return squash_error (SQUASH_MEMORY);
+      }
+      chunks = tmp;
+    }
+
+    chunks[n_chunks].compressed = compressed_block;
+    chunks[n_chunks].decompressed = decompressed + pos;
+    n_chunks++;
+    pos += chunk_size;
+  }
+
+  res = squash_parallel_run (n_chunks, threads, squash_wflz_decompress_chunk_task, chunks);
+
+  if (chunks != NULL)
+    squash_free (chunks);
+
+  return res;
+}
+
 static SquashStatus
 squash_wflz_decompress_buffer (SquashCodec* codec,
                                size_t* decompressed_size,
@@ -208,18 +472,26 @@ squash_wflz_decompress_buffer (SquashCodec* codec,
   if (codec_name[4] == '\0') {
     wfLZ_Decompress (compressed, decompressed);
   } else {
-    uint8_t* dest = decompressed;
-    uint32_t* chunk = NULL;
-    uint8_t* compressed_block;
+    const unsigned int threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_WFLZ_OPT_THREADS);
+
+    if (threads != 1 && decompressed_s >= SQUASH_WFLZ_PARALLEL_MIN_SIZE) {
+      const SquashStatus res = squash_wflz_decompress_chunks (threads, *decompressed_size, decompressed, compressed);
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        return res;
+    } else {
+      uint8_t* dest = decompressed;
+      uint32_t* chunk = NULL;
+      uint8_t* compressed_block;
 
-    while ( (compressed_block = wfLZ_ChunkDecompressLoop ((uint8_t*) compressed, &chunk)) != NULL ) {
-      const uint32_t chunk_size = wfLZ_GetDecompressedSize (compressed_block);
+      while ( (compressed_block = wfLZ_ChunkDecompressLoop ((uint8_t*) compressed, &chunk)) != NULL ) {
+        const uint32_t chunk_size = wfLZ_GetDecompressedSize (compressed_block);
 
-      if (HEDLEY_UNLIKELY((dest + chunk_size) > (decompressed + *decompressed_size)))
-        return squash_error (SQUASH_BUFFER_FULL);
+        if (HEDLEY_UNLIKELY((dest + chunk_size) > (decompressed + *decompressed_size)))
+          return squash_error (SQUASH_BUFFER_FULL);
 
-      wfLZ_Decompress (compressed_block, dest);
-      dest += chunk_size;
+        wfLZ_Decompress (compressed_block, dest);
+        dest += chunk_size;
+      }
     }
   }
 
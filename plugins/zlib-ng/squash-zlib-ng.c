@@ -36,7 +36,8 @@
 typedef enum SquashZlibType_e {
   SQUASH_ZLIB_TYPE_ZLIB,
   SQUASH_ZLIB_TYPE_GZIP,
-  SQUASH_ZLIB_TYPE_DEFLATE
+  SQUASH_ZLIB_TYPE_DEFLATE,
+  SQUASH_ZLIB_TYPE_BGZF
 } SquashZlibType;
 
 typedef struct SquashZlibStream_s {
@@ -44,6 +45,19 @@ typedef struct SquashZlibStream_s {
 
   SquashZlibType type;
   z_stream stream;
+
+  /* A gzip member has ended; another may follow. */
+  bool member_done;
+
+  /* BGZF compression works on whole blocks, so input is collected in
+     bgzf_in until a block is full (or the stream is flushed), then the
+     finished member waits in bgzf_out until it has been copied out. */
+  uint8_t* bgzf_in;
+  size_t bgzf_in_size;
+  uint8_t* bgzf_out;
+  size_t bgzf_out_pos;
+  size_t bgzf_out_size;
+  bool bgzf_eof_written;
 } SquashZlibStream;
 
 #define SQUASH_ZLIB_DEFAULT_LEVEL 6
@@ -91,6 +105,46 @@ static SquashOptionInfo squash_zlib_options[] = {
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
+/* BGZF is described in section 4.1 of the SAM/BAM specification
+   (https://samtools.github.io/hts-specs/SAMv1.pdf).  Each member
+   holds at most 64 KiB of compressed data; bgzip never puts more than
+   0xff00 bytes of input in one so even incompressible data fits. */
+#define SQUASH_BGZF_BLOCK_SIZE     ((size_t) 0x10000)
+#define SQUASH_BGZF_MAX_INPUT_SIZE ((size_t) 0xff00)
+#define SQUASH_BGZF_HEADER_SIZE    ((size_t) 18)
+#define SQUASH_BGZF_FOOTER_SIZE    ((size_t) 8)
+
+/* An empty member, written at the end of every file so readers can
+   tell whether it has been truncated.  The first 16 bytes double as
+   the header of every other member. */
+static const uint8_t squash_bgzf_eof[28] = {
+  0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+  0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00
+};
+
+enum SquashBgzfOptIndex {
+  SQUASH_BGZF_OPT_LEVEL = 0,
+  SQUASH_BGZF_OPT_THREADS
+};
+
+static SquashOptionInfo squash_bgzf_options[] = {
+  { "level",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 1,
+      .max = 9 },
+    .default_value.int_value = SQUASH_ZLIB_DEFAULT_LEVEL },
+  { "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 0 },
+  { NULL, SQUASH_OPTION_TYPE_NONE, }
+};
+
 SQUASH_PLUGIN_EXPORT
 SquashStatus              squash_plugin_init_codec   (SquashCodec* codec, SquashCodecImpl* impl);
 
@@ -122,6 +176,8 @@ static SquashZlibType squash_zlib_codec_to_type (SquashCodec* codec) {
     return SQUASH_ZLIB_TYPE_ZLIB;
   } else if (strcmp ("deflate", name) == 0) {
     return SQUASH_ZLIB_TYPE_DEFLATE;
+  } else if (strcmp ("bgzf", name) == 0) {
+    return SQUASH_ZLIB_TYPE_BGZF;
   } else {
     HEDLEY_UNREACHABLE();
   }
@@ -137,12 +193,26 @@ squash_zlib_stream_init (SquashZlibStream* stream,
 
   z_stream tmp = { 0, };
   stream->stream = tmp;
+  stream->member_done = false;
+  stream->bgzf_in = NULL;
+  stream->bgzf_in_size = 0;
+  stream->bgzf_out = NULL;
+  stream->bgzf_out_pos = 0;
+  stream->bgzf_out_size = 0;
+  stream->bgzf_eof_written = false;
   stream->stream.zalloc = squash_zlib_malloc;
   stream->stream.zfree  = squash_zlib_free;
 }
 
 static void
 squash_zlib_stream_destroy (void* stream) {
+  SquashZlibStream* s = (SquashZlibStream*) stream;
+
+  if (s->bgzf_in != NULL)
+    squash_free (s->bgzf_in);
+  if (s->bgzf_out != NULL)
+    squash_free (s->bgzf_out);
+
   switch (((SquashStream*) stream)->stream_type) {
     case SQUASH_STREAM_COMPRESS:
       deflateEnd (&(((SquashZlibStream*) stream)->stream));
@@ -169,6 +239,34 @@ squash_zlib_stream_new (SquashCodec* codec, SquashStreamType stream_type, Squash
 
   stream->type = squash_zlib_codec_to_type (codec);
 
+  if (stream->type == SQUASH_ZLIB_TYPE_BGZF) {
+    /* Blocks are raw deflate data wrapped by squash_bgzf_compress_block,
+       but decompression can use the regular gzip path. */
+    if (stream_type == SQUASH_STREAM_COMPRESS) {
+      stream->bgzf_in = squash_malloc (SQUASH_BGZF_MAX_INPUT_SIZE);
+      stream->bgzf_out = squash_malloc (SQUASH_BGZF_BLOCK_SIZE);
+      if (HEDLEY_UNLIKELY(stream->bgzf_in == NULL || stream->bgzf_out == NULL)) {
+        squash_object_unref (stream);
+        return NULL;
+      }
+
+      zlib_e = deflateInit2 (&(stream->stream),
+                             squash_options_get_int_at (options, codec, SQUASH_BGZF_OPT_LEVEL),
+                             Z_DEFLATED,
+                             -15,
+                             SQUASH_ZLIB_DEFAULT_MEM_LEVEL,
+                             SQUASH_ZLIB_DEFAULT_STRATEGY);
+    } else {
+      zlib_e = inflateInit2 (&(stream->stream), 15 + 16);
+    }
+
+    if (zlib_e != Z_OK) {
+      stream = squash_object_unref (stream);
+    }
+
+    return stream;
+  }
+
   window_bits = squash_options_get_int_at (options, codec, SQUASH_ZLIB_OPT_WINDOW_BITS);
   if (stream->type == SQUASH_ZLIB_TYPE_DEFLATE) {
     window_bits = -window_bits;
@@ -250,7 +348,20 @@ squash_zlib_process_stream (SquashStream* stream, SquashOperation operation) {
   if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
     zlib_e = deflate (zlib_stream, squash_operation_to_zlib (operation));
   } else {
+    SquashZlibStream* s = (SquashZlibStream*) stream;
+
+    /* Like gunzip, decode gzip members which have been concatenated
+       (RFC 1952, section 2.2).  Anything else after a member is
+       ignored, as it always has been. */
+    if (s->member_done && zlib_stream->avail_in != 0 && zlib_stream->next_in[0] == 0x1f) {
+      s->member_done = false;
+      inflateReset (zlib_stream);
+    }
+
     zlib_e = inflate (zlib_stream, squash_operation_to_zlib (operation));
+
+    if (zlib_e == Z_STREAM_END && (s->type == SQUASH_ZLIB_TYPE_GZIP || s->type == SQUASH_ZLIB_TYPE_BGZF))
+      s->member_done = true;
   }
 
 #if SIZE_MAX < UINT_MAX
@@ -298,7 +409,8 @@ squash_zlib_process_stream (SquashStream* stream, SquashOperation operation) {
       }
       break;
     case Z_STREAM_END:
-      res = SQUASH_OK;
+      res = (((SquashZlibStream*) stream)->member_done && stream->avail_in != 0 && stream->next_in[0] == 0x1f) ?
+        SQUASH_PROCESSING : SQUASH_OK;
       break;
     case Z_MEM_ERROR:
       res = SQUASH_MEMORY;
@@ -354,6 +466,407 @@ squash_zlib_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_siz
   }
 }
 
+/* Members written by BGZF (and compatible tools) record their own
+   size in a "BC" extra subfield, so they can be found without
+   inflating anything.  Other gzip data can't be split up. */
+static SquashStatus
+squash_zlib_scan_frames (SquashCodec* codec,
+                         size_t compressed_size,
+                         const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                         SquashFrameFunc func,
+                         void* user_data) {
+  size_t pos = 0;
+
+  while (pos < compressed_size) {
+    const uint8_t* member = compressed + pos;
+    const size_t remaining = compressed_size - pos;
+    size_t xlen, xpos, member_size = 0;
+
+    /* ID1, ID2, CM, FLG (FEXTRA), MTIME, XFL, OS, XLEN */
+    if (remaining < 18 || member[0] != 0x1f || member[1] != 0x8b || member[2] != 8 || (member[3] & 0x04) == 0)
+      return SQUASH_RANGE;
+
+    xlen = ((size_t) member[10]) | (((size_t) member[11]) << 8);
+    if (remaining < 12 + xlen)
+      return SQUASH_INVALID_BUFFER;
+
+    for (xpos = 12 ; xpos + 4 <= 12 + xlen ; ) {
+      const size_t slen = ((size_t) member[xpos + 2]) | (((size_t) member[xpos + 3]) << 8);
+
+      if (member[xpos] == 'B' && member[xpos + 1] == 'C' && slen == 2 && xpos + 6 <= 12 + xlen) {
+        member_size = (((size_t) member[xpos + 4]) | (((size_t) member[xpos + 5]) << 8)) + 1;
+        break;
+      }
+
+      xpos += 4 + slen;
+    }
+
+    if (member_size == 0)
+      return SQUASH_RANGE;
+    else if (member_size > remaining || member_size < 12 + xlen + 8)
+      return SQUASH_INVALID_BUFFER;
+
+    /* ISIZE is the size modulo 2^32, but BGZF blocks are at most
+       64 KiB. */
+    const SquashFrame frame = {
+      pos,
+      member_size,
+      ((size_t) member[member_size - 4]) |
+      ((size_t) member[member_size - 3] <<  8) |
+      ((size_t) member[member_size - 2] << 16) |
+      ((size_t) member[member_size - 1] << 24)
+    };
+    const SquashStatus res = func (&frame, user_data);
+    if (res != SQUASH_OK)
+      return res;
+
+    pos += member_size;
+  }
+
+  return SQUASH_OK;
+}
+
+static void
+squash_bgzf_write_le32 (uint8_t* dest, uint32_t value) {
+  dest[0] = (uint8_t) (value      );
+  dest[1] = (uint8_t) (value >>  8);
+  dest[2] = (uint8_t) (value >> 16);
+  dest[3] = (uint8_t) (value >> 24);
+}
+
+static uint32_t
+squash_bgzf_read_le32 (const uint8_t* src) {
+  return
+    ((uint32_t) src[0]      ) |
+    ((uint32_t) src[1] <<  8) |
+    ((uint32_t) src[2] << 16) |
+    ((uint32_t) src[3] << 24);
+}
+
+/* Compress up to SQUASH_BGZF_MAX_INPUT_SIZE bytes into a complete
+   member.  @a zlib_stream must have been initialized for raw deflate;
+   @a block must be SQUASH_BGZF_BLOCK_SIZE bytes. */
+static SquashStatus
+squash_bgzf_compress_block (z_stream* zlib_stream,
+                            size_t* block_size,
+                            uint8_t block[HEDLEY_ARRAY_PARAM(SQUASH_BGZF_BLOCK_SIZE)],
+                            size_t uncompressed_size,
+                            const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)]) {
+  const size_t max_data_size = SQUASH_BGZF_BLOCK_SIZE - SQUASH_BGZF_HEADER_SIZE - SQUASH_BGZF_FOOTER_SIZE;
+  size_t data_size;
+  int zlib_e;
+
+  assert (uncompressed_size <= SQUASH_BGZF_MAX_INPUT_SIZE);
+
+  zlib_e = deflateReset (zlib_stream);
+  if (HEDLEY_UNLIKELY(zlib_e != Z_OK))
+    return squash_error (SQUASH_FAILED);
+
+  zlib_stream->next_in = (Bytef*) uncompressed;
+  zlib_stream->avail_in = (uInt) uncompressed_size;
+  zlib_stream->next_out = block + SQUASH_BGZF_HEADER_SIZE;
+  zlib_stream->avail_out = (uInt) max_data_size;
+
+  zlib_e = deflate (zlib_stream, Z_FINISH);
+  if (HEDLEY_LIKELY(zlib_e == Z_STREAM_END)) {
+    data_size = max_data_size - zlib_stream->avail_out;
+  } else if (zlib_e == Z_OK || zlib_e == Z_BUF_ERROR) {
+    /* Didn't fit; fall back on a single stored block, which always
+       does. */
+    uint8_t* data = block + SQUASH_BGZF_HEADER_SIZE;
+    data[0] = 0x01;
+    data[1] = (uint8_t) (uncompressed_size     );
+    data[2] = (uint8_t) (uncompressed_size >> 8);
+    data[3] = (uint8_t) ~data[1];
+    data[4] = (uint8_t) ~data[2];
+    memcpy (data + 5, uncompressed, uncompressed_size);
+    data_size = uncompressed_size + 5;
+  } else {
+    return squash_error (SQUASH_FAILED);
+  }
+
+  const size_t member_size = SQUASH_BGZF_HEADER_SIZE + data_size + SQUASH_BGZF_FOOTER_SIZE;
+
+  memcpy (block, squash_bgzf_eof, 16);
+  block[16] = (uint8_t) ((member_size - 1)     );
+  block[17] = (uint8_t) ((member_size - 1) >> 8);
+
+  squash_bgzf_write_le32 (block + SQUASH_BGZF_HEADER_SIZE + data_size,
+                          (uint32_t) crc32 (0L, uncompressed, (uInt) uncompressed_size));
+  squash_bgzf_write_le32 (block + SQUASH_BGZF_HEADER_SIZE + data_size + 4,
+                          (uint32_t) uncompressed_size);
+
+  *block_size = member_size;
+
+  return SQUASH_OK;
+}
+
+/* Decompress a single member, as found by squash_zlib_scan_frames.
+   @a zlib_stream must have been initialized for raw inflate. */
+static SquashStatus
+squash_bgzf_decompress_block (z_stream* zlib_stream,
+                              size_t* decompressed_size,
+                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                              size_t block_size,
+                              const uint8_t block[HEDLEY_ARRAY_PARAM(block_size)]) {
+  const size_t header_size = 12 + (((size_t) block[10]) | (((size_t) block[11]) << 8));
+  const uint8_t* footer = block + block_size - SQUASH_BGZF_FOOTER_SIZE;
+  const size_t size = (size_t) squash_bgzf_read_le32 (footer + 4);
+  int zlib_e;
+
+  if (HEDLEY_UNLIKELY(size > SQUASH_BGZF_BLOCK_SIZE))
+    return squash_error (SQUASH_INVALID_BUFFER);
+  else if (HEDLEY_UNLIKELY(size > *decompressed_size))
+    return squash_error (SQUASH_BUFFER_FULL);
+
+  zlib_e = inflateReset (zlib_stream);
+  if (HEDLEY_UNLIKELY(zlib_e != Z_OK))
+    return squash_error (SQUASH_FAILED);
+
+  zlib_stream->next_in = (Bytef*) block + header_size;
+  zlib_stream->avail_in = (uInt) (block_size - header_size - SQUASH_BGZF_FOOTER_SIZE);
+  zlib_stream->next_out = decompressed;
+  zlib_stream->avail_out = (uInt) size;
+
+  zlib_e = inflate (zlib_stream, Z_FINISH);
+  if (HEDLEY_UNLIKELY(zlib_e != Z_STREAM_END)) {
+    if (zlib_e == Z_MEM_ERROR)
+      return squash_error (SQUASH_MEMORY);
+    else
+      return squash_error (SQUASH_INVALID_BUFFER);
+  }
+
+  if (HEDLEY_UNLIKELY(zlib_stream->avail_out != 0 ||
+                      squash_bgzf_read_le32 (footer) != (uint32_t) crc32 (0L, decompressed, (uInt) size)))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  *decompressed_size = size;
+
+  return SQUASH_OK;
+}
+
+static size_t
+squash_bgzf_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
+  const size_t n_blocks = (uncompressed_size / SQUASH_BGZF_MAX_INPUT_SIZE) + ((uncompressed_size % SQUASH_BGZF_MAX_INPUT_SIZE) != 0);
+
+  if (HEDLEY_UNLIKELY(((SIZE_MAX - sizeof (squash_bgzf_eof)) / SQUASH_BGZF_BLOCK_SIZE) < n_blocks)) {
+    squash_error (SQUASH_RANGE);
+    return 0;
+  }
+
+  return (n_blocks * SQUASH_BGZF_BLOCK_SIZE) + sizeof (squash_bgzf_eof);
+}
+
+static SquashStatus
+squash_bgzf_add_frame_size (const SquashFrame* frame, void* user_data) {
+  size_t* total = (size_t*) user_data;
+
+  if (HEDLEY_UNLIKELY((SIZE_MAX - *total) < frame->decompressed_size))
+    return SQUASH_RANGE;
+
+  *total += frame->decompressed_size;
+
+  return SQUASH_OK;
+}
+
+static size_t
+squash_bgzf_get_uncompressed_size (SquashCodec* codec,
+                                   size_t compressed_size,
+                                   const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]) {
+  size_t total = 0;
+
+  if (squash_zlib_scan_frames (codec, compressed_size, compressed, squash_bgzf_add_frame_size, &total) != SQUASH_OK)
+    return 0;
+
+  return total;
+}
+
+typedef struct SquashBgzfCompressData_s {
+  int level;
+  size_t uncompressed_size;
+  const uint8_t* uncompressed;
+  uint8_t* compressed;
+  size_t* block_sizes;
+} SquashBgzfCompressData;
+
+/* Each block is compressed into its own worst-case slot of the output
+   buffer, so the tasks don't depend on each other at all. */
+static SquashStatus
+squash_bgzf_compress_task (size_t task, void* user_data) {
+  SquashBgzfCompressData* data = (SquashBgzfCompressData*) user_data;
+  const size_t offset = task * SQUASH_BGZF_MAX_INPUT_SIZE;
+  const size_t remaining = data->uncompressed_size - offset;
+  z_stream zlib_stream = { 0, };
+  SquashStatus res;
+  int zlib_e;
+
+  zlib_stream.zalloc = squash_zlib_malloc;
+  zlib_stream.zfree = squash_zlib_free;
+
+  zlib_e = deflateInit2 (&zlib_stream, data->level, Z_DEFLATED, -15,
+                         SQUASH_ZLIB_DEFAULT_MEM_LEVEL, SQUASH_ZLIB_DEFAULT_STRATEGY);
+  if (HEDLEY_UNLIKELY(zlib_e != Z_OK))
+    return squash_error (zlib_e == Z_MEM_ERROR ? SQUASH_MEMORY : SQUASH_FAILED);
+
+  res = squash_bgzf_compress_block (&zlib_stream,
+                                    &(data->block_sizes[task]),
+                                    data->compressed + (task * SQUASH_BGZF_BLOCK_SIZE),
+                                    (remaining < SQUASH_BGZF_MAX_INPUT_SIZE) ? remaining : SQUASH_BGZF_MAX_INPUT_SIZE,
+                                    data->uncompressed + offset);
+
+  deflateEnd (&zlib_stream);
+
+  return res;
+}
+
+static SquashStatus
+squash_bgzf_compress_buffer_unsafe (SquashCodec* codec,
+                                    size_t* compressed_size,
+                                    uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                                    size_t uncompressed_size,
+                                    const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                                    SquashOptions* options) {
+  const size_t n_blocks = (uncompressed_size / SQUASH_BGZF_MAX_INPUT_SIZE) + ((uncompressed_size % SQUASH_BGZF_MAX_INPUT_SIZE) != 0);
+  size_t pos = 0;
+
+  if (n_blocks != 0) {
+    SquashBgzfCompressData data = {
+      squash_options_get_int_at (options, codec, SQUASH_BGZF_OPT_LEVEL),
+      uncompressed_size,
+      uncompressed,
+      compressed,
+      squash_malloc (n_blocks * sizeof (size_t))
+    };
+    if (HEDLEY_UNLIKELY(data.block_sizes == NULL))
+      return squash_error (SQUASH_MEMORY);
+
+    const SquashStatus res =
+      squash_parallel_run (n_blocks,
+                           (unsigned int) squash_options_get_int_at (options, codec, SQUASH_BGZF_OPT_THREADS),
+                           squash_bgzf_compress_task, &data);
+    if (HEDLEY_LIKELY(res == SQUASH_OK)) {
+      /* Close the gaps between the slots. */
+      for (size_t block = 0 ; block < n_blocks ; block++) {
+        memmove (compressed + pos, compressed + (block * SQUASH_BGZF_BLOCK_SIZE), data.block_sizes[block]);
+        pos += data.block_sizes[block];
+      }
+    }
+
+    squash_free (data.block_sizes);
+
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+  }
+
+  memcpy (compressed + pos, squash_bgzf_eof, sizeof (squash_bgzf_eof));
+  *compressed_size = pos + sizeof (squash_bgzf_eof);
+
+  return SQUASH_OK;
+}
+
+typedef struct SquashBgzfDecompressData_s {
+  z_stream stream;
+  const uint8_t* compressed;
+  size_t decompressed_size;
+  uint8_t* decompressed;
+  size_t pos;
+} SquashBgzfDecompressData;
+
+static SquashStatus
+squash_bgzf_decompress_frame (const SquashFrame* frame, void* user_data) {
+  SquashBgzfDecompressData* data = (SquashBgzfDecompressData*) user_data;
+  size_t size = data->decompressed_size - data->pos;
+
+  const SquashStatus res =
+    squash_bgzf_decompress_block (&(data->stream), &size, data->decompressed + data->pos,
+                                  frame->compressed_size, data->compressed + frame->compressed_offset);
+  if (HEDLEY_LIKELY(res == SQUASH_OK))
+    data->pos += size;
+
+  return res;
+}
+
+static SquashStatus
+squash_bgzf_decompress_buffer (SquashCodec* codec,
+                               size_t* decompressed_size,
+                               uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                               size_t compressed_size,
+                               const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                               SquashOptions* options) {
+  SquashBgzfDecompressData data = { { 0, }, compressed, *decompressed_size, decompressed, 0 };
+  SquashStatus res;
+  int zlib_e;
+
+  data.stream.zalloc = squash_zlib_malloc;
+  data.stream.zfree = squash_zlib_free;
+
+  zlib_e = inflateInit2 (&(data.stream), -15);
+  if (HEDLEY_UNLIKELY(zlib_e != Z_OK))
+    return squash_error (zlib_e == Z_MEM_ERROR ? SQUASH_MEMORY : SQUASH_FAILED);
+
+  res = squash_zlib_scan_frames (codec, compressed_size, compressed, squash_bgzf_decompress_frame, &data);
+  if (res == SQUASH_RANGE)
+    res = squash_error (SQUASH_INVALID_BUFFER);
+  else if (res == SQUASH_OK)
+    *decompressed_size = data.pos;
+
+  inflateEnd (&(data.stream));
+
+  return res;
+}
+
+static SquashStatus
+squash_bgzf_process_stream (SquashStream* stream, SquashOperation operation) {
+  SquashZlibStream* s = (SquashZlibStream*) stream;
+
+  if (stream->stream_type == SQUASH_STREAM_DECOMPRESS)
+    return squash_zlib_process_stream (stream, operation);
+
+  while (true) {
+    if (s->bgzf_out_pos != s->bgzf_out_size) {
+      const size_t remaining = s->bgzf_out_size - s->bgzf_out_pos;
+      const size_t cp = (remaining < stream->avail_out) ? remaining : stream->avail_out;
+
+      memcpy (stream->next_out, s->bgzf_out + s->bgzf_out_pos, cp);
+      stream->next_out += cp;
+      stream->avail_out -= cp;
+      s->bgzf_out_pos += cp;
+
+      if (s->bgzf_out_pos != s->bgzf_out_size)
+        return SQUASH_PROCESSING;
+    }
+
+    if (stream->avail_in != 0) {
+      const size_t space = SQUASH_BGZF_MAX_INPUT_SIZE - s->bgzf_in_size;
+      const size_t cp = (space < stream->avail_in) ? space : stream->avail_in;
+
+      memcpy (s->bgzf_in + s->bgzf_in_size, stream->next_in, cp);
+      stream->next_in += cp;
+      stream->avail_in -= cp;
+      s->bgzf_in_size += cp;
+    }
+
+    if (s->bgzf_in_size == SQUASH_BGZF_MAX_INPUT_SIZE ||
+        (operation != SQUASH_OPERATION_PROCESS && s->bgzf_in_size != 0)) {
+      /* Flushing simply ends the current block early. */
+      const SquashStatus res =
+        squash_bgzf_compress_block (&(s->stream), &(s->bgzf_out_size), s->bgzf_out, s->bgzf_in_size, s->bgzf_in);
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        return res;
+
+      s->bgzf_in_size = 0;
+      s->bgzf_out_pos = 0;
+    } else if (operation == SQUASH_OPERATION_FINISH && !s->bgzf_eof_written) {
+      memcpy (s->bgzf_out, squash_bgzf_eof, sizeof (squash_bgzf_eof));
+      s->bgzf_out_pos = 0;
+      s->bgzf_out_size = sizeof (squash_bgzf_eof);
+      s->bgzf_eof_written = true;
+    } else {
+      return SQUASH_OK;
+    }
+  }
+}
+
 SquashStatus
 squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   const char* name = squash_codec_get_name (codec);
@@ -366,6 +879,18 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
     impl->create_stream = squash_zlib_create_stream;
     impl->process_stream = squash_zlib_process_stream;
     impl->get_max_compressed_size = squash_zlib_get_max_compressed_size;
+    if (strcmp ("gzip", name) == 0)
+      impl->scan_frames = squash_zlib_scan_frames;
+  } else if (strcmp ("bgzf", name) == 0) {
+    impl->info = SQUASH_CODEC_INFO_CAN_FLUSH;
+    impl->options = squash_bgzf_options;
+    impl->create_stream = squash_zlib_create_stream;
+    impl->process_stream = squash_bgzf_process_stream;
+    impl->get_max_compressed_size = squash_bgzf_get_max_compressed_size;
+    impl->get_uncompressed_size = squash_bgzf_get_uncompressed_size;
+    impl->compress_buffer_unsafe = squash_bgzf_compress_buffer_unsafe;
+    impl->decompress_buffer = squash_bgzf_decompress_buffer;
+    impl->scan_frames = squash_zlib_scan_frames;
   } else {
     return SQUASH_UNABLE_TO_LOAD;
   }
@@ -190,6 +190,253 @@ squash_zling_splice (SquashCodec* codec,
   HEDLEY_UNREACHABLE ();
 }
 
+/* libzling reads this much input before encoding a block, so giving
+   it one block per call produces the same output as a single call
+   covering the whole stream. */
+#define SQUASH_ZLING_BLOCK_SIZE ((size_t) (1024 * 1024 * 16))
+
+struct _SquashZlingStream {
+  SquashStream base_object;
+
+  /* When compressing, the input for the current block.  The decoder
+     can't stop part way through, so when decompressing this is all of
+     the input until the stream is finished. */
+  uint8_t* input;
+  size_t input_size;
+  size_t input_allocated;
+
+  /* Output which didn't fit in next_out yet. */
+  uint8_t* output;
+  size_t output_size;
+  size_t output_pos;
+  size_t output_allocated;
+
+  bool decoded;
+};
+
+static bool
+squash_zling_append (uint8_t** buf, size_t* size, size_t* allocated, const uint8_t* data, size_t data_size) {
+  if (data_size == 0)
+    return true;
+
+  if (*allocated - *size < data_size) {
+    size_t new_size = (*allocated != 0) ? *allocated : 4096;
+    while (new_size - *size < data_size)
+      new_size *= 2;
+
+    uint8_t* new_buf = (uint8_t*) squash_realloc (*buf, new_size);
+    if (HEDLEY_UNLIKELY(new_buf == NULL))
+      return false;
+
+    *buf = new_buf;
+    *allocated = new_size;
+  }
+
+  memcpy (*buf + *size, data, data_size);
+  *size += data_size;
+
+  return true;
+}
+
+/* Copy pending output to next_out; returns true once none is left. */
+static bool
+squash_zling_stream_drain (SquashZlingStream* s) {
+  SquashStream* stream = &(s->base_object);
+  const size_t n = MIN(s->output_size - s->output_pos, stream->avail_out);
+
+  if (n != 0) {
+    memcpy (stream->next_out, s->output + s->output_pos, n);
+    stream->next_out += n;
+    stream->avail_out -= n;
+    s->output_pos += n;
+  }
+
+  if (s->output_pos != s->output_size)
+    return false;
+
+  s->output_size = s->output_pos = 0;
+  return true;
+}
+
+/* Feeds one buffer to libzling and writes straight to next_out,
+   keeping whatever doesn't fit for later. */
+struct SquashZlingBlockIO: public baidu::zling::Inputter, public baidu::zling::Outputter {
+public:
+  SquashZlingStream* stream_;
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_;
+  bool err_;
+
+  SquashZlingBlockIO(SquashZlingStream* stream, const uint8_t* data, size_t size) :
+    stream_ (stream),
+    data_ (data),
+    size_ (size),
+    pos_ (0),
+    err_ (false) { }
+
+  size_t GetData(unsigned char* buf, size_t len);
+  size_t PutData(unsigned char* buf, size_t len);
+  bool   IsEnd();
+  bool   IsErr();
+};
+
+size_t
+SquashZlingBlockIO::GetData (unsigned char* buf, size_t len) {
+  const size_t n = MIN(len, this->size_ - this->pos_);
+
+  if (n != 0)
+    memcpy (buf, this->data_ + this->pos_, n);
+  this->pos_ += n;
+
+  return n;
+}
+
+size_t
+SquashZlingBlockIO::PutData (unsigned char* buf, size_t len) {
+  SquashStream* stream = &(this->stream_->base_object);
+  const size_t direct = (this->stream_->output_size == 0) ? MIN(len, stream->avail_out) : 0;
+
+  if (direct != 0) {
+    memcpy (stream->next_out, buf, direct);
+    stream->next_out += direct;
+    stream->avail_out -= direct;
+  }
+
+  if (direct != len &&
+      !squash_zling_append (&(this->stream_->output), &(this->stream_->output_size), &(this->stream_->output_allocated),
+                            buf + direct, len - direct)) {
+    this->err_ = true;
+    return 0;
+  }
+
+  return len;
+}
+
+bool
+SquashZlingBlockIO::IsEnd () {
+  return this->pos_ == this->size_;
+}
+
+bool
+SquashZlingBlockIO::IsErr () {
+  return this->err_;
+}
+
+static SquashStatus
+squash_zling_stream_run (SquashZlingStream* s, const uint8_t* data, size_t size) {
+  SquashStream* stream = &(s->base_object);
+
+  try {
+    SquashZlingBlockIO io(s, data, size);
+    int zres;
+
+    if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
+      zres = baidu::zling::Encode(&io, &io, NULL, squash_options_get_int_at (stream->options, stream->codec, SQUASH_ZLING_OPT_LEVEL));
+    } else {
+      zres = baidu::zling::Decode(&io, &io, NULL);
+    }
+
+    if (zres == 0)
+      return SQUASH_OK;
+    else if (io.err_)
+      return squash_error (SQUASH_MEMORY);
+    else
+      return squash_error (SQUASH_FAILED);
+  } catch (const std::bad_alloc& e) {
+    return squash_error (SQUASH_MEMORY);
+  } catch (...) {
+    return squash_error (SQUASH_FAILED);
+  }
+
+  HEDLEY_UNREACHABLE ();
+}
+
+static void
+squash_zling_stream_destroy (void* stream) {
+  SquashZlingStream* s = (SquashZlingStream*) stream;
+
+  if (s->input != NULL)
+    squash_free (s->input);
+  if (s->output != NULL)
+    squash_free (s->output);
+
+  squash_stream_destroy (stream);
+}
+
+static SquashStream*
+squash_zling_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashZlingStream* stream;
+
+  assert (codec != NULL);
+  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
+
+  stream = (SquashZlingStream*) squash_malloc (sizeof (SquashZlingStream));
+  if (HEDLEY_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), (SquashStream*) NULL);
+
+  stream->input = NULL;
+  stream->input_size = stream->input_allocated = 0;
+  stream->output = NULL;
+  stream->output_size = stream->output_pos = stream->output_allocated = 0;
+  stream->decoded = false;
+  squash_stream_init ((SquashStream*) stream, codec, stream_type, options, squash_zling_stream_destroy);
+
+  return (SquashStream*) stream;
+}
+
+static SquashStatus
+squash_zling_process_stream (SquashStream* stream, SquashOperation operation) {
+  SquashZlingStream* s = (SquashZlingStream*) stream;
+  SquashStatus res;
+
+  if (!squash_zling_stream_drain (s))
+    return SQUASH_PROCESSING;
+
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS) {
+    while (stream->avail_in != 0) {
+      const size_t n = MIN(stream->avail_in, SQUASH_ZLING_BLOCK_SIZE - s->input_size);
+      if (HEDLEY_UNLIKELY(!squash_zling_append (&(s->input), &(s->input_size), &(s->input_allocated), stream->next_in, n)))
+        return squash_error (SQUASH_MEMORY);
+      stream->next_in += n;
+      stream->avail_in -= n;
+
+      if (s->input_size == SQUASH_ZLING_BLOCK_SIZE) {
+        res = squash_zling_stream_run (s, s->input, s->input_size);
+        s->input_size = 0;
+        if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+          return res;
+        if (!squash_zling_stream_drain (s))
+          return SQUASH_PROCESSING;
+      }
+    }
+
+    if (operation == SQUASH_OPERATION_FINISH && s->input_size != 0) {
+      res = squash_zling_stream_run (s, s->input, s->input_size);
+      s->input_size = 0;
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        return res;
+    }
+  } else {
+    if (HEDLEY_UNLIKELY(!squash_zling_append (&(s->input), &(s->input_size), &(s->input_allocated), stream->next_in, stream->avail_in)))
+      return squash_error (SQUASH_MEMORY);
+    stream->next_in += stream->avail_in;
+    stream->avail_in = 0;
+
+    if (operation == SQUASH_OPERATION_FINISH && !s->decoded) {
+      s->decoded = true;
+      res = squash_zling_stream_run (s, s->input, s->input_size);
+      squash_free (s->input);
+      s->input = NULL;
+      s->input_size = s->input_allocated = 0;
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        return res;
+    }
+  }
+
+  return squash_zling_stream_drain (s) ? SQUASH_OK : SQUASH_PROCESSING;
+}
+
 static size_t
 squash_zling_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
   return
@@ -212,6 +459,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
 
   if (HEDLEY_LIKELY(strcmp ("zling", name) == 0)) {
     impl->options = squash_zling_options;
+    impl->create_stream = squash_zling_create_stream;
+    impl->process_stream = squash_zling_process_stream;
     impl->splice = squash_zling_splice;
     impl->get_max_compressed_size = squash_zling_get_max_compressed_size;
   } else {
@@ -36,19 +36,46 @@
 #endif
 #endif
 
+#include <string>
+#include <vector>
+
 #include <squash/squash.h>
 
 #include <libzpaq.h>
 
 #define SQUASH_ZPAQ_DEFAULT_LEVEL 1
 
+/* libzpaq's compress() splits its input into blocks of this size (method
+ * "N" without a block size digit); each block is independent. */
+#define SQUASH_ZPAQ_DEFAULT_BLOCK_SIZE ((((size_t) 1) << 24) - 4096)
+#define SQUASH_ZPAQ_MIN_BLOCK_SIZE     (((size_t) 1) << 16)
+#define SQUASH_ZPAQ_MAX_BLOCK_SIZE     ((((size_t) 1) << 31) - 4096)
+
+/* How much compressed data to read at a time while looking for block
+ * boundaries. */
+#define SQUASH_ZPAQ_READ_SIZE (((size_t) 1) << 20)
+
+/* Every block written by libzpaq starts with a locator tag followed by
+ * "zPQ", and ends with 0xff. */
+#define SQUASH_ZPAQ_BLOCK_TAG_SIZE 16
+static const uint8_t squash_zpaq_block_tag[SQUASH_ZPAQ_BLOCK_TAG_SIZE] = {
+  0x37, 0x6b, 0x53, 0x74, 0xa0, 0x31, 0x83, 0xd3,
+  0x8c, 0xb2, 0x28, 0xb0, 0xd3, 'z',  'P',  'Q'
+};
+
 enum SquashZpaqOptIndex {
-  SQUASH_ZPAQ_OPT_LEVEL = 0
+  SQUASH_ZPAQ_OPT_LEVEL = 0,
+  SQUASH_ZPAQ_OPT_BLOCK_SIZE,
+  SQUASH_ZPAQ_OPT_THREADS
 };
 
 static SquashOptionInfo squash_zpaq_options[] = {
   { (char*) "level",
     SQUASH_OPTION_TYPE_RANGE_INT, },
+  { (char*) "block-size",
+    SQUASH_OPTION_TYPE_RANGE_SIZE, },
+  { (char*) "threads",
+    SQUASH_OPTION_TYPE_RANGE_INT, },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -66,10 +93,74 @@ public:
   int read (char* buf, int n);
   void write (const char* buf, int n);
 
+  /* Data which has already been pulled from reader_, returned before
+     anything else is read. */
+  std::string pending_;
+  size_t pending_pos_;
+
   SquashZpaqIO(void* user_data, SquashReadFunc reader, SquashWriteFunc writer) :
     user_data_ (user_data),
     reader_ (reader),
-    writer_ (writer) { }
+    writer_ (writer),
+    pending_pos_ (0) { }
+};
+
+class SquashZpaqMemoryReader: public libzpaq::Reader {
+public:
+  const uint8_t* data_;
+  size_t size_;
+  size_t pos_;
+
+  int get () {
+    return HEDLEY_LIKELY(this->pos_ < this->size_) ? (int) this->data_[this->pos_++] : -1;
+  }
+
+  int read (char* buf, int n) {
+    size_t l = this->size_ - this->pos_;
+    if (l > (size_t) n)
+      l = (size_t) n;
+    memcpy (buf, this->data_ + this->pos_, l);
+    this->pos_ += l;
+    return (int) l;
+  }
+
+  SquashZpaqMemoryReader(const uint8_t* data, size_t size) :
+    data_ (data),
+    size_ (size),
+    pos_ (0) { }
+};
+
+/* One block of a batch being compressed or decompressed in parallel. */
+class SquashZpaqBlock {
+public:
+  libzpaq::StringBuffer input;
+  libzpaq::StringBuffer output;
+  const uint8_t* compressed;
+  size_t compressed_size;
+  SquashStatus res;
+
+  SquashZpaqBlock() :
+    compressed (NULL),
+    compressed_size (0),
+    res (SQUASH_OK) { }
+};
+
+class SquashZpaqBatch {
+public:
+  SquashZpaqBlock* blocks;
+  const char* method;
+
+  SquashZpaqBatch(unsigned int n_blocks, const char* m) :
+    blocks (new SquashZpaqBlock[n_blocks]),
+    method (m) { }
+
+  ~SquashZpaqBatch() {
+    delete[] this->blocks;
+  }
+
+private:
+  SquashZpaqBatch(const SquashZpaqBatch&);
+  void operator=(const SquashZpaqBatch&);
 };
 
 extern "C" SQUASH_PLUGIN_EXPORT
@@ -89,11 +180,20 @@ libzpaq::error (const char* msg) {
 }
 
 int SquashZpaqIO::get () {
-  char v;
-  return (this->read(&v, 1)) ? (int) v : -1;
+  uint8_t v;
+  return (this->read((char*) &v, 1)) ? (int) v : -1;
 }
 
 int SquashZpaqIO::read (char* buf, int size) {
+  if (HEDLEY_UNLIKELY(this->pending_pos_ < this->pending_.size())) {
+    size_t l = this->pending_.size() - this->pending_pos_;
+    if (l > (size_t) size)
+      l = (size_t) size;
+    memcpy (buf, this->pending_.data() + this->pending_pos_, l);
+    this->pending_pos_ += l;
+    return (int) l;
+  }
+
   size_t l = (size_t) size;
   this->reader_ (&l, (uint8_t*) buf, this->user_data_);
   return l;
@@ -111,6 +211,254 @@ void SquashZpaqIO::write (const char* buf, int n) {
     throw res;
 }
 
+static unsigned int
+squash_zpaq_get_threads (SquashCodec* codec, SquashOptions* options) {
+  unsigned int threads = (unsigned int) squash_options_get_int_at (options, codec, SQUASH_ZPAQ_OPT_THREADS);
+
+  if (threads == 0)
+    threads = squash_get_cpu_count ();
+
+  return (threads == 0) ? 1 : threads;
+}
+
+static SquashStatus
+squash_zpaq_task_status (void) {
+  try {
+    throw;
+  } catch (const std::bad_alloc& e) {
+    (void) e;
+    return squash_error (SQUASH_MEMORY);
+  } catch (const SquashStatus e) {
+    return e;
+  } catch (...) {
+    return squash_error (SQUASH_FAILED);
+  }
+}
+
+static SquashStatus
+squash_zpaq_compress_task (size_t task, void* user_data) {
+  SquashZpaqBatch* batch = (SquashZpaqBatch*) user_data;
+  SquashZpaqBlock* block = &(batch->blocks[task]);
+
+  try {
+    libzpaq::compressBlock (&(block->input), &(block->output), batch->method);
+  } catch (...) {
+    return block->res = squash_zpaq_task_status ();
+  }
+
+  return block->res = SQUASH_OK;
+}
+
+static SquashStatus
+squash_zpaq_decompress_task (size_t task, void* user_data) {
+  SquashZpaqBatch* batch = (SquashZpaqBatch*) user_data;
+  SquashZpaqBlock* block = &(batch->blocks[task]);
+
+  try {
+    SquashZpaqMemoryReader reader(block->compressed, block->compressed_size);
+    libzpaq::decompress (&reader, &(block->output));
+  } catch (...) {
+    return block->res = squash_zpaq_task_status ();
+  }
+
+  return block->res = SQUASH_OK;
+}
+
+/* Keep reading until the buffer is full or the input runs out. */
+static SquashStatus
+squash_zpaq_read_full (SquashReadFunc read_cb, void* user_data,
+                       uint8_t* buf, size_t size,
+                       size_t* read_size, bool* eof) {
+  *read_size = 0;
+
+  while (*read_size < size && !*eof) {
+    size_t l = size - *read_size;
+    const SquashStatus res = read_cb (&l, buf + *read_size, user_data);
+    *read_size += l;
+    if (res == SQUASH_END_OF_STREAM)
+      *eof = true;
+    else if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+  }
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_zpaq_write_blocks (SquashZpaqBatch* batch, size_t n_blocks,
+                          SquashWriteFunc write_cb, void* user_data) {
+  for (size_t i = 0 ; i < n_blocks ; i++) {
+    SquashZpaqBlock* block = &(batch->blocks[i]);
+    if (HEDLEY_UNLIKELY(block->res != SQUASH_OK))
+      return block->res;
+
+    size_t l = block->output.size ();
+    if (l != 0) {
+      const SquashStatus res = write_cb (&l, (const uint8_t*) block->output.data (), user_data);
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        return res;
+    }
+  }
+
+  return SQUASH_OK;
+}
+
+/* Reads up to one block per thread, compresses each with
+ * compressBlock() (which is all compress() does), and writes the
+ * results in order.  The output is the same as compress() with the
+ * same block size. */
+static SquashStatus
+squash_zpaq_compress_splice (const char* method, size_t block_size, unsigned int threads,
+                             SquashReadFunc read_cb, SquashWriteFunc write_cb, void* user_data) {
+  SquashZpaqBatch batch(threads, method);
+  bool eof = false;
+
+  while (!eof) {
+    size_t n_blocks = 0;
+
+    for (; n_blocks < threads && !eof ; n_blocks++) {
+      SquashZpaqBlock* block = &(batch.blocks[n_blocks]);
+      size_t l;
+
+      block->input.resize (0);
+      block->input.write (NULL, (int) block_size);
+      block->output.resize (0);
+
+      const SquashStatus res = squash_zpaq_read_full (read_cb, user_data, block->input.data (), block_size, &l, &eof);
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        return res;
+
+      block->input.resize (l);
+      if (l == 0)
+        break;
+    }
+
+    if (n_blocks == 0)
+      break;
+
+    SquashStatus res = squash_parallel_run (n_blocks, threads, squash_zpaq_compress_task, &batch);
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+
+    res = squash_zpaq_write_blocks (&batch, n_blocks, write_cb, user_data);
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+  }
+
+  return SQUASH_OK;
+}
+
+static bool
+squash_zpaq_is_block_start (const std::string& buf, size_t pos) {
+  return
+    buf.size () - pos >= SQUASH_ZPAQ_BLOCK_TAG_SIZE &&
+    memcmp (buf.data () + pos, squash_zpaq_block_tag, SQUASH_ZPAQ_BLOCK_TAG_SIZE) == 0;
+}
+
+/* Position of the next block starting at or after pos, or
+ * std::string::npos.  A block always follows the 0xff which ends the
+ * previous one. */
+static size_t
+squash_zpaq_find_block (const std::string& buf, size_t pos) {
+  if (buf.size () < SQUASH_ZPAQ_BLOCK_TAG_SIZE)
+    return std::string::npos;
+
+  const size_t last = buf.size () - SQUASH_ZPAQ_BLOCK_TAG_SIZE;
+  const char* data = buf.data ();
+
+  while (pos <= last) {
+    const char* tag = (const char*) memchr (data + pos, squash_zpaq_block_tag[0], last - pos + 1);
+    if (tag == NULL)
+      break;
+
+    pos = (size_t) (tag - data);
+    if (pos > 0 && (uint8_t) data[pos - 1] == 0xff && squash_zpaq_is_block_start (buf, pos))
+      return pos;
+    pos++;
+  }
+
+  return std::string::npos;
+}
+
+/* Splits the input at block boundaries and decompresses up to one
+ * block per thread at a time.  Input which doesn't start with a block
+ * is handed to libzpaq's decompress() as-is. */
+static SquashStatus
+squash_zpaq_decompress_splice (unsigned int threads,
+                               SquashReadFunc read_cb, SquashWriteFunc write_cb, void* user_data) {
+  SquashZpaqIO stream(user_data, read_cb, write_cb);
+  std::string& buf = stream.pending_;
+  bool eof = false;
+  size_t l;
+
+  buf.resize (SQUASH_ZPAQ_READ_SIZE);
+  SquashStatus res = squash_zpaq_read_full (read_cb, user_data, (uint8_t*) &(buf[0]), SQUASH_ZPAQ_READ_SIZE, &l, &eof);
+  if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+    return res;
+  buf.resize (l);
+
+  if (!squash_zpaq_is_block_start (buf, 0)) {
+    decompress (&stream, &stream);
+    return SQUASH_OK;
+  }
+
+  SquashZpaqBatch batch(threads, NULL);
+  std::vector<size_t> ends(threads);
+  size_t search_pos = 1;
+
+  while (!(eof && buf.empty ())) {
+    size_t n_blocks = 0;
+
+    while (n_blocks < threads) {
+      const size_t pos = squash_zpaq_find_block (buf, search_pos);
+      if (pos != std::string::npos) {
+        ends[n_blocks++] = pos;
+        search_pos = pos + 1;
+        continue;
+      } else if (eof) {
+        ends[n_blocks++] = buf.size ();
+        break;
+      }
+
+      if (buf.size () >= SQUASH_ZPAQ_BLOCK_TAG_SIZE && search_pos < buf.size () - SQUASH_ZPAQ_BLOCK_TAG_SIZE + 1)
+        search_pos = buf.size () - SQUASH_ZPAQ_BLOCK_TAG_SIZE + 1;
+
+      const size_t old_size = buf.size ();
+      buf.resize (old_size + SQUASH_ZPAQ_READ_SIZE);
+      l = SQUASH_ZPAQ_READ_SIZE;
+      res = read_cb (&l, (uint8_t*) &(buf[old_size]), user_data);
+      buf.resize (old_size + l);
+      if (res == SQUASH_END_OF_STREAM) {
+        eof = true;
+      } else if (HEDLEY_UNLIKELY(res != SQUASH_OK)) {
+        return res;
+      }
+    }
+
+    for (size_t i = 0 ; i < n_blocks ; i++) {
+      SquashZpaqBlock* block = &(batch.blocks[i]);
+      const size_t start = (i == 0) ? 0 : ends[i - 1];
+
+      block->compressed = (const uint8_t*) buf.data () + start;
+      block->compressed_size = ends[i] - start;
+      block->output.resize (0);
+    }
+
+    res = squash_parallel_run (n_blocks, threads, squash_zpaq_decompress_task, &batch);
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+
+    res = squash_zpaq_write_blocks (&batch, n_blocks, write_cb, user_data);
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+
+    buf.erase (0, ends[n_blocks - 1]);
+    search_pos = 1;
+  }
+
+  return SQUASH_OK;
+}
+
 static SquashStatus
 squash_zpaq_splice (SquashCodec* codec,
                     SquashOptions* options,
@@ -118,14 +466,20 @@ squash_zpaq_splice (SquashCodec* codec,
                     SquashReadFunc read_cb,
                     SquashWriteFunc write_cb,
                     void* user_data) {
+  const unsigned int threads = squash_zpaq_get_threads (codec, options);
+
   try {
-    SquashZpaqIO stream(user_data, read_cb, write_cb);
     if (stream_type == SQUASH_STREAM_COMPRESS) {
       char level_s[3] = { 0, };
       snprintf (level_s, sizeof(level_s), "%d", squash_options_get_int_at (options, codec, SQUASH_ZPAQ_OPT_LEVEL));
 
-      compress (&stream, &stream, level_s);
+      return squash_zpaq_compress_splice (level_s,
+                                          squash_options_get_size_at (options, codec, SQUASH_ZPAQ_OPT_BLOCK_SIZE),
+                                          threads, read_cb, write_cb, user_data);
+    } else if (threads > 1) {
+      return squash_zpaq_decompress_splice (threads, read_cb, write_cb, user_data);
     } else {
+      SquashZpaqIO stream(user_data, read_cb, write_cb);
       decompress (&stream, &stream);
     }
   } catch (const std::bad_alloc& e) {
@@ -145,15 +499,21 @@ squash_zpaq_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_siz
   return
     uncompressed_size +
     ((uncompressed_size / 100) * 1) + ((uncompressed_size % 100) > 0 ? 1 : 0) +
-    377;
+    (377 * ((uncompressed_size / SQUASH_ZPAQ_MIN_BLOCK_SIZE) + 1));
 }
 
 extern "C" SquashStatus
 squash_plugin_init_plugin (SquashPlugin* plugin) {
   const SquashOptionInfoRangeInt level_range = { 1, 5, 0, false };
+  const SquashOptionInfoRangeSize block_size_range = { SQUASH_ZPAQ_MIN_BLOCK_SIZE, SQUASH_ZPAQ_MAX_BLOCK_SIZE, 0, false };
+  const SquashOptionInfoRangeInt threads_range = { 0, 256, 0, false };
 
   squash_zpaq_options[SQUASH_ZPAQ_OPT_LEVEL].default_value.int_value = 1;
   squash_zpaq_options[SQUASH_ZPAQ_OPT_LEVEL].info.range_int = level_range;
+  squash_zpaq_options[SQUASH_ZPAQ_OPT_BLOCK_SIZE].default_value.size_value = SQUASH_ZPAQ_DEFAULT_BLOCK_SIZE;
+  squash_zpaq_options[SQUASH_ZPAQ_OPT_BLOCK_SIZE].info.range_size = block_size_range;
+  squash_zpaq_options[SQUASH_ZPAQ_OPT_THREADS].default_value.int_value = 1;
+  squash_zpaq_options[SQUASH_ZPAQ_OPT_THREADS].info.range_int = threads_range;
 
   return SQUASH_OK;
 }
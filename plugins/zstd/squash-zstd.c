@@ -25,29 +25,41 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
 #include <squash/squash.h>
 
+/* Experimental parameters (such as the stable buffer flags) are
+   only declared with ZSTD_STATIC_LINKING_ONLY.  They're passed by
+   value, so they are safe to use with a shared libzstd; experimental
+   functions are only used when zstd is embedded. */
+#define ZSTD_STATIC_LINKING_ONLY
+
 #include <zstd.h>
+#include <zstd_errors.h>
 
-/* Use non-public APIs. */
-#if defined(SQUASH_ZSTD_EMBED)
-#  define ZSTD_STATIC_LINKING_ONLY
-#  include "zstd/lib/common/error_public.h"
+#if ZSTD_VERSION_NUMBER < 10400
+#  error "zstd 1.4.0 or later is required"
 #endif
 
-
 typedef struct SquashZstdStream_s {
   SquashStream base_object;
-  ZSTD_CStream* cstream;
-  ZSTD_DStream* dstream;
+  ZSTD_CCtx* cctx;
+  ZSTD_DCtx* dctx;
   size_t last_res;
+
+  /* With the stable-buffers option, the start of the caller's input
+     (when compressing) or output (when decompressing) buffer.  zstd
+     is always handed the whole buffer so far, not just the part
+     after next_in/next_out. */
+  bool stable;
+  uint8_t* stable_base;
 } SquashZstdStream;
 
-#if defined(ZSTD_STATIC_LINKING_ONLY)
+#if defined(SQUASH_ZSTD_EMBED)
 static void*
 squash_zstd_malloc (void* opaque, size_t size) {
   void* address = squash_malloc (size);
@@ -60,6 +72,8 @@ squash_zstd_free (void * opaque, void* address) {
   (void)opaque;
   squash_free (address);
 }
+
+static const ZSTD_customMem squash_zstd_custom_mem = { squash_zstd_malloc, squash_zstd_free, NULL };
 #endif
 
 
@@ -67,16 +81,63 @@ SQUASH_PLUGIN_EXPORT
 SquashStatus squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl);
 
 enum SquashZstdOptIndex {
-  SQUASH_ZSTD_OPT_LEVEL = 0
+  SQUASH_ZSTD_OPT_LEVEL = 0,
+  SQUASH_ZSTD_OPT_STRATEGY,
+  SQUASH_ZSTD_OPT_WINDOW_LOG,
+  SQUASH_ZSTD_OPT_LONG,
+  SQUASH_ZSTD_OPT_WORKERS,
+  SQUASH_ZSTD_OPT_JOB_SIZE,
+  SQUASH_ZSTD_OPT_STABLE_BUFFERS
 };
 
 static SquashOptionInfo squash_zstd_options[] = {
   { "level",
     SQUASH_OPTION_TYPE_RANGE_INT,
     .info.range_int = {
-      .min = 1,
+      /* Negative levels are the "fast" levels; -(1 << 17) is
+         ZSTD_minCLevel(), which isn't a constant expression. */
+      .min = -(1 << 17),
       .max = 22 },
     .default_value.int_value = 9 },
+  { "strategy",
+    SQUASH_OPTION_TYPE_ENUM_STRING,
+    .info.enum_string = {
+      .values = (const SquashOptionInfoEnumStringMap []) {
+        { "default", 0 },
+        { "fast", ZSTD_fast },
+        { "dfast", ZSTD_dfast },
+        { "greedy", ZSTD_greedy },
+        { "lazy", ZSTD_lazy },
+        { "lazy2", ZSTD_lazy2 },
+        { "btlazy2", ZSTD_btlazy2 },
+        { "btopt", ZSTD_btopt },
+        { "btultra", ZSTD_btultra },
+        { "btultra2", ZSTD_btultra2 },
+        { NULL, 0 } } },
+    .default_value.int_value = 0 },
+  { "window-log",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = ZSTD_WINDOWLOG_MIN,
+      .max = ZSTD_WINDOWLOG_MAX,
+      .modulus = 0,
+      .allow_zero = true },
+    .default_value.int_value = 0 },
+  { "long",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = false },
+  { "workers",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 200 },
+    .default_value.int_value = 0 },
+  { "job-size",
+    SQUASH_OPTION_TYPE_SIZE,
+    .default_value.size_value = 0 },
+  { "stable-buffers",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = false },
   { NULL, SQUASH_OPTION_TYPE_NONE, }
 };
 
@@ -85,49 +146,169 @@ squash_zstd_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_siz
   return ZSTD_compressBound (uncompressed_size);
 }
 
+static size_t
+squash_zstd_get_uncompressed_size (SquashCodec* codec,
+                                   size_t compressed_size,
+                                   const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]) {
+  /* The input may contain several frames (and skippable frames,
+     which have a content size of 0), so add them all up.  If any
+     frame doesn't record its size the total is unknown. */
+  unsigned long long total = 0;
+
+  while (compressed_size > 0) {
+    const unsigned long long content_size = ZSTD_getFrameContentSize (compressed, compressed_size);
+    if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR)
+      return 0;
+
+    const size_t frame_size = ZSTD_findFrameCompressedSize (compressed, compressed_size);
+    if (ZSTD_isError (frame_size) || frame_size > compressed_size)
+      return 0;
+
+    total += content_size;
+    if (HEDLEY_UNLIKELY(total < content_size || total > SIZE_MAX))
+      return 0;
+
+    compressed += frame_size;
+    compressed_size -= frame_size;
+  }
+
+  return (size_t) total;
+}
+
+static SquashStatus
+squash_zstd_scan_frames (SquashCodec* codec,
+                         size_t compressed_size,
+                         const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                         SquashFrameFunc func,
+                         void* user_data) {
+  size_t pos = 0;
+
+  while (pos < compressed_size) {
+    const size_t frame_size = ZSTD_findFrameCompressedSize (compressed + pos, compressed_size - pos);
+    if (ZSTD_isError (frame_size) || frame_size > (compressed_size - pos))
+      return SQUASH_INVALID_BUFFER;
+
+    /* Skippable frames carry no data; leave them out. */
+    if ((compressed_size - pos) < 4 ||
+        ((((uint32_t) compressed[pos    ]      ) |
+          ((uint32_t) compressed[pos + 1] <<  8) |
+          ((uint32_t) compressed[pos + 2] << 16) |
+          ((uint32_t) compressed[pos + 3] << 24)) & ZSTD_MAGIC_SKIPPABLE_MASK) != ZSTD_MAGIC_SKIPPABLE_START) {
+      const unsigned long long content_size = ZSTD_getFrameContentSize (compressed + pos, compressed_size - pos);
+      if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR || content_size > SIZE_MAX)
+        return SQUASH_RANGE;
+
+      const SquashFrame frame = { pos, frame_size, (size_t) content_size };
+      const SquashStatus res = func (&frame, user_data);
+      if (res != SQUASH_OK)
+        return res;
+    }
+
+    pos += frame_size;
+  }
+
+  return SQUASH_OK;
+}
+
 static SquashStatus
 squash_zstd_status_from_zstd_error (size_t res) {
   if (!ZSTD_isError (res))
     return SQUASH_OK;
 
-#if defined(ZSTD_STATIC_LINKING_ONLY)
-  const ZSTD_ErrorCode error_code = (ZSTD_ErrorCode) (-(int)(res));
-
-  switch (error_code) {
+  switch ((int) ZSTD_getErrorCode (res)) {
     case ZSTD_error_no_error:
       return SQUASH_OK;
     case ZSTD_error_memory_allocation:
       return squash_error (SQUASH_MEMORY);
     case ZSTD_error_dstSize_tooSmall:
-      /* To detect ABI breaks */
-      assert (strcmp (ZSTD_getErrorName (res), "Destination buffer is too small") == 0);
       return squash_error (SQUASH_BUFFER_FULL);
-    case ZSTD_error_GENERIC:
-    case ZSTD_error_prefix_unknown:
-    case ZSTD_error_frameParameter_unsupported:
-    case ZSTD_error_frameParameter_unsupportedBy32bits:
-    case ZSTD_error_init_missing:
-    case ZSTD_error_stage_wrong:
-    case ZSTD_error_srcSize_wrong:
-    case ZSTD_error_corruption_detected:
-    case ZSTD_error_tableLog_tooLarge:
-    case ZSTD_error_maxSymbolValue_tooLarge:
-    case ZSTD_error_maxSymbolValue_tooSmall:
-    case ZSTD_error_dictionary_corrupted:
-    case ZSTD_error_maxCode:
-    case ZSTD_error_compressionParameter_unsupported:
-    case ZSTD_error_checksum_wrong:
-    case ZSTD_error_dictionary_wrong:
-    case ZSTD_error_version_unsupported:
-    case ZSTD_error_parameter_unknown:
+    case ZSTD_error_parameter_unsupported:
+    case ZSTD_error_parameter_outOfBound:
+      return squash_error (SQUASH_BAD_VALUE);
     default:
       return squash_error (SQUASH_FAILED);
   }
+}
+
+static SquashStatus
+squash_zstd_cctx_set_options (ZSTD_CCtx* cctx, SquashCodec* codec, SquashOptions* options) {
+  size_t res;
+
+  res = ZSTD_CCtx_setParameter (cctx, ZSTD_c_compressionLevel,
+                                squash_options_get_int_at (options, codec, SQUASH_ZSTD_OPT_LEVEL));
+  if (HEDLEY_UNLIKELY(ZSTD_isError (res)))
+    return squash_zstd_status_from_zstd_error (res);
+
+  const int strategy = squash_options_get_int_at (options, codec, SQUASH_ZSTD_OPT_STRATEGY);
+  if (strategy != 0) {
+    res = ZSTD_CCtx_setParameter (cctx, ZSTD_c_strategy, strategy);
+    if (HEDLEY_UNLIKELY(ZSTD_isError (res)))
+      return squash_zstd_status_from_zstd_error (res);
+  }
+
+  const int window_log = squash_options_get_int_at (options, codec, SQUASH_ZSTD_OPT_WINDOW_LOG);
+  if (window_log != 0) {
+    res = ZSTD_CCtx_setParameter (cctx, ZSTD_c_windowLog, window_log);
+    if (HEDLEY_UNLIKELY(ZSTD_isError (res)))
+      return squash_zstd_status_from_zstd_error (res);
+  }
+
+  if (squash_options_get_bool_at (options, codec, SQUASH_ZSTD_OPT_LONG)) {
+    res = ZSTD_CCtx_setParameter (cctx, ZSTD_c_enableLongDistanceMatching, 1);
+    if (HEDLEY_UNLIKELY(ZSTD_isError (res)))
+      return squash_zstd_status_from_zstd_error (res);
+  }
+
+  const int workers = squash_options_get_int_at (options, codec, SQUASH_ZSTD_OPT_WORKERS);
+  if (workers != 0) {
+    /* If zstd was built without threading support this fails with
+       parameter_unsupported; just compress on the calling thread. */
+    res = ZSTD_CCtx_setParameter (cctx, ZSTD_c_nbWorkers, workers);
+    if (!ZSTD_isError (res)) {
+      const size_t job_size = squash_options_get_size_at (options, codec, SQUASH_ZSTD_OPT_JOB_SIZE);
+      if (job_size != 0) {
+        res = ZSTD_CCtx_setParameter (cctx, ZSTD_c_jobSize, job_size > INT_MAX ? INT_MAX : (int) job_size);
+        if (HEDLEY_UNLIKELY(ZSTD_isError (res)))
+          return squash_zstd_status_from_zstd_error (res);
+      }
+    } else if (ZSTD_getErrorCode (res) != ZSTD_error_parameter_unsupported) {
+      return squash_zstd_status_from_zstd_error (res);
+    }
+  }
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_zstd_dctx_set_options (ZSTD_DCtx* dctx, SquashCodec* codec, SquashOptions* options) {
+  /* Frames with a window larger than ZSTD_WINDOWLOG_LIMIT_DEFAULT
+     (which long mode may produce) are rejected unless the decoder is
+     told to expect them. */
+  const int window_log = squash_options_get_int_at (options, codec, SQUASH_ZSTD_OPT_WINDOW_LOG);
+  if (window_log != 0) {
+    const size_t res = ZSTD_DCtx_setParameter (dctx, ZSTD_d_windowLogMax, window_log);
+    if (HEDLEY_UNLIKELY(ZSTD_isError (res)))
+      return squash_zstd_status_from_zstd_error (res);
+  }
+
+  return SQUASH_OK;
+}
+
+static ZSTD_CCtx*
+squash_zstd_cctx_new (void) {
+#if defined(SQUASH_ZSTD_EMBED)
+  return ZSTD_createCCtx_advanced (squash_zstd_custom_mem);
 #else
-  if (strcmp (ZSTD_getErrorName (res), "Destination buffer is too small") == 0)
-    return squash_error (SQUASH_BUFFER_FULL);
+  return ZSTD_createCCtx ();
+#endif
+}
 
-  return squash_error (SQUASH_FAILED);
+static ZSTD_DCtx*
+squash_zstd_dctx_new (void) {
+#if defined(SQUASH_ZSTD_EMBED)
+  return ZSTD_createDCtx_advanced (squash_zstd_custom_mem);
+#else
+  return ZSTD_createDCtx ();
 #endif
 }
 
@@ -138,9 +319,21 @@ squash_zstd_decompress_buffer (SquashCodec* codec,
                                size_t compressed_size,
                                const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
                                SquashOptions* options) {
-  *decompressed_size = ZSTD_decompress (decompressed, *decompressed_size, compressed, compressed_size);
+  ZSTD_DCtx* dctx = squash_zstd_dctx_new ();
+  if (HEDLEY_UNLIKELY(dctx == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  SquashStatus res = squash_zstd_dctx_set_options (dctx, codec, options);
+  if (HEDLEY_LIKELY(res == SQUASH_OK)) {
+    const size_t zres = ZSTD_decompressDCtx (dctx, decompressed, *decompressed_size, compressed, compressed_size);
+    res = squash_zstd_status_from_zstd_error (zres);
+    if (HEDLEY_LIKELY(res == SQUASH_OK))
+      *decompressed_size = zres;
+  }
 
-  return squash_zstd_status_from_zstd_error (*decompressed_size);
+  ZSTD_freeDCtx (dctx);
+
+  return res;
 }
 
 static SquashStatus
@@ -150,83 +343,97 @@ squash_zstd_compress_buffer (SquashCodec* codec,
                              size_t uncompressed_size,
                              const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
                              SquashOptions* options) {
-  const int level = squash_options_get_int_at (options, codec, SQUASH_ZSTD_OPT_LEVEL);
+  ZSTD_CCtx* cctx = squash_zstd_cctx_new ();
+  if (HEDLEY_UNLIKELY(cctx == NULL))
+    return squash_error (SQUASH_MEMORY);
+
+  /* ZSTD_compress2 knows the size of the input, so with the content
+     size flag (which is the default, but we rely on it) the frame
+     header records it for squash_zstd_get_uncompressed_size. */
+  SquashStatus res = squash_zstd_cctx_set_options (cctx, codec, options);
+  if (HEDLEY_LIKELY(res == SQUASH_OK))
+    res = squash_zstd_status_from_zstd_error (ZSTD_CCtx_setParameter (cctx, ZSTD_c_contentSizeFlag, 1));
+  if (HEDLEY_LIKELY(res == SQUASH_OK)) {
+    const size_t zres = ZSTD_compress2 (cctx, compressed, *compressed_size, uncompressed, uncompressed_size);
+    res = squash_zstd_status_from_zstd_error (zres);
+    if (HEDLEY_LIKELY(res == SQUASH_OK))
+      *compressed_size = zres;
+  }
 
-  *compressed_size = ZSTD_compress (compressed, *compressed_size, uncompressed, uncompressed_size, level);
+  ZSTD_freeCCtx (cctx);
 
-  return squash_zstd_status_from_zstd_error (*compressed_size);
+  return res;
 }
 
 static void
 squash_zstd_stream_destroy (void* s) {
   SquashZstdStream* stream = (SquashZstdStream*) s;
 
-  if (((SquashStream*) s)->stream_type == SQUASH_STREAM_COMPRESS) {
-    ZSTD_freeCStream(stream->cstream);
-  } else {
-    ZSTD_freeDStream(stream->dstream);
-  }
+  ZSTD_freeCCtx (stream->cctx);
+  ZSTD_freeDCtx (stream->dctx);
 
   squash_stream_destroy (stream);
 }
 
-
-static SquashStream*
-squash_zstd_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
-  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
-
-#if defined(ZSTD_STATIC_LINKING_ONLY)
-  ZSTD_customMem cMem = { squash_zstd_malloc, squash_zstd_free, NULL };
-#endif
-
-  SquashZstdStream* stream = squash_malloc(sizeof (SquashZstdStream));
-  squash_stream_init ((SquashStream*)stream, codec, stream_type, options, squash_zstd_stream_destroy);
-
-  if(stream_type == SQUASH_STREAM_COMPRESS) {
-#if defined(ZSTD_STATIC_LINKING_ONLY)
-    stream->cstream = ZSTD_createCStream_advanced(cMem);
+static SquashStatus
+squash_zstd_stream_set_stable (SquashZstdStream* stream) {
+#if defined(ZSTD_c_stableInBuffer) && defined(ZSTD_d_stableOutBuffer)
+  const size_t res = (((SquashStream*) stream)->stream_type == SQUASH_STREAM_COMPRESS) ?
+    ZSTD_CCtx_setParameter (stream->cctx, ZSTD_c_stableInBuffer, 1) :
+    ZSTD_DCtx_setParameter (stream->dctx, ZSTD_d_stableOutBuffer, 1);
+
+  /* Older versions of libzstd don't know about it; that's fine, it
+     just means an extra copy. */
+  if (!ZSTD_isError (res))
+    stream->stable = true;
+  else if (ZSTD_getErrorCode (res) != ZSTD_error_parameter_unsupported)
+    return squash_zstd_status_from_zstd_error (res);
 #else
-    stream->cstream = ZSTD_createCStream();
+  (void) stream;
 #endif
-    stream->dstream = NULL;
-    stream->last_res = 0;
 
-    if(stream->cstream == NULL) {
-      squash_free(stream);
-      return NULL;
-    }
+  return SQUASH_OK;
+}
 
-    const int level = squash_options_get_int_at (options, codec, SQUASH_ZSTD_OPT_LEVEL);
-    size_t const initResult = ZSTD_initCStream(stream->cstream, level);
-    if (ZSTD_isError(initResult)) {
-      ZSTD_freeCStream(stream->cstream);
-      squash_free(stream);
-      return NULL;
-    }
+static SquashStream*
+squash_zstd_create_stream (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
+  SquashZstdStream* stream = squash_malloc (sizeof (SquashZstdStream));
+  if (HEDLEY_UNLIKELY(stream == NULL))
+    return (squash_error (SQUASH_MEMORY), NULL);
+
+  squash_stream_init ((SquashStream*) stream, codec, stream_type, options, squash_zstd_stream_destroy);
+  stream->cctx = NULL;
+  stream->dctx = NULL;
+  stream->last_res = 0;
+  stream->stable = false;
+  stream->stable_base = NULL;
+
+  SquashStatus res;
+  if (stream_type == SQUASH_STREAM_COMPRESS) {
+    stream->cctx = squash_zstd_cctx_new ();
+    res = HEDLEY_LIKELY(stream->cctx != NULL) ?
+      squash_zstd_cctx_set_options (stream->cctx, codec, options) :
+      squash_error (SQUASH_MEMORY);
   } else {
-#if defined(ZSTD_STATIC_LINKING_ONLY)
-    stream->dstream = ZSTD_createDStream_advanced(cMem);
-#else
-    stream->dstream = ZSTD_createDStream();
-#endif
-    stream->cstream = NULL;
+    stream->dctx = squash_zstd_dctx_new ();
+    res = HEDLEY_LIKELY(stream->dctx != NULL) ?
+      squash_zstd_dctx_set_options (stream->dctx, codec, options) :
+      squash_error (SQUASH_MEMORY);
+  }
 
-    if(stream->dstream == NULL) {
-      squash_free(stream);
-      return NULL;
-    }
+  if (HEDLEY_LIKELY(res == SQUASH_OK) && squash_options_get_bool_at (options, codec, SQUASH_ZSTD_OPT_STABLE_BUFFERS))
+    res = squash_zstd_stream_set_stable (stream);
 
-    size_t const initResult = ZSTD_initDStream(stream->dstream);
-    if (ZSTD_isError(initResult)) {
-      ZSTD_freeDStream(stream->dstream);
-      squash_free(stream);
-      return NULL;
-    }
+  if (HEDLEY_UNLIKELY(res != SQUASH_OK)) {
+    squash_object_unref (stream);
+    return NULL;
   }
 
   return (SquashStream*) stream;
 }
+
 static SquashStatus
 squash_zstd_process_stream (SquashStream* ss, SquashOperation operation) {
   SquashZstdStream* stream = (SquashZstdStream*)ss;
@@ -234,56 +441,68 @@ squash_zstd_process_stream (SquashStream* ss, SquashOperation operation) {
   ZSTD_inBuffer input = { ss->next_in, ss->avail_in, 0 };
   ZSTD_outBuffer output = { ss->next_out, ss->avail_out, 0 };
 
-  if(ss->stream_type == SQUASH_STREAM_COMPRESS) {
-    switch (operation) {
-      case SQUASH_OPERATION_PROCESS: {
-        size_t hint = stream->last_res = ZSTD_compressStream(stream->cstream, &output, &input);
-
-        ss->avail_in -= input.pos;
-        ss->next_in += input.pos;
-        ss->avail_out -= output.pos;
-        ss->next_out += output.pos;
-
-        if(ZSTD_isError(hint))
-          return squash_zstd_status_from_zstd_error(hint);
-
-        return  (ss->avail_in != 0) ? SQUASH_PROCESSING : SQUASH_OK;
-      }
-      case SQUASH_OPERATION_FLUSH: {
-        size_t remaining = stream->last_res = ZSTD_flushStream(stream->cstream, &output);
+  if (stream->stable) {
+    /* zstd requires exactly the same buffer on every call, with pos
+       where it left off, so present everything since the first
+       call. */
+    if (ss->stream_type == SQUASH_STREAM_COMPRESS) {
+      if (stream->stable_base == NULL)
+        stream->stable_base = (uint8_t*) ss->next_in;
+      input.src = stream->stable_base;
+      input.pos = (size_t) (ss->next_in - stream->stable_base);
+      input.size = input.pos + ss->avail_in;
+    } else {
+      if (stream->stable_base == NULL)
+        stream->stable_base = ss->next_out;
+      output.dst = stream->stable_base;
+      output.pos = (size_t) (ss->next_out - stream->stable_base);
+      output.size = output.pos + ss->avail_out;
+    }
+  }
 
-        ss->avail_out -= output.pos;
-        ss->next_out += output.pos;
+  const size_t in_start = input.pos;
+  const size_t out_start = output.pos;
 
-        if(ZSTD_isError(remaining))
-          return squash_zstd_status_from_zstd_error(remaining);
+  if(ss->stream_type == SQUASH_STREAM_COMPRESS) {
+    ZSTD_EndDirective directive = ZSTD_e_continue;
+    switch (operation) {
+      case SQUASH_OPERATION_PROCESS:
+        directive = ZSTD_e_continue;
+        break;
+      case SQUASH_OPERATION_FLUSH:
+        directive = ZSTD_e_flush;
+        break;
+      case SQUASH_OPERATION_FINISH:
+        directive = ZSTD_e_end;
+        break;
+      case SQUASH_OPERATION_TERMINATE:
+        HEDLEY_UNREACHABLE();
+    }
 
-        return (remaining > 0) ? SQUASH_PROCESSING : SQUASH_OK;
-      }
-      case SQUASH_OPERATION_FINISH: {
-        size_t remaining = stream->last_res = ZSTD_endStream(stream->cstream, &output);
+    size_t remaining = stream->last_res = ZSTD_compressStream2 (stream->cctx, &output, &input, directive);
 
-        ss->avail_out -= output.pos;
-        ss->next_out += output.pos;
+    ss->avail_in -= input.pos - in_start;
+    ss->next_in += input.pos - in_start;
+    ss->avail_out -= output.pos - out_start;
+    ss->next_out += output.pos - out_start;
 
-        if(ZSTD_isError(remaining))
-          return squash_zstd_status_from_zstd_error(remaining);
+    if(ZSTD_isError(remaining))
+      return squash_zstd_status_from_zstd_error(remaining);
 
-        return (remaining > 0) ? SQUASH_PROCESSING : SQUASH_OK;
-      }
-      case SQUASH_OPERATION_TERMINATE:
-        HEDLEY_UNREACHABLE();
-    }
+    if (operation == SQUASH_OPERATION_PROCESS)
+      return (ss->avail_in != 0) ? SQUASH_PROCESSING : SQUASH_OK;
+    else
+      return (remaining > 0) ? SQUASH_PROCESSING : SQUASH_OK;
   } else {
     if (stream->last_res == 0 && ss->avail_in == 0)
       return SQUASH_OK;
 
-    size_t remaining = stream->last_res = ZSTD_decompressStream(stream->dstream, &output, &input);
+    size_t remaining = stream->last_res = ZSTD_decompressStream(stream->dctx, &output, &input);
 
-    ss->avail_in -= input.pos;
-    ss->next_in += input.pos;
-    ss->avail_out -= output.pos;
-    ss->next_out += output.pos;
+    ss->avail_in -= input.pos - in_start;
+    ss->next_in += input.pos - in_start;
+    ss->avail_out -= output.pos - out_start;
+    ss->next_out += output.pos - out_start;
 
     if(ZSTD_isError(remaining))
       return squash_zstd_status_from_zstd_error(remaining);
@@ -296,7 +515,6 @@ squash_zstd_process_stream (SquashStream* ss, SquashOperation operation) {
       return SQUASH_OK;
     }
   }
-  return squash_error (SQUASH_FAILED);
 }
 
 
@@ -307,6 +525,8 @@ squash_plugin_init_codec (SquashCodec* codec, SquashCodecImpl* impl) {
   if (HEDLEY_LIKELY(strcmp ("zstd", name) == 0)) {
     impl->options = squash_zstd_options;
     impl->get_max_compressed_size = squash_zstd_get_max_compressed_size;
+    impl->get_uncompressed_size = squash_zstd_get_uncompressed_size;
+    impl->scan_frames = squash_zstd_scan_frames;
     impl->decompress_buffer = squash_zstd_decompress_buffer;
     impl->compress_buffer_unsafe = squash_zstd_compress_buffer;
     impl->create_stream = squash_zstd_create_stream;
@@ -0,0 +1,98 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include "squash-internal.h" */
+
+#ifndef SQUASH_BLOCK_INTERNAL_H
+#define SQUASH_BLOCK_INTERNAL_H
+
+#if !defined (SQUASH_COMPILATION)
+#error "This is internal API; you cannot use it."
+#endif
+
+HEDLEY_BEGIN_C_DECLS
+
+/* Squash's own framing.  When enabled (see squash_block_is_enabled)
+ * the output is SQUASH_BLOCK_MAGIC followed by a sequence of blocks,
+ * each of which is:
+ *
+ *   flags             1 byte
+ *   uncompressed size varuint64
+ *   payload size      varuint64, omitted if SQUASH_BLOCK_FLAG_STORED
+ *   checksum          4 bytes, little-endian CRC-32C of the
+ *                     uncompressed data; only if
+ *                     SQUASH_BLOCK_FLAG_CHECKSUM
+ *   payload
+ *
+ * The payload of a stored block is the uncompressed data itself;
+ * otherwise it is the output of the codec for that block. */
+
+#define SQUASH_BLOCK_MAGIC           "\xb1SqB"
+#define SQUASH_BLOCK_MAGIC_SIZE      ((size_t) 4)
+
+#define SQUASH_BLOCK_FLAG_STORED     ((uint8_t) 0x01)
+#define SQUASH_BLOCK_FLAG_CHECKSUM   ((uint8_t) 0x02)
+#define SQUASH_BLOCK_FLAGS_MASK      ((uint8_t) 0x03)
+
+#define SQUASH_BLOCK_CHECKSUM_SIZE   ((size_t) 4)
+#define SQUASH_BLOCK_HEADER_MAX_SIZE ((size_t) (1 + 9 + 9 + SQUASH_BLOCK_CHECKSUM_SIZE))
+
+typedef struct SquashBlockStream_ {
+  SquashStream base_object;
+
+  SquashBuffer* input;
+  SquashBuffer* output;
+  size_t output_pos;
+
+  /* Number of bytes of the magic read so far (decompression only) */
+  size_t magic_pos;
+} SquashBlockStream;
+
+HEDLEY_NON_NULL(1) SQUASH_INTERNAL
+bool               squash_block_is_enabled (SquashCodec* codec, SquashOptions* options);
+SQUASH_INTERNAL
+size_t             squash_block_get_max_stored_size (size_t uncompressed_size);
+SQUASH_INTERNAL
+bool               squash_block_has_magic (size_t data_size, const uint8_t data[HEDLEY_ARRAY_PARAM(data_size)]);
+HEDLEY_NON_NULL(1, 2, 3, 5, 6) SQUASH_INTERNAL
+SquashStatus       squash_block_compress   (SquashCodec* codec,
+                                            size_t* compressed_size,
+                                            uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                                            size_t uncompressed_size,
+                                            const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                                            SquashOptions* options);
+HEDLEY_NON_NULL(1, 2, 3, 5) SQUASH_INTERNAL
+SquashStatus       squash_block_decompress (SquashCodec* codec,
+                                            size_t* decompressed_size,
+                                            uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                            size_t compressed_size,
+                                            const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                            SquashOptions* options);
+HEDLEY_NON_NULL(1, 3) SQUASH_INTERNAL
+SquashBlockStream* squash_block_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options);
+
+HEDLEY_END_C_DECLS
+
+#endif /* SQUASH_BLOCK_INTERNAL_H */
@@ -0,0 +1,638 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include "squash-internal.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef MIN
+#  define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+/* Inputs smaller than this are always handed to the codec; the
+   histogram of a few hundred bytes says very little. */
+#define SQUASH_BLOCK_ENTROPY_MIN_SIZE ((size_t) 1024)
+
+/* Larger inputs are sampled instead of scanned in their entirety. */
+#define SQUASH_BLOCK_ENTROPY_SAMPLE_SIZE ((size_t) 4096)
+#define SQUASH_BLOCK_ENTROPY_SAMPLES ((size_t) 64)
+
+typedef struct SquashBlockHeader_ {
+  uint8_t flags;
+  size_t header_size;
+  size_t uncompressed_size;
+  size_t payload_size;
+  uint32_t checksum;
+} SquashBlockHeader;
+
+/**
+ * @brief Determine whether Squash's own framing is in use
+ * @private
+ *
+ * @param codec The codec
+ * @param options The options, or *NULL*
+ * @return Whether data should be run through squash_block_compress,
+ *   squash_block_decompress, and squash_block_stream_new.
+ */
+bool
+squash_block_is_enabled (SquashCodec* codec, SquashOptions* options) {
+  if (options == NULL)
+    return false;
+
+  return
+    squash_options_get_core_int (options, codec, SQUASH_OPTIONS_CORE_FRAMING) == SQUASH_OPTIONS_FRAMING_CHUNKED ||
+    squash_options_get_core_bool (options, codec, SQUASH_OPTIONS_CORE_STORE_INCOMPRESSIBLE);
+}
+
+static uint32_t
+squash_block_checksum (size_t data_size, const uint8_t data[HEDLEY_ARRAY_PARAM(data_size)]) {
+  return squash_crc32c (0xffffffff, data_size, data) ^ 0xffffffff;
+}
+
+static size_t
+squash_block_write_checksum (uint8_t* p, uint32_t checksum) {
+  p[0] = (uint8_t) (checksum      );
+  p[1] = (uint8_t) (checksum >>  8);
+  p[2] = (uint8_t) (checksum >> 16);
+  p[3] = (uint8_t) (checksum >> 24);
+
+  return SQUASH_BLOCK_CHECKSUM_SIZE;
+}
+
+static void
+squash_block_histogram (uint32_t counts[256], size_t data_size, const uint8_t data[HEDLEY_ARRAY_PARAM(data_size)]) {
+  /* Four separate tables so runs of the same byte don't serialize on
+     a single counter; this is what keeps the loop close to memory
+     bandwidth on current CPUs. */
+  uint32_t c[4][256];
+  size_t i = 0;
+
+  memset (c, 0, sizeof (c));
+
+  for ( ; (i + 4) <= data_size ; i += 4) {
+    uint32_t v;
+    memcpy (&v, data + i, sizeof (v));
+
+    c[0][(uint8_t) (v      )]++;
+    c[1][(uint8_t) (v >>  8)]++;
+    c[2][(uint8_t) (v >> 16)]++;
+    c[3][(uint8_t) (v >> 24)]++;
+  }
+
+  for ( ; i < data_size ; i++)
+    c[0][data[i]]++;
+
+  for (i = 0 ; i < 256 ; i++)
+    counts[i] += c[0][i] + c[1][i] + c[2][i] + c[3][i];
+}
+
+/* Estimate the order-0 entropy of the data, in hundredths of a bit
+   per byte. */
+static int
+squash_block_estimate_entropy (size_t data_size, const uint8_t data[HEDLEY_ARRAY_PARAM(data_size)]) {
+  uint32_t counts[256] = { 0, };
+  size_t sampled;
+
+  if (data_size <= (SQUASH_BLOCK_ENTROPY_SAMPLE_SIZE * SQUASH_BLOCK_ENTROPY_SAMPLES)) {
+    squash_block_histogram (counts, data_size, data);
+    sampled = data_size;
+  } else {
+    const size_t stride = data_size / SQUASH_BLOCK_ENTROPY_SAMPLES;
+
+    for (size_t i = 0 ; i < SQUASH_BLOCK_ENTROPY_SAMPLES ; i++)
+      squash_block_histogram (counts, SQUASH_BLOCK_ENTROPY_SAMPLE_SIZE, data + (i * stride));
+    sampled = SQUASH_BLOCK_ENTROPY_SAMPLE_SIZE * SQUASH_BLOCK_ENTROPY_SAMPLES;
+  }
+
+  double entropy = 0.0;
+  unsigned int symbols = 0;
+  for (size_t i = 0 ; i < 256 ; i++) {
+    if (counts[i] != 0) {
+      const double p = ((double) counts[i]) / ((double) sampled);
+      entropy -= p * log2 (p);
+      symbols++;
+    }
+  }
+
+  /* Miller-Madow correction; the plug-in estimate is biased low for
+     small samples, which would hide random data in small blocks. */
+  entropy += ((double) (symbols - 1)) / (2.0 * 0.69314718055994530942 * ((double) sampled));
+
+  return (int) MIN(entropy * 100.0, 800.0);
+}
+
+static SquashStatus
+squash_block_read_header (size_t data_size, const uint8_t data[HEDLEY_ARRAY_PARAM(data_size)], SquashBlockHeader* header) {
+  uint64_t v;
+  size_t pos = 0, len;
+
+  if (data_size == 0)
+    return SQUASH_BUFFER_EMPTY;
+
+  header->flags = data[pos++];
+  if (HEDLEY_UNLIKELY((header->flags & ~SQUASH_BLOCK_FLAGS_MASK) != 0))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  len = squash_read_varuint64 (data + pos, data_size - pos, &v);
+  if (len == 0)
+    return SQUASH_BUFFER_EMPTY;
+#if SIZE_MAX < UINT64_MAX
+  if (HEDLEY_UNLIKELY(v > SIZE_MAX))
+    return squash_error (SQUASH_RANGE);
+#endif
+  header->uncompressed_size = (size_t) v;
+  pos += len;
+
+  if ((header->flags & SQUASH_BLOCK_FLAG_STORED) == 0) {
+    len = squash_read_varuint64 (data + pos, data_size - pos, &v);
+    if (len == 0)
+      return SQUASH_BUFFER_EMPTY;
+#if SIZE_MAX < UINT64_MAX
+    if (HEDLEY_UNLIKELY(v > SIZE_MAX))
+      return squash_error (SQUASH_RANGE);
+#endif
+    header->payload_size = (size_t) v;
+    pos += len;
+
+    if (HEDLEY_UNLIKELY(header->uncompressed_size == 0))
+      return squash_error (SQUASH_INVALID_BUFFER);
+  } else {
+    header->payload_size = header->uncompressed_size;
+  }
+
+  if ((header->flags & SQUASH_BLOCK_FLAG_CHECKSUM) != 0) {
+    if ((data_size - pos) < SQUASH_BLOCK_CHECKSUM_SIZE)
+      return SQUASH_BUFFER_EMPTY;
+    header->checksum =
+      ((uint32_t) data[pos    ]      ) | ((uint32_t) data[pos + 1] <<  8) |
+      ((uint32_t) data[pos + 2] << 16) | ((uint32_t) data[pos + 3] << 24);
+    pos += SQUASH_BLOCK_CHECKSUM_SIZE;
+  }
+
+  if (HEDLEY_UNLIKELY(header->payload_size > (SIZE_MAX - pos)))
+    return squash_error (SQUASH_RANGE);
+
+  header->header_size = pos;
+
+  return SQUASH_OK;
+}
+
+/**
+ * @brief Get the size of a stored block
+ * @private
+ *
+ * A block is only compressed if that makes it smaller, so this is
+ * also the largest size Squash's framing will produce for a single
+ * block.
+ *
+ * @param uncompressed_size Size of the uncompressed data
+ * @return Size of the data when stored in a single block, including
+ *   the magic and room for a checksum
+ */
+size_t
+squash_block_get_max_stored_size (size_t uncompressed_size) {
+  return SQUASH_BLOCK_MAGIC_SIZE + 1 + squash_size_varuint64 (uncompressed_size) + SQUASH_BLOCK_CHECKSUM_SIZE + uncompressed_size;
+}
+
+/**
+ * @brief Check whether data begins with Squash's framing magic
+ * @private
+ *
+ * @param data_size Size of the data
+ * @param data The data
+ * @return Whether the data starts with SQUASH_BLOCK_MAGIC
+ */
+bool
+squash_block_has_magic (size_t data_size, const uint8_t data[HEDLEY_ARRAY_PARAM(data_size)]) {
+  return data_size >= SQUASH_BLOCK_MAGIC_SIZE && memcmp (data, SQUASH_BLOCK_MAGIC, SQUASH_BLOCK_MAGIC_SIZE) == 0;
+}
+
+static size_t
+squash_block_get_max_encoded_size (SquashCodec* codec, size_t uncompressed_size) {
+  return SQUASH_BLOCK_HEADER_MAX_SIZE + squash_codec_get_max_compressed_size (codec, uncompressed_size);
+}
+
+static SquashStatus
+squash_block_encode (SquashCodec* codec,
+                     size_t* compressed_size,
+                     uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                     size_t uncompressed_size,
+                     const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                     SquashOptions* options) {
+  const size_t capacity = *compressed_size;
+  const bool checksum = squash_options_get_core_bool (options, codec, SQUASH_OPTIONS_CORE_FRAME_CHECKSUM);
+  const uint8_t flags = checksum ? SQUASH_BLOCK_FLAG_CHECKSUM : 0;
+  const size_t checksum_size = checksum ? SQUASH_BLOCK_CHECKSUM_SIZE : 0;
+  const size_t stored_header_size = 1 + squash_size_varuint64 (uncompressed_size) + checksum_size;
+  const uint32_t crc = checksum ? squash_block_checksum (uncompressed_size, uncompressed) : 0;
+  bool store = (uncompressed_size == 0);
+
+  if (uncompressed_size >= SQUASH_BLOCK_ENTROPY_MIN_SIZE &&
+      squash_options_get_core_bool (options, codec, SQUASH_OPTIONS_CORE_STORE_INCOMPRESSIBLE)) {
+    const int threshold = squash_options_get_core_int (options, codec, SQUASH_OPTIONS_CORE_INCOMPRESSIBLE_THRESHOLD);
+    store = squash_block_estimate_entropy (uncompressed_size, uncompressed) >= threshold;
+  }
+
+  if (!store) {
+    /* Leave room for the largest possible header, then move the
+       payload down once we know how big the header actually is. */
+    const size_t header_max_size = stored_header_size + squash_size_varuint64 (capacity);
+
+    if (capacity > header_max_size) {
+      size_t payload_size = capacity - header_max_size;
+      SquashStatus res = squash_codec_compress_internal (codec,
+                                                         &payload_size, compressed + header_max_size,
+                                                         uncompressed_size, uncompressed,
+                                                         options);
+      if (res == SQUASH_OK && payload_size < uncompressed_size) {
+        size_t pos = 0;
+
+        compressed[pos++] = flags;
+        pos += squash_write_varuint64 (compressed + pos, capacity - pos, uncompressed_size);
+        pos += squash_write_varuint64 (compressed + pos, capacity - pos, payload_size);
+        if (checksum)
+          pos += squash_block_write_checksum (compressed + pos, crc);
+        assert (pos <= header_max_size);
+
+        memmove (compressed + pos, compressed + header_max_size, payload_size);
+        *compressed_size = pos + payload_size;
+
+        return SQUASH_OK;
+      } else if (res != SQUASH_OK && res != SQUASH_BUFFER_FULL) {
+        return res;
+      }
+    }
+  }
+
+  /* Either the data looked incompressible or the codec didn't manage
+     to shrink it, so store it as-is. */
+  if (HEDLEY_UNLIKELY(capacity < stored_header_size || (capacity - stored_header_size) < uncompressed_size))
+    return squash_error (SQUASH_BUFFER_FULL);
+
+  size_t pos = 0;
+  compressed[pos++] = flags | SQUASH_BLOCK_FLAG_STORED;
+  pos += squash_write_varuint64 (compressed + pos, capacity - pos, uncompressed_size);
+  if (checksum)
+    pos += squash_block_write_checksum (compressed + pos, crc);
+  assert (pos == stored_header_size);
+  if (uncompressed_size != 0)
+    memcpy (compressed + stored_header_size, uncompressed, uncompressed_size);
+  *compressed_size = stored_header_size + uncompressed_size;
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_block_decode (SquashCodec* codec,
+                     const SquashBlockHeader* header,
+                     const uint8_t payload[HEDLEY_ARRAY_PARAM(header->payload_size)],
+                     size_t decompressed_size,
+                     uint8_t decompressed[HEDLEY_ARRAY_PARAM(decompressed_size)],
+                     SquashOptions* options) {
+  if (HEDLEY_UNLIKELY(decompressed_size < header->uncompressed_size))
+    return squash_error (SQUASH_BUFFER_FULL);
+
+  if ((header->flags & SQUASH_BLOCK_FLAG_STORED) != 0) {
+    if (header->uncompressed_size != 0)
+      memcpy (decompressed, payload, header->uncompressed_size);
+  } else {
+    size_t block_decompressed_size = header->uncompressed_size;
+    SquashStatus res = squash_codec_decompress_internal (codec,
+                                                         &block_decompressed_size, decompressed,
+                                                         header->payload_size, payload,
+                                                         options);
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+    if (HEDLEY_UNLIKELY(block_decompressed_size != header->uncompressed_size))
+      return squash_error (SQUASH_INVALID_BUFFER);
+  }
+
+  if ((header->flags & SQUASH_BLOCK_FLAG_CHECKSUM) != 0 &&
+      HEDLEY_UNLIKELY(squash_block_checksum (header->uncompressed_size, decompressed) != header->checksum))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  return SQUASH_OK;
+}
+
+/**
+ * @brief Compress a buffer using Squash's own framing
+ * @private
+ *
+ * The data is written as the magic followed by a single block, which
+ * is stored instead of compressed if it looks incompressible or the
+ * codec fails to make it any smaller.
+ *
+ * @param codec The codec to use
+ * @param[out] compressed Location to store the compressed data
+ * @param[in,out] compressed_size Location storing the size of the
+ *   @a compressed buffer on input, replaced with the actual size of
+ *   the compressed data
+ * @param uncompressed The uncompressed data
+ * @param uncompressed_size Size of the uncompressed data (in bytes)
+ * @param options Compression options
+ * @return A status code
+ */
+SquashStatus
+squash_block_compress (SquashCodec* codec,
+                       size_t* compressed_size,
+                       uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                       size_t uncompressed_size,
+                       const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                       SquashOptions* options) {
+  if (HEDLEY_UNLIKELY(*compressed_size < SQUASH_BLOCK_MAGIC_SIZE))
+    return squash_error (SQUASH_BUFFER_FULL);
+
+  size_t block_size = *compressed_size - SQUASH_BLOCK_MAGIC_SIZE;
+  SquashStatus res = squash_block_encode (codec, &block_size, compressed + SQUASH_BLOCK_MAGIC_SIZE, uncompressed_size, uncompressed, options);
+  if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+    return res;
+
+  memcpy (compressed, SQUASH_BLOCK_MAGIC, SQUASH_BLOCK_MAGIC_SIZE);
+  *compressed_size = SQUASH_BLOCK_MAGIC_SIZE + block_size;
+
+  return SQUASH_OK;
+}
+
+/**
+ * @brief Decompress a buffer using Squash's own framing
+ * @private
+ *
+ * @param codec The codec to use
+ * @param[out] decompressed Location to store the decompressed data
+ * @param[in,out] decompressed_size Location storing the size of the
+ *   @a decompressed buffer on input, replaced with the actual size of
+ *   the decompressed data
+ * @param compressed The compressed data
+ * @param compressed_size Size of the compressed data (in bytes)
+ * @param options Decompression options, or *NULL*
+ * @return A status code
+ */
+SquashStatus
+squash_block_decompress (SquashCodec* codec,
+                         size_t* decompressed_size,
+                         uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                         size_t compressed_size,
+                         const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                         SquashOptions* options) {
+  size_t in_pos = SQUASH_BLOCK_MAGIC_SIZE, out_pos = 0;
+
+  if (HEDLEY_UNLIKELY(!squash_block_has_magic (compressed_size, compressed)))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  while (in_pos < compressed_size) {
+    SquashBlockHeader header;
+
+    SquashStatus res = squash_block_read_header (compressed_size - in_pos, compressed + in_pos, &header);
+    if (HEDLEY_UNLIKELY(res == SQUASH_BUFFER_EMPTY))
+      return squash_error (SQUASH_INVALID_BUFFER);
+    else if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+
+    in_pos += header.header_size;
+    if (HEDLEY_UNLIKELY((compressed_size - in_pos) < header.payload_size))
+      return squash_error (SQUASH_INVALID_BUFFER);
+
+    res = squash_block_decode (codec, &header, compressed + in_pos,
+                               *decompressed_size - out_pos, decompressed + out_pos,
+                               options);
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+
+    in_pos += header.payload_size;
+    out_pos += header.uncompressed_size;
+  }
+
+  *decompressed_size = out_pos;
+
+  return SQUASH_OK;
+}
+
+/* Copy as much pending output as possible to the stream.  Returns
+   true once the output buffer has been drained. */
+static bool
+squash_block_stream_drain (SquashBlockStream* s) {
+  SquashStream* stream = (SquashStream*) s;
+  SquashBuffer* output = s->output;
+
+  const size_t cp_size = MIN(output->size - s->output_pos, stream->avail_out);
+  if (cp_size != 0) {
+    memcpy (stream->next_out, output->data + s->output_pos, cp_size);
+    stream->next_out += cp_size;
+    stream->avail_out -= cp_size;
+    s->output_pos += cp_size;
+  }
+
+  if (s->output_pos == output->size) {
+    output->size = 0;
+    s->output_pos = 0;
+    return true;
+  }
+
+  return false;
+}
+
+static SquashStatus
+squash_block_stream_encode (SquashBlockStream* s) {
+  SquashStream* stream = (SquashStream*) s;
+  SquashBuffer* input = s->input;
+  SquashStatus res;
+
+  size_t encoded_size = squash_block_get_max_encoded_size (stream->codec, input->size);
+  if (stream->avail_out >= encoded_size) {
+    res = squash_block_encode (stream->codec, &encoded_size, stream->next_out, input->size, input->data, stream->options);
+    if (HEDLEY_LIKELY(res == SQUASH_OK)) {
+      stream->next_out += encoded_size;
+      stream->avail_out -= encoded_size;
+    }
+  } else {
+    if (HEDLEY_UNLIKELY(!squash_buffer_set_size (s->output, encoded_size)))
+      return squash_error (SQUASH_MEMORY);
+
+    res = squash_block_encode (stream->codec, &encoded_size, s->output->data, input->size, input->data, stream->options);
+    s->output->size = (res == SQUASH_OK) ? encoded_size : 0;
+  }
+
+  input->size = 0;
+
+  return res;
+}
+
+static SquashStatus
+squash_block_stream_compress (SquashBlockStream* s, SquashOperation operation) {
+  SquashStream* stream = (SquashStream*) s;
+  SquashBuffer* input = s->input;
+  const size_t block_size = squash_options_get_core_size (stream->options, stream->codec, SQUASH_OPTIONS_CORE_FRAME_BLOCK_SIZE);
+
+  while (true) {
+    if (!squash_block_stream_drain (s))
+      return SQUASH_PROCESSING;
+
+    const size_t cp_size = MIN(block_size - input->size, stream->avail_in);
+    if (cp_size != 0) {
+      if (HEDLEY_UNLIKELY(!squash_buffer_append (input, cp_size, stream->next_in)))
+        return squash_error (SQUASH_MEMORY);
+      stream->next_in += cp_size;
+      stream->avail_in -= cp_size;
+    }
+
+    if (input->size == block_size ||
+        (operation != SQUASH_OPERATION_PROCESS && stream->avail_in == 0 && input->size != 0)) {
+      SquashStatus res = squash_block_stream_encode (s);
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        return res;
+    } else {
+      assert (stream->avail_in == 0);
+      return SQUASH_OK;
+    }
+  }
+}
+
+static SquashStatus
+squash_block_stream_decompress (SquashBlockStream* s, SquashOperation operation) {
+  SquashStream* stream = (SquashStream*) s;
+  SquashBuffer* input = s->input;
+
+  for ( ; s->magic_pos < SQUASH_BLOCK_MAGIC_SIZE && stream->avail_in != 0 ; s->magic_pos++) {
+    if (HEDLEY_UNLIKELY(*(stream->next_in) != (uint8_t) SQUASH_BLOCK_MAGIC[s->magic_pos]))
+      return squash_error (SQUASH_INVALID_BUFFER);
+    stream->next_in++;
+    stream->avail_in--;
+  }
+
+  if (s->magic_pos < SQUASH_BLOCK_MAGIC_SIZE)
+    return (operation == SQUASH_OPERATION_FINISH) ? squash_error (SQUASH_INVALID_BUFFER) : SQUASH_OK;
+
+  while (true) {
+    if (!squash_block_stream_drain (s))
+      return SQUASH_PROCESSING;
+
+    SquashBlockHeader header;
+    SquashStatus res = squash_block_read_header (input->size, input->data, &header);
+    if (HEDLEY_UNLIKELY(res < 0 && res != SQUASH_BUFFER_EMPTY))
+      return res;
+
+    if (res == SQUASH_OK && input->size == (header.header_size + header.payload_size)) {
+      const uint8_t* payload = input->data + header.header_size;
+
+      if (stream->avail_out >= header.uncompressed_size) {
+        res = squash_block_decode (stream->codec, &header, payload, stream->avail_out, stream->next_out, stream->options);
+        if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+          return res;
+        stream->next_out += header.uncompressed_size;
+        stream->avail_out -= header.uncompressed_size;
+      } else {
+        if (HEDLEY_UNLIKELY(!squash_buffer_set_size (s->output, header.uncompressed_size)))
+          return squash_error (SQUASH_MEMORY);
+
+        res = squash_block_decode (stream->codec, &header, payload, s->output->size, s->output->data, stream->options);
+        if (HEDLEY_UNLIKELY(res != SQUASH_OK)) {
+          s->output->size = 0;
+          return res;
+        }
+      }
+
+      input->size = 0;
+      continue;
+    }
+
+    if (stream->avail_in == 0)
+      break;
+
+    /* Only read up to the end of the current block, one byte at a
+       time while we're still inside the header. */
+    const size_t wanted = (res == SQUASH_OK) ? ((header.header_size + header.payload_size) - input->size) : 1;
+    const size_t cp_size = MIN(wanted, stream->avail_in);
+    if (HEDLEY_UNLIKELY(!squash_buffer_append (input, cp_size, stream->next_in)))
+      return squash_error (SQUASH_MEMORY);
+    stream->next_in += cp_size;
+    stream->avail_in -= cp_size;
+  }
+
+  if (operation == SQUASH_OPERATION_FINISH && input->size != 0)
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  return SQUASH_OK;
+}
+
+static SquashStatus
+squash_block_stream_process (SquashStream* stream, SquashOperation operation) {
+  if (stream->stream_type == SQUASH_STREAM_COMPRESS)
+    return squash_block_stream_compress ((SquashBlockStream*) stream, operation);
+  else
+    return squash_block_stream_decompress ((SquashBlockStream*) stream, operation);
+}
+
+static void
+squash_block_stream_destroy (void* stream) {
+  SquashBlockStream* s = (SquashBlockStream*) stream;
+
+  squash_buffer_free (s->input);
+  squash_buffer_free (s->output);
+
+  squash_stream_destroy (stream);
+}
+
+/**
+ * @brief Create a stream using Squash's own framing
+ * @private
+ *
+ * Input is split into blocks of frame-block-size bytes, each of which
+ * is encoded independently by squash_block_compress.
+ *
+ * @param codec The codec
+ * @param stream_type The direction of the stream
+ * @param options The options for the stream
+ * @return A new stream, or *NULL* on failure
+ */
+SquashBlockStream*
+squash_block_stream_new (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashBlockStream* stream;
+
+  stream = (SquashBlockStream*) squash_malloc (sizeof (SquashBlockStream));
+  if (HEDLEY_UNLIKELY(stream == NULL))
+    return NULL;
+
+  squash_stream_init_internal (stream, codec, stream_type, options, squash_block_stream_destroy, squash_block_stream_process);
+
+  stream->input = squash_buffer_new (0);
+  stream->output = squash_buffer_new (0);
+  stream->output_pos = 0;
+  stream->magic_pos = 0;
+
+  /* The magic goes out ahead of the first block. */
+  if (stream_type == SQUASH_STREAM_COMPRESS &&
+      HEDLEY_UNLIKELY(!squash_buffer_append (stream->output, SQUASH_BLOCK_MAGIC_SIZE, (const uint8_t*) SQUASH_BLOCK_MAGIC))) {
+    squash_object_unref (stream);
+    return NULL;
+  }
+
+  return stream;
+}
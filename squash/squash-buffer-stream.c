@@ -108,7 +108,7 @@ squash_buffer_stream_finish (SquashBufferStream* stream) {
   if (output == NULL) {
     SquashStatus res;
     if (s->stream_type == SQUASH_STREAM_COMPRESS) {
-      size_t compressed_size = squash_codec_get_max_compressed_size (codec, input->size);
+      size_t compressed_size = squash_codec_get_max_compressed_size_with_options (codec, input->size, s->options);
       if (s->avail_out >= compressed_size) {
         /* There is enough room available in next_out to hold the full
            contents of the compressed data, so write directly to
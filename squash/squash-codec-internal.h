@@ -52,6 +52,24 @@ SquashStatus            squash_codec_decompress_to_buffer    (SquashCodec* codec
                                                               size_t compressed_size,
                                                               uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
                                                               SquashOptions* options);
+HEDLEY_NON_NULL(1) SQUASH_INTERNAL
+SquashStream*           squash_codec_create_stream_internal  (SquashCodec* codec,
+                                                              SquashStreamType stream_type,
+                                                              SquashOptions* options);
+HEDLEY_NON_NULL(1, 2, 3, 5) SQUASH_INTERNAL
+SquashStatus            squash_codec_compress_internal       (SquashCodec* codec,
+                                                              size_t* compressed_size,
+                                                              uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                                                              size_t uncompressed_size,
+                                                              const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                                                              SquashOptions* options);
+HEDLEY_NON_NULL(1, 2, 3, 5) SQUASH_INTERNAL
+SquashStatus            squash_codec_decompress_internal     (SquashCodec* codec,
+                                                              size_t* decompressed_size,
+                                                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                                              size_t compressed_size,
+                                                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                                              SquashOptions* options);
 
 SQUASH_TREE_PROTOTYPES(SquashCodec_, tree)
 SQUASH_TREE_DEFINE(SquashCodec_, tree)
@@ -181,23 +181,103 @@
  */
 
 /**
- * @var SquashCodecImpl_::_reserved1
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::scan_frames
+ * @brief Split a buffer into independently decodable frames.
+ *
+ * Formats which allow several frames (or members, or streams) to be
+ * concatenated can implement this so Squash can decompress large
+ * buffers on several threads.  @a func must be called for each
+ * frame, in order.  Bytes between frames (such as padding or
+ * skippable frames) are ignored, so the plugin is responsible for
+ * validating them.
+ *
+ * Only return @ref SQUASH_OK if the whole buffer was scanned and the
+ * decompressed size of every frame is known; anything else makes
+ * Squash decompress the buffer serially instead.
+ *
+ * @param codec The codec.
+ * @param compressed_size Size of the compressed data.
+ * @param compressed The compressed data.
+ * @param func Function to call for each frame.
+ * @param user_data Data to pass to @a func.
+ * @return A status code.  If @a func fails, its status should be
+ *   returned.
  */
 
 /**
- * @var SquashCodecImpl_::_reserved2
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::create_stream_at
+ * @brief Create a decompression stream starting partway through a
+ *   buffer.
+ *
+ * Formats with an index of independently decodable blocks can
+ * implement this so @ref SquashFile can seek without decompressing
+ * everything before the requested offset.  The returned stream should
+ * be fed the compressed data starting at @a restart_compressed_offset
+ * and will produce the decompressed data starting at
+ * @a restart_uncompressed_offset, which must not be greater than
+ * @a uncompressed_offset.
+ *
+ * Reading the index is usually much more expensive than creating the
+ * stream, so the plugin can store it (as a @ref SquashObject) in
+ * @a index the first time and reuse it on later calls for the same
+ * buffer.  The caller releases it with ::squash_object_unref.
+ *
+ * @param codec The codec.
+ * @param options Decompression options (or *NULL*).
+ * @param compressed_size Size of the compressed data.
+ * @param compressed The compressed data.
+ * @param uncompressed_offset Offset in the decompressed data.
+ * @param index Location of the cached index; *NULL* until the plugin
+ *   stores one.
+ * @param restart_compressed_offset Location to store the offset in
+ *   @a compressed where decoding should start.
+ * @param restart_uncompressed_offset Location to store the offset in
+ *   the decompressed data where decoding will start.
+ * @return A new stream, or *NULL* if the offset can't be located.
  */
 
 /**
- * @var SquashCodecImpl_::_reserved3
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::decompress_buffer_unsafe
+ * @brief Decompress a buffer without validating it.
+ *
+ * This is only used by @ref squash_codec_decompress_trusted, so
+ * plugins implementing it can assume that @a compressed was produced
+ * by the codec and has not been altered, and that
+ * @a decompressed_size is the exact size of the decompressed data.
+ * It is meant for libraries which offer a faster decoder which
+ * doesn't check for malformed input, such as `LZ4_decompress_fast`.
+ *
+ * @param codec The codec.
+ * @param compressed The compressed data.
+ * @param compressed_size Size of the compressed data.
+ * @param decompressed Buffer in which to store the decompressed data.
+ * @param decompressed_size Location of the size of the decompressed
+ *   data on input, used to store the size of the decompressed data
+ *   on output.
+ * @param options Decompression options (or *NULL*)
+ *
+ * @see squash_codec_decompress_trusted_with_options
  */
 
 /**
- * @var SquashCodecImpl_::_reserved4
- * @brief Reserved for future use.
+ * @var SquashCodecImpl_::decompress_prefix
+ * @brief Decompress the beginning of a buffer.
+ *
+ * Decode at most @a decompressed_size bytes and stop, returning
+ * @ref SQUASH_OK even if there is more data.  Plugins should only
+ * implement this if the library can stop early; otherwise Squash
+ * will use a stream and stop feeding it once the output buffer is
+ * full.
+ *
+ * @param codec The codec.
+ * @param compressed The compressed data.
+ * @param compressed_size Size of the compressed data.
+ * @param decompressed Buffer in which to store the decompressed data.
+ * @param decompressed_size Location of the buffer size on input,
+ *   used to store the number of bytes decompressed on output.
+ * @param options Decompression options (or *NULL*)
+ *
+ * @see squash_codec_decompress_prefix_with_options
  */
 
 /**
@@ -319,6 +399,13 @@ squash_codec_extension_compare (SquashCodec* a, SquashCodec* b) {
  * @brief The codec natively supports a streaming interface.
  */
 
+/**
+ * @var SquashCodecInfo::SQUASH_CODEC_INFO_DECOMPRESS_TRUSTED
+ * @brief The codec has a faster decoder for trusted input.
+ *
+ * @see squash_codec_decompress_trusted
+ */
+
 /**
  * @def SQUASH_CODEC_INFO_INVALID
  * @brief Invalid codec
@@ -415,89 +502,6 @@ squash_codec_get_impl (SquashCodec* codec) {
   return &(codec->impl);
 }
 
-static size_t
-squash_read_varuint64 (const uint8_t *p, size_t p_size, uint64_t *v) {
-  uint64_t n = 0;
-  size_t i;
-
-  for (i = 0; i < 8 && i < p_size && *p > 0x7F; ++i) {
-    n = (n << 7) | (*p++ & 0x7F);
-  }
-
-  if (i == p_size) {
-    return 0;
-  }
-  else if (i == 8) {
-    n = (n << 8) | *p;
-  }
-  else {
-    n = (n << 7) | *p;
-  }
-
-  *v = n;
-
-  return i + 1;
-}
-
-static size_t
-squash_write_varuint64 (uint8_t *p, size_t p_size, uint64_t v) {
-  uint8_t buf[10];
-  size_t i;
-  size_t j;
-
-  if (v & 0xFF00000000000000ULL) {
-    if (p_size < 9) {
-      return 0;
-    }
-
-    p[8] = (uint8_t) v;
-    v >>= 8;
-
-    i = 7;
-
-    for (j = 0; j < 8; ++j) {
-      p[i--] = (uint8_t) ((v & 0x7F) | 0x80);
-      v >>= 7;
-    }
-
-    return 9;
-  }
-
-  i = 0;
-
-  buf[i++] = (uint8_t) (v & 0x7F);
-  v >>= 7;
-
-  while (v > 0) {
-    buf[i++] = (uint8_t) ((v & 0x7F) | 0x80);
-    v >>= 7;
-  }
-
-  if (i > p_size) {
-    return 0;
-  }
-
-  for (j = 0; j < i; ++j) {
-    p[j] = buf[i - j - 1];
-  }
-
-  return i;
-}
-
-static size_t
-squash_size_varuint64 (const uint64_t value) {
-  if (value & 0xFF00000000000000ULL)
-    return 9;
-
-  size_t required = 1;
-
-  for (size_t s = 7 ; s < 64 ; s += 7, required++)
-    if (value < (UINT64_C(1) << s))
-      break;
-
-  return required;
-}
-
 /**
  * @brief Get the uncompressed size of the compressed buffer
  *
@@ -551,6 +555,10 @@ squash_codec_get_uncompressed_size (SquashCodec* codec,
  * used with the single-call buffer-to-buffer functions such as
  * ::squash_codec_compress and ::squash_codec_compress_with_options.
  *
+ * This is the size required without Squash's own framing; if the
+ * "framing" or "store-incompressible" options are used, see
+ * ::squash_codec_get_max_compressed_size_with_options.
+ *
  * @param codec The codec
  * @param uncompressed_size Size of the uncompressed data in bytes
  * @return The maximum size required to store a compressed buffer
@@ -558,7 +566,27 @@ squash_codec_get_uncompressed_size (SquashCodec* codec,
  */
 size_t
 squash_codec_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_size) {
+  return squash_codec_get_max_compressed_size_with_options (codec, uncompressed_size, NULL);
+}
+
+/**
+ * @brief Get the maximum buffer size necessary to store compressed
+ *   data with existing @ref SquashOptions
+ *
+ * If @a options enable Squash's framing (see the "framing" and
+ * "store-incompressible" options) the result is never smaller than
+ * what is required to store the data uncompressed in a single block.
+ *
+ * @param codec The codec
+ * @param uncompressed_size Size of the uncompressed data in bytes
+ * @param options Compression options, or *NULL*
+ * @return The maximum size required to store a compressed buffer
+ *   representing @a uncompressed_size of uncompressed data.
+ */
+size_t
+squash_codec_get_max_compressed_size_with_options (SquashCodec* codec, size_t uncompressed_size, SquashOptions* options) {
   SquashCodecImpl* impl = NULL;
+  size_t max_compressed_size;
 
   assert (codec != NULL);
 
@@ -567,9 +595,17 @@ squash_codec_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_si
   assert (impl->get_max_compressed_size != NULL);
 
   if (impl->info & SQUASH_CODEC_INFO_WRAP_SIZE)
-    return squash_size_varuint64(uncompressed_size) + impl->get_max_compressed_size (codec, uncompressed_size);
+    max_compressed_size = squash_size_varuint64(uncompressed_size) + impl->get_max_compressed_size (codec, uncompressed_size);
   else
-    return impl->get_max_compressed_size (codec, uncompressed_size);
+    max_compressed_size = impl->get_max_compressed_size (codec, uncompressed_size);
+
+  if (squash_block_is_enabled (codec, options)) {
+    const size_t max_stored_size = squash_block_get_max_stored_size (uncompressed_size);
+    if (max_stored_size > max_compressed_size)
+      max_compressed_size = max_stored_size;
+  }
+
+  return max_compressed_size;
 }
 
 /**
@@ -583,11 +619,32 @@ squash_codec_get_max_compressed_size (SquashCodec* codec, size_t uncompressed_si
  */
 SquashStream*
 squash_codec_create_stream_with_options (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
-  SquashCodecImpl* impl = NULL;
-
   assert (codec != NULL);
   assert (stream_type == SQUASH_STREAM_COMPRESS || stream_type == SQUASH_STREAM_DECOMPRESS);
 
+  if (HEDLEY_UNLIKELY(squash_codec_get_impl (codec) == NULL))
+    return NULL;
+
+  if (squash_block_is_enabled (codec, options))
+    return (SquashStream*) squash_block_stream_new (codec, stream_type, options);
+  else
+    return squash_codec_create_stream_internal (codec, stream_type, options);
+}
+
+/**
+ * @brief Create a new stream, bypassing Squash's own framing
+ * @private
+ *
+ * @param codec The codec
+ * @param stream_type The direction of the stream
+ * @param options The options for the stream, or *NULL* to use the
+ *     defaults
+ * @return A new stream, or *NULL* on failure
+ */
+SquashStream*
+squash_codec_create_stream_internal (SquashCodec* codec, SquashStreamType stream_type, SquashOptions* options) {
+  SquashCodecImpl* impl = NULL;
+
   impl = squash_codec_get_impl (codec);
   if (impl == NULL) {
     return NULL;
@@ -734,7 +791,6 @@ squash_codec_compress_with_options (SquashCodec* codec,
                                     const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
                                     SquashOptions* options) {
   SquashStatus res = SQUASH_OK;
-  SquashCodecImpl* impl = NULL;
 
   assert (codec != NULL);
 
@@ -743,8 +799,7 @@ squash_codec_compress_with_options (SquashCodec* codec,
 
   squash_object_ref (options);
 
-  impl = squash_codec_get_impl (codec);
-  if (HEDLEY_UNLIKELY(impl == NULL)) {
+  if (HEDLEY_UNLIKELY(squash_codec_get_impl (codec) == NULL)) {
     res = squash_error (SQUASH_UNABLE_TO_LOAD);
     goto cleanup;
   }
@@ -754,6 +809,46 @@ squash_codec_compress_with_options (SquashCodec* codec,
     goto cleanup;
   }
 
+  if (squash_block_is_enabled (codec, options)) {
+    res = squash_block_compress (codec, compressed_size, compressed, uncompressed_size, uncompressed, options);
+  } else {
+    res = squash_codec_compress_internal (codec, compressed_size, compressed, uncompressed_size, uncompressed, options);
+  }
+
+ cleanup:
+
+  squash_object_unref (options);
+  return res;
+}
+
+/**
+ * @brief Compress a buffer, bypassing Squash's own framing
+ * @private
+ *
+ * The caller is responsible for holding a reference to @a options.
+ *
+ * @param codec The codec to use
+ * @param[out] compressed Location to store the compressed data
+ * @param[in,out] compressed_size Location storing the size of the
+ *   @a compressed buffer on input, replaced with the actual size of
+ *   the compressed data
+ * @param uncompressed The uncompressed data
+ * @param uncompressed_size Size of the uncompressed data (in bytes)
+ * @param options Compression options
+ * @return A status code
+ */
+SquashStatus
+squash_codec_compress_internal (SquashCodec* codec,
+                                size_t* compressed_size,
+                                uint8_t compressed[HEDLEY_ARRAY_PARAM(*compressed_size)],
+                                size_t uncompressed_size,
+                                const uint8_t uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_size)],
+                                SquashOptions* options) {
+  SquashStatus res = SQUASH_OK;
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+
+  assert (impl != NULL);
+
   if (impl->compress_buffer ||
       impl->compress_buffer_unsafe) {
     const size_t internal_max_compressed_size = impl->get_max_compressed_size (codec, uncompressed_size);
@@ -762,10 +857,8 @@ squash_codec_compress_with_options (SquashCodec* codec,
 
     if (impl->info & SQUASH_CODEC_INFO_WRAP_SIZE) {
       const size_t encoded_size_length = squash_write_varuint64 (compressed, *compressed_size, uncompressed_size);
-      if (HEDLEY_UNLIKELY(encoded_size_length == 0)) {
-        res = squash_error (SQUASH_BUFFER_FULL);
-        goto cleanup;
-      }
+      if (HEDLEY_UNLIKELY(encoded_size_length == 0))
+        return squash_error (SQUASH_BUFFER_FULL);
 
       internal_compressed = compressed + encoded_size_length;
       internal_compressed_size = *compressed_size - encoded_size_length;
@@ -820,15 +913,12 @@ squash_codec_compress_with_options (SquashCodec* codec,
       *compressed_size = internal_compressed_size + (internal_compressed - compressed);
   } else if (impl->splice != NULL) {
     res = squash_buffer_splice (codec, SQUASH_STREAM_COMPRESS, compressed_size, compressed, uncompressed_size, uncompressed, options);
-    goto cleanup;
   } else {
     SquashStream* stream;
 
-    stream = squash_codec_create_stream_with_options (codec, SQUASH_STREAM_COMPRESS, options);
-    if (HEDLEY_UNLIKELY(stream == NULL)) {
-      res = squash_error (SQUASH_FAILED);
-      goto cleanup;
-    }
+    stream = squash_codec_create_stream_internal (codec, SQUASH_STREAM_COMPRESS, options);
+    if (HEDLEY_UNLIKELY(stream == NULL))
+      return squash_error (SQUASH_FAILED);
 
     stream->next_in = uncompressed;
     stream->avail_in = uncompressed_size;
@@ -839,28 +929,18 @@ squash_codec_compress_with_options (SquashCodec* codec,
       res = squash_stream_process (stream);
     } while (res == SQUASH_PROCESSING);
 
-    if (res != SQUASH_OK) {
-      squash_object_unref (stream);
-      goto cleanup;
+    if (res == SQUASH_OK) {
+      do {
+        res = squash_stream_finish (stream);
+      } while (res == SQUASH_PROCESSING);
     }
 
-    do {
-      res = squash_stream_finish (stream);
-    } while (res == SQUASH_PROCESSING);
-
-    if (res != SQUASH_OK) {
-      squash_object_unref (stream);
-      goto cleanup;
-    }
+    if (res == SQUASH_OK)
+      *compressed_size = stream->total_out;
 
-    *compressed_size = stream->total_out;
     squash_object_unref (stream);
-    goto cleanup;
   }
 
- cleanup:
-
-  squash_object_unref (options);
   return res;
 }
 
@@ -899,6 +979,28 @@ SquashStatus squash_codec_compress (SquashCodec* codec,
                                              options);
 }
 
+/* Try to decompress data which starts with Squash's framing magic.
+ * If it doesn't decode it may just be native data which happens to
+ * start with the same bytes, so this returns false on any failure and
+ * the caller should decompress it natively instead. */
+static bool
+squash_codec_decompress_framed (SquashCodec* codec,
+                                size_t* decompressed_size,
+                                uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                size_t compressed_size,
+                                const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                SquashOptions* options,
+                                SquashStatus* res) {
+  size_t framed_size = *decompressed_size;
+
+  *res = squash_block_decompress (codec, &framed_size, decompressed, compressed_size, compressed, options);
+  if (*res != SQUASH_OK)
+    return false;
+
+  *decompressed_size = framed_size;
+  return true;
+}
+
 /**
  * @brief Decompress a buffer with an existing @ref SquashOptions
  *
@@ -919,12 +1021,11 @@ squash_codec_decompress_with_options (SquashCodec* codec,
                                       size_t compressed_size,
                                       const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
                                       SquashOptions* options) {
-  SquashCodecImpl* impl = NULL;
+  SquashStatus res;
 
   assert (codec != NULL);
 
-  impl = squash_codec_get_impl (codec);
-  if (HEDLEY_UNLIKELY(impl == NULL))
+  if (HEDLEY_UNLIKELY(squash_codec_get_impl (codec) == NULL))
     return squash_error (SQUASH_UNABLE_TO_LOAD);
 
   if (HEDLEY_UNLIKELY(decompressed == compressed))
@@ -933,55 +1034,111 @@ squash_codec_decompress_with_options (SquashCodec* codec,
   if (HEDLEY_UNLIKELY(*decompressed_size == 0))
     return squash_error (SQUASH_INVALID_BUFFER);
 
-  if (impl->decompress_buffer != NULL) {
-    SquashStatus res;
+  squash_object_ref (options);
 
-    if (impl->info & SQUASH_CODEC_INFO_WRAP_SIZE) {
-      const uint8_t* internal_compressed;
-      size_t internal_compressed_size;
-      size_t internal_decompressed_size;
+  if (squash_block_is_enabled (codec, options)) {
+    res = squash_block_decompress (codec, decompressed_size, decompressed, compressed_size, compressed, options);
+  } else if (squash_block_has_magic (compressed_size, compressed) &&
+             squash_codec_decompress_framed (codec, decompressed_size, decompressed, compressed_size, compressed, options, &res)) {
+    /* Written with framing=chunked or store-incompressible. */
+  } else if (!squash_parallel_decompress (codec, decompressed_size, decompressed, compressed_size, compressed, options, &res)) {
+    res = squash_codec_decompress_internal (codec, decompressed_size, decompressed, compressed_size, compressed, options);
+  }
 
-      uint64_t encoded_decompressed_size = 0;
-      const size_t encoded_decompressed_size_length = squash_read_varuint64(compressed, compressed_size, &encoded_decompressed_size);
+  squash_object_unref (options);
+
+  return res;
+}
+
+/* Call a plugin's buffer decompression function, taking care of the
+ * size prefix for codecs with SQUASH_CODEC_INFO_WRAP_SIZE. */
+static SquashStatus
+squash_codec_decompress_buffer (SquashCodec* codec,
+                                SquashStatus (* decompress_buffer) (SquashCodec*, size_t*, uint8_t*, size_t, const uint8_t*, SquashOptions*),
+                                size_t* decompressed_size,
+                                uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                size_t compressed_size,
+                                const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                SquashOptions* options) {
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+  SquashStatus res;
+
+  if (impl->info & SQUASH_CODEC_INFO_WRAP_SIZE) {
+    const uint8_t* internal_compressed;
+    size_t internal_compressed_size;
+    size_t internal_decompressed_size;
+
+    uint64_t encoded_decompressed_size = 0;
+    const size_t encoded_decompressed_size_length = squash_read_varuint64(compressed, compressed_size, &encoded_decompressed_size);
 #if SIZE_MAX < UINT64_MAX
-      if (HEDLEY_UNLIKELY(SIZE_MAX < encoded_decompressed_size))
-        return squash_error (SQUASH_RANGE);
+    if (HEDLEY_UNLIKELY(SIZE_MAX < encoded_decompressed_size))
+      return squash_error (SQUASH_RANGE);
 #endif
 
-      if (*decompressed_size < encoded_decompressed_size)
-        return squash_error (SQUASH_BUFFER_FULL);
+    if (*decompressed_size < encoded_decompressed_size)
+      return squash_error (SQUASH_BUFFER_FULL);
 
-      internal_decompressed_size = (size_t) encoded_decompressed_size;
-      internal_compressed = compressed + encoded_decompressed_size_length;
-      internal_compressed_size = compressed_size - encoded_decompressed_size_length;
-      *decompressed_size = (size_t) encoded_decompressed_size;
+    internal_decompressed_size = (size_t) encoded_decompressed_size;
+    internal_compressed = compressed + encoded_decompressed_size_length;
+    internal_compressed_size = compressed_size - encoded_decompressed_size_length;
+    *decompressed_size = (size_t) encoded_decompressed_size;
 
-      res = impl->decompress_buffer (codec,
-                                     &internal_decompressed_size, decompressed,
-                                     internal_compressed_size, internal_compressed,
-                                     squash_object_ref (options));
-      squash_object_unref (options);
+    res = decompress_buffer (codec,
+                             &internal_decompressed_size, decompressed,
+                             internal_compressed_size, internal_compressed,
+                             options);
 
-      if (HEDLEY_LIKELY(res == SQUASH_OK) &&
-          HEDLEY_UNLIKELY(internal_decompressed_size != encoded_decompressed_size)) {
-        res = squash_error (SQUASH_INVALID_BUFFER);
-      }
-    } else {
-      res = impl->decompress_buffer (codec,
-                                     decompressed_size, decompressed,
-                                     compressed_size, compressed,
-                                     squash_object_ref (options));
-      squash_object_unref (options);
+    if (HEDLEY_LIKELY(res == SQUASH_OK) &&
+        HEDLEY_UNLIKELY(internal_decompressed_size != encoded_decompressed_size)) {
+      res = squash_error (SQUASH_INVALID_BUFFER);
     }
+  } else {
+    res = decompress_buffer (codec,
+                             decompressed_size, decompressed,
+                             compressed_size, compressed,
+                             options);
+  }
 
-    return res;
+  return res;
+}
+
+/**
+ * @brief Decompress a buffer, bypassing Squash's own framing
+ * @private
+ *
+ * The caller is responsible for holding a reference to @a options.
+ *
+ * @param codec The codec to use
+ * @param[out] decompressed Location to store the decompressed data
+ * @param[in,out] decompressed_size Location storing the size of the
+ *   @a decompressed buffer on input, replaced with the actual size of
+ *   the decompressed data
+ * @param compressed The compressed data
+ * @param compressed_size Size of the compressed data (in bytes)
+ * @param options Compression options
+ * @return A status code
+ */
+SquashStatus
+squash_codec_decompress_internal (SquashCodec* codec,
+                                  size_t* decompressed_size,
+                                  uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                  size_t compressed_size,
+                                  const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                  SquashOptions* options) {
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+
+  assert (impl != NULL);
+
+  if (impl->decompress_buffer != NULL) {
+    return squash_codec_decompress_buffer (codec, impl->decompress_buffer,
+                                           decompressed_size, decompressed,
+                                           compressed_size, compressed,
+                                           options);
   } else {
     SquashStatus status;
     SquashStream* stream;
 
-    stream = squash_codec_create_stream_with_options (codec, SQUASH_STREAM_DECOMPRESS, options);
-    if (stream == NULL)
-      exit(EXIT_FAILURE);
+    stream = squash_codec_create_stream_internal (codec, SQUASH_STREAM_DECOMPRESS, options);
     if (HEDLEY_UNLIKELY(stream == NULL))
       return squash_error (SQUASH_FAILED);
     stream->next_in = compressed;
@@ -1053,34 +1210,753 @@ squash_codec_decompress (SquashCodec* codec,
 }
 
 /**
- * @brief Create a new codec
- * @private
+ * @brief Decompress a buffer from a trusted source with an existing
+ *   @ref SquashOptions
  *
- * @param plugin Plugin to which this codec belongs
- * @param name Name of the codec
+ * Some libraries provide a decoder which skips the bounds checks
+ * needed to safely handle malformed data (for example,
+ * `LZ4_decompress_fast` or LZO's `lzo1x_decompress`).  This function
+ * will use such a decoder if the codec has one (see
+ * @ref SQUASH_CODEC_INFO_DECOMPRESS_TRUSTED), and otherwise behaves
+ * exactly like @ref squash_codec_decompress_with_options.
+ *
+ * @warning Only use this for data you compressed yourself and have
+ * verified (for example, with a checksum) since.  Corrupt or
+ * malicious input may cause reads and writes outside of the buffers.
+ *
+ * @param codec The codec to use
+ * @param[out] decompressed Location to store the decompressed data
+ * @param[in,out] decompressed_size Location storing the exact size of
+ *   the decompressed data, or for codecs which don't need it (see
+ *   @ref SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE) the size of the
+ *   @a decompressed buffer; replaced with the actual size of the
+ *   decompressed data
+ * @param compressed The compressed data
+ * @param compressed_size Size of the compressed data (in bytes)
+ * @param options Decompression options
+ * @return A status code
  */
-SquashCodec*
-squash_codec_new (SquashPlugin* plugin, const char* name) {
-  SquashCodec* codecp = (SquashCodec*) squash_malloc (sizeof (SquashCodec));
-  SquashCodec codec = { 0, };
+SquashStatus
+squash_codec_decompress_trusted_with_options (SquashCodec* codec,
+                                              size_t* decompressed_size,
+                                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                              size_t compressed_size,
+                                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                              SquashOptions* options) {
+  SquashCodecImpl* impl;
+  SquashStatus res;
 
-  codec.plugin = plugin;
-  codec.name = strdup (name);
-  codec.priority = 50;
-  SQUASH_TREE_ENTRY_INIT(codec.tree);
+  assert (codec != NULL);
 
-  *codecp = codec;
+  impl = squash_codec_get_impl (codec);
+  if (HEDLEY_UNLIKELY(impl == NULL))
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
 
-  /* squash_plugin_add_codec (plugin, codecp); */
+  /* Framed data has to be parsed with the checked path; the unchecked
+     decoders would treat the framing as codec data. */
+  if (impl->decompress_buffer_unsafe == NULL ||
+      squash_block_is_enabled (codec, options) ||
+      squash_block_has_magic (compressed_size, compressed))
+    return squash_codec_decompress_with_options (codec, decompressed_size, decompressed, compressed_size, compressed, options);
 
-  return codecp;
+  if (HEDLEY_UNLIKELY(decompressed == compressed))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  if (HEDLEY_UNLIKELY(*decompressed_size == 0))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  squash_object_ref (options);
+  res = squash_codec_decompress_buffer (codec, impl->decompress_buffer_unsafe,
+                                        decompressed_size, decompressed,
+                                        compressed_size, compressed,
+                                        options);
+  squash_object_unref (options);
+
+  return res;
 }
 
 /**
- * @brief Set the codec's extension
- * @private
+ * @brief Decompress a buffer from a trusted source
  *
- * @param codec The codec
+ * @see squash_codec_decompress_trusted_with_options
+ *
+ * @param codec The codec to use
+ * @param[out] decompressed Location to store the decompressed data
+ * @param[in,out] decompressed_size Location storing the exact size of
+ *   the decompressed data, replaced with the actual size of the
+ *   decompressed data
+ * @param compressed The compressed data
+ * @param compressed_size Size of the compressed data (in bytes)
+ * @param ... A variadic list of key/value option pairs, followed by
+ *   *NULL*
+ * @return A status code
+ */
+SquashStatus
+squash_codec_decompress_trusted (SquashCodec* codec,
+                                 size_t* decompressed_size,
+                                 uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                 size_t compressed_size,
+                                 const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                 ...) {
+  SquashOptions* options;
+  va_list ap;
+
+  assert (codec != NULL);
+
+  va_start (ap, compressed);
+  options = squash_options_newv (codec, ap);
+  va_end (ap);
+
+  return squash_codec_decompress_trusted_with_options (codec,
+                                                       decompressed_size, decompressed,
+                                                       compressed_size, compressed,
+                                                       options);
+}
+
+static SquashStatus
+squash_codec_decompress_prefix_stream (SquashStream* stream,
+                                       bool finish_validates,
+                                       size_t* decompressed_size,
+                                       uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                       size_t compressed_size,
+                                       const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]) {
+  SquashStatus res;
+
+  stream->next_in = compressed;
+  stream->avail_in = compressed_size;
+  stream->next_out = decompressed;
+  stream->avail_out = *decompressed_size;
+
+  /* Stop as soon as the output buffer is full; the stream is simply
+     abandoned with whatever is left. */
+  do {
+    res = squash_stream_process (stream);
+  } while (res == SQUASH_PROCESSING && stream->avail_out != 0);
+
+  /* With room left over the whole stream has to be there, otherwise
+     truncated input would look like a short prefix. */
+  if (res == SQUASH_OK && stream->avail_out != 0) {
+    if (finish_validates) {
+      do {
+        res = squash_stream_finish (stream);
+      } while (res == SQUASH_PROCESSING && stream->avail_out != 0);
+    } else {
+      /* Most native streams don't report the end of the stream, and
+         not all of them fail when finishing a truncated one.  Since
+         everything fit in the buffer anyway, let the checked decoder
+         decide. */
+      size_t checked_size = *decompressed_size;
+      res = squash_codec_decompress_with_options (stream->codec,
+                                                  &checked_size, decompressed,
+                                                  compressed_size, compressed,
+                                                  stream->options);
+      if (res == SQUASH_OK)
+        *decompressed_size = checked_size;
+      return res;
+    }
+  }
+
+  if (res < 0)
+    return res;
+
+  *decompressed_size = stream->total_out;
+
+  return SQUASH_OK;
+}
+
+/**
+ * @brief Decompress the beginning of a buffer with an existing
+ *   @ref SquashOptions
+ *
+ * Unlike @ref squash_codec_decompress_with_options, this doesn't
+ * require room for all of the decompressed data.  Decompression stops
+ * once the @a decompressed buffer is full, so the cost depends on how
+ * much data is requested rather than on the size of the input (where
+ * the codec allows it).  It is not an error for the data to be
+ * shorter than the buffer, but it is for the data to be truncated.
+ *
+ * Codecs which can't stop early (those with only a buffer interface)
+ * are decompressed in full to a temporary buffer first.
+ *
+ * @param codec The codec to use
+ * @param[out] decompressed Location to store the decompressed data
+ * @param[in,out] decompressed_size Location storing the number of
+ *   bytes wanted, replaced with the number of bytes decompressed
+ * @param compressed The compressed data
+ * @param compressed_size Size of the compressed data (in bytes)
+ * @param options Decompression options
+ * @return A status code
+ */
+SquashStatus
+squash_codec_decompress_prefix_with_options (SquashCodec* codec,
+                                             size_t* decompressed_size,
+                                             uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                             size_t compressed_size,
+                                             const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                             SquashOptions* options) {
+  SquashCodecImpl* impl;
+  SquashStatus res;
+
+  assert (codec != NULL);
+
+  impl = squash_codec_get_impl (codec);
+  if (HEDLEY_UNLIKELY(impl == NULL))
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
+
+  if (HEDLEY_UNLIKELY(decompressed == compressed))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  if (HEDLEY_UNLIKELY(*decompressed_size == 0))
+    return squash_error (SQUASH_INVALID_BUFFER);
+
+  squash_object_ref (options);
+
+  /* Written with framing=chunked or store-incompressible; fall back on
+     the codec's own format if the framing doesn't parse. */
+  if (!squash_block_is_enabled (codec, options) && squash_block_has_magic (compressed_size, compressed)) {
+    SquashStream* stream = (SquashStream*) squash_block_stream_new (codec, SQUASH_STREAM_DECOMPRESS, options);
+    if (stream != NULL) {
+      size_t framed_size = *decompressed_size;
+      res = squash_codec_decompress_prefix_stream (stream, true,
+                                                   &framed_size, decompressed,
+                                                   compressed_size, compressed);
+      squash_object_unref (stream);
+
+      if (res == SQUASH_OK) {
+        *decompressed_size = framed_size;
+        squash_object_unref (options);
+        return SQUASH_OK;
+      }
+    }
+  }
+
+  if (impl->decompress_prefix != NULL && !squash_block_is_enabled (codec, options)) {
+    size_t requested = *decompressed_size;
+
+    if (impl->info & SQUASH_CODEC_INFO_WRAP_SIZE) {
+      uint64_t encoded_decompressed_size = 0;
+      const size_t encoded_decompressed_size_length = squash_read_varuint64(compressed, compressed_size, &encoded_decompressed_size);
+
+      if (encoded_decompressed_size < *decompressed_size)
+        requested = *decompressed_size = (size_t) encoded_decompressed_size;
+
+      res = impl->decompress_prefix (codec,
+                                     decompressed_size, decompressed,
+                                     compressed_size - encoded_decompressed_size_length,
+                                     compressed + encoded_decompressed_size_length,
+                                     options);
+    } else {
+      res = impl->decompress_prefix (codec,
+                                     decompressed_size, decompressed,
+                                     compressed_size, compressed,
+                                     options);
+    }
+
+    /* Partial decoders may stop quietly when the input runs out, so a
+       short result has to be checked like the stream path does. */
+    if (res == SQUASH_OK && *decompressed_size < requested) {
+      *decompressed_size = requested;
+      res = squash_codec_decompress_with_options (codec,
+                                                  decompressed_size, decompressed,
+                                                  compressed_size, compressed,
+                                                  options);
+    }
+  } else {
+    SquashStream* stream = squash_codec_create_stream_with_options (codec, SQUASH_STREAM_DECOMPRESS, options);
+    if (HEDLEY_UNLIKELY(stream == NULL)) {
+      squash_object_unref (options);
+      return squash_error (SQUASH_FAILED);
+    }
+
+    /* Streams which only decode once they're finished (buffer and
+       splice codecs, and framed streams) check the input when
+       finishing. */
+    res = squash_codec_decompress_prefix_stream (stream,
+                                                 impl->process_stream == NULL || squash_block_is_enabled (codec, options),
+                                                 decompressed_size, decompressed,
+                                                 compressed_size, compressed);
+    squash_object_unref (stream);
+  }
+
+  squash_object_unref (options);
+
+  return (res > 0) ? SQUASH_OK : res;
+}
+
+/**
+ * @brief Decompress the beginning of a buffer
+ *
+ * @see squash_codec_decompress_prefix_with_options
+ *
+ * @param codec The codec to use
+ * @param[out] decompressed Location to store the decompressed data
+ * @param[in,out] decompressed_size Location storing the number of
+ *   bytes wanted, replaced with the number of bytes decompressed
+ * @param compressed The compressed data
+ * @param compressed_size Size of the compressed data (in bytes)
+ * @param ... A variadic list of key/value option pairs, followed by
+ *   *NULL*
+ * @return A status code
+ */
+SquashStatus
+squash_codec_decompress_prefix (SquashCodec* codec,
+                                size_t* decompressed_size,
+                                uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                size_t compressed_size,
+                                const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                ...) {
+  SquashOptions* options;
+  va_list ap;
+
+  assert (codec != NULL);
+
+  va_start (ap, compressed);
+  options = squash_options_newv (codec, ap);
+  va_end (ap);
+
+  return squash_codec_decompress_prefix_with_options (codec,
+                                                      decompressed_size, decompressed,
+                                                      compressed_size, compressed,
+                                                      options);
+}
+
+struct SquashIOVecSpliceData {
+  size_t input_count;
+  SquashIOVec* input;
+  size_t output_count;
+  SquashIOVec* output;
+  size_t output_remaining;
+};
+
+static SquashStatus
+squash_iovec_splice_read (size_t* data_size,
+                          uint8_t data[HEDLEY_ARRAY_PARAM(*data_size)],
+                          void* user_data) {
+  struct SquashIOVecSpliceData* ctx = (struct SquashIOVecSpliceData*) user_data;
+
+  *data_size = squash_iovec_read (&(ctx->input_count), &(ctx->input), *data_size, data);
+
+  return (*data_size != 0) ? SQUASH_OK : SQUASH_END_OF_STREAM;
+}
+
+static SquashStatus
+squash_iovec_splice_write (size_t* data_size,
+                           const uint8_t data[HEDLEY_ARRAY_PARAM(*data_size)],
+                           void* user_data) {
+  struct SquashIOVecSpliceData* ctx = (struct SquashIOVecSpliceData*) user_data;
+
+  if (HEDLEY_UNLIKELY(*data_size > ctx->output_remaining)) {
+    *data_size = 0;
+    return squash_error (SQUASH_BUFFER_FULL);
+  }
+
+  squash_iovec_write (&(ctx->output_count), &(ctx->output), *data_size, data);
+  ctx->output_remaining -= *data_size;
+
+  return SQUASH_OK;
+}
+
+/* Count the non-empty segments in a list, and find the first one. */
+static size_t
+squash_iovec_count (size_t count, const SquashIOVec iov[HEDLEY_ARRAY_PARAM(count)], const SquashIOVec** first) {
+  size_t n = 0;
+
+  *first = NULL;
+  for (size_t i = 0 ; i < count ; i++) {
+    if (iov[i].size != 0) {
+      if (n++ == 0)
+        *first = &(iov[i]);
+    }
+  }
+
+  return n;
+}
+
+static SquashStatus
+squash_codec_processv_stream (SquashCodec* codec,
+                              SquashStreamType stream_type,
+                              size_t* output_size,
+                              size_t output_count,
+                              SquashIOVec* output,
+                              size_t input_count,
+                              SquashIOVec* input,
+                              SquashOptions* options) {
+  SquashStatus res;
+  uint8_t overflow;
+  const size_t capacity = squash_iovec_get_size (output_count, output);
+
+  SquashStream* stream = squash_codec_create_stream_with_options (codec, stream_type, options);
+  if (HEDLEY_UNLIKELY(stream == NULL))
+    return squash_error (SQUASH_FAILED);
+
+  /* The caller reserved an extra slot at the end of the output list.
+     Giving the stream one more byte lets it tell us it is done when
+     the output is exactly the right size (for example when all that
+     is left of the input is a footer), instead of us reporting that
+     more space is needed.  If anything is actually written there, the
+     output really was too small. */
+  output[output_count].data = &overflow;
+  output[output_count].size = 1;
+  output_count++;
+
+  res = squash_stream_finishv (stream, &input_count, &input, &output_count, &output);
+
+  if (res == SQUASH_END_OF_STREAM)
+    res = SQUASH_OK;
+  else if (res == SQUASH_PROCESSING)
+    res = squash_error (SQUASH_BUFFER_FULL);
+
+  if (res == SQUASH_OK) {
+    if (HEDLEY_UNLIKELY(stream->total_out > capacity))
+      res = squash_error (SQUASH_BUFFER_FULL);
+    else
+      *output_size = stream->total_out;
+  }
+
+  squash_object_unref (stream);
+
+  return res;
+}
+
+static SquashStatus
+squash_codec_processv_buffer (SquashCodec* codec,
+                              SquashStreamType stream_type,
+                              size_t* output_size,
+                              size_t output_count,
+                              const SquashIOVec output[HEDLEY_ARRAY_PARAM(output_count)],
+                              size_t input_count,
+                              const SquashIOVec input[HEDLEY_ARRAY_PARAM(input_count)],
+                              SquashOptions* options) {
+  static const uint8_t empty = 0;
+  SquashStatus res;
+  const SquashIOVec* single_input;
+  const SquashIOVec* single_output;
+  const uint8_t* input_data = &empty;
+  size_t input_size = 0;
+  uint8_t* gathered = NULL;
+  uint8_t* linear_output = NULL;
+
+  /* Only linearise the side(s) which actually need it. */
+  if (squash_iovec_count (input_count, input, &single_input) > 1) {
+    input_size = squash_iovec_get_size (input_count, input);
+    gathered = squash_malloc (input_size);
+    if (HEDLEY_UNLIKELY(gathered == NULL))
+      return squash_error (SQUASH_MEMORY);
+
+    for (size_t i = 0, pos = 0 ; i < input_count ; i++) {
+      if (input[i].size != 0) {
+        memcpy (gathered + pos, input[i].data, input[i].size);
+        pos += input[i].size;
+      }
+    }
+    input_data = gathered;
+  } else if (single_input != NULL) {
+    input_data = single_input->data;
+    input_size = single_input->size;
+  }
+
+  size_t linear_output_size;
+  if (squash_iovec_count (output_count, output, &single_output) > 1) {
+    linear_output_size = squash_iovec_get_size (output_count, output);
+
+    if (stream_type == SQUASH_STREAM_COMPRESS) {
+      const size_t max_compressed_size = squash_codec_get_max_compressed_size_with_options (codec, input_size, options);
+      if (max_compressed_size < linear_output_size)
+        linear_output_size = max_compressed_size;
+    } else {
+      const size_t uncompressed_size = squash_codec_get_uncompressed_size (codec, input_size, input_data);
+      if (uncompressed_size != 0 && uncompressed_size < linear_output_size)
+        linear_output_size = uncompressed_size;
+    }
+
+    linear_output = squash_malloc (linear_output_size);
+    if (HEDLEY_UNLIKELY(linear_output == NULL)) {
+      squash_free (gathered);
+      return squash_error (SQUASH_MEMORY);
+    }
+  } else {
+    assert (single_output != NULL);
+    linear_output_size = single_output->size;
+  }
+
+  uint8_t* output_data = (linear_output != NULL) ? linear_output : single_output->data;
+  if (stream_type == SQUASH_STREAM_COMPRESS)
+    res = squash_codec_compress_with_options (codec, &linear_output_size, output_data, input_size, input_data, options);
+  else
+    res = squash_codec_decompress_with_options (codec, &linear_output_size, output_data, input_size, input_data, options);
+
+  if (res == SQUASH_OK) {
+    if (linear_output != NULL) {
+      for (size_t i = 0, pos = 0 ; pos < linear_output_size ; i++) {
+        const size_t cp_size = (output[i].size < (linear_output_size - pos)) ? output[i].size : (linear_output_size - pos);
+        if (cp_size != 0) {
+          memcpy (output[i].data, linear_output + pos, cp_size);
+          pos += cp_size;
+        }
+      }
+    }
+
+    *output_size = linear_output_size;
+  }
+
+  squash_free (gathered);
+  squash_free (linear_output);
+
+  return res;
+}
+
+static SquashStatus
+squash_codec_processv (SquashCodec* codec,
+                       SquashStreamType stream_type,
+                       size_t* output_size,
+                       size_t output_count,
+                       const SquashIOVec output[HEDLEY_ARRAY_PARAM(output_count)],
+                       size_t input_count,
+                       const SquashIOVec input[HEDLEY_ARRAY_PARAM(input_count)],
+                       SquashOptions* options) {
+  SquashStatus res;
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+  const SquashIOVec* first;
+  SquashIOVec* output_cursor = NULL;
+  SquashIOVec* input_cursor = NULL;
+
+  assert (output_size != NULL);
+  assert (output != NULL);
+  assert (input != NULL || input_count == 0);
+
+  if (HEDLEY_UNLIKELY(impl == NULL))
+    return squash_error (SQUASH_UNABLE_TO_LOAD);
+
+  if (HEDLEY_UNLIKELY(squash_iovec_count (output_count, output, &first) == 0))
+    return squash_error (SQUASH_BUFFER_FULL);
+
+  squash_object_ref (options);
+
+  const bool gather = squash_iovec_count (input_count, input, &first) > 1;
+  const bool scatter = squash_iovec_count (output_count, output, &first) > 1;
+
+  if ((!gather && !scatter) ||
+      (impl->process_stream == NULL && impl->splice == NULL && !squash_block_is_enabled (codec, options))) {
+    /* Either everything is already contiguous, or the codec only
+       works on whole buffers anyway. */
+    res = squash_codec_processv_buffer (codec, stream_type, output_size, output_count, output, input_count, input, options);
+    goto cleanup;
+  }
+
+  /* Streaming codecs walk the segments directly; the lists are copied
+     so they can be used as cursors without modifying the caller's. */
+  output_cursor = squash_malloc (sizeof (SquashIOVec) * (output_count + 1));
+  if (input_count != 0)
+    input_cursor = squash_malloc (sizeof (SquashIOVec) * input_count);
+  if (HEDLEY_UNLIKELY(output_cursor == NULL || (input_count != 0 && input_cursor == NULL))) {
+    res = squash_error (SQUASH_MEMORY);
+    goto cleanup;
+  }
+  memcpy (output_cursor, output, sizeof (SquashIOVec) * output_count);
+  if (input_count != 0)
+    memcpy (input_cursor, input, sizeof (SquashIOVec) * input_count);
+
+  if (impl->process_stream != NULL || squash_block_is_enabled (codec, options)) {
+    res = squash_codec_processv_stream (codec, stream_type, output_size,
+                                        output_count, output_cursor,
+                                        input_count, input_cursor,
+                                        options);
+  } else {
+    struct SquashIOVecSpliceData data = {
+      input_count, input_cursor,
+      output_count, output_cursor, squash_iovec_get_size (output_count, output)
+    };
+
+    const size_t capacity = data.output_remaining;
+    res = impl->splice (codec, options, stream_type, squash_iovec_splice_read, squash_iovec_splice_write, &data);
+    if (res == SQUASH_OK)
+      *output_size = capacity - data.output_remaining;
+  }
+
+ cleanup:
+
+  squash_free (output_cursor);
+  squash_free (input_cursor);
+  squash_object_unref (options);
+
+  return res;
+}
+
+/**
+ * @brief Compress data from a scatter/gather list
+ *
+ * Codecs with a streaming implementation process the segments
+ * directly.  For codecs which only operate on whole buffers, the
+ * input (or output) is only copied into a contiguous buffer if it
+ * consists of more than one non-empty segment.
+ *
+ * @param codec The codec to use
+ * @param[out] compressed_size Location to store the total size of
+ *   the compressed data
+ * @param compressed_count Number of segments in @a compressed
+ * @param compressed Segments to store the compressed data in, in
+ *   order
+ * @param uncompressed_count Number of segments in @a uncompressed
+ * @param uncompressed Segments of uncompressed data
+ * @param options Compression options
+ * @return A status code
+ */
+SquashStatus
+squash_codec_compressv_with_options (SquashCodec* codec,
+                                     size_t* compressed_size,
+                                     size_t compressed_count,
+                                     const SquashIOVec compressed[HEDLEY_ARRAY_PARAM(compressed_count)],
+                                     size_t uncompressed_count,
+                                     const SquashIOVec uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_count)],
+                                     SquashOptions* options) {
+  assert (codec != NULL);
+
+  return squash_codec_processv (codec, SQUASH_STREAM_COMPRESS,
+                                compressed_size, compressed_count, compressed,
+                                uncompressed_count, uncompressed,
+                                options);
+}
+
+/**
+ * @brief Compress data from a scatter/gather list
+ *
+ * @param codec The codec to use
+ * @param[out] compressed_size Location to store the total size of
+ *   the compressed data
+ * @param compressed_count Number of segments in @a compressed
+ * @param compressed Segments to store the compressed data in, in
+ *   order
+ * @param uncompressed_count Number of segments in @a uncompressed
+ * @param uncompressed Segments of uncompressed data
+ * @param ... A variadic list of key/value option pairs, followed by
+ *   *NULL*
+ * @return A status code
+ * @see squash_codec_compressv_with_options
+ */
+SquashStatus
+squash_codec_compressv (SquashCodec* codec,
+                        size_t* compressed_size,
+                        size_t compressed_count,
+                        const SquashIOVec compressed[HEDLEY_ARRAY_PARAM(compressed_count)],
+                        size_t uncompressed_count,
+                        const SquashIOVec uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_count)],
+                        ...) {
+  SquashOptions* options;
+  va_list ap;
+
+  assert (codec != NULL);
+
+  va_start (ap, uncompressed);
+  options = squash_options_newv (codec, ap);
+  va_end (ap);
+
+  return squash_codec_compressv_with_options (codec,
+                                              compressed_size, compressed_count, compressed,
+                                              uncompressed_count, uncompressed,
+                                              options);
+}
+
+/**
+ * @brief Decompress data from a scatter/gather list
+ *
+ * See ::squash_codec_compressv_with_options for when the data is
+ * copied.
+ *
+ * @param codec The codec to use
+ * @param[out] decompressed_size Location to store the total size of
+ *   the decompressed data
+ * @param decompressed_count Number of segments in @a decompressed
+ * @param decompressed Segments to store the decompressed data in, in
+ *   order
+ * @param compressed_count Number of segments in @a compressed
+ * @param compressed Segments of compressed data
+ * @param options Decompression options
+ * @return A status code
+ */
+SquashStatus
+squash_codec_decompressv_with_options (SquashCodec* codec,
+                                       size_t* decompressed_size,
+                                       size_t decompressed_count,
+                                       const SquashIOVec decompressed[HEDLEY_ARRAY_PARAM(decompressed_count)],
+                                       size_t compressed_count,
+                                       const SquashIOVec compressed[HEDLEY_ARRAY_PARAM(compressed_count)],
+                                       SquashOptions* options) {
+  assert (codec != NULL);
+
+  return squash_codec_processv (codec, SQUASH_STREAM_DECOMPRESS,
+                                decompressed_size, decompressed_count, decompressed,
+                                compressed_count, compressed,
+                                options);
+}
+
+/**
+ * @brief Decompress data from a scatter/gather list
+ *
+ * @param codec The codec to use
+ * @param[out] decompressed_size Location to store the total size of
+ *   the decompressed data
+ * @param decompressed_count Number of segments in @a decompressed
+ * @param decompressed Segments to store the decompressed data in, in
+ *   order
+ * @param compressed_count Number of segments in @a compressed
+ * @param compressed Segments of compressed data
+ * @param ... A variadic list of key/value option pairs, followed by
+ *   *NULL*
+ * @return A status code
+ * @see squash_codec_decompressv_with_options
+ */
+SquashStatus
+squash_codec_decompressv (SquashCodec* codec,
+                          size_t* decompressed_size,
+                          size_t decompressed_count,
+                          const SquashIOVec decompressed[HEDLEY_ARRAY_PARAM(decompressed_count)],
+                          size_t compressed_count,
+                          const SquashIOVec compressed[HEDLEY_ARRAY_PARAM(compressed_count)],
+                          ...) {
+  SquashOptions* options;
+  va_list ap;
+
+  assert (codec != NULL);
+
+  va_start (ap, compressed);
+  options = squash_options_newv (codec, ap);
+  va_end (ap);
+
+  return squash_codec_decompressv_with_options (codec,
+                                                decompressed_size, decompressed_count, decompressed,
+                                                compressed_count, compressed,
+                                                options);
+}
+
+/**
+ * @brief Create a new codec
+ * @private
+ *
+ * @param plugin Plugin to which this codec belongs
+ * @param name Name of the codec
+ */
+SquashCodec*
+squash_codec_new (SquashPlugin* plugin, const char* name) {
+  SquashCodec* codecp = (SquashCodec*) squash_malloc (sizeof (SquashCodec));
+  SquashCodec codec = { 0, };
+
+  codec.plugin = plugin;
+  codec.name = strdup (name);
+  codec.priority = 50;
+  SQUASH_TREE_ENTRY_INIT(codec.tree);
+
+  *codecp = codec;
+
+  /* squash_plugin_add_codec (plugin, codecp); */
+
+  return codecp;
+}
+
+/**
+ * @brief Set the codec's extension
+ * @private
+ *
+ * @param codec The codec
  * @param name Extension of the codec
  */
 void
@@ -1137,6 +2013,11 @@ squash_codec_get_option_info (SquashCodec* codec) {
   return HEDLEY_LIKELY(impl != NULL) ? impl->options : NULL;
 }
 
+/* Limits on trusting the uncompressed size recorded in a header, see
+   squash_codec_decompress_to_buffer. */
+#define SQUASH_DECOMPRESS_EXACT_MIN       ((size_t) (1024 * 1024))
+#define SQUASH_DECOMPRESS_EXACT_MAX_RATIO ((size_t) 1024)
+
 SquashStatus
 squash_codec_decompress_to_buffer (SquashCodec* codec,
                                    SquashBuffer* decompressed,
@@ -1154,6 +2035,37 @@ squash_codec_decompress_to_buffer (SquashCodec* codec,
   size_t decompressed_alloc = compressed_npot_size << 3;
   size_t decompressed_size;
   bool try_smaller = false;
+
+  /* If the data records its size, try an exactly sized buffer before
+     guessing.  The size comes straight from the (possibly corrupt or
+     hostile) header, so don't allocate more than a plausible
+     compression ratio allows; bigger outputs still work, they just go
+     through the growing loop below. */
+  if (compressed_size != 0 &&
+      (squash_codec_get_info (codec) & SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE) == SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE &&
+      !squash_block_is_enabled (codec, options)) {
+    decompressed_size = squash_codec_get_uncompressed_size (codec, compressed_size, compressed);
+    if (decompressed_size != 0 &&
+        (decompressed_size <= SQUASH_DECOMPRESS_EXACT_MIN ||
+         (decompressed_size / SQUASH_DECOMPRESS_EXACT_MAX_RATIO) < compressed_size)) {
+      decompressed_data = squash_malloc (decompressed_size);
+      if (HEDLEY_UNLIKELY(decompressed_data == NULL))
+        return squash_error (SQUASH_MEMORY);
+
+      const size_t exact_size = decompressed_size;
+      res = squash_codec_decompress_with_options(codec, &decompressed_size, decompressed_data, compressed_size, compressed, options);
+      if (HEDLEY_LIKELY(res == SQUASH_OK)) {
+        squash_buffer_steal (decompressed, decompressed_size, exact_size, decompressed_data);
+        return res;
+      }
+
+      squash_free (decompressed_data);
+      decompressed_data = NULL;
+      if (res != SQUASH_BUFFER_FULL)
+        return res;
+    }
+  }
+
   do {
     if (HEDLEY_UNLIKELY(try_smaller))
       decompressed_alloc >>= 1;
@@ -47,6 +47,7 @@ typedef enum {
   SQUASH_CODEC_INFO_VALID                   = 1 << 16,
   SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE = 1 << 17,
   SQUASH_CODEC_INFO_NATIVE_STREAMING        = 1 << 18,
+  SQUASH_CODEC_INFO_DECOMPRESS_TRUSTED      = 1 << 19,
 
   SQUASH_CODEC_INFO_MASK                    = 0x00ffffff
 } SquashCodecInfo;
@@ -60,6 +61,8 @@ typedef SquashStatus (*SquashWriteFunc) (size_t* data_size,
                                          const uint8_t data[HEDLEY_ARRAY_PARAM(*data_size)],
                                          void* user_data);
 
+typedef SquashStatus (*SquashFrameFunc) (const SquashFrame* frame, void* user_data);
+
 struct SquashCodecImpl_ {
   SquashCodecInfo           info;
 
@@ -103,11 +106,40 @@ struct SquashCodecImpl_ {
                                                         const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]);
   size_t                  (* get_max_compressed_size)  (SquashCodec* codec, size_t uncompressed_size);
 
+  /* Frames */
+  SquashStatus            (* scan_frames)              (SquashCodec* codec,
+                                                        size_t compressed_size,
+                                                        const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                                        SquashFrameFunc func,
+                                                        void* user_data);
+
+  /* Random access */
+  SquashStream*           (* create_stream_at)         (SquashCodec* codec,
+                                                        SquashOptions* options,
+                                                        size_t compressed_size,
+                                                        const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                                        uint64_t uncompressed_offset,
+                                                        SquashObject** index,
+                                                        size_t* restart_compressed_offset,
+                                                        uint64_t* restart_uncompressed_offset);
+
+  /* Trusted input */
+  SquashStatus            (* decompress_buffer_unsafe) (SquashCodec* codec,
+                                                        size_t* decompressed_size,
+                                                        uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                                        size_t compressed_size,
+                                                        const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                                        SquashOptions* options);
+
+  /* Partial decompression */
+  SquashStatus            (* decompress_prefix)        (SquashCodec* codec,
+                                                        size_t* decompressed_size,
+                                                        uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                                        size_t compressed_size,
+                                                        const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                                        SquashOptions* options);
+
   /* Reserved */
-  void                    (* _reserved1)               (void);
-  void                    (* _reserved2)               (void);
-  void                    (* _reserved3)               (void);
-  void                    (* _reserved4)               (void);
   void                    (* _reserved5)               (void);
   void                    (* _reserved6)               (void);
   void                    (* _reserved7)               (void);
@@ -135,6 +167,9 @@ SQUASH_API size_t                  squash_codec_get_uncompressed_size        (Sq
                                                                               const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)]);
 HEDLEY_NON_NULL(1)
 SQUASH_API size_t                  squash_codec_get_max_compressed_size      (SquashCodec* codec, size_t uncompressed_size);
+HEDLEY_NON_NULL(1)
+SQUASH_API size_t                  squash_codec_get_max_compressed_size_with_options
+                                                                             (SquashCodec* codec, size_t uncompressed_size, SquashOptions* options);
 
 HEDLEY_SENTINEL(0)
 HEDLEY_NON_NULL(1)
@@ -172,6 +207,70 @@ SQUASH_API SquashStatus            squash_codec_decompress_with_options      (Sq
                                                                               size_t compressed_size,
                                                                               const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
                                                                               SquashOptions* options);
+HEDLEY_SENTINEL(0)
+HEDLEY_NON_NULL(1, 2, 3, 5)
+SQUASH_API SquashStatus            squash_codec_decompress_trusted           (SquashCodec* codec,
+                                                                              size_t* decompressed_size,
+                                                                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                                                              size_t compressed_size,
+                                                                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                                                              ...);
+HEDLEY_NON_NULL(1, 2, 3, 5)
+SQUASH_API SquashStatus            squash_codec_decompress_trusted_with_options (SquashCodec* codec,
+                                                                              size_t* decompressed_size,
+                                                                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                                                              size_t compressed_size,
+                                                                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                                                              SquashOptions* options);
+HEDLEY_SENTINEL(0)
+HEDLEY_NON_NULL(1, 2, 3, 5)
+SQUASH_API SquashStatus            squash_codec_decompress_prefix            (SquashCodec* codec,
+                                                                              size_t* decompressed_size,
+                                                                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                                                              size_t compressed_size,
+                                                                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                                                              ...);
+HEDLEY_NON_NULL(1, 2, 3, 5)
+SQUASH_API SquashStatus            squash_codec_decompress_prefix_with_options (SquashCodec* codec,
+                                                                              size_t* decompressed_size,
+                                                                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                                                              size_t compressed_size,
+                                                                              const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                                                              SquashOptions* options);
+HEDLEY_SENTINEL(0)
+HEDLEY_NON_NULL(1, 2, 4)
+SQUASH_API SquashStatus            squash_codec_compressv                    (SquashCodec* codec,
+                                                                              size_t* compressed_size,
+                                                                              size_t compressed_count,
+                                                                              const SquashIOVec compressed[HEDLEY_ARRAY_PARAM(compressed_count)],
+                                                                              size_t uncompressed_count,
+                                                                              const SquashIOVec uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_count)],
+                                                                              ...);
+HEDLEY_NON_NULL(1, 2, 4)
+SQUASH_API SquashStatus            squash_codec_compressv_with_options       (SquashCodec* codec,
+                                                                              size_t* compressed_size,
+                                                                              size_t compressed_count,
+                                                                              const SquashIOVec compressed[HEDLEY_ARRAY_PARAM(compressed_count)],
+                                                                              size_t uncompressed_count,
+                                                                              const SquashIOVec uncompressed[HEDLEY_ARRAY_PARAM(uncompressed_count)],
+                                                                              SquashOptions* options);
+HEDLEY_SENTINEL(0)
+HEDLEY_NON_NULL(1, 2, 4)
+SQUASH_API SquashStatus            squash_codec_decompressv                  (SquashCodec* codec,
+                                                                              size_t* decompressed_size,
+                                                                              size_t decompressed_count,
+                                                                              const SquashIOVec decompressed[HEDLEY_ARRAY_PARAM(decompressed_count)],
+                                                                              size_t compressed_count,
+                                                                              const SquashIOVec compressed[HEDLEY_ARRAY_PARAM(compressed_count)],
+                                                                              ...);
+HEDLEY_NON_NULL(1, 2, 4)
+SQUASH_API SquashStatus            squash_codec_decompressv_with_options     (SquashCodec* codec,
+                                                                              size_t* decompressed_size,
+                                                                              size_t decompressed_count,
+                                                                              const SquashIOVec decompressed[HEDLEY_ARRAY_PARAM(decompressed_count)],
+                                                                              size_t compressed_count,
+                                                                              const SquashIOVec compressed[HEDLEY_ARRAY_PARAM(compressed_count)],
+                                                                              SquashOptions* options);
 HEDLEY_NON_NULL(1)
 SQUASH_API SquashCodecInfo         squash_codec_get_info                     (SquashCodec* codec);
 HEDLEY_NON_NULL(1)
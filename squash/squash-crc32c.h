@@ -0,0 +1,61 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash.h> */
+
+#ifndef SQUASH_CRC32C_H
+#define SQUASH_CRC32C_H
+
+#if !defined (SQUASH_H_INSIDE) && !defined (SQUASH_COMPILATION)
+#error "Only <squash.h> can be included directly."
+#endif
+
+#include <squash.h>
+
+HEDLEY_BEGIN_C_DECLS
+
+/* Implementations for squash_crc32c_kernel; not part of the stable
+ * API. */
+typedef enum {
+  SQUASH_CRC32C_KERNEL_SLICE8,
+  SQUASH_CRC32C_KERNEL_SSE42,
+  SQUASH_CRC32C_KERNEL_PCLMUL,
+  SQUASH_CRC32C_KERNEL_ARMV8
+} SquashCrc32cKernel;
+
+HEDLEY_NON_NULL(3)
+SQUASH_API uint32_t squash_crc32c (uint32_t crc,
+                                   size_t data_size,
+                                   const uint8_t data[HEDLEY_ARRAY_PARAM(data_size)]);
+
+HEDLEY_NON_NULL(2,4)
+SQUASH_API SquashStatus squash_crc32c_kernel (SquashCrc32cKernel kernel,
+                                              uint32_t* crc,
+                                              size_t data_size,
+                                              const uint8_t data[HEDLEY_ARRAY_PARAM(data_size)]);
+
+HEDLEY_END_C_DECLS
+
+#endif /* SQUASH_CRC32C_H */
@@ -0,0 +1,328 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <assert.h>
+#include "squash-internal.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#if !defined(SQUASH_FD_STREAM_BUF_SIZE)
+#  define SQUASH_FD_STREAM_BUF_SIZE ((size_t) (64 * 1024))
+#endif
+
+/**
+ * @cond INTERNAL
+ */
+
+struct SquashFdStream_ {
+  SquashStream* stream;
+  int in_fd;
+  int out_fd;
+
+  /* Status to return from subsequent calls once we are done, either
+   * SQUASH_END_OF_STREAM or an error. */
+  SquashStatus status;
+
+  bool eof;
+  bool flush_pending;
+  bool finish_pending;
+
+  size_t in_pos;
+  size_t in_length;
+  size_t out_pos;
+  size_t out_length;
+
+  uint8_t in[SQUASH_FD_STREAM_BUF_SIZE];
+  uint8_t out[SQUASH_FD_STREAM_BUF_SIZE];
+};
+
+/**
+ * @endcond INTERNAL
+ */
+
+/**
+ * @defgroup SquashFdStream SquashFdStream
+ * @brief Drive a stream from non-blocking file descriptors
+ *
+ * A @ref SquashFdStream connects a @ref SquashStream to an input
+ * and an output file descriptor (which may be the same socket) and
+ * owns the buffers between them.  Each call moves data as far as the
+ * descriptors allow without blocking, then tells the caller whether
+ * it is waiting for the input to become readable or the output to
+ * become writable, so it can be dropped into a *poll*, *epoll*, or
+ * *kqueue* based event loop.
+ *
+ * The descriptors should be in non-blocking mode (*O_NONBLOCK*).
+ * Blocking descriptors work too, but then the calls will block.  The
+ * descriptors are never closed by Squash.
+ *
+ * This API is not available on Windows.
+ *
+ * @{
+ */
+
+/**
+ * @brief Create a new fd stream
+ *
+ * @param stream the stream to drive; a reference is taken
+ * @param in_fd descriptor to read input from
+ * @param out_fd descriptor to write output to
+ * @return a new fd stream, or *NULL* on failure
+ */
+SquashFdStream*
+squash_fd_stream_new (SquashStream* stream, int in_fd, int out_fd) {
+  assert (stream != NULL);
+
+  SquashFdStream* fd_stream = squash_malloc (sizeof (SquashFdStream));
+  if (HEDLEY_UNLIKELY(fd_stream == NULL)) {
+    squash_error (SQUASH_MEMORY);
+    return NULL;
+  }
+
+  fd_stream->stream = squash_object_ref (stream);
+  fd_stream->in_fd = in_fd;
+  fd_stream->out_fd = out_fd;
+  fd_stream->status = SQUASH_OK;
+  fd_stream->eof = false;
+  fd_stream->flush_pending = false;
+  fd_stream->finish_pending = false;
+  fd_stream->in_pos = 0;
+  fd_stream->in_length = 0;
+  fd_stream->out_pos = 0;
+  fd_stream->out_length = 0;
+
+  return fd_stream;
+}
+
+/**
+ * @brief Free an fd stream
+ *
+ * Any data which has not yet been written is discarded, and the
+ * descriptors are left open.
+ *
+ * @param fd_stream the fd stream to free
+ */
+void
+squash_fd_stream_free (SquashFdStream* fd_stream) {
+  if (fd_stream == NULL)
+    return;
+
+  squash_object_unref (fd_stream->stream);
+  squash_free (fd_stream);
+}
+
+/**
+ * @brief Get the underlying stream
+ *
+ * @param fd_stream the fd stream
+ * @return the stream passed to ::squash_fd_stream_new
+ */
+SquashStream*
+squash_fd_stream_get_stream (SquashFdStream* fd_stream) {
+  assert (fd_stream != NULL);
+
+  return fd_stream->stream;
+}
+
+static SquashStatus
+squash_fd_stream_fail (SquashFdStream* fd_stream, SquashStatus status) {
+  fd_stream->status = status;
+  return status;
+}
+
+static SquashStatus
+squash_fd_stream_pump (SquashFdStream* fd_stream, SquashFdStreamWant* want) {
+  SquashStream* stream = fd_stream->stream;
+  SquashStatus res;
+
+  if (want != NULL)
+    *want = SQUASH_FD_STREAM_WANT_NONE;
+
+  if (fd_stream->status < 0)
+    return fd_stream->status;
+
+  while (true) {
+    while (fd_stream->out_pos < fd_stream->out_length) {
+      const ssize_t bytes_written = write (fd_stream->out_fd,
+                                           fd_stream->out + fd_stream->out_pos,
+                                           fd_stream->out_length - fd_stream->out_pos);
+      if (bytes_written < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN
+#if EWOULDBLOCK != EAGAIN
+            || errno == EWOULDBLOCK
+#endif
+            ) {
+          if (want != NULL)
+            *want = SQUASH_FD_STREAM_WANT_WRITE;
+          return SQUASH_OK;
+        }
+        return squash_fd_stream_fail (fd_stream, squash_error (SQUASH_IO));
+      }
+      fd_stream->out_pos += (size_t) bytes_written;
+    }
+    fd_stream->out_pos = fd_stream->out_length = 0;
+
+    if (fd_stream->status == SQUASH_END_OF_STREAM)
+      return SQUASH_END_OF_STREAM;
+
+    const bool finishing = fd_stream->eof || fd_stream->finish_pending;
+
+    if (fd_stream->in_pos == fd_stream->in_length && !finishing && !fd_stream->flush_pending) {
+      const ssize_t bytes_read = read (fd_stream->in_fd, fd_stream->in, sizeof (fd_stream->in));
+      if (bytes_read < 0) {
+        if (errno == EINTR)
+          continue;
+        if (errno == EAGAIN
+#if EWOULDBLOCK != EAGAIN
+            || errno == EWOULDBLOCK
+#endif
+            ) {
+          if (want != NULL)
+            *want = SQUASH_FD_STREAM_WANT_READ;
+          return SQUASH_OK;
+        }
+        return squash_fd_stream_fail (fd_stream, squash_error (SQUASH_IO));
+      } else if (bytes_read == 0) {
+        fd_stream->eof = true;
+      } else {
+        fd_stream->in_pos = 0;
+        fd_stream->in_length = (size_t) bytes_read;
+      }
+      continue;
+    }
+
+    stream->next_in = fd_stream->in + fd_stream->in_pos;
+    stream->avail_in = fd_stream->in_length - fd_stream->in_pos;
+    stream->next_out = fd_stream->out;
+    stream->avail_out = sizeof (fd_stream->out);
+
+    if (finishing)
+      res = squash_stream_finish (stream);
+    else if (fd_stream->flush_pending)
+      res = squash_stream_flush (stream);
+    else
+      res = squash_stream_process (stream);
+
+    fd_stream->in_pos = fd_stream->in_length - stream->avail_in;
+    fd_stream->out_length = sizeof (fd_stream->out) - stream->avail_out;
+
+    if (HEDLEY_UNLIKELY(res < 0)) {
+      return squash_fd_stream_fail (fd_stream, res);
+    } else if (res == SQUASH_END_OF_STREAM || (res == SQUASH_OK && finishing)) {
+      /* Anything left in the input buffer after the end of a
+       * compressed stream is discarded. */
+      fd_stream->status = SQUASH_END_OF_STREAM;
+    } else if (res == SQUASH_OK && fd_stream->flush_pending) {
+      fd_stream->flush_pending = false;
+    }
+  }
+}
+
+/**
+ * @brief Move data between the descriptors and the stream
+ *
+ * Reads as much input as is available, feeds it through the stream,
+ * and writes the output, stopping as soon as either descriptor would
+ * block.  When the input descriptor reaches end of file the stream is
+ * finished automatically.
+ *
+ * @param fd_stream the fd stream
+ * @param[out] want location to store what the stream is waiting
+ *   for, or *NULL*
+ * @return @ref SQUASH_OK if the stream is waiting on one of the
+ *   descriptors (see @a want), @ref SQUASH_END_OF_STREAM once the
+ *   stream is finished and all output has been written, or a
+ *   negative error code on failure (@ref SQUASH_IO if *read* or
+ *   *write* failed; check *errno*)
+ */
+SquashStatus
+squash_fd_stream_process (SquashFdStream* fd_stream, SquashFdStreamWant* want) {
+  assert (fd_stream != NULL);
+
+  return squash_fd_stream_pump (fd_stream, want);
+}
+
+/**
+ * @brief Flush the stream
+ *
+ * Requests that everything read so far be flushed to the output
+ * descriptor, then continues as ::squash_fd_stream_process would.
+ * No further input is read until the flush has completed.
+ *
+ * @param fd_stream the fd stream
+ * @param[out] want location to store what the stream is waiting
+ *   for, or *NULL*
+ * @return same as ::squash_fd_stream_process, or @ref
+ *   SQUASH_INVALID_OPERATION if the codec does not support flushing
+ */
+SquashStatus
+squash_fd_stream_flush (SquashFdStream* fd_stream, SquashFdStreamWant* want) {
+  assert (fd_stream != NULL);
+
+  if (want != NULL)
+    *want = SQUASH_FD_STREAM_WANT_NONE;
+
+  if (HEDLEY_UNLIKELY((squash_codec_get_info (fd_stream->stream->codec) & SQUASH_CODEC_INFO_CAN_FLUSH) == 0))
+    return squash_error (SQUASH_INVALID_OPERATION);
+
+  if (fd_stream->status == SQUASH_OK && !fd_stream->eof && !fd_stream->finish_pending)
+    fd_stream->flush_pending = true;
+
+  return squash_fd_stream_pump (fd_stream, want);
+}
+
+/**
+ * @brief Finish the stream without waiting for end of file
+ *
+ * Stops reading from the input descriptor, finishes the stream with
+ * whatever input has already been read, and writes the remaining
+ * output.  This is useful when the end of the data is signalled by
+ * something other than end of file, such as a higher-level protocol.
+ *
+ * @param fd_stream the fd stream
+ * @param[out] want location to store what the stream is waiting
+ *   for, or *NULL*
+ * @return same as ::squash_fd_stream_process
+ */
+SquashStatus
+squash_fd_stream_finish (SquashFdStream* fd_stream, SquashFdStreamWant* want) {
+  assert (fd_stream != NULL);
+
+  fd_stream->finish_pending = true;
+
+  return squash_fd_stream_pump (fd_stream, want);
+}
+
+/**
+ * @}
+ */
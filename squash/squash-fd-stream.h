@@ -0,0 +1,81 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash.h> */
+
+#ifndef SQUASH_FD_STREAM_H
+#define SQUASH_FD_STREAM_H
+
+#if !defined (SQUASH_H_INSIDE) && !defined (SQUASH_COMPILATION)
+#error "Only <squash.h> can be included directly."
+#endif
+
+#include <squash.h>
+
+#if !defined(_WIN32)
+
+HEDLEY_BEGIN_C_DECLS
+
+/**
+ * @ingroup SquashFdStream
+ * @brief What an fd stream is waiting for
+ *
+ * Returned by ::squash_fd_stream_process (and friends) when the
+ * stream could not make any more progress without blocking.  The
+ * values may be combined.
+ */
+typedef enum {
+  /** @brief Nothing; the stream is finished or has failed */
+  SQUASH_FD_STREAM_WANT_NONE  = 0,
+  /** @brief Wait for the input descriptor to become readable */
+  SQUASH_FD_STREAM_WANT_READ  = 1 << 0,
+  /** @brief Wait for the output descriptor to become writable */
+  SQUASH_FD_STREAM_WANT_WRITE = 1 << 1
+} SquashFdStreamWant;
+
+HEDLEY_NON_NULL(1)
+SQUASH_API SquashFdStream* squash_fd_stream_new     (SquashStream* stream,
+                                                     int in_fd,
+                                                     int out_fd);
+SQUASH_API void            squash_fd_stream_free    (SquashFdStream* fd_stream);
+
+HEDLEY_NON_NULL(1)
+SQUASH_API SquashStatus    squash_fd_stream_process (SquashFdStream* fd_stream,
+                                                     SquashFdStreamWant* want);
+HEDLEY_NON_NULL(1)
+SQUASH_API SquashStatus    squash_fd_stream_flush   (SquashFdStream* fd_stream,
+                                                     SquashFdStreamWant* want);
+HEDLEY_NON_NULL(1)
+SQUASH_API SquashStatus    squash_fd_stream_finish  (SquashFdStream* fd_stream,
+                                                     SquashFdStreamWant* want);
+
+HEDLEY_NON_NULL(1)
+SQUASH_API SquashStream*   squash_fd_stream_get_stream (SquashFdStream* fd_stream);
+
+HEDLEY_END_C_DECLS
+
+#endif /* !defined(_WIN32) */
+
+#endif /* SQUASH_FD_STREAM_H */
@@ -49,6 +49,11 @@
  * @cond INTERNAL
  */
 
+typedef struct SquashFileIndexEntry_s {
+  uint64_t compressed_offset;
+  uint64_t uncompressed_offset;
+} SquashFileIndexEntry;
+
 struct SquashFile_ {
   FILE* fp;
   mtx_t mtx;
@@ -61,6 +66,21 @@ struct SquashFile_ {
 #if defined(SQUASH_MMAP_IO)
   SquashMappedFile map;
 #endif
+
+  /* Offset of the compressed data in fp, and our position in the
+     uncompressed data. */
+  off_t origin;
+  uint64_t position;
+
+  /* Points squash_file_seek can restart decompression from, sorted by
+     offset.  The start of the file is implied. */
+  SquashFileIndexEntry* index;
+  size_t index_length;
+  size_t index_allocated;
+  bool index_loaded;
+
+  /* The codec's own index, cached by create_stream_at. */
+  SquashObject* codec_index;
 };
 
 /**
@@ -283,6 +303,13 @@ squash_file_steal_with_options (SquashCodec* codec, FILE* fp, SquashOptions* opt
 #if defined(SQUASH_MMAP_IO)
   file->map = squash_mapped_file_empty;
 #endif
+  file->origin = ftello (fp);
+  file->position = 0;
+  file->index = NULL;
+  file->index_length = 0;
+  file->index_allocated = 0;
+  file->index_loaded = false;
+  file->codec_index = NULL;
 
   mtx_init (&(file->mtx), mtx_recursive);
 
@@ -426,6 +453,7 @@ squash_file_read_unlocked (SquashFile* file,
   }
 
   *decompressed_size = (stream->next_out - decompressed);
+  file->position += *decompressed_size;
 
   stream->next_out = 0;
   stream->avail_out = 0;
@@ -492,6 +520,7 @@ squash_file_write_internal (SquashFile* file,
  cleanup:
 
   if (file->stream != NULL) {
+    file->position += uncompressed_size - file->stream->avail_in;
     file->stream->next_in = NULL;
     file->stream->avail_in = 0;
     file->stream->next_out = NULL;
@@ -801,6 +830,369 @@ squash_file_error (SquashFile* file) {
   return file->last_status;
 }
 
+static uint64_t
+squash_file_read_le64 (const uint8_t* buf) {
+  uint64_t value = 0;
+  for (int i = 7 ; i >= 0 ; i--)
+    value = (value << 8) | buf[i];
+  return value;
+}
+
+static SquashStatus
+squash_file_index_append (SquashFile* file, uint64_t compressed_offset, uint64_t uncompressed_offset) {
+  if (file->index_length == file->index_allocated) {
+    const size_t allocated = (file->index_allocated == 0) ? 64 : (file->index_allocated * 2);
+    SquashFileIndexEntry* index = squash_realloc (file->index, allocated * sizeof (SquashFileIndexEntry));
+    if (HEDLEY_UNLIKELY(index == NULL))
+      return squash_error (SQUASH_MEMORY);
+
+    file->index = index;
+    file->index_allocated = allocated;
+  }
+
+  file->index[file->index_length].compressed_offset = compressed_offset;
+  file->index[file->index_length].uncompressed_offset = uncompressed_offset;
+  file->index_length++;
+
+  return SQUASH_OK;
+}
+
+static void
+squash_file_index_clear (SquashFile* file) {
+  if (file->index != NULL)
+    squash_free (file->index);
+  file->index = NULL;
+  file->index_length = 0;
+  file->index_allocated = 0;
+}
+
+/**
+ * @brief Load a BGZF index
+ *
+ * Reads an index in the format written by `bgzip -i` (usually stored
+ * next to the compressed file with a *.gzi* extension): a
+ * little-endian 64-bit count followed by that many pairs of 64-bit
+ * compressed and uncompressed offsets.  @ref squash_file_seek uses
+ * the index to start decompressing from the closest preceding block
+ * instead of the beginning of the file.
+ *
+ * Offsets are relative to the position of the file's *FILE* pointer
+ * when the @ref SquashFile was created.
+ *
+ * Loading an index is optional; for codecs which can locate frames
+ * themselves (such as *bgzf*), Squash will build one the first time
+ * @ref squash_file_seek is called.
+ *
+ * @param file the file to use the index for
+ * @param filename name of the index
+ * @return @ref SQUASH_OK on success or a negative error code on
+ *   failure
+ */
+SquashStatus
+squash_file_load_index (SquashFile* file, const char* filename) {
+  SquashStatus res = SQUASH_OK;
+  uint8_t buf[16];
+
+  assert (file != NULL);
+  assert (filename != NULL);
+
+  FILE* fp = fopen (filename, "rb");
+  if (HEDLEY_UNLIKELY(fp == NULL))
+    return squash_error (SQUASH_IO);
+
+  squash_file_lock (file);
+  squash_file_index_clear (file);
+
+  if (HEDLEY_UNLIKELY(fread (buf, 1, 8, fp) != 8)) {
+    res = squash_error (SQUASH_IO);
+  } else {
+    const uint64_t n_entries = squash_file_read_le64 (buf);
+    uint64_t compressed_offset = 0, uncompressed_offset = 0;
+
+    for (uint64_t i = 0 ; i < n_entries ; i++) {
+      if (HEDLEY_UNLIKELY(fread (buf, 1, 16, fp) != 16)) {
+        res = squash_error (SQUASH_IO);
+        break;
+      }
+
+      const uint64_t c = squash_file_read_le64 (buf);
+      const uint64_t u = squash_file_read_le64 (buf + 8);
+      if (HEDLEY_UNLIKELY(c < compressed_offset || u < uncompressed_offset)) {
+        res = squash_error (SQUASH_INVALID_BUFFER);
+        break;
+      }
+      compressed_offset = c;
+      uncompressed_offset = u;
+
+      res = squash_file_index_append (file, c, u);
+      if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+        break;
+    }
+  }
+
+  if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+    squash_file_index_clear (file);
+  file->index_loaded = (res == SQUASH_OK);
+
+  squash_file_unlock (file);
+
+  fclose (fp);
+
+  return res;
+}
+
+#if !defined(_WIN32)
+typedef struct SquashFileScanData_s {
+  SquashFile* file;
+  uint64_t uncompressed_offset;
+} SquashFileScanData;
+
+static SquashStatus
+squash_file_index_frame (const SquashFrame* frame, void* user_data) {
+  SquashFileScanData* data = (SquashFileScanData*) user_data;
+
+  if (frame->compressed_offset != 0 && frame->decompressed_size != 0) {
+    const SquashStatus res = squash_file_index_append (data->file, frame->compressed_offset, data->uncompressed_offset);
+    if (HEDLEY_UNLIKELY(res != SQUASH_OK))
+      return res;
+  }
+  data->uncompressed_offset += frame->decompressed_size;
+
+  return SQUASH_OK;
+}
+#endif
+
+/* Build an index by asking the codec where its frames are.  If it
+   can't tell us, seeking simply decompresses from the start. */
+static void
+squash_file_index_build (SquashFile* file) {
+  file->index_loaded = true;
+
+#if !defined(_WIN32)
+  SquashCodecImpl* impl = squash_codec_get_impl (file->codec);
+  if (impl == NULL || impl->scan_frames == NULL || file->origin < 0)
+    return;
+
+  const off_t pos = ftello (file->fp);
+  if (HEDLEY_UNLIKELY(pos < 0 || fseeko (file->fp, file->origin, SEEK_SET) != 0))
+    return;
+
+  SquashMappedFile map = squash_mapped_file_empty;
+  if (squash_mapped_file_init (&map, file->fp, 0, false)) {
+    SquashFileScanData data = { file, 0 };
+    if (impl->scan_frames (file->codec, map.size, map.data, squash_file_index_frame, &data) != SQUASH_OK)
+      squash_file_index_clear (file);
+    squash_mapped_file_destroy (&map, false);
+  }
+
+  fseeko (file->fp, pos, SEEK_SET);
+#endif
+}
+
+/* Some codecs (such as xz) keep their own index of blocks and can
+   create a stream which starts at the right one, which is much finer
+   grained than anything we could build from the frames. */
+static SquashStream*
+squash_file_create_stream_at (SquashFile* file, uint64_t offset,
+                              uint64_t* compressed_offset, uint64_t* uncompressed_offset) {
+  SquashStream* stream = NULL;
+
+#if !defined(_WIN32)
+  SquashCodecImpl* impl = squash_codec_get_impl (file->codec);
+  if (impl == NULL || impl->create_stream_at == NULL || file->origin < 0)
+    return NULL;
+
+  const off_t pos = ftello (file->fp);
+  if (HEDLEY_UNLIKELY(pos < 0 || fseeko (file->fp, file->origin, SEEK_SET) != 0))
+    return NULL;
+
+  SquashMappedFile map = squash_mapped_file_empty;
+  if (squash_mapped_file_init (&map, file->fp, 0, false)) {
+    size_t restart_compressed_offset = 0;
+    uint64_t restart_uncompressed_offset = 0;
+
+    stream = impl->create_stream_at (file->codec, file->options, map.size, map.data, offset,
+                                     &(file->codec_index),
+                                     &restart_compressed_offset, &restart_uncompressed_offset);
+    if (stream != NULL) {
+      *compressed_offset = (uint64_t) restart_compressed_offset;
+      *uncompressed_offset = restart_uncompressed_offset;
+    }
+    squash_mapped_file_destroy (&map, false);
+  }
+
+  fseeko (file->fp, pos, SEEK_SET);
+#else
+  (void) file;
+  (void) offset;
+  (void) compressed_offset;
+  (void) uncompressed_offset;
+#endif
+
+  return stream;
+}
+
+/**
+ * @brief Seek to a position in the decompressed data
+ *
+ * Only files being read can seek.  Unless the codec stores data in
+ * independent blocks and an index is available (see @ref
+ * squash_file_load_index), seeking backwards means decompressing
+ * everything from the beginning of the file again, and seeking
+ * forwards means decompressing everything in between.  With an
+ * index, only the block containing @a offset is decompressed.
+ *
+ * Codecs which store an index of their own, like *xz* (when the file
+ * contains more than one block, as written by `xz -T`), don't need a
+ * separate one.
+ *
+ * @param file the file to seek in
+ * @param offset offset, in bytes of decompressed data, from the
+ *   beginning of the file
+ * @return @ref SQUASH_OK on success or a negative error code on
+ *   failure
+ * @retval SQUASH_INVALID_OPERATION @a file is being written to
+ * @retval SQUASH_RANGE @a offset is beyond the end of the file
+ */
+SquashStatus
+squash_file_seek (SquashFile* file, uint64_t offset) {
+  SquashStatus res = SQUASH_OK;
+  uint8_t discard[4096];
+
+  assert (file != NULL);
+
+  squash_file_lock (file);
+
+  if (HEDLEY_UNLIKELY(file->stream != NULL && file->stream->stream_type == SQUASH_STREAM_COMPRESS)) {
+    res = squash_error (SQUASH_INVALID_OPERATION);
+    goto cleanup;
+  }
+
+  uint64_t compressed_offset = 0, uncompressed_offset = 0;
+  SquashStream* restart_stream = NULL;
+
+  if (!file->index_loaded)
+    restart_stream = squash_file_create_stream_at (file, offset, &compressed_offset, &uncompressed_offset);
+
+  if (restart_stream == NULL) {
+    if (!file->index_loaded)
+      squash_file_index_build (file);
+
+    /* Find the last restart point at or before the offset. */
+    size_t lo = 0, hi = file->index_length;
+    while (lo < hi) {
+      const size_t mid = lo + ((hi - lo) / 2);
+      if (file->index[mid].uncompressed_offset <= offset)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo != 0) {
+      compressed_offset = file->index[lo - 1].compressed_offset;
+      uncompressed_offset = file->index[lo - 1].uncompressed_offset;
+    }
+  }
+
+  /* Restart unless we can get there faster by simply reading ahead. */
+  if (file->stream == NULL || file->last_status < 0 ||
+      offset < file->position || uncompressed_offset > file->position) {
+    if (HEDLEY_UNLIKELY(file->origin < 0 ||
+                        fseeko (file->fp, file->origin + (off_t) compressed_offset, SEEK_SET) != 0)) {
+      squash_object_unref (restart_stream);
+      res = file->last_status = squash_error (SQUASH_IO);
+      goto cleanup;
+    }
+
+#if defined(SQUASH_MMAP_IO)
+    squash_mapped_file_destroy (&(file->map), false);
+#endif
+    squash_object_unref (file->stream);
+    file->stream = restart_stream;
+    file->last_status = SQUASH_OK;
+    file->eof = false;
+    file->position = uncompressed_offset;
+  } else {
+    squash_object_unref (restart_stream);
+  }
+
+  while (file->position < offset) {
+    size_t discard_size = ((offset - file->position) < sizeof (discard)) ? (size_t) (offset - file->position) : sizeof (discard);
+
+    res = squash_file_read_unlocked (file, &discard_size, discard);
+    if (HEDLEY_UNLIKELY(res < 0)) {
+      goto cleanup;
+    } else if (discard_size == 0) {
+      res = squash_error (SQUASH_RANGE);
+      goto cleanup;
+    }
+  }
+
+  res = SQUASH_OK;
+
+ cleanup:
+
+  squash_file_unlock (file);
+
+  return res;
+}
+
+/**
+ * @brief Read from a position in a compressed file
+ *
+ * This is the same as calling @ref squash_file_seek and then @ref
+ * squash_file_read, except that the lock is held for both so another
+ * thread can't move the position in between.
+ *
+ * @param file the file to read from
+ * @param offset offset, in bytes of decompressed data, to read from
+ * @param decompressed_size number of bytes to attempt to write to @a decompressed
+ * @param decompressed buffer to write the decompressed data to
+ * @return the result of the operation
+ * @retval SQUASH_OK successfully read some data
+ * @retval SQUASH_END_OF_STREAM the end of the file was reached
+ * @retval SQUASH_RANGE @a offset is beyond the end of the file
+ */
+SquashStatus
+squash_file_pread (SquashFile* file,
+                   uint64_t offset,
+                   size_t* decompressed_size,
+                   uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)]) {
+  assert (file != NULL);
+  assert (decompressed_size != NULL);
+  assert (decompressed != NULL);
+
+  squash_file_lock (file);
+  SquashStatus res = squash_file_seek (file, offset);
+  if (HEDLEY_LIKELY(res == SQUASH_OK))
+    res = squash_file_read_unlocked (file, decompressed_size, decompressed);
+  else
+    *decompressed_size = 0;
+  squash_file_unlock (file);
+
+  return res;
+}
+
+/**
+ * @brief Get the current position in the decompressed data
+ *
+ * For files being read this is the amount of data which has been
+ * read so far (adjusted by @ref squash_file_seek); for files being
+ * written it is the amount of data written so far.
+ *
+ * @param file the file
+ * @return the current offset, in bytes of uncompressed data
+ */
+uint64_t
+squash_file_tell (SquashFile* file) {
+  assert (file != NULL);
+
+  squash_file_lock (file);
+  const uint64_t position = file->position;
+  squash_file_unlock (file);
+
+  return position;
+}
+
 /**
  * @brief Close a file
  *
@@ -881,6 +1273,9 @@ squash_file_free (SquashFile* file, FILE** fp) {
 
   squash_object_unref (file->stream);
   squash_object_unref (file->options);
+  squash_object_unref (file->codec_index);
+  if (file->index != NULL)
+    squash_free (file->index);
 
   squash_file_unlock (file);
 
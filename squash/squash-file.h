@@ -90,6 +90,19 @@ SQUASH_API SquashStatus squash_file_close                    (SquashFile* file);
 SQUASH_API SquashStatus squash_file_free                     (SquashFile* file,
                                                               FILE** fp);
 HEDLEY_NON_NULL(1)
+SQUASH_API SquashStatus squash_file_seek                     (SquashFile* file,
+                                                              uint64_t offset);
+HEDLEY_NON_NULL(1, 3, 4)
+SQUASH_API SquashStatus squash_file_pread                    (SquashFile* file,
+                                                              uint64_t offset,
+                                                              size_t* decompressed_size,
+                                                              uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)]);
+HEDLEY_NON_NULL(1)
+SQUASH_API uint64_t     squash_file_tell                     (SquashFile* file);
+HEDLEY_NON_NULL(1, 2)
+SQUASH_API SquashStatus squash_file_load_index               (SquashFile* file,
+                                                              const char* filename);
+HEDLEY_NON_NULL(1)
 SQUASH_API bool         squash_file_eof                      (SquashFile* file);
 HEDLEY_NON_NULL(1)
 SQUASH_API SquashStatus squash_file_error                    (SquashFile* file);
@@ -57,8 +57,11 @@
 #include <squash/squash-slist-internal.h>
 #include <squash/squash-buffer-internal.h>
 #include <squash/squash-buffer-stream-internal.h>
+#include <squash/squash-block-internal.h>
 #include <squash/squash-ini-internal.h>
 #include <squash/squash-mtx-internal.h>
+#include <squash/squash-options-internal.h>
+#include <squash/squash-parallel-internal.h>
 #include <squash/squash-stream-internal.h>
 #include <squash/squash-util-internal.h>
 #if !defined(_WIN32)
@@ -43,6 +43,7 @@ typedef struct SquashMappedFile_s {
   size_t window_offset;
   FILE* fp;
   bool writable;
+  uint64_t original_size;
 } SquashMappedFile;
 
 static const SquashMappedFile squash_mapped_file_empty = { MAP_FAILED, 0 };
@@ -33,6 +33,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -42,8 +43,9 @@ squash_mapped_file_init_full (SquashMappedFile* mapped, FILE* fp, size_t size, b
   assert (mapped != NULL);
   assert (fp != NULL);
 
-  if (mapped->data != MAP_FAILED)
-    munmap (mapped->data - mapped->window_offset, mapped->size + mapped->window_offset);
+  /* Anything written to a previous mapping is being thrown away, so
+     put the file back the way it was. */
+  squash_mapped_file_destroy (mapped, false);
 
   int fd = fileno (fp);
   if (fd == -1)
@@ -61,6 +63,15 @@ squash_mapped_file_init_full (SquashMappedFile* mapped, FILE* fp, size_t size, b
     return false;
 
   if (writable) {
+    /* A shared writable mapping needs a descriptor which is open for
+       reading too, so don't extend files opened with "w" (or "a") and
+       leave them padded with zeros when mmap fails. */
+    const int fl = fcntl (fd, F_GETFL);
+    if (fl == -1 || (fl & O_ACCMODE) != O_RDWR || (fl & O_APPEND) != 0)
+      return false;
+
+    mapped->original_size = (uint64_t) fp_stat.st_size;
+
     ires = ftruncate (fd, offset + (off_t) size);
     if (ires == -1)
       return false;
@@ -98,8 +109,13 @@ squash_mapped_file_init_full (SquashMappedFile* mapped, FILE* fp, size_t size, b
   else
     mapped->data = mmap (NULL, mapped->map_size, PROT_READ, map_flags, fd, offset - mapped->window_offset);
 
-  if (mapped->data == MAP_FAILED)
+  if (mapped->data == MAP_FAILED) {
+    if (writable) {
+      ires = ftruncate (fd, fp_stat.st_size);
+      (void) ires;
+    }
     return false;
+  }
 
   mapped->data += mapped->window_offset;
   mapped->fp = fp;
@@ -134,6 +150,9 @@ squash_mapped_file_destroy (SquashMappedFile* mapped, bool success) {
       } else {
         return false;
       }
+    } else if (mapped->writable) {
+      /* Drop whatever the mapping added to the file. */
+      return ftruncate (fileno (mapped->fp), (off_t) mapped->original_size) != -1;
     }
   }
 
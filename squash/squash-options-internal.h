@@ -0,0 +1,64 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include "squash-internal.h" */
+
+#ifndef SQUASH_OPTIONS_INTERNAL_H
+#define SQUASH_OPTIONS_INTERNAL_H
+
+#if !defined (SQUASH_COMPILATION)
+#error "This is internal API; you cannot use it."
+#endif
+
+HEDLEY_BEGIN_C_DECLS
+
+/* Indices into the list of options Squash itself understands for
+   every codec.  Keep in sync with squash_options_core_info. */
+typedef enum {
+  SQUASH_OPTIONS_CORE_STORE_INCOMPRESSIBLE = 0,
+  SQUASH_OPTIONS_CORE_INCOMPRESSIBLE_THRESHOLD,
+  SQUASH_OPTIONS_CORE_FRAME_BLOCK_SIZE,
+  SQUASH_OPTIONS_CORE_FRAMING,
+  SQUASH_OPTIONS_CORE_FRAME_CHECKSUM,
+  SQUASH_OPTIONS_CORE_DECOMPRESS_THREADS,
+  SQUASH_OPTIONS_CORE_PARALLEL_THRESHOLD
+} SquashOptionsCoreIndex;
+
+/* Values of the "framing" option. */
+typedef enum {
+  SQUASH_OPTIONS_FRAMING_NONE = 0,
+  SQUASH_OPTIONS_FRAMING_CHUNKED = 1
+} SquashOptionsFraming;
+
+HEDLEY_NON_NULL(2) SQUASH_INTERNAL
+bool   squash_options_get_core_bool (SquashOptions* options, SquashCodec* codec, SquashOptionsCoreIndex idx);
+HEDLEY_NON_NULL(2) SQUASH_INTERNAL
+int    squash_options_get_core_int  (SquashOptions* options, SquashCodec* codec, SquashOptionsCoreIndex idx);
+HEDLEY_NON_NULL(2) SQUASH_INTERNAL
+size_t squash_options_get_core_size (SquashOptions* options, SquashCodec* codec, SquashOptionsCoreIndex idx);
+
+HEDLEY_END_C_DECLS
+
+#endif /* SQUASH_OPTIONS_INTERNAL_H */
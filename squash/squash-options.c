@@ -156,6 +156,70 @@
  * @brief value to use if none is provided by the user
  */
 
+/* Options understood by Squash itself, regardless of the codec.
+ * Their values are stored after the codec's own options, so codecs
+ * can keep using the indices of their own option arrays.  Codec
+ * options take precedence if the names collide. */
+static const SquashOptionInfo squash_options_core_info[] = {
+  { (char*) "store-incompressible",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = false },
+  { (char*) "incompressible-threshold",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 800 },
+    .default_value.int_value = 790 },
+  { (char*) "frame-block-size",
+    SQUASH_OPTION_TYPE_RANGE_SIZE,
+    .info.range_size = {
+      .min = 4096,
+      .max = 64 * 1024 * 1024 },
+    .default_value.size_value = 1024 * 1024 },
+  { (char*) "framing",
+    SQUASH_OPTION_TYPE_ENUM_STRING,
+    .info.enum_string = {
+      .values = (const SquashOptionInfoEnumStringMap []) {
+        { "none", SQUASH_OPTIONS_FRAMING_NONE },
+        { "chunked", SQUASH_OPTIONS_FRAMING_CHUNKED },
+        { NULL, 0 } } },
+    .default_value.int_value = SQUASH_OPTIONS_FRAMING_NONE },
+  { (char*) "frame-checksum",
+    SQUASH_OPTION_TYPE_BOOL,
+    .default_value.bool_value = false },
+  { (char*) "decompress-threads",
+    SQUASH_OPTION_TYPE_RANGE_INT,
+    .info.range_int = {
+      .min = 0,
+      .max = 256 },
+    .default_value.int_value = 0 },
+  { (char*) "parallel-threshold",
+    SQUASH_OPTION_TYPE_SIZE,
+    .default_value.size_value = 4 * 1024 * 1024 },
+  { NULL, SQUASH_OPTION_TYPE_NONE, }
+};
+
+static size_t
+squash_options_count (const SquashOptionInfo* info) {
+  size_t n_options = 0;
+
+  if (info != NULL)
+    while (info[n_options].name != NULL)
+      n_options++;
+
+  return n_options;
+}
+
+static const SquashOptionInfo*
+squash_options_get_info_at (SquashCodec* codec, size_t idx) {
+  const SquashOptionInfo* info = squash_codec_get_option_info (codec);
+  const size_t n_codec_options = squash_options_count (info);
+
+  return (idx < n_codec_options) ?
+    &(info[idx]) :
+    &(squash_options_core_info[idx - n_codec_options]);
+}
+
 static ptrdiff_t
 squash_options_find (SquashOptions* options, SquashCodec* codec, const char* key) {
   assert (key != NULL);
@@ -166,13 +230,10 @@ squash_options_find (SquashOptions* options, SquashCodec* codec, const char* key
     assert (codec != NULL);
   }
 
-  const SquashOptionInfo* info = squash_codec_get_option_info (codec);
-  if (info == NULL)
-    return -1;
-
-  {
-    ptrdiff_t option_n = 0;
+  ptrdiff_t option_n = 0;
 
+  const SquashOptionInfo* info = squash_codec_get_option_info (codec);
+  if (info != NULL) {
     while (info->name != NULL) {
       if (strcasecmp (key, info->name) == 0)
         return option_n;
@@ -182,6 +243,10 @@ squash_options_find (SquashOptions* options, SquashCodec* codec, const char* key
     }
   }
 
+  for (info = squash_options_core_info ; info->name != NULL ; info++, option_n++)
+    if (strcasecmp (key, info->name) == 0)
+      return option_n;
+
   return -1;
 }
 
@@ -279,10 +344,7 @@ squash_options_get_size (SquashOptions* options, SquashCodec* codec, const char*
 
 static const SquashOptionValue*
 squash_options_get_value_at (SquashOptions* options, SquashCodec* codec, const SquashOptionInfo** info, SquashOptionType* type, size_t idx) {
-  const SquashOptionInfo* ci = squash_codec_get_option_info (codec);
-  if (HEDLEY_UNLIKELY(ci == NULL))
-    return NULL;
-  ci = &(ci[idx]);
+  const SquashOptionInfo* ci = squash_options_get_info_at (codec, idx);
 
   if (info != NULL)
     *info = ci;
@@ -547,11 +609,7 @@ squash_options_set_string_at (SquashOptions* options, size_t idx, const char* va
   assert (options != NULL);
   assert (value != NULL);
 
-  const SquashOptionInfo* info = squash_codec_get_option_info (options->codec);
-  if (info == NULL)
-    return squash_error (SQUASH_BAD_PARAM);
-
-  info += idx;
+  const SquashOptionInfo* info = squash_options_get_info_at (options->codec, idx);
   assert (options->values != NULL);
   SquashOptionValue* val = options->values + idx;
 
@@ -589,11 +647,7 @@ SquashStatus
 squash_options_set_bool_at (SquashOptions* options, size_t idx, bool value) {
   assert (options != NULL);
 
-  const SquashOptionInfo* info = squash_codec_get_option_info (options->codec);
-  if (info == NULL)
-    return squash_error (SQUASH_BAD_PARAM);
-
-  info += idx;
+  const SquashOptionInfo* info = squash_options_get_info_at (options->codec, idx);
   assert (options->values != NULL);
   SquashOptionValue* val = options->values + idx;
 
@@ -623,11 +677,7 @@ SquashStatus
 squash_options_set_int_at (SquashOptions* options, size_t idx, int value) {
   assert (options != NULL);
 
-  const SquashOptionInfo* info = squash_codec_get_option_info (options->codec);
-  if (info == NULL)
-    return squash_error (SQUASH_BAD_PARAM);
-
-  info += idx;
+  const SquashOptionInfo* info = squash_options_get_info_at (options->codec, idx);
   assert (options->values != NULL);
   SquashOptionValue* val = options->values + idx;
 
@@ -671,11 +721,7 @@ SquashStatus
 squash_options_set_size_at (SquashOptions* options, size_t idx, size_t value) {
   assert (options != NULL);
 
-  const SquashOptionInfo* info = squash_codec_get_option_info (options->codec);
-  if (info == NULL)
-    return squash_error (SQUASH_BAD_PARAM);
-
-  info += idx;
+  const SquashOptionInfo* info = squash_options_get_info_at (options->codec, idx);
   assert (options->values != NULL);
   SquashOptionValue* val = options->values + idx;
 
@@ -724,7 +770,7 @@ squash_options_parse_option (SquashOptions* options, const char* key, const char
   if (option_n < 0)
     return squash_error (SQUASH_BAD_PARAM);
 
-  const SquashOptionInfo* info = squash_codec_get_option_info (options->codec) + option_n;
+  const SquashOptionInfo* info = squash_options_get_info_at (options->codec, option_n);
 
   switch (info->type) {
     case SQUASH_OPTION_TYPE_ENUM_INT:
@@ -957,8 +1003,7 @@ squash_options_create (SquashCodec* codec) {
  *
  * @param codec The codec to create the options for.
  * @param options A variadic list of string key/value pairs followed by *NULL*
- * @return A new option group, or *NULL* if @a codec does not accept
- *   any options or could not be loaded.
+ * @return A new option group, or *NULL* on failure.
  */
 SquashOptions*
 squash_options_newv (SquashCodec* codec, va_list options) {
@@ -966,10 +1011,8 @@ squash_options_newv (SquashCodec* codec, va_list options) {
 
   assert (codec != NULL);
 
-  if (squash_codec_get_option_info (codec) != NULL) {
-    opts = squash_options_create (codec);
-    squash_options_parsev (opts, options);
-  }
+  opts = squash_options_create (codec);
+  squash_options_parsev (opts, options);
 
   return opts;
 }
@@ -992,10 +1035,8 @@ squash_options_newa (SquashCodec* codec, const char* const* keys, const char* co
 
   assert (codec != NULL);
 
-  if (squash_codec_get_option_info (codec) != NULL) {
-    opts = squash_options_create (codec);
-    squash_options_parsea (opts, keys, values);
-  }
+  opts = squash_options_create (codec);
+  squash_options_parsea (opts, keys, values);
 
   return opts;
 }
@@ -1025,38 +1066,36 @@ squash_options_init (void* options,
   squash_object_init (o, true, destroy_notify);
   o->codec = codec;
 
-  const SquashOptionInfo* info = squash_codec_get_option_info (codec);
-  if (info != NULL) {
-    size_t n_options;
-    for (n_options = 0 ; info[n_options].name != NULL ; n_options++) { }
-
-    assert (n_options != 0);
-
-    o->values = squash_malloc (n_options * sizeof (SquashOptionValue));
-    assert (o->values != NULL);
-    memset (o->values, 0, n_options * sizeof (SquashOptionValue));
-    for (size_t c_option = 0 ; c_option < n_options ; c_option++) {
-      switch (info[c_option].type) {
-        case SQUASH_OPTION_TYPE_ENUM_STRING:
-        case SQUASH_OPTION_TYPE_RANGE_INT:
-        case SQUASH_OPTION_TYPE_INT:
-        case SQUASH_OPTION_TYPE_ENUM_INT:
-          o->values[c_option].int_value = info[c_option].default_value.int_value;
-          break;
-        case SQUASH_OPTION_TYPE_BOOL:
-          o->values[c_option].bool_value = info[c_option].default_value.bool_value;
-          break;
-        case SQUASH_OPTION_TYPE_SIZE:
-        case SQUASH_OPTION_TYPE_RANGE_SIZE:
-          o->values[c_option].size_value = info[c_option].default_value.size_value;
-          break;
-        case SQUASH_OPTION_TYPE_STRING:
-          o->values[c_option].string_value = strdup (info[c_option].default_value.string_value);
-          break;
-        case SQUASH_OPTION_TYPE_NONE:
-        default:
-          HEDLEY_UNREACHABLE();
-      }
+  const size_t n_options =
+    squash_options_count (squash_codec_get_option_info (codec)) +
+    squash_options_count (squash_options_core_info);
+
+  o->values = squash_malloc (n_options * sizeof (SquashOptionValue));
+  assert (o->values != NULL);
+  memset (o->values, 0, n_options * sizeof (SquashOptionValue));
+  for (size_t c_option = 0 ; c_option < n_options ; c_option++) {
+    const SquashOptionInfo* info = squash_options_get_info_at (codec, c_option);
+
+    switch (info->type) {
+      case SQUASH_OPTION_TYPE_ENUM_STRING:
+      case SQUASH_OPTION_TYPE_RANGE_INT:
+      case SQUASH_OPTION_TYPE_INT:
+      case SQUASH_OPTION_TYPE_ENUM_INT:
+        o->values[c_option].int_value = info->default_value.int_value;
+        break;
+      case SQUASH_OPTION_TYPE_BOOL:
+        o->values[c_option].bool_value = info->default_value.bool_value;
+        break;
+      case SQUASH_OPTION_TYPE_SIZE:
+      case SQUASH_OPTION_TYPE_RANGE_SIZE:
+        o->values[c_option].size_value = info->default_value.size_value;
+        break;
+      case SQUASH_OPTION_TYPE_STRING:
+        o->values[c_option].string_value = strdup (info->default_value.string_value);
+        break;
+      case SQUASH_OPTION_TYPE_NONE:
+      default:
+        HEDLEY_UNREACHABLE();
     }
   }
 }
@@ -1079,11 +1118,12 @@ squash_options_destroy (void* options) {
 
   SquashOptionValue* values = o->values;
   if (values != NULL) {
-    const SquashOptionInfo* info = squash_codec_get_option_info (o->codec);
-    assert (info != NULL);
+    const size_t n_options =
+      squash_options_count (squash_codec_get_option_info (o->codec)) +
+      squash_options_count (squash_options_core_info);
 
-    for (int i = 0 ; info[i].name != NULL ; i++)
-      if (info[i].type == SQUASH_OPTION_TYPE_STRING)
+    for (size_t i = 0 ; i < n_options ; i++)
+      if (squash_options_get_info_at (o->codec, i)->type == SQUASH_OPTION_TYPE_STRING)
         squash_free (values[i].string_value);
 
     squash_free (values);
@@ -1092,6 +1132,26 @@ squash_options_destroy (void* options) {
   squash_object_destroy (o);
 }
 
+static size_t
+squash_options_core_index (SquashCodec* codec, SquashOptionsCoreIndex idx) {
+  return squash_options_count (squash_codec_get_option_info (codec)) + (size_t) idx;
+}
+
+bool
+squash_options_get_core_bool (SquashOptions* options, SquashCodec* codec, SquashOptionsCoreIndex idx) {
+  return squash_options_get_bool_at (options, codec, squash_options_core_index (codec, idx));
+}
+
+int
+squash_options_get_core_int (SquashOptions* options, SquashCodec* codec, SquashOptionsCoreIndex idx) {
+  return squash_options_get_int_at (options, codec, squash_options_core_index (codec, idx));
+}
+
+size_t
+squash_options_get_core_size (SquashOptions* options, SquashCodec* codec, SquashOptionsCoreIndex idx) {
+  return squash_options_get_size_at (options, codec, squash_options_core_index (codec, idx));
+}
+
 #if defined(SQUASH_ENABLE_WIDE_CHAR_API)
 /**
  * @brief Parse a single option with wide character strings.
@@ -1216,8 +1276,7 @@ squash_options_neww (SquashCodec* codec, ...) {
  *
  * @param codec The codec to create the options for.
  * @param options A variadic list of string key/value pairs followed by *NULL*
- * @return A new option group, or *NULL* if @a codec does not accept
- *   any options or could not be loaded.
+ * @return A new option group, or *NULL* on failure.
  */
 SquashOptions*
 squash_options_newvw (SquashCodec* codec, va_list options) {
@@ -1225,10 +1284,8 @@ squash_options_newvw (SquashCodec* codec, va_list options) {
 
   assert (codec != NULL);
 
-  if (squash_codec_get_option_info (codec) != NULL) {
-    opts = squash_options_create (codec);
-    squash_options_parsevw (opts, options);
-  }
+  opts = squash_options_create (codec);
+  squash_options_parsevw (opts, options);
 
   return opts;
 }
@@ -1251,10 +1308,8 @@ squash_options_newaw (SquashCodec* codec, const wchar_t* const* keys, const wcha
 
   assert (codec != NULL);
 
-  if (squash_codec_get_option_info (codec) != NULL) {
-    opts = squash_options_create (codec);
-    squash_options_parseaw (opts, keys, values);
-  }
+  opts = squash_options_create (codec);
+  squash_options_parseaw (opts, keys, values);
 
   return opts;
 }
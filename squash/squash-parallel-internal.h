@@ -0,0 +1,56 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include "squash-internal.h" */
+
+#ifndef SQUASH_PARALLEL_INTERNAL_H
+#define SQUASH_PARALLEL_INTERNAL_H
+
+#if !defined (SQUASH_COMPILATION)
+#error "This is internal API; you cannot use it."
+#endif
+
+HEDLEY_BEGIN_C_DECLS
+
+/* Decompress a buffer made of several independent frames (as
+ * reported by the codec's scan_frames callback) on multiple threads.
+ *
+ * Returns false without touching @a res if the buffer isn't a
+ * candidate (the codec can't scan frames, the buffer is below the
+ * "parallel-threshold" option, there is only one frame, ...), in
+ * which case the caller should decompress it serially.  Otherwise the
+ * result is stored in @a res. */
+HEDLEY_NON_NULL(1, 2, 3, 5, 7) SQUASH_INTERNAL
+bool squash_parallel_decompress (SquashCodec* codec,
+                                 size_t* decompressed_size,
+                                 uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                                 size_t compressed_size,
+                                 const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                                 SquashOptions* options,
+                                 SquashStatus* res);
+
+HEDLEY_END_C_DECLS
+
+#endif /* SQUASH_PARALLEL_INTERNAL_H */
@@ -0,0 +1,344 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+
+#include <assert.h>
+#include "squash-internal.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "squash/tinycthread/source/tinycthread.h"
+
+#if !defined(_WIN32)
+#  include <unistd.h>
+#else
+#  include <windows.h>
+#endif
+
+/**
+ * @cond INTERNAL
+ */
+
+typedef struct SquashParallelData_ {
+  mtx_t lock;
+  size_t n_tasks;
+  size_t next_task;
+
+  /* Lowest task which has failed (n_tasks if none), and its
+   * status. */
+  size_t failed_task;
+  SquashStatus status;
+
+  SquashParallelFunc func;
+  void* user_data;
+} SquashParallelData;
+
+static int
+squash_parallel_worker (void* user_data) {
+  SquashParallelData* data = (SquashParallelData*) user_data;
+
+  while (true) {
+    size_t task;
+    SquashStatus res;
+
+    mtx_lock (&(data->lock));
+    if (data->next_task >= data->n_tasks || data->failed_task != data->n_tasks) {
+      mtx_unlock (&(data->lock));
+      break;
+    }
+    task = data->next_task++;
+    mtx_unlock (&(data->lock));
+
+    res = data->func (task, data->user_data);
+
+    if (HEDLEY_UNLIKELY(res < 0)) {
+      mtx_lock (&(data->lock));
+      if (task < data->failed_task) {
+        data->failed_task = task;
+        data->status = res;
+      }
+      mtx_unlock (&(data->lock));
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * @endcond INTERNAL
+ */
+
+/**
+ * @defgroup SquashParallel Parallel execution
+ * @brief Run independent tasks on several threads
+ *
+ * Squash uses these functions to decompress independent frames
+ * concurrently, and plugins may use them to spread work on
+ * independent blocks over several cores without bringing their own
+ * thread pool.
+ *
+ * @{
+ */
+
+/**
+ * @brief Get the number of processors available
+ *
+ * @return the number of online processors, or 1 if it can't be
+ *   determined
+ */
+unsigned int
+squash_get_cpu_count (void) {
+  static unsigned int cpu_count = 0;
+
+  if (HEDLEY_UNLIKELY(cpu_count == 0)) {
+#if defined(_WIN32)
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    cpu_count = (si.dwNumberOfProcessors > 0) ? (unsigned int) si.dwNumberOfProcessors : 1;
+#elif defined(_SC_NPROCESSORS_ONLN)
+    const long n = sysconf (_SC_NPROCESSORS_ONLN);
+    cpu_count = HEDLEY_UNLIKELY(n < 1) ? 1 : ((unsigned int) n);
+#else
+    cpu_count = 1;
+#endif
+  }
+
+  return cpu_count;
+}
+
+/**
+ * @brief Run a function for each of a number of tasks
+ *
+ * Tasks are handed out in order to up to @a n_threads threads,
+ * including the calling thread, and this function returns once all
+ * of them have finished.  After a task fails no new tasks are
+ * started.
+ *
+ * @param n_tasks number of tasks
+ * @param n_threads maximum number of threads to use, or 0 for the
+ *   number of processors
+ * @param func function to call for each task
+ * @param user_data data to pass to @a func
+ * @return @ref SQUASH_OK if every task succeeded, otherwise the
+ *   status of the failed task with the lowest index
+ */
+SquashStatus
+squash_parallel_run (size_t n_tasks, unsigned int n_threads, SquashParallelFunc func, void* user_data) {
+  SquashParallelData data;
+  thrd_t* threads = NULL;
+  size_t n_started = 0;
+
+  assert (func != NULL);
+
+  if (n_threads == 0)
+    n_threads = squash_get_cpu_count ();
+  if (n_threads > n_tasks)
+    n_threads = (unsigned int) n_tasks;
+
+  if (n_threads <= 1) {
+    for (size_t task = 0 ; task < n_tasks ; task++) {
+      const SquashStatus res = func (task, user_data);
+      if (HEDLEY_UNLIKELY(res < 0))
+        return res;
+    }
+
+    return SQUASH_OK;
+  }
+
+  if (HEDLEY_UNLIKELY(mtx_init (&(data.lock), mtx_plain) != thrd_success))
+    return squash_error (SQUASH_FAILED);
+
+  data.n_tasks = n_tasks;
+  data.next_task = 0;
+  data.failed_task = n_tasks;
+  data.status = SQUASH_OK;
+  data.func = func;
+  data.user_data = user_data;
+
+  /* If we can't get more threads we just do more of the work
+   * ourselves. */
+  threads = squash_malloc (sizeof (thrd_t) * (n_threads - 1));
+  if (HEDLEY_LIKELY(threads != NULL)) {
+    for ( ; n_started < (n_threads - 1) ; n_started++) {
+      if (HEDLEY_UNLIKELY(thrd_create (&(threads[n_started]), squash_parallel_worker, &data) != thrd_success))
+        break;
+    }
+  }
+
+  squash_parallel_worker (&data);
+
+  for (size_t i = 0 ; i < n_started ; i++)
+    thrd_join (threads[i], NULL);
+
+  if (threads != NULL)
+    squash_free (threads);
+  mtx_destroy (&(data.lock));
+
+  return data.status;
+}
+
+/**
+ * @}
+ */
+
+/**
+ * @cond INTERNAL
+ */
+
+typedef struct SquashParallelFrames_ {
+  SquashFrame* frames;
+  size_t n_frames;
+  size_t allocated;
+
+  size_t compressed_size;
+  size_t decompressed_size;
+  size_t max_decompressed_size;
+} SquashParallelFrames;
+
+static SquashStatus
+squash_parallel_add_frame (const SquashFrame* frame, void* user_data) {
+  SquashParallelFrames* frames = (SquashParallelFrames*) user_data;
+  const size_t prev_end = (frames->n_frames == 0) ? 0 :
+    frames->frames[frames->n_frames - 1].compressed_offset + frames->frames[frames->n_frames - 1].compressed_size;
+
+  if (HEDLEY_UNLIKELY(frame->compressed_offset < prev_end ||
+                      frame->compressed_size == 0 ||
+                      frame->compressed_size > (frames->compressed_size - frame->compressed_offset) ||
+                      frame->decompressed_size > (frames->max_decompressed_size - frames->decompressed_size)))
+    return SQUASH_INVALID_BUFFER;
+
+  if (frames->n_frames == frames->allocated) {
+    const size_t allocated = (frames->allocated == 0) ? 32 : frames->allocated * 2;
+    SquashFrame* f = squash_realloc (frames->frames, sizeof (SquashFrame) * allocated);
+    if (HEDLEY_UNLIKELY(f == NULL))
+      return SQUASH_MEMORY;
+    frames->frames = f;
+    frames->allocated = allocated;
+  }
+
+  frames->frames[frames->n_frames++] = *frame;
+  frames->decompressed_size += frame->decompressed_size;
+
+  return SQUASH_OK;
+}
+
+typedef struct SquashParallelDecompress_ {
+  SquashCodec* codec;
+  SquashOptions* options;
+  const SquashFrame* frames;
+  /* Offset of each frame in the decompressed output */
+  const size_t* offsets;
+  const uint8_t* compressed;
+  uint8_t* decompressed;
+} SquashParallelDecompress;
+
+static SquashStatus
+squash_parallel_decompress_frame (size_t task, void* user_data) {
+  SquashParallelDecompress* data = (SquashParallelDecompress*) user_data;
+  const SquashFrame* frame = &(data->frames[task]);
+  uint8_t empty[1];
+  uint8_t* out = (frame->decompressed_size != 0) ? data->decompressed + data->offsets[task] : empty;
+  size_t out_size = (frame->decompressed_size != 0) ? frame->decompressed_size : sizeof (empty);
+  SquashStatus res;
+
+  res = squash_codec_decompress_internal (data->codec,
+                                          &out_size, out,
+                                          frame->compressed_size, data->compressed + frame->compressed_offset,
+                                          data->options);
+  if (HEDLEY_LIKELY(res == SQUASH_OK) && HEDLEY_UNLIKELY(out_size != frame->decompressed_size))
+    res = squash_error (SQUASH_INVALID_BUFFER);
+
+  return res;
+}
+
+bool
+squash_parallel_decompress (SquashCodec* codec,
+                            size_t* decompressed_size,
+                            uint8_t decompressed[HEDLEY_ARRAY_PARAM(*decompressed_size)],
+                            size_t compressed_size,
+                            const uint8_t compressed[HEDLEY_ARRAY_PARAM(compressed_size)],
+                            SquashOptions* options,
+                            SquashStatus* res) {
+  SquashCodecImpl* impl = squash_codec_get_impl (codec);
+  SquashParallelFrames frames = { NULL, 0, 0, compressed_size, 0, *decompressed_size };
+  SquashParallelDecompress data;
+  unsigned int n_threads;
+  size_t* offsets;
+  bool attempted = false;
+
+  assert (impl != NULL);
+
+  if (impl->scan_frames == NULL)
+    return false;
+
+  if (compressed_size < squash_options_get_core_size (options, codec, SQUASH_OPTIONS_CORE_PARALLEL_THRESHOLD))
+    return false;
+
+  n_threads = (unsigned int) squash_options_get_core_int (options, codec, SQUASH_OPTIONS_CORE_DECOMPRESS_THREADS);
+  if (n_threads == 0)
+    n_threads = squash_get_cpu_count ();
+  if (n_threads <= 1)
+    return false;
+
+  /* Anything which doesn't look right is left to the serial path,
+   * which will report the appropriate error. */
+  if (impl->scan_frames (codec, compressed_size, compressed, squash_parallel_add_frame, &frames) != SQUASH_OK ||
+      frames.n_frames < 2)
+    goto cleanup;
+
+  offsets = squash_malloc (sizeof (size_t) * frames.n_frames);
+  if (HEDLEY_UNLIKELY(offsets == NULL))
+    goto cleanup;
+
+  for (size_t i = 0, pos = 0 ; i < frames.n_frames ; i++) {
+    offsets[i] = pos;
+    pos += frames.frames[i].decompressed_size;
+  }
+
+  data.codec = codec;
+  data.options = options;
+  data.frames = frames.frames;
+  data.offsets = offsets;
+  data.compressed = compressed;
+  data.decompressed = decompressed;
+
+  *res = squash_parallel_run (frames.n_frames, n_threads, squash_parallel_decompress_frame, &data);
+  if (HEDLEY_LIKELY(*res == SQUASH_OK))
+    *decompressed_size = frames.decompressed_size;
+  attempted = true;
+
+  squash_free (offsets);
+
+ cleanup:
+  if (frames.frames != NULL)
+    squash_free (frames.frames);
+
+  return attempted;
+}
+
+/**
+ * @endcond INTERNAL
+ */
@@ -0,0 +1,59 @@
+/* Copyright (c) 2017 The Squash Authors
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ * Authors:
+ *   Evan Nemerson <evan@nemerson.com>
+ */
+/* IWYU pragma: private, include <squash.h> */
+
+#ifndef SQUASH_PARALLEL_H
+#define SQUASH_PARALLEL_H
+
+#if !defined (SQUASH_H_INSIDE) && !defined (SQUASH_COMPILATION)
+#error "Only <squash.h> can be included directly."
+#endif
+
+#include <squash.h>
+
+HEDLEY_BEGIN_C_DECLS
+
+/**
+ * @ingroup SquashParallel
+ * @brief Function to run for each task
+ *
+ * @param task index of the task, from 0 to the number of tasks - 1
+ * @param user_data data passed to ::squash_parallel_run
+ * @return @ref SQUASH_OK on success, or a negative error code
+ */
+typedef SquashStatus (*SquashParallelFunc) (size_t task, void* user_data);
+
+SQUASH_API unsigned int squash_get_cpu_count (void);
+
+HEDLEY_NON_NULL(3)
+SQUASH_API SquashStatus squash_parallel_run  (size_t n_tasks,
+                                              unsigned int n_threads,
+                                              SquashParallelFunc func,
+                                              void* user_data);
+
+HEDLEY_END_C_DECLS
+
+#endif /* SQUASH_PARALLEL_H */
@@ -302,6 +302,8 @@ squash_plugin_init_codec (SquashPlugin* plugin, SquashCodec* codec, SquashCodecI
         codec->impl.info |= (SquashCodecInfo) SQUASH_CODEC_INFO_NATIVE_STREAMING;
       if (codec->impl.get_uncompressed_size != NULL || (codec->impl.info & SQUASH_CODEC_INFO_WRAP_SIZE))
         codec->impl.info |= (SquashCodecInfo) SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE;
+      if (codec->impl.decompress_buffer_unsafe != NULL)
+        codec->impl.info |= (SquashCodecInfo) SQUASH_CODEC_INFO_DECOMPRESS_TRUSTED;
     }
     SQUASH_MTX_UNLOCK(codec_init);
   }
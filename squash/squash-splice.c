@@ -104,7 +104,7 @@ squash_splice_map (FILE* fp_in, FILE* fp_out, size_t size, SquashStreamType stre
     if (!squash_mapped_file_init (&mapped_in, fp_in, size, false))
       goto cleanup;
 
-    const size_t max_output_size = squash_codec_get_max_compressed_size(codec, mapped_in.size);
+    const size_t max_output_size = squash_codec_get_max_compressed_size_with_options (codec, mapped_in.size, options);
     if (!squash_mapped_file_init (&mapped_out, fp_out, max_output_size, true))
       goto cleanup;
 
@@ -119,11 +119,17 @@ squash_splice_map (FILE* fp_in, FILE* fp_out, size_t size, SquashStreamType stre
       goto cleanup;
 
     const SquashCodecInfo codec_info = squash_codec_get_info (codec);
-    const bool knows_uncompressed = ((codec_info & SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE) == SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE);
+    bool knows_uncompressed = ((codec_info & SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE) == SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE);
 
     size_t max_output_size = knows_uncompressed ?
-      squash_codec_get_uncompressed_size(codec, mapped_in.size, mapped_in.data) :
-      squash_npot (mapped_in.size) << 3;
+      squash_codec_get_uncompressed_size(codec, mapped_in.size, mapped_in.data) : 0;
+
+    /* Some formats only record the size optionally (e.g., zstd frames
+       written by a streaming compressor), so fall back on guessing. */
+    if (max_output_size == 0) {
+      knows_uncompressed = false;
+      max_output_size = squash_npot (mapped_in.size) << 3;
+    }
 
     do {
       if (!squash_mapped_file_init (&mapped_out, fp_out, max_output_size, true)) {
@@ -133,6 +139,10 @@ squash_splice_map (FILE* fp_in, FILE* fp_out, size_t size, SquashStreamType stre
 
       res = squash_codec_decompress_with_options (codec, &mapped_out.size, mapped_out.data, mapped_in.size, mapped_in.data, options);
       if (res == SQUASH_OK) {
+        /* The whole input is decoded, but only size bytes are kept. */
+        if (size != 0 && mapped_out.size > size)
+          mapped_out.size = size;
+
         squash_mapped_file_destroy (&mapped_in, true);
         squash_mapped_file_destroy (&mapped_out, true);
       } else {
@@ -421,16 +431,30 @@ squash_splice_with_options (SquashCodec* codec,
   SQUASH_FLOCKFILE(fp_in);
   SQUASH_FLOCKFILE(fp_out);
 
-  if (codec->impl.splice != NULL) {
-    res = squash_file_splice (fp_in, fp_out, size, stream_type, codec, options);
-  } else {
+  const bool framed = squash_block_is_enabled (codec, options);
+
 #if !defined(_WIN32)
-    if (squash_splice_try_mmap == 3 || (squash_splice_try_mmap == 2 && codec->impl.create_stream == NULL)) {
+  /* Squash's framing may be larger than the codec's maximum
+     compressed size, so it can't use a single mapping.  Codecs which
+     can split their input into frames are decompressed from a mapping
+     too, so the frames can be decoded in parallel; that is preferred
+     even over the codec's own splice, which is still used if the
+     input can't be mapped. */
+  const bool parallel = stream_type == SQUASH_STREAM_DECOMPRESS && codec->impl.scan_frames != NULL;
+  if (!framed) {
+    if (codec->impl.splice != NULL) {
+      if (parallel && squash_splice_try_mmap >= 2)
+        res = squash_splice_map (fp_in, fp_out, size, stream_type, codec, options);
+    } else if (squash_splice_try_mmap == 3 || (squash_splice_try_mmap == 2 && (codec->impl.create_stream == NULL || parallel))) {
       res = squash_splice_map (fp_in, fp_out, size, stream_type, codec, options);
     }
+  }
 #endif
 
-    if (res == SQUASH_MMAP_FAILED)
+  if (res == SQUASH_MMAP_FAILED) {
+    if (codec->impl.splice != NULL && !framed)
+      res = squash_file_splice (fp_in, fp_out, size, stream_type, codec, options);
+    else
       res = squash_splice_stream (fp_in, fp_out, size, stream_type, codec, options);
   }
 
@@ -528,9 +552,11 @@ squash_splice_custom_with_options (SquashCodec* codec,
 
   squash_object_ref (options);
 
-  if (codec->impl.splice != NULL) {
+  const bool framed = squash_block_is_enabled (codec, options);
+
+  if (codec->impl.splice != NULL && !framed) {
     if (size == 0) {
-      res = codec->impl.splice (codec, options, stream_type, squash_file_splice_read, squash_file_splice_write, user_data);
+      res = codec->impl.splice (codec, options, stream_type, read_cb, write_cb, user_data);
     } else {
       /* We need to limit the amount of data input (for compression)
          and output (for decompression), so we some wrapper
@@ -549,7 +575,7 @@ squash_splice_custom_with_options (SquashCodec* codec,
         res = SQUASH_OK;
       }
     }
-  } else if (codec->impl.process_stream) {
+  } else if (codec->impl.process_stream != NULL || framed) {
     SquashStream* stream = squash_stream_new_with_options(codec, stream_type, options);
     if (HEDLEY_UNLIKELY(stream == NULL))
       return squash_error (SQUASH_FAILED);
@@ -654,7 +680,7 @@ squash_splice_custom_with_options (SquashCodec* codec,
 
     /* Process (compress or decompress) the data. */
     if (stream_type == SQUASH_STREAM_COMPRESS) {
-      out_data_size = squash_codec_get_max_compressed_size (codec, buffer->size);
+      out_data_size = squash_codec_get_max_compressed_size_with_options (codec, buffer->size, options);
       out_data = squash_malloc (out_data_size);
       if (HEDLEY_UNLIKELY(out_data == NULL)) {
         res = squash_error (SQUASH_MEMORY);
@@ -668,13 +694,12 @@ squash_splice_custom_with_options (SquashCodec* codec,
       const bool knows_uncompressed =
         (squash_codec_get_info (codec) & SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE) == SQUASH_CODEC_INFO_KNOWS_UNCOMPRESSED_SIZE;
 
-      if (knows_uncompressed) {
+      /* A size of 0 means the codec couldn't tell for this data, so
+         fall back on decompressing to a growing buffer. */
+      if (knows_uncompressed)
         out_data_size = squash_codec_get_uncompressed_size(codec, buffer->size, buffer->data);
-        if (HEDLEY_UNLIKELY(out_data_size == 0)) {
-          res = squash_error (SQUASH_INVALID_BUFFER);
-          goto cleanup_buffer;
-        }
 
+      if (knows_uncompressed && out_data_size != 0) {
         out_data = squash_malloc (out_data_size);
         if (HEDLEY_UNLIKELY(out_data == NULL)) {
           res = squash_error (SQUASH_MEMORY);
@@ -34,7 +34,14 @@
 
 HEDLEY_BEGIN_C_DECLS
 
+typedef SquashStatus (*SquashStreamProcessFunc) (SquashStream* stream, SquashOperation operation);
+
 struct SquashStreamPrivate_ {
+  /* Only set for streams implemented by Squash itself instead of by
+     the codec (see squash-block.c); such streams don't use the
+     thread. */
+  SquashStreamProcessFunc process;
+
   thrd_t thread;
   bool finished;
 
@@ -50,6 +57,14 @@ struct SquashStreamPrivate_ {
 #define SQUASH_OPERATION_INVALID ((SquashOperation) 0)
 #define SQUASH_STATUS_INVALID ((SquashStatus) 0)
 
+HEDLEY_NON_NULL(1, 2, 6) SQUASH_INTERNAL
+void squash_stream_init_internal (void* stream,
+                                  SquashCodec* codec,
+                                  SquashStreamType stream_type,
+                                  SquashOptions* options,
+                                  SquashDestroyNotify destroy_notify,
+                                  SquashStreamProcessFunc process);
+
 HEDLEY_END_C_DECLS
 
 #endif /* !defined(SQUASH_STREAM_INTERNAL_H) */
@@ -410,6 +410,7 @@ squash_stream_init (void* stream,
 
   if (codec->impl.create_stream == NULL && codec->impl.splice != NULL) {
     s->priv = squash_malloc (sizeof (SquashStreamPrivate));
+    s->priv->process = NULL;
 
     mtx_init (&(s->priv->io_mtx), mtx_plain);
     mtx_lock (&(s->priv->io_mtx));
@@ -435,6 +436,54 @@ squash_stream_init (void* stream,
   }
 }
 
+/**
+ * @brief Initialize a stream which is processed by Squash itself
+ * @private
+ *
+ * Rather than dispatching to the codec, ::squash_stream_process,
+ * ::squash_stream_flush, and ::squash_stream_finish will call @a
+ * process.
+ *
+ * @param stream The stream to initialize.
+ * @param codec The codec to use.
+ * @param stream_type The stream type.
+ * @param options The options.
+ * @param destroy_notify Function to call to destroy the instance.
+ * @param process Function used to process the stream.
+ */
+void
+squash_stream_init_internal (void* stream,
+                             SquashCodec* codec,
+                             SquashStreamType stream_type,
+                             SquashOptions* options,
+                             SquashDestroyNotify destroy_notify,
+                             SquashStreamProcessFunc process) {
+  SquashStream* s = (SquashStream*) stream;
+
+  assert (process != NULL);
+
+  squash_object_init (stream, false, destroy_notify);
+
+  s->next_in = NULL;
+  s->avail_in = 0;
+  s->total_in = 0;
+
+  s->next_out = NULL;
+  s->avail_out = 0;
+  s->total_out = 0;
+
+  s->codec = codec;
+  s->options = (options != NULL) ? squash_object_ref (options) : NULL;
+  s->stream_type = stream_type;
+  s->state = SQUASH_STREAM_STATE_IDLE;
+
+  s->user_data = NULL;
+  s->destroy_user_data = NULL;
+
+  s->priv = squash_malloc (sizeof (SquashStreamPrivate));
+  s->priv->process = process;
+}
+
 /**
  * @brief Destroy a stream.
  * @protected
@@ -463,12 +512,14 @@ squash_stream_destroy (void* stream) {
   if (HEDLEY_UNLIKELY(s->priv != NULL)) {
     SquashStreamPrivate* priv = (SquashStreamPrivate*) s->priv;
 
-    if (!priv->finished) {
-      squash_stream_send_to_thread (s, SQUASH_OPERATION_TERMINATE);
+    if (priv->process == NULL) {
+      if (!priv->finished) {
+        squash_stream_send_to_thread (s, SQUASH_OPERATION_TERMINATE);
+      }
+      cnd_destroy (&(priv->request_cnd));
+      cnd_destroy (&(priv->result_cnd));
+      mtx_destroy (&(priv->io_mtx));
     }
-    cnd_destroy (&(priv->request_cnd));
-    cnd_destroy (&(priv->result_cnd));
-    mtx_destroy (&(priv->io_mtx));
 
     squash_free (s->priv);
   }
@@ -581,6 +632,8 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
   impl = squash_codec_get_impl (codec);
   assert (impl != NULL);
 
+  const SquashStreamProcessFunc process = (stream->priv != NULL) ? stream->priv->process : NULL;
+
   /* Flush is optional, so return an error if it doesn't exist but
      flushing was requested. */
   if (HEDLEY_UNLIKELY(operation == SQUASH_OPERATION_FLUSH && ((impl->info & SQUASH_CODEC_INFO_CAN_FLUSH) == 0))) {
@@ -673,7 +726,9 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
       } else {
         stream->state = SQUASH_STREAM_STATE_RUNNING;
 
-        if (impl->process_stream != NULL) {
+        if (process != NULL) {
+          res = process (stream, current_operation);
+        } else if (impl->process_stream != NULL) {
           res = impl->process_stream (stream, current_operation);
         } else if (impl->splice != NULL) {
           res = squash_stream_send_to_thread (stream, current_operation);
@@ -700,9 +755,13 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
 
       if (current_operation == operation) {
         if ((impl->info & SQUASH_CODEC_INFO_CAN_FLUSH) == SQUASH_CODEC_INFO_CAN_FLUSH) {
-          assert (impl->process_stream != NULL);
+          if (process != NULL) {
+            res = process (stream, current_operation);
+          } else {
+            assert (impl->process_stream != NULL);
 
-          res = impl->process_stream (stream, current_operation);
+            res = impl->process_stream (stream, current_operation);
+          }
         } else {
           /* We aready checked to make sure the stream is flushable if
              the user called flush directly, so if this code is
@@ -729,7 +788,9 @@ squash_stream_process_internal (SquashStream* stream, SquashOperation operation)
     } else if (current_operation == SQUASH_OPERATION_FINISH) {
       stream->state = SQUASH_STREAM_STATE_FINISHING;
 
-      if (impl->process_stream != NULL) {
+      if (process != NULL) {
+        res = process (stream, current_operation);
+      } else if (impl->process_stream != NULL) {
         res = impl->process_stream (stream, current_operation);
       } else if (impl->splice) {
         res = squash_stream_send_to_thread (stream, current_operation);
@@ -835,6 +896,134 @@ squash_stream_finish (SquashStream* stream) {
   return squash_stream_process_internal (stream, SQUASH_OPERATION_FINISH);
 }
 
+static SquashStatus
+squash_stream_processv_internal (SquashStream* stream,
+                                 size_t* in_count,
+                                 SquashIOVec** in,
+                                 size_t* out_count,
+                                 SquashIOVec** out,
+                                 SquashOperation operation) {
+  SquashStatus res = SQUASH_OK;
+
+  squash_iovec_advance (in_count, in, 0);
+  squash_iovec_advance (out_count, out, 0);
+
+  while (true) {
+    /* Only the last input segment is flushed or finished; everything
+       before it is simply processed. */
+    const SquashOperation current_operation = (*in_count > 1) ? SQUASH_OPERATION_PROCESS : operation;
+
+    if (current_operation == SQUASH_OPERATION_PROCESS && *in_count == 0)
+      return SQUASH_OK;
+
+    if (*out_count == 0)
+      return SQUASH_PROCESSING;
+
+    const size_t avail_in = (*in_count != 0) ? (*in)->size : 0;
+    const size_t avail_out = (*out)->size;
+
+    stream->next_in = (*in_count != 0) ? (*in)->data : NULL;
+    stream->avail_in = avail_in;
+    stream->next_out = (*out)->data;
+    stream->avail_out = avail_out;
+
+    res = squash_stream_process_internal (stream, current_operation);
+
+    const size_t consumed = avail_in - stream->avail_in;
+    const size_t produced = avail_out - stream->avail_out;
+
+    stream->next_in = NULL;
+    stream->avail_in = 0;
+    stream->next_out = NULL;
+    stream->avail_out = 0;
+
+    squash_iovec_advance (in_count, in, consumed);
+    squash_iovec_advance (out_count, out, produced);
+
+    if (res == SQUASH_PROCESSING) {
+      if (consumed == 0 && produced == 0)
+        return res;
+    } else if (res != SQUASH_OK || current_operation != SQUASH_OPERATION_PROCESS) {
+      return res;
+    }
+  }
+}
+
+/**
+ * @brief Process a stream using scatter/gather lists
+ *
+ * This is equivalent to calling ::squash_stream_process for each
+ * input segment in turn, moving on to the next output segment
+ * whenever the current one is full, but without copying the data into
+ * contiguous buffers first.
+ *
+ * The lists are used as cursors: on return @a in and @a out point to
+ * the first segment which has not been completely consumed (or
+ * filled), that segment's *data* and *size* fields are adjusted to
+ * exclude anything already processed, and @a in_count and @a
+ * out_count are reduced accordingly.  The call can simply be
+ * repeated, with more output space if necessary.
+ *
+ * @param stream The stream.
+ * @param[in,out] in_count Number of segments in @a in
+ * @param[in,out] in Input segments
+ * @param[in,out] out_count Number of segments in @a out
+ * @param[in,out] out Output segments
+ * @return A status code; see ::squash_stream_process.
+ */
+SquashStatus
+squash_stream_processv (SquashStream* stream,
+                        size_t* in_count,
+                        SquashIOVec** in,
+                        size_t* out_count,
+                        SquashIOVec** out) {
+  return squash_stream_processv_internal (stream, in_count, in, out_count, out, SQUASH_OPERATION_PROCESS);
+}
+
+/**
+ * @brief Flush a stream using scatter/gather lists
+ *
+ * All input segments are processed, then the stream is flushed.  See
+ * ::squash_stream_processv for how the lists are updated.
+ *
+ * @param stream The stream.
+ * @param[in,out] in_count Number of segments in @a in
+ * @param[in,out] in Input segments
+ * @param[in,out] out_count Number of segments in @a out
+ * @param[in,out] out Output segments
+ * @return A status code; see ::squash_stream_flush.
+ */
+SquashStatus
+squash_stream_flushv (SquashStream* stream,
+                      size_t* in_count,
+                      SquashIOVec** in,
+                      size_t* out_count,
+                      SquashIOVec** out) {
+  return squash_stream_processv_internal (stream, in_count, in, out_count, out, SQUASH_OPERATION_FLUSH);
+}
+
+/**
+ * @brief Finish a stream using scatter/gather lists
+ *
+ * All input segments are processed, then the stream is finished.
+ * See ::squash_stream_processv for how the lists are updated.
+ *
+ * @param stream The stream.
+ * @param[in,out] in_count Number of segments in @a in
+ * @param[in,out] in Input segments
+ * @param[in,out] out_count Number of segments in @a out
+ * @param[in,out] out Output segments
+ * @return A status code; see ::squash_stream_finish.
+ */
+SquashStatus
+squash_stream_finishv (SquashStream* stream,
+                       size_t* in_count,
+                       SquashIOVec** in,
+                       size_t* out_count,
+                       SquashIOVec** out) {
+  return squash_stream_processv_internal (stream, in_count, in, out_count, out, SQUASH_OPERATION_FINISH);
+}
+
 /**
  * @}
  */
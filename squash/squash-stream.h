@@ -107,6 +107,25 @@ SQUASH_API SquashStatus    squash_stream_flush                  (SquashStream* s
 HEDLEY_NON_NULL(1)
 SQUASH_API SquashStatus    squash_stream_finish                 (SquashStream* stream);
 
+HEDLEY_NON_NULL(1, 2, 3, 4, 5)
+SQUASH_API SquashStatus    squash_stream_processv               (SquashStream* stream,
+                                                                 size_t* in_count,
+                                                                 SquashIOVec** in,
+                                                                 size_t* out_count,
+                                                                 SquashIOVec** out);
+HEDLEY_NON_NULL(1, 2, 3, 4, 5)
+SQUASH_API SquashStatus    squash_stream_flushv                 (SquashStream* stream,
+                                                                 size_t* in_count,
+                                                                 SquashIOVec** in,
+                                                                 size_t* out_count,
+                                                                 SquashIOVec** out);
+HEDLEY_NON_NULL(1, 2, 3, 4, 5)
+SQUASH_API SquashStatus    squash_stream_finishv                (SquashStream* stream,
+                                                                 size_t* in_count,
+                                                                 SquashIOVec** in,
+                                                                 size_t* out_count,
+                                                                 SquashIOVec** out);
+
 HEDLEY_NON_NULL(1, 2)
 SQUASH_API void            squash_stream_init                   (void* stream,
                                                                  SquashCodec* codec,
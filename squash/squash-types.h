@@ -44,6 +44,38 @@ typedef struct SquashCodec_      SquashCodec;
 typedef struct SquashCodecImpl_  SquashCodecImpl;
 typedef struct SquashPlugin_     SquashPlugin;
 typedef struct SquashFile_       SquashFile;
+typedef struct SquashFdStream_   SquashFdStream;
+
+/**
+ * @brief A segment of a scatter/gather list
+ *
+ * Used by ::squash_codec_compressv, ::squash_codec_decompressv,
+ * ::squash_stream_processv and friends to process data which is not
+ * contiguous in memory without first copying it into a single
+ * buffer.
+ */
+typedef struct SquashIOVec_ {
+  /** @brief Start of the segment */
+  uint8_t* data;
+  /** @brief Size of the segment, in bytes */
+  size_t size;
+} SquashIOVec;
+
+/**
+ * @brief An independently decodable frame within a compressed buffer
+ *
+ * Reported by a codec's frame scanner (see
+ * SquashCodecImpl_::scan_frames) so that Squash can decompress each
+ * frame separately.
+ */
+typedef struct SquashFrame_ {
+  /** @brief Offset of the frame in the compressed buffer, in bytes */
+  size_t compressed_offset;
+  /** @brief Size of the frame, in bytes */
+  size_t compressed_size;
+  /** @brief Size of the frame's decompressed data, in bytes */
+  size_t decompressed_size;
+} SquashFrame;
 
 HEDLEY_END_C_DECLS
 
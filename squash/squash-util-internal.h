@@ -41,6 +41,22 @@ size_t squash_npot               (size_t v);
 SQUASH_INTERNAL
 size_t squash_get_huge_page_size (void);
 
+HEDLEY_NON_NULL(1, 3) SQUASH_INTERNAL
+size_t squash_read_varuint64     (const uint8_t *p, size_t p_size, uint64_t *v);
+HEDLEY_NON_NULL(1) SQUASH_INTERNAL
+size_t squash_write_varuint64    (uint8_t *p, size_t p_size, uint64_t v);
+SQUASH_INTERNAL
+size_t squash_size_varuint64     (const uint64_t value);
+
+SQUASH_INTERNAL
+size_t squash_iovec_get_size     (size_t count, const SquashIOVec iov[HEDLEY_ARRAY_PARAM(count)]);
+HEDLEY_NON_NULL(1, 2) SQUASH_INTERNAL
+void   squash_iovec_advance      (size_t* count, SquashIOVec** iov, size_t size);
+HEDLEY_NON_NULL(1, 2) SQUASH_INTERNAL
+size_t squash_iovec_read         (size_t* count, SquashIOVec** iov, size_t size, uint8_t data[HEDLEY_ARRAY_PARAM(size)]);
+HEDLEY_NON_NULL(1, 2) SQUASH_INTERNAL
+size_t squash_iovec_write        (size_t* count, SquashIOVec** iov, size_t size, const uint8_t data[HEDLEY_ARRAY_PARAM(size)]);
+
 HEDLEY_END_C_DECLS
 
 #endif /* SQUASH_UTIL_INTERNAL_H */
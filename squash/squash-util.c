@@ -137,3 +137,148 @@ squash_npot (size_t v) {
   v++;
   return v;
 }
+
+size_t
+squash_read_varuint64 (const uint8_t *p, size_t p_size, uint64_t *v) {
+  uint64_t n = 0;
+  size_t i;
+
+  for (i = 0; i < 8 && i < p_size && *p > 0x7F; ++i) {
+    n = (n << 7) | (*p++ & 0x7F);
+  }
+
+  if (i == p_size) {
+    return 0;
+  }
+  else if (i == 8) {
+    n = (n << 8) | *p;
+  }
+  else {
+    n = (n << 7) | *p;
+  }
+
+  *v = n;
+
+  return i + 1;
+}
+
+size_t
+squash_write_varuint64 (uint8_t *p, size_t p_size, uint64_t v) {
+  uint8_t buf[10];
+  size_t i;
+  size_t j;
+
+  if (v & 0xFF00000000000000ULL) {
+    if (p_size < 9) {
+      return 0;
+    }
+
+    p[8] = (uint8_t) v;
+    v >>= 8;
+
+    i = 7;
+
+    for (j = 0; j < 8; ++j) {
+      p[i--] = (uint8_t) ((v & 0x7F) | 0x80);
+      v >>= 7;
+    }
+
+    return 9;
+  }
+
+  i = 0;
+
+  buf[i++] = (uint8_t) (v & 0x7F);
+  v >>= 7;
+
+  while (v > 0) {
+    buf[i++] = (uint8_t) ((v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+
+  if (i > p_size) {
+    return 0;
+  }
+
+  for (j = 0; j < i; ++j) {
+    p[j] = buf[i - j - 1];
+  }
+
+  return i;
+}
+
+size_t
+squash_size_varuint64 (const uint64_t value) {
+  if (value & 0xFF00000000000000ULL)
+    return 9;
+
+  size_t required = 1;
+
+  for (size_t s = 7 ; s < 64 ; s += 7, required++)
+    if (value < (UINT64_C(1) << s))
+      break;
+
+  return required;
+}
+
+/* Scatter/gather helpers.  Lists of SquashIOVec are consumed through
+   a cursor (a pointer to the current segment plus the number of
+   segments remaining); the current segment is adjusted in place as
+   data is consumed, and empty segments are skipped. */
+
+size_t
+squash_iovec_get_size (size_t count, const SquashIOVec iov[HEDLEY_ARRAY_PARAM(count)]) {
+  size_t size = 0;
+
+  for (size_t i = 0 ; i < count ; i++)
+    size += iov[i].size;
+
+  return size;
+}
+
+void
+squash_iovec_advance (size_t* count, SquashIOVec** iov, size_t size) {
+  while (*count != 0) {
+    if ((*iov)->size > size) {
+      (*iov)->data += size;
+      (*iov)->size -= size;
+      return;
+    }
+
+    size -= (*iov)->size;
+    (*iov)->data += (*iov)->size;
+    (*iov)->size = 0;
+    (*iov)++;
+    (*count)--;
+  }
+}
+
+size_t
+squash_iovec_read (size_t* count, SquashIOVec** iov, size_t size, uint8_t data[HEDLEY_ARRAY_PARAM(size)]) {
+  size_t pos = 0;
+
+  squash_iovec_advance (count, iov, 0);
+  while (pos < size && *count != 0) {
+    const size_t cp_size = ((*iov)->size < (size - pos)) ? (*iov)->size : (size - pos);
+    memcpy (data + pos, (*iov)->data, cp_size);
+    pos += cp_size;
+    squash_iovec_advance (count, iov, cp_size);
+  }
+
+  return pos;
+}
+
+size_t
+squash_iovec_write (size_t* count, SquashIOVec** iov, size_t size, const uint8_t data[HEDLEY_ARRAY_PARAM(size)]) {
+  size_t pos = 0;
+
+  squash_iovec_advance (count, iov, 0);
+  while (pos < size && *count != 0) {
+    const size_t cp_size = ((*iov)->size < (size - pos)) ? (*iov)->size : (size - pos);
+    memcpy ((*iov)->data, data + pos, cp_size);
+    pos += cp_size;
+    squash_iovec_advance (count, iov, cp_size);
+  }
+
+  return pos;
+}
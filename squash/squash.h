@@ -81,9 +81,12 @@
 #include <squash/squash-options.h>
 #include <squash/squash-stream.h>
 #include <squash/squash-file.h>
+#include <squash/squash-fd-stream.h>
 #include <squash/squash-license.h>
 #include <squash/squash-codec.h>
 #include <squash/squash-splice.h>
+#include <squash/squash-parallel.h>
+#include <squash/squash-crc32c.h>
 #include <squash/squash-plugin.h>
 #include <squash/squash-memory.h>
 #include <squash/squash-context.h>
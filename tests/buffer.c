@@ -66,6 +66,118 @@ squash_test_single_byte(MUNIT_UNUSED const MunitParameter params[], void* user_d
   return MUNIT_OK;
 }
 
+static MunitResult
+squash_test_trusted(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH);
+  size_t decompressed_length = LOREM_IPSUM_LENGTH;
+  uint8_t* compressed = (uint8_t*) munit_malloc (compressed_length);
+  uint8_t* decompressed = (uint8_t*) munit_malloc (LOREM_IPSUM_LENGTH);
+
+  SquashStatus res = squash_codec_compress (codec, &compressed_length, compressed, LOREM_IPSUM_LENGTH, (uint8_t*) LOREM_IPSUM, NULL);
+  SQUASH_ASSERT_OK(res);
+
+  res = squash_codec_decompress_trusted (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(LOREM_IPSUM_LENGTH, ==, decompressed_length);
+  munit_assert_memory_equal(LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+  free (compressed);
+
+  /* Framed data is recognized without the option, and never reaches
+     the codec's unchecked decoder. */
+  SquashOptions* options = squash_options_new (codec, "framing", "chunked", NULL);
+  munit_assert_not_null (options);
+  squash_object_ref_sink (options);
+
+  compressed_length = squash_codec_get_max_compressed_size_with_options (codec, LOREM_IPSUM_LENGTH, options);
+  compressed = (uint8_t*) munit_malloc (compressed_length);
+  res = squash_codec_compress_with_options (codec, &compressed_length, compressed, LOREM_IPSUM_LENGTH, (uint8_t*) LOREM_IPSUM, options);
+  SQUASH_ASSERT_OK(res);
+  squash_object_unref (options);
+
+  memset (decompressed, 0, LOREM_IPSUM_LENGTH);
+  decompressed_length = LOREM_IPSUM_LENGTH;
+  res = squash_codec_decompress_trusted (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(LOREM_IPSUM_LENGTH, ==, decompressed_length);
+  munit_assert_memory_equal(LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_prefix(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH);
+  uint8_t* compressed = (uint8_t*) munit_malloc (compressed_length);
+  uint8_t* decompressed = (uint8_t*) munit_malloc (LOREM_IPSUM_LENGTH + 64);
+
+  SquashStatus res = squash_codec_compress (codec, &compressed_length, compressed, LOREM_IPSUM_LENGTH, (uint8_t*) LOREM_IPSUM, NULL);
+  SQUASH_ASSERT_OK(res);
+
+  const size_t wanted = (size_t) munit_rand_int_range (1, (int) LOREM_IPSUM_LENGTH - 1);
+  size_t decompressed_length = wanted;
+  res = squash_codec_decompress_prefix (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(wanted, ==, decompressed_length);
+  munit_assert_memory_equal(wanted, decompressed, LOREM_IPSUM);
+
+  /* Asking for more than there is isn't an error */
+  decompressed_length = LOREM_IPSUM_LENGTH + 64;
+  res = squash_codec_decompress_prefix (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(LOREM_IPSUM_LENGTH, ==, decompressed_length);
+  munit_assert_memory_equal(LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+  /* ... but running out of input before the end of the stream is,
+     for codecs which can tell */
+  decompressed_length = LOREM_IPSUM_LENGTH + 64;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length - 20, compressed, NULL);
+  if (res != SQUASH_OK) {
+    decompressed_length = LOREM_IPSUM_LENGTH + 64;
+    res = squash_codec_decompress_prefix (codec, &decompressed_length, decompressed, compressed_length - 20, compressed, NULL);
+    munit_assert_int(res, <, 0);
+  }
+
+  free (compressed);
+
+  /* Framed data is recognized without any options */
+  SquashOptions* options = squash_options_new (codec, "framing", "chunked", NULL);
+  munit_assert_not_null(options);
+  squash_object_ref_sink (options);
+
+  compressed_length = squash_codec_get_max_compressed_size_with_options (codec, LOREM_IPSUM_LENGTH, options);
+  compressed = (uint8_t*) munit_malloc (compressed_length);
+  res = squash_codec_compress_with_options (codec, &compressed_length, compressed, LOREM_IPSUM_LENGTH, (uint8_t*) LOREM_IPSUM, options);
+  SQUASH_ASSERT_OK(res);
+  squash_object_unref (options);
+
+  decompressed_length = wanted;
+  res = squash_codec_decompress_prefix (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(wanted, ==, decompressed_length);
+  munit_assert_memory_equal(wanted, decompressed, LOREM_IPSUM);
+
+  decompressed_length = LOREM_IPSUM_LENGTH + 64;
+  res = squash_codec_decompress_prefix (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size(LOREM_IPSUM_LENGTH, ==, decompressed_length);
+  munit_assert_memory_equal(LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
 #if defined(SQUASH_TEST_DATA_DIR)
 
 static MunitResult
@@ -125,6 +237,8 @@ squash_test_endianness_le(MUNIT_UNUSED const MunitParameter params[], void* user
 MunitTest squash_buffer_tests[] = {
   { (char*) "/basic", squash_test_basic, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { (char*) "/single-byte", squash_test_single_byte, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/prefix", squash_test_prefix, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/trusted", squash_test_trusted, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
 #if defined(SQUASH_TEST_DATA_DIR)
   { (char*) "/endianness", squash_test_endianness_le, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   /* { (char*) "/endianness/be", squash_test_endianness_be, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER }, */
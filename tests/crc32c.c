@@ -0,0 +1,81 @@
+#include "test-squash.h"
+
+#define CRC32C_BUFFER_SIZE ((size_t) (64 * 1024))
+
+static uint32_t
+crc32c_bitwise (uint32_t crc, size_t data_size, const uint8_t* data) {
+  for (size_t i = 0 ; i < data_size ; i++) {
+    crc ^= data[i];
+    for (int bit = 0 ; bit < 8 ; bit++)
+      crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+  }
+
+  return crc;
+}
+
+static MunitResult
+squash_test_crc32c_values(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  /* Lengths around the stripe sizes of the hardware kernels. */
+  static const size_t lengths[] = {
+    0, 1, 7, 8, 9, 63, 767, 768, 769, 1000,
+    24575, 24576, 24577, 3 * 24576 + 1000, CRC32C_BUFFER_SIZE - 16
+  };
+  uint8_t* buf = munit_newa (uint8_t, CRC32C_BUFFER_SIZE);
+
+  munit_rand_memory (CRC32C_BUFFER_SIZE, buf);
+
+  /* Check value from RFC 3720, B.4. */
+  munit_assert_uint32 (squash_crc32c (0xffffffff, 9, (const uint8_t*) "123456789") ^ 0xffffffff, ==, 0xe3069283);
+
+  for (size_t offset = 0 ; offset < 16 ; offset++) {
+    for (size_t i = 0 ; i < sizeof (lengths) / sizeof (lengths[0]) ; i++) {
+      const uint32_t init = munit_rand_uint32 ();
+      munit_assert_uint32 (squash_crc32c (init, lengths[i], buf + offset), ==,
+                           crc32c_bitwise (init, lengths[i], buf + offset));
+    }
+  }
+
+  /* Every kernel this CPU supports must agree with slicing-by-8. */
+  static const SquashCrc32cKernel kernels[] = {
+    SQUASH_CRC32C_KERNEL_SSE42,
+    SQUASH_CRC32C_KERNEL_PCLMUL,
+    SQUASH_CRC32C_KERNEL_ARMV8
+  };
+  for (size_t k = 0 ; k < sizeof (kernels) / sizeof (kernels[0]) ; k++) {
+    for (size_t offset = 0 ; offset < 16 ; offset++) {
+      for (size_t i = 0 ; i < sizeof (lengths) / sizeof (lengths[0]) ; i++) {
+        const uint32_t init = munit_rand_uint32 ();
+        uint32_t expected = init, actual = init;
+
+        SQUASH_ASSERT_OK(squash_crc32c_kernel (SQUASH_CRC32C_KERNEL_SLICE8, &expected, lengths[i], buf + offset));
+        if (squash_crc32c_kernel (kernels[k], &actual, lengths[i], buf + offset) != SQUASH_OK)
+          break;
+        munit_assert_uint32 (actual, ==, expected);
+        munit_assert_uint32 (actual, ==, crc32c_bitwise (init, lengths[i], buf + offset));
+      }
+    }
+  }
+
+  /* Updating in pieces must match a single pass. */
+  uint32_t crc = 0xffffffff;
+  for (size_t pos = 0 ; pos < CRC32C_BUFFER_SIZE ; pos += 1000)
+    crc = squash_crc32c (crc, MIN(1000, CRC32C_BUFFER_SIZE - pos), buf + pos);
+  munit_assert_uint32 (crc, ==, squash_crc32c (0xffffffff, CRC32C_BUFFER_SIZE, buf));
+
+  free (buf);
+
+  return MUNIT_OK;
+}
+
+static MunitTest squash_crc32c_tests[] = {
+  { (char*) "/values", squash_test_crc32c_values, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_crc32c = {
+  (char*) "/crc32c",
+  squash_crc32c_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
@@ -0,0 +1,131 @@
+#include "test-squash.h"
+
+#if !defined(_WIN32)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static bool
+squash_test_fd_stream_would_block (void) {
+#if EWOULDBLOCK != EAGAIN
+  if (errno == EWOULDBLOCK)
+    return true;
+#endif
+  return errno == EAGAIN;
+}
+
+/* Push data through a stream using a pair of non-blocking pipes,
+   feeding the input in random chunks and draining the output as we
+   go, the same way an event loop would. */
+static void
+squash_test_fd_stream_run (SquashCodec* codec, SquashStreamType stream_type,
+                           size_t input_length, const uint8_t* input,
+                           size_t* output_length, uint8_t* output) {
+  int in_pipe[2], out_pipe[2];
+  munit_assert_int (pipe (in_pipe), ==, 0);
+  munit_assert_int (pipe (out_pipe), ==, 0);
+  for (int i = 0 ; i < 2 ; i++) {
+    munit_assert_int (fcntl (in_pipe[i], F_SETFL, O_NONBLOCK), ==, 0);
+    munit_assert_int (fcntl (out_pipe[i], F_SETFL, O_NONBLOCK), ==, 0);
+  }
+
+  SquashStream* stream = squash_codec_create_stream (codec, stream_type, NULL);
+  munit_assert_not_null (stream);
+  SquashFdStream* fd_stream = squash_fd_stream_new (stream, in_pipe[0], out_pipe[1]);
+  munit_assert_not_null (fd_stream);
+  squash_object_unref (stream);
+
+  size_t written = 0, read_total = 0;
+  SquashFdStreamWant want;
+  SquashStatus res = SQUASH_OK;
+
+  while (res != SQUASH_END_OF_STREAM) {
+    if (in_pipe[1] != -1) {
+      const size_t max_chunk = (size_t) munit_rand_int_range (1, 8192);
+      const size_t chunk = MIN(input_length - written, max_chunk);
+      const ssize_t w = write (in_pipe[1], input + written, chunk);
+      if (w > 0)
+        written += (size_t) w;
+      else
+        munit_assert_true (w == 0 || squash_test_fd_stream_would_block ());
+
+      if (written == input_length) {
+        close (in_pipe[1]);
+        in_pipe[1] = -1;
+      }
+    }
+
+    res = squash_fd_stream_process (fd_stream, &want);
+    munit_assert_int (res, >=, 0);
+    if (res == SQUASH_OK)
+      munit_assert_int (want, !=, SQUASH_FD_STREAM_WANT_NONE);
+
+    while (true) {
+      const ssize_t r = read (out_pipe[0], output + read_total, *output_length - read_total);
+      if (r <= 0) {
+        munit_assert_true (r == 0 || squash_test_fd_stream_would_block ());
+        break;
+      }
+      read_total += (size_t) r;
+      munit_assert_size (read_total, <, *output_length);
+    }
+  }
+
+  /* Calling it again once finished is harmless. */
+  SQUASH_ASSERT_STATUS (squash_fd_stream_process (fd_stream, &want), SQUASH_END_OF_STREAM);
+  munit_assert_int (want, ==, SQUASH_FD_STREAM_WANT_NONE);
+
+  squash_fd_stream_free (fd_stream);
+  close (in_pipe[0]);
+  if (in_pipe[1] != -1)
+    close (in_pipe[1]);
+  close (out_pipe[0]);
+  close (out_pipe[1]);
+
+  *output_length = read_total;
+}
+
+static MunitResult
+squash_test_fd_stream_pipe(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH) + 1024;
+  uint8_t* compressed = munit_newa (uint8_t, compressed_length);
+  size_t decompressed_length = LOREM_IPSUM_LENGTH + 1;
+  uint8_t* decompressed = munit_newa (uint8_t, decompressed_length);
+
+  squash_test_fd_stream_run (codec, SQUASH_STREAM_COMPRESS,
+                             LOREM_IPSUM_LENGTH, LOREM_IPSUM,
+                             &compressed_length, compressed);
+
+  squash_test_fd_stream_run (codec, SQUASH_STREAM_DECOMPRESS,
+                             compressed_length, compressed,
+                             &decompressed_length, decompressed);
+
+  munit_assert_size (decompressed_length, ==, LOREM_IPSUM_LENGTH);
+  munit_assert_memory_equal (LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+#endif /* !defined(_WIN32) */
+
+static MunitTest squash_fd_stream_tests[] = {
+#if !defined(_WIN32)
+  { (char*) "/pipe", squash_test_fd_stream_pipe, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+#endif
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_fd_stream = {
+  (char*) "/fd-stream",
+  squash_fd_stream_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
@@ -1,8 +1,8 @@
-#if defined(_POSIX_C_SOURCE) && (_POSIX_C_SOURCE < 200112L)
+#if defined(_POSIX_C_SOURCE) && (_POSIX_C_SOURCE < 200809L)
 #  undef _POSIX_C_SOURCE
 #endif
 #if !defined(_POSIX_C_SOURCE)
-#  define _POSIX_C_SOURCE 200112L
+#  define _POSIX_C_SOURCE 200809L
 #endif
 
 #include "test-squash.h"
@@ -199,10 +199,56 @@ squash_test_splice_partial(const MunitParameter params[], void* user_data) {
   memcpy (decompressed_data, filler, sizeof (decompressed_data));
   res = squash_splice (codec, SQUASH_STREAM_DECOMPRESS, decompressed, compressed, len2, NULL);
   SQUASH_ASSERT_OK(res);
+  munit_assert_size (ftello (decompressed), ==, (off_t) len2);
 
   return MUNIT_OK;
 }
 
+#if !defined(_WIN32)
+static MunitResult
+squash_test_splice_write_only(const MunitParameter params[], void* user_data) {
+  struct Triple* data = (struct Triple*) user_data;
+  char filename[] = "/tmp/squash-test-XXXXXX";
+  uint8_t decompressed_data[LOREM_IPSUM_LENGTH + 1];
+  size_t bytes;
+
+  FILE* uncompressed = data->file[0];
+  FILE* compressed   = data->file[1];
+
+  bytes = fwrite (LOREM_IPSUM, 1, LOREM_IPSUM_LENGTH, uncompressed);
+  munit_assert_size (bytes, ==, LOREM_IPSUM_LENGTH);
+  fflush (uncompressed);
+  rewind (uncompressed);
+
+  SquashStatus res = squash_splice (data->codec, SQUASH_STREAM_COMPRESS, compressed, uncompressed, 0, NULL);
+  SQUASH_ASSERT_OK(res);
+  rewind (compressed);
+
+  /* The output can't be mapped, so nothing may be left behind from
+     trying. */
+  const int fd = mkstemp (filename);
+  munit_assert_int (fd, !=, -1);
+  close (fd);
+
+  FILE* decompressed = fopen (filename, "wb");
+  munit_assert_not_null (decompressed);
+  res = squash_splice (data->codec, SQUASH_STREAM_DECOMPRESS, decompressed, compressed, 0, NULL);
+  fclose (decompressed);
+  SQUASH_ASSERT_OK(res);
+
+  decompressed = fopen (filename, "rb");
+  munit_assert_not_null (decompressed);
+  bytes = fread (decompressed_data, 1, sizeof (decompressed_data), decompressed);
+  fclose (decompressed);
+  unlink (filename);
+
+  munit_assert_size (bytes, ==, LOREM_IPSUM_LENGTH);
+  munit_assert_memory_equal (LOREM_IPSUM_LENGTH, decompressed_data, LOREM_IPSUM);
+
+  return MUNIT_OK;
+}
+#endif
+
 #define HELLO_WORLD_LENGTH ((size_t) 13)
 
 static MunitResult
@@ -246,11 +292,85 @@ squash_test_printf(const MunitParameter params[], void* user_data) {
   return MUNIT_OK;
 }
 
+#define SEEK_DATA_LENGTH ((size_t) (128 * 1024))
+
+static MunitResult
+squash_test_seek(const MunitParameter params[], void* user_data) {
+  struct Single* data = (struct Single*) user_data;
+  munit_assert_not_null (data);
+
+  /* Long enough for codecs which work in blocks (like bgzf) to use
+     several of them, but not so compressible that codecs which don't
+     know the decompressed size can't guess it. */
+  uint8_t* uncompressed = munit_malloc (SEEK_DATA_LENGTH);
+  for (size_t i = 0 ; i < SEEK_DATA_LENGTH ; i++)
+    uncompressed[i] = (LOREM_IPSUM)[munit_rand_int_range (0, LOREM_IPSUM_LENGTH - 1)];
+
+  SquashFile* file = squash_file_steal (data->codec, data->file, NULL);
+  munit_assert_not_null (file);
+  SquashStatus res = squash_file_write (file, SEEK_DATA_LENGTH, uncompressed);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_uint64 (squash_file_tell (file), ==, SEEK_DATA_LENGTH);
+  SQUASH_ASSERT_STATUS(squash_file_seek (file, 0), SQUASH_INVALID_OPERATION);
+  squash_file_free (file, NULL);
+
+  fflush (data->file);
+  rewind (data->file);
+
+  file = squash_file_steal (data->codec, data->file, NULL);
+  munit_assert_not_null (file);
+
+  uint8_t decompressed[256];
+  const size_t offsets[] = {
+    SEEK_DATA_LENGTH / 2,
+    SEEK_DATA_LENGTH - 100,
+    1,
+    (SEEK_DATA_LENGTH / 2) + 1000,
+    (SEEK_DATA_LENGTH / 2) + 1500
+  };
+  for (size_t i = 0 ; i < sizeof (offsets) / sizeof (offsets[0]) ; i++) {
+    const size_t expected = MIN(sizeof (decompressed), SEEK_DATA_LENGTH - offsets[i]);
+    size_t total_read = 0;
+
+    res = squash_file_seek (file, offsets[i]);
+    SQUASH_ASSERT_OK(res);
+    munit_assert_uint64 (squash_file_tell (file), ==, offsets[i]);
+
+    do {
+      size_t bytes_read = sizeof (decompressed) - total_read;
+      res = squash_file_read (file, &bytes_read, decompressed + total_read);
+      SQUASH_ASSERT_NO_ERROR(res);
+      total_read += bytes_read;
+    } while (total_read < expected && res != SQUASH_END_OF_STREAM);
+
+    munit_assert_size (total_read, ==, expected);
+    munit_assert_memory_equal (expected, decompressed, uncompressed + offsets[i]);
+    munit_assert_uint64 (squash_file_tell (file), ==, offsets[i] + expected);
+  }
+
+  size_t pread_size = sizeof (decompressed);
+  res = squash_file_pread (file, 1000, &pread_size, decompressed);
+  SQUASH_ASSERT_NO_ERROR(res);
+  munit_assert_size (pread_size, ==, sizeof (decompressed));
+  munit_assert_memory_equal (pread_size, decompressed, uncompressed + 1000);
+
+  SQUASH_ASSERT_STATUS(squash_file_seek (file, SEEK_DATA_LENGTH + 1), SQUASH_RANGE);
+
+  squash_file_free (file, NULL);
+  free (uncompressed);
+
+  return MUNIT_OK;
+}
+
 MunitTest squash_file_tests[] = {
   { (char*) "/io", squash_test_io, squash_test_single_setup, squash_test_single_tear_down, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { (char*) "/splice/full", squash_test_splice_full, squash_test_triple_setup, squash_test_triple_tear_down, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { (char*) "/splice/partial", squash_test_splice_partial, squash_test_triple_setup, squash_test_triple_tear_down, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+#if !defined(_WIN32)
+  { (char*) "/splice/write-only", squash_test_splice_write_only, squash_test_triple_setup, squash_test_triple_tear_down, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+#endif
   { (char*) "/printf", squash_test_printf, squash_test_single_setup, squash_test_single_tear_down, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/seek", squash_test_seek, squash_test_single_setup, squash_test_single_tear_down, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
@@ -0,0 +1,138 @@
+#include "test-squash.h"
+
+#define SQUASH_TEST_IOVEC_MAX_SEGMENTS 64
+
+/* Split a buffer into a random number of segments, some of them
+   empty. */
+static size_t
+squash_test_iovec_split (SquashIOVec iov[SQUASH_TEST_IOVEC_MAX_SEGMENTS], size_t size, uint8_t* data) {
+  size_t count = 0;
+  size_t pos = 0;
+
+  while (pos < size && count < (SQUASH_TEST_IOVEC_MAX_SEGMENTS - 1)) {
+    const size_t max_segment_size = (size_t) munit_rand_int_range (0, (int) (size / 8) + 1);
+    const size_t segment_size = MIN(size - pos, max_segment_size);
+    iov[count].data = data + pos;
+    iov[count].size = segment_size;
+    pos += segment_size;
+    count++;
+  }
+
+  iov[count].data = data + pos;
+  iov[count].size = size - pos;
+
+  return count + 1;
+}
+
+static MunitResult
+squash_test_iovec_buffer(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  SquashIOVec in[SQUASH_TEST_IOVEC_MAX_SEGMENTS];
+  SquashIOVec out[SQUASH_TEST_IOVEC_MAX_SEGMENTS];
+  size_t in_count, out_count;
+
+  uint8_t* uncompressed = munit_newa (uint8_t, LOREM_IPSUM_LENGTH);
+  memcpy (uncompressed, LOREM_IPSUM, LOREM_IPSUM_LENGTH);
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH);
+  uint8_t* compressed = munit_newa (uint8_t, compressed_length);
+  size_t decompressed_length = LOREM_IPSUM_LENGTH;
+  uint8_t* decompressed = munit_newa (uint8_t, LOREM_IPSUM_LENGTH);
+  SquashStatus res;
+
+  in_count = squash_test_iovec_split (in, LOREM_IPSUM_LENGTH, uncompressed);
+  out_count = squash_test_iovec_split (out, compressed_length, compressed);
+  res = squash_codec_compressv (codec, &compressed_length, out_count, out, in_count, in, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (compressed_length, <=, squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH));
+
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, LOREM_IPSUM_LENGTH);
+  munit_assert_memory_equal (LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+  memset (decompressed, 0, LOREM_IPSUM_LENGTH);
+  in_count = squash_test_iovec_split (in, compressed_length, compressed);
+  out_count = squash_test_iovec_split (out, LOREM_IPSUM_LENGTH, decompressed);
+  res = squash_codec_decompressv (codec, &decompressed_length, out_count, out, in_count, in, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, LOREM_IPSUM_LENGTH);
+  munit_assert_memory_equal (LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+  free (uncompressed);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_iovec_stream(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  SquashIOVec in_segments[SQUASH_TEST_IOVEC_MAX_SEGMENTS];
+  SquashIOVec out_segments[SQUASH_TEST_IOVEC_MAX_SEGMENTS];
+  SquashIOVec* in = in_segments;
+  SquashIOVec* out = out_segments;
+  size_t in_count, out_count;
+
+  uint8_t* uncompressed = munit_newa (uint8_t, LOREM_IPSUM_LENGTH);
+  memcpy (uncompressed, LOREM_IPSUM, LOREM_IPSUM_LENGTH);
+  const size_t compressed_size = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH) + 1024;
+  uint8_t* compressed = munit_newa (uint8_t, compressed_size);
+  size_t decompressed_length = LOREM_IPSUM_LENGTH;
+  uint8_t* decompressed = munit_newa (uint8_t, LOREM_IPSUM_LENGTH);
+  SquashStatus res;
+
+  SquashStream* stream = squash_codec_create_stream (codec, SQUASH_STREAM_COMPRESS, NULL);
+  munit_assert_not_null (stream);
+
+  in_count = squash_test_iovec_split (in_segments, LOREM_IPSUM_LENGTH, uncompressed);
+  out_count = squash_test_iovec_split (out_segments, compressed_size, compressed);
+
+  /* Feed the input a few segments at a time. */
+  while (in_count > 1) {
+    const size_t max_batch = (size_t) munit_rand_int_range (1, 4);
+    size_t batch = MIN(in_count - 1, max_batch);
+    const size_t remaining = in_count - batch;
+
+    res = squash_stream_processv (stream, &batch, &in, &out_count, &out);
+    SQUASH_ASSERT_OK(res);
+    munit_assert_size (batch, ==, 0);
+    in_count = remaining;
+  }
+
+  res = squash_stream_finishv (stream, &in_count, &in, &out_count, &out);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (in_count, ==, 0);
+  munit_assert_size (stream->total_in, ==, LOREM_IPSUM_LENGTH);
+
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, stream->total_out, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, LOREM_IPSUM_LENGTH);
+  munit_assert_memory_equal (LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+  squash_object_unref (stream);
+
+  free (uncompressed);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitTest squash_iovec_tests[] = {
+  { (char*) "/buffer", squash_test_iovec_buffer, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/stream", squash_test_iovec_stream, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_iovec = {
+  (char*) "/iovec",
+  squash_iovec_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
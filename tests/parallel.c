@@ -0,0 +1,196 @@
+#include "test-squash.h"
+
+#define PARALLEL_FRAMES 8
+
+static SquashStatus
+parallel_square (size_t task, void* user_data) {
+  size_t* results = (size_t*) user_data;
+
+  results[task] = task * task;
+
+  if (task == 37)
+    return SQUASH_FAILED;
+  else if (task == 41)
+    return SQUASH_MEMORY;
+  else
+    return SQUASH_OK;
+}
+
+static MunitResult
+squash_test_parallel_run(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  size_t results[64] = { 0, };
+
+  SQUASH_ASSERT_OK(squash_parallel_run (37, 4, parallel_square, results));
+  for (size_t i = 0 ; i < 37 ; i++)
+    munit_assert_size (results[i], ==, i * i);
+  munit_assert_size (results[37], ==, 0);
+
+  /* The failure with the lowest index wins. */
+  munit_assert_int (squash_parallel_run (64, 4, parallel_square, results), ==, SQUASH_FAILED);
+  munit_assert_int (squash_parallel_run (64, 1, parallel_square, results), ==, SQUASH_FAILED);
+
+  SQUASH_ASSERT_OK(squash_parallel_run (0, 0, parallel_square, results));
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_parallel_frames(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  const size_t frame_length = LOREM_IPSUM_LENGTH;
+  const size_t uncompressed_length = frame_length * PARALLEL_FRAMES;
+  const size_t max_frame_size = squash_codec_get_max_compressed_size (codec, frame_length);
+  uint8_t* uncompressed = munit_newa (uint8_t, uncompressed_length);
+  uint8_t* compressed = munit_newa (uint8_t, max_frame_size * PARALLEL_FRAMES);
+  uint8_t* decompressed = munit_newa (uint8_t, uncompressed_length);
+  size_t compressed_length = 0;
+  size_t decompressed_length;
+  SquashStatus res;
+
+  for (size_t i = 0 ; i < PARALLEL_FRAMES ; i++) {
+    size_t frame_size = max_frame_size;
+
+    for (size_t j = 0 ; j < frame_length ; j++)
+      uncompressed[(i * frame_length) + j] = (LOREM_IPSUM)[(i + j) % LOREM_IPSUM_LENGTH];
+
+    res = squash_codec_compress (codec, &frame_size, compressed + compressed_length,
+                                 frame_length, uncompressed + (i * frame_length), NULL);
+    SQUASH_ASSERT_OK(res);
+    compressed_length += frame_size;
+  }
+
+  /* Only formats which allow concatenation are interesting. */
+  decompressed_length = uncompressed_length;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed,
+                                 "decompress-threads", "1", NULL);
+  if (res != SQUASH_OK || decompressed_length != uncompressed_length) {
+    free (uncompressed);
+    free (compressed);
+    free (decompressed);
+    return MUNIT_SKIP;
+  }
+
+  memset (decompressed, 0, uncompressed_length);
+  decompressed_length = uncompressed_length;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed,
+                                 "decompress-threads", "4", "parallel-threshold", "0", NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, uncompressed_length);
+  munit_assert_memory_equal (uncompressed_length, decompressed, uncompressed);
+
+  decompressed_length = uncompressed_length - 1;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed,
+                                 "decompress-threads", "4", "parallel-threshold", "0", NULL);
+  munit_assert_int (res, <, 0);
+
+  free (uncompressed);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_parallel_blocks(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  SquashCodec* codec = squash_get_codec ("lz4");
+  if (codec == NULL)
+    return MUNIT_SKIP;
+
+  /* A bit over 2 MiB, so the last 64 KiB block is short. */
+  const size_t uncompressed_length = (2 * 1024 * 1024) + 12345;
+  uint8_t* uncompressed = munit_newa (uint8_t, uncompressed_length);
+  uint8_t* decompressed = munit_newa (uint8_t, uncompressed_length);
+  size_t compressed_length = squash_codec_get_max_compressed_size (codec, uncompressed_length);
+  uint8_t* compressed = munit_newa (uint8_t, compressed_length);
+  size_t decompressed_length;
+  SquashStatus res;
+
+  for (size_t i = 0 ; i < uncompressed_length ; i++)
+    uncompressed[i] = (uint8_t) (LOREM_IPSUM)[(i + (i / LOREM_IPSUM_LENGTH)) % LOREM_IPSUM_LENGTH];
+
+  res = squash_codec_compress (codec, &compressed_length, compressed, uncompressed_length, uncompressed,
+                               "block-mode", "independent", NULL);
+  SQUASH_ASSERT_OK(res);
+
+  decompressed_length = uncompressed_length;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed,
+                                 "threads", "4", NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, uncompressed_length);
+  munit_assert_memory_equal (uncompressed_length, decompressed, uncompressed);
+
+  decompressed_length = uncompressed_length - 1;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed,
+                                 "threads", "4", NULL);
+  munit_assert_int (res, <, 0);
+
+  free (uncompressed);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_parallel_chunks(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  SquashCodec* codec = squash_get_codec ("wflz-chunked");
+  if (codec == NULL)
+    return MUNIT_SKIP;
+
+  /* A bit over 2 MiB, so the last chunk is short. */
+  const size_t uncompressed_length = (2 * 1024 * 1024) + 12345;
+  uint8_t* uncompressed = munit_newa (uint8_t, uncompressed_length);
+  uint8_t* decompressed = munit_newa (uint8_t, uncompressed_length);
+  const size_t max_compressed_length = squash_codec_get_max_compressed_size (codec, uncompressed_length);
+  uint8_t* serial = munit_newa (uint8_t, max_compressed_length);
+  uint8_t* parallel = munit_newa (uint8_t, max_compressed_length);
+  size_t serial_length = max_compressed_length;
+  size_t parallel_length = max_compressed_length;
+  size_t decompressed_length;
+  SquashStatus res;
+
+  for (size_t i = 0 ; i < uncompressed_length ; i++)
+    uncompressed[i] = (uint8_t) (LOREM_IPSUM)[(i + (i / LOREM_IPSUM_LENGTH)) % LOREM_IPSUM_LENGTH];
+
+  res = squash_codec_compress (codec, &serial_length, serial, uncompressed_length, uncompressed,
+                               "threads", "1", NULL);
+  SQUASH_ASSERT_OK(res);
+
+  res = squash_codec_compress (codec, &parallel_length, parallel, uncompressed_length, uncompressed,
+                               "threads", "4", NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (parallel_length, ==, serial_length);
+  munit_assert_memory_equal (serial_length, parallel, serial);
+
+  decompressed_length = uncompressed_length;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, parallel_length, parallel,
+                                 "threads", "4", NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, uncompressed_length);
+  munit_assert_memory_equal (uncompressed_length, decompressed, uncompressed);
+
+  free (uncompressed);
+  free (decompressed);
+  free (serial);
+  free (parallel);
+
+  return MUNIT_OK;
+}
+
+static MunitTest squash_parallel_tests[] = {
+  { (char*) "/run", squash_test_parallel_run, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { (char*) "/frames", squash_test_parallel_frames, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/blocks", squash_test_parallel_blocks, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { (char*) "/chunks", squash_test_parallel_chunks, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_parallel = {
+  (char*) "/parallel",
+  squash_parallel_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
@@ -2,6 +2,7 @@
 
 struct SpliceBuffers {
   SquashStreamType stream_type;
+  bool limited;
 
   uint8_t* input;
   size_t input_length;
@@ -40,7 +41,7 @@ read_cb (size_t* length, uint8_t* buffer, void* user_data) {
 
   const size_t remaining = data->input_length - data->input_pos;
 
-  if (data->stream_type == SQUASH_STREAM_COMPRESS)
+  if (data->stream_type == SQUASH_STREAM_COMPRESS && data->limited)
     munit_assert_size (*length, <=, remaining);
   else if (*length > remaining)
     *length = remaining;
@@ -65,6 +66,7 @@ squash_test_custom(MUNIT_UNUSED const MunitParameter params[], void* user_data)
   const size_t max_compressed_length = squash_codec_get_max_compressed_size (codec, LOREM_IPSUM_LENGTH);
   struct SpliceBuffers data = {
     SQUASH_STREAM_COMPRESS,
+    true,
     (uint8_t*) LOREM_IPSUM,
     LOREM_IPSUM_LENGTH,
     0,
@@ -110,6 +112,35 @@ squash_test_custom(MUNIT_UNUSED const MunitParameter params[], void* user_data)
   free (data.input);
   free (data.output);
 
+  /* A size of 0 means the whole input. */
+  data.stream_type = SQUASH_STREAM_COMPRESS;
+  data.limited = false;
+  data.input = (uint8_t*) LOREM_IPSUM;
+  data.input_length = LOREM_IPSUM_LENGTH;
+  data.input_pos = 0;
+  data.output = munit_malloc (max_compressed_length);
+  data.output_length = max_compressed_length;
+  data.output_pos = 0;
+
+  res = squash_splice_custom (codec, SQUASH_STREAM_COMPRESS, write_cb, read_cb, &data, 0, NULL);
+  SQUASH_ASSERT_OK (res);
+
+  data.stream_type = SQUASH_STREAM_DECOMPRESS;
+  data.input = data.output;
+  data.input_length = data.output_pos;
+  data.input_pos = 0;
+  data.output = munit_malloc (LOREM_IPSUM_LENGTH);
+  data.output_length = LOREM_IPSUM_LENGTH;
+  data.output_pos = 0;
+
+  res = squash_splice_custom (codec, SQUASH_STREAM_DECOMPRESS, write_cb, read_cb, &data, 0, NULL);
+  SQUASH_ASSERT_OK (res);
+  munit_assert_size (data.output_pos, ==, LOREM_IPSUM_LENGTH);
+  munit_assert_memory_equal(LOREM_IPSUM_LENGTH, data.output, LOREM_IPSUM);
+
+  free (data.input);
+  free (data.output);
+
   return MUNIT_OK;
 }
 
@@ -0,0 +1,231 @@
+#include "test-squash.h"
+
+#define STORED_INPUT_SIZE ((size_t) (1024 * 64))
+
+static MunitResult
+squash_test_stored_buffer(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  SquashOptions* options = squash_options_new (codec, "store-incompressible", "true", NULL);
+  munit_assert_not_null (options);
+  squash_object_ref_sink (options);
+
+  uint8_t* uncompressed = munit_newa (uint8_t, STORED_INPUT_SIZE);
+  size_t compressed_length = squash_codec_get_max_compressed_size_with_options (codec, STORED_INPUT_SIZE, options);
+  uint8_t* compressed = munit_newa (uint8_t, compressed_length);
+  size_t decompressed_length = STORED_INPUT_SIZE;
+  uint8_t* decompressed = munit_newa (uint8_t, STORED_INPUT_SIZE);
+  SquashStatus res;
+
+  munit_rand_memory (STORED_INPUT_SIZE, uncompressed);
+
+  res = squash_codec_compress_with_options (codec, &compressed_length, compressed, STORED_INPUT_SIZE, uncompressed, options);
+  SQUASH_ASSERT_OK(res);
+  /* Four bytes of magic, one byte of flags plus the size of the
+     block. */
+  munit_assert_size (compressed_length, <=, STORED_INPUT_SIZE + 8);
+
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed,
+                                 "store-incompressible", "true", NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, STORED_INPUT_SIZE);
+  munit_assert_memory_equal (STORED_INPUT_SIZE, decompressed, uncompressed);
+
+  /* The framing is recognized without the option, too. */
+  decompressed_length = STORED_INPUT_SIZE;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, STORED_INPUT_SIZE);
+  munit_assert_memory_equal (STORED_INPUT_SIZE, decompressed, uncompressed);
+
+  compressed_length = squash_codec_get_max_compressed_size_with_options (codec, LOREM_IPSUM_LENGTH, options);
+  res = squash_codec_compress_with_options (codec, &compressed_length, compressed, LOREM_IPSUM_LENGTH, LOREM_IPSUM, options);
+  SQUASH_ASSERT_OK(res);
+
+  decompressed_length = LOREM_IPSUM_LENGTH;
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed,
+                                 "store-incompressible", "true", NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, LOREM_IPSUM_LENGTH);
+  munit_assert_memory_equal (LOREM_IPSUM_LENGTH, decompressed, LOREM_IPSUM);
+
+  free (uncompressed);
+  free (compressed);
+  free (decompressed);
+  squash_object_unref (options);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_stored_stream(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  /* Alternate between compressible and incompressible blocks. */
+  uint8_t* uncompressed = munit_newa (uint8_t, STORED_INPUT_SIZE);
+  for (size_t pos = 0 ; pos < STORED_INPUT_SIZE ; pos += 8192) {
+    const size_t len = MIN(8192, STORED_INPUT_SIZE - pos);
+    if ((pos / 8192) % 2)
+      munit_rand_memory (len, uncompressed + pos);
+    else
+      for (size_t i = 0 ; i < len ; i++)
+        uncompressed[pos + i] = (LOREM_IPSUM)[(pos + i) % LOREM_IPSUM_LENGTH];
+  }
+
+  const size_t compressed_size = STORED_INPUT_SIZE * 2;
+  uint8_t* compressed = munit_newa (uint8_t, compressed_size);
+  size_t decompressed_length = STORED_INPUT_SIZE;
+  uint8_t* decompressed = munit_newa (uint8_t, STORED_INPUT_SIZE);
+  const size_t step_size = munit_rand_int_range (64, 4096);
+  SquashStatus res;
+
+  SquashStream* stream = squash_codec_create_stream (codec, SQUASH_STREAM_COMPRESS,
+                                                     "store-incompressible", "true",
+                                                     "frame-block-size", "8192", NULL);
+  munit_assert_not_null (stream);
+
+  stream->next_in = uncompressed;
+  stream->next_out = compressed;
+  stream->avail_out = compressed_size;
+
+  while (stream->total_in < STORED_INPUT_SIZE) {
+    stream->avail_in = MIN(STORED_INPUT_SIZE - stream->total_in, step_size);
+
+    do {
+      res = squash_stream_process (stream);
+    } while (res == SQUASH_PROCESSING);
+    SQUASH_ASSERT_OK(res);
+  }
+
+  do {
+    res = squash_stream_finish (stream);
+  } while (res == SQUASH_PROCESSING);
+  SQUASH_ASSERT_OK(res);
+
+  munit_assert_size (stream->total_out, <, 4 + STORED_INPUT_SIZE + (STORED_INPUT_SIZE / 8192) * 4);
+
+  res = squash_codec_decompress (codec, &decompressed_length, decompressed, stream->total_out, compressed,
+                                 "store-incompressible", "true", NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, STORED_INPUT_SIZE);
+  munit_assert_memory_equal (STORED_INPUT_SIZE, decompressed, uncompressed);
+
+  squash_object_unref (stream);
+
+  free (uncompressed);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_stored_chunked(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  uint8_t* uncompressed = munit_newa (uint8_t, STORED_INPUT_SIZE);
+  for (size_t i = 0 ; i < STORED_INPUT_SIZE ; i++)
+    uncompressed[i] = (LOREM_IPSUM)[i % LOREM_IPSUM_LENGTH];
+
+  const size_t compressed_size = STORED_INPUT_SIZE * 2;
+  uint8_t* compressed = munit_newa (uint8_t, compressed_size);
+  size_t compressed_length;
+  size_t decompressed_length = STORED_INPUT_SIZE;
+  uint8_t* decompressed = munit_newa (uint8_t, STORED_INPUT_SIZE);
+  SquashStatus res;
+
+  SquashOptions* options = squash_options_new (codec,
+                                               "framing", "chunked",
+                                               "frame-checksum", "true",
+                                               "frame-block-size", "4096", NULL);
+  munit_assert_not_null (options);
+  squash_object_ref_sink (options);
+
+  SquashStream* stream = squash_codec_create_stream_with_options (codec, SQUASH_STREAM_COMPRESS, options);
+  munit_assert_not_null (stream);
+
+  /* Output should be available as soon as the first block is full,
+     not only once the stream is finished. */
+  stream->next_in = uncompressed;
+  stream->avail_in = 4096;
+  stream->next_out = compressed;
+  stream->avail_out = compressed_size;
+  do {
+    res = squash_stream_process (stream);
+  } while (res == SQUASH_PROCESSING);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (stream->total_out, >, 0);
+
+  stream->avail_in = STORED_INPUT_SIZE - 4096;
+  do {
+    res = squash_stream_finish (stream);
+  } while (res == SQUASH_PROCESSING);
+  SQUASH_ASSERT_OK(res);
+  compressed_length = stream->total_out;
+  squash_object_unref (stream);
+
+  res = squash_codec_decompress_with_options (codec, &decompressed_length, decompressed, compressed_length, compressed, options);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, STORED_INPUT_SIZE);
+  munit_assert_memory_equal (STORED_INPUT_SIZE, decompressed, uncompressed);
+
+  /* Corrupt the checksum of the first block, which follows the magic,
+     the flags and one (stored) or two (compressed) varints. */
+  {
+    size_t pos = 5;
+    for (int varints = (compressed[4] & 1) ? 1 : 2 ; varints > 0 ; varints--)
+      while (compressed[pos++] & 0x80) { }
+    compressed[pos] ^= 0x5a;
+  }
+  decompressed_length = STORED_INPUT_SIZE;
+  res = squash_codec_decompress_with_options (codec, &decompressed_length, decompressed, compressed_length, compressed, options);
+  munit_assert_int (res, <, 0);
+
+  squash_object_unref (options);
+
+  free (uncompressed);
+  free (compressed);
+  free (decompressed);
+
+  return MUNIT_OK;
+}
+
+static MunitResult
+squash_test_stored_native(MUNIT_UNUSED const MunitParameter params[], MUNIT_UNUSED void* user_data) {
+  SquashCodec* codec = squash_get_codec ("copy");
+  if (codec == NULL)
+    return MUNIT_SKIP;
+
+  /* Native data which starts with the framing magic and looks like a
+     block whose payload decompresses to more than the header says, so
+     the framed path fails with SQUASH_BUFFER_FULL. */
+  static const uint8_t data[] = { 0xb1, 'S', 'q', 'B', 0x00, 0x01, 0x04, 'a', 'b', 'c', 'd' };
+  uint8_t decompressed[sizeof (data)];
+  size_t decompressed_length = sizeof (decompressed);
+
+  SquashStatus res = squash_codec_decompress (codec, &decompressed_length, decompressed, sizeof (data), data, NULL);
+  SQUASH_ASSERT_OK(res);
+  munit_assert_size (decompressed_length, ==, sizeof (data));
+  munit_assert_memory_equal (sizeof (data), decompressed, data);
+
+  return MUNIT_OK;
+}
+
+static MunitTest squash_stored_tests[] = {
+  { (char*) "/buffer", squash_test_stored_buffer, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/native", squash_test_stored_native, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL },
+  { (char*) "/chunked", squash_test_stored_chunked, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/stream", squash_test_stored_stream, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
+};
+
+MunitSuite squash_test_suite_stored = {
+  (char*) "/stored",
+  squash_stored_tests,
+  NULL,
+  1,
+  MUNIT_SUITE_OPTION_NONE
+};
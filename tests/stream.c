@@ -223,10 +223,60 @@ squash_test_stream_single_byte(MUNIT_UNUSED const MunitParameter params[], void*
   return MUNIT_OK;
 }
 
+static MunitResult
+squash_test_stream_empty(MUNIT_UNUSED const MunitParameter params[], void* user_data) {
+  munit_assert_not_null(user_data);
+  SquashCodec* codec = (SquashCodec*) user_data;
+
+  /* Raw LZ4 has no framing, so empty output doesn't decode. */
+  if (strcmp ("lz4-raw", squash_codec_get_name (codec)) == 0)
+    return MUNIT_SKIP;
+
+  uint8_t compressed[8192];
+  uint8_t decompressed[64];
+  size_t compressed_length;
+  size_t decompressed_length;
+  SquashStatus res;
+  SquashStream* stream;
+
+  { // Finish a stream without giving it any input
+    stream = squash_codec_create_stream (codec, SQUASH_STREAM_COMPRESS, NULL);
+    munit_assert_not_null (stream);
+    stream->next_out = compressed;
+    stream->avail_out = sizeof(compressed);
+
+    do {
+      res = squash_stream_finish (stream);
+    } while (res == SQUASH_PROCESSING);
+    SQUASH_ASSERT_OK(res);
+
+    decompressed_length = sizeof(decompressed);
+    res = squash_codec_decompress (codec, &decompressed_length, decompressed, stream->total_out, compressed, NULL);
+    SQUASH_ASSERT_OK(res);
+    munit_assert_size (decompressed_length, ==, 0);
+
+    squash_object_unref (stream);
+  }
+
+  { // Buffer API
+    compressed_length = sizeof(compressed);
+    res = squash_codec_compress (codec, &compressed_length, compressed, 0, (const uint8_t*) "", NULL);
+    SQUASH_ASSERT_OK(res);
+
+    decompressed_length = sizeof(decompressed);
+    res = squash_codec_decompress (codec, &decompressed_length, decompressed, compressed_length, compressed, NULL);
+    SQUASH_ASSERT_OK(res);
+    munit_assert_size (decompressed_length, ==, 0);
+  }
+
+  return MUNIT_OK;
+}
+
 MunitTest squash_stream_tests[] = {
   { (char*) "/compress", squash_test_stream_compress, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { (char*) "/decompress", squash_test_stream_decompress, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { (char*) "/single-byte", squash_test_stream_single_byte, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
+  { (char*) "/empty", squash_test_stream_empty, squash_test_get_codec, NULL, MUNIT_TEST_OPTION_NONE, SQUASH_CODEC_PARAMETER },
   { NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL }
 };
 
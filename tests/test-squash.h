@@ -11,11 +11,16 @@ void* squash_test_get_codec(MUNIT_UNUSED const MunitParameter params[], void* us
 
 MunitSuite squash_test_suite_buffer;
 MunitSuite squash_test_suite_bounds;
+MunitSuite squash_test_suite_crc32c;
+MunitSuite squash_test_suite_fd_stream;
 MunitSuite squash_test_suite_file;
 MunitSuite squash_test_suite_flush;
 MunitSuite squash_test_suite_interop;
+MunitSuite squash_test_suite_iovec;
+MunitSuite squash_test_suite_parallel;
 MunitSuite squash_test_suite_random;
 MunitSuite squash_test_suite_splice;
+MunitSuite squash_test_suite_stored;
 MunitSuite squash_test_suite_stream;
 MunitSuite squash_test_suite_threads;
 MunitSuite squash_test_suite_version;
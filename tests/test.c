@@ -95,11 +95,16 @@ main(int argc, char* const argv[MUNIT_ARRAY_PARAM(argc + 1)]) {
   MunitSuite test_suites[] = {
     squash_test_suite_buffer,
     squash_test_suite_bounds,
+    squash_test_suite_crc32c,
+    squash_test_suite_fd_stream,
     squash_test_suite_file,
     squash_test_suite_flush,
     squash_test_suite_interop,
+    squash_test_suite_iovec,
+    squash_test_suite_parallel,
     squash_test_suite_random,
     squash_test_suite_splice,
+    squash_test_suite_stored,
     squash_test_suite_stream,
     squash_test_suite_threads,
     squash_test_suite_version,